@@ -99,8 +99,7 @@ get_dev_tools() {
             libbison-dev          \
             bison                 \
             flex                  \
-            bc                    \
-            libbpfcc-dev
+            bc
     fi
 }
 
@@ -113,7 +112,8 @@ get_required_libs() {
             xz-devel \
             re2-devel \
             libatomic-static \
-            libsodium-static
+            libsodium-static \
+            libpcap-devel
     else
         sudo apt-get install -y    \
             libgoogle-glog-dev     \
@@ -121,7 +121,8 @@ get_required_libs() {
             libelf-dev             \
             libmnl-dev             \
             liblzma-dev            \
-            libre2-dev
+            libre2-dev             \
+            libpcap-dev
         sudo apt-get install -y libsodium-dev
     fi
 }
@@ -0,0 +1,74 @@
+#!/usr/bin/env bash
+
+ # Copyright (C) 2018-present, Facebook, Inc.
+ #
+ # This program is free software; you can redistribute it and/or modify
+ # it under the terms of the GNU General Public License as published by
+ # the Free Software Foundation; version 2 of the License.
+ #
+ # This program is distributed in the hope that it will be useful,
+ # but WITHOUT ANY WARRANTY; without even the implied warranty of
+ # MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ # GNU General Public License for more details.
+ #
+ # You should have received a copy of the GNU General Public License along
+ # with this program; if not, write to the Free Software Foundation, Inc.,
+ # 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# builds balancer's bpf program for each combination of compile time features
+# and loads it w/ katran_load_stats, which checks verifier's complexity
+# (processed insns) and load time against the limits. if BASELINE file is
+# provided (output of previous run) growth of processed insns is checked
+# as well. results are appended to OUTPUT (csv).
+# must be run from katran's root dir (the same as build_bpf_modules_opensource)
+
+set -xeo pipefail
+
+if [ -z "${KATRAN_BUILD_DIR}" ]
+then
+    KATRAN_BUILD_DIR=$(pwd)/_build/build
+fi
+
+if [ -z "${BUILD_DIR}" ]
+then
+    BUILD_DIR=$(pwd)/_build
+fi
+
+if [ -z "${OUTPUT}" ]
+then
+    OUTPUT=${BUILD_DIR}/bpf_complexity.csv
+fi
+
+FEATURE_SETS=(
+  "default:"
+  "inline_decap_gue:-DINLINE_DECAP_GUE"
+  "lpm_src_lookup:-DLPM_SRC_LOOKUP"
+  "gue_encap:-DGUE_ENCAP"
+  "icmp_toobig:-DICMP_TOOBIG_GENERATION"
+  "introspection:-DKATRAN_INTROSPECTION"
+  "numa_replicas:-DNUMA_REPLICAS"
+  "exit_hook:-DKATRAN_EXIT_HOOK"
+  "verdict_introspection:-DKATRAN_VERDICT_INTROSPECTION"
+  "vip_addr_prefilter:-DVIP_ADDR_PREFILTER"
+  "vip_port_ranges:-DVIP_PORT_RANGES"
+  "all:-DINLINE_DECAP_GUE -DLPM_SRC_LOOKUP -DGUE_ENCAP -DICMP_TOOBIG_GENERATION -DKATRAN_INTROSPECTION -DNUMA_REPLICAS -DKATRAN_EXIT_HOOK -DKATRAN_VERDICT_INTROSPECTION -DVIP_ADDR_PREFILTER -DVIP_PORT_RANGES"
+)
+
+rm -f "${OUTPUT}"
+FAILED=0
+for FEATURE_SET in "${FEATURE_SETS[@]}"; do
+  NAME=${FEATURE_SET%%:*}
+  FLAGS=${FEATURE_SET#*:}
+  # shellcheck disable=SC2086
+  ./build_bpf_modules_opensource.sh -s "$(pwd)" -b "${BUILD_DIR}" ${FLAGS}
+  EXTRA_ARGS=""
+  if [[ "${FLAGS}" == *"-DNUMA_REPLICAS"* ]]; then
+    EXTRA_ARGS="-numa_replicas=true"
+  fi
+  if [ -n "${BASELINE}" ]; then
+    EXTRA_ARGS="${EXTRA_ARGS} -baseline ${BASELINE}"
+  fi
+  sudo sh -c "${KATRAN_BUILD_DIR}/katran/lib/testing/katran_load_stats -balancer_prog ${BUILD_DIR}/deps/bpfprog/bpf/balancer_kern.o -healthchecking_prog ${BUILD_DIR}/deps/bpfprog/bpf/healthchecking_ipip.o -feature_set ${NAME} -output ${OUTPUT} ${EXTRA_ARGS} $1" || FAILED=1
+done
+
+exit ${FAILED}
@@ -19,6 +19,7 @@
 
 #include <cstdint>
 
+#include "katran/lib/KatranMetrics.h"
 #include "katran/lib/MacHelpers.h"
 
 namespace lb {
@@ -32,6 +33,7 @@ using Guard = std::lock_guard<std::mutex>;
   vk.address = vip.address;
   vk.port = vip.port;
   vk.proto = vip.protocol;
+  vk.lastPort = vip.lastPort;
   return vk;
 }
 
@@ -101,6 +103,7 @@ void KatranSimpleServiceHandler::getAllVips(
     vip.address = v.address;
     vip.port = v.port;
     vip.protocol = v.proto;
+    vip.lastPort = v.lastPort;
     _return.push_back(vip);
   }
   return;
@@ -335,5 +338,21 @@ void KatranSimpleServiceHandler::getHealthcheckersDst(
   return;
 }
 
+void KatranSimpleServiceHandler::collectMetrics(
+    ::katran::MetricsBuilder& builder) {
+  Guard lock(giant_);
+  ::katran::collectKatranLbMetrics(lb_, builder, true, hcForwarding_);
+}
+
+void KatranSimpleServiceHandler::refreshForwardingCores() {
+  Guard lock(giant_);
+  lb_.refreshForwardingCores();
+}
+
+void KatranSimpleServiceHandler::rebalanceLrus() {
+  Guard lock(giant_);
+  lb_.rebalanceLrus();
+}
+
 } // namespace katran
 } // namespace lb
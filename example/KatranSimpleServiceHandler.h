@@ -22,6 +22,7 @@
 
 #include "katran/if/gen-cpp2/KatranService.h"
 #include "katran/lib/KatranLb.h"
+#include "katran/lib/MetricsExporter.h"
 
 namespace lb {
 namespace katran {
@@ -92,6 +93,23 @@ class KatranSimpleServiceHandler : virtual public KatranServiceSvIf {
 
   void getHealthcheckersDst(::lb::katran::hcMap& _return) override;
 
+  /**
+   * collector for metrics endpoint. serialized w/ all other calls to katran
+   */
+  void collectMetrics(::katran::MetricsBuilder& builder);
+
+  /**
+   * picks up forwarding cores changes. serialized w/ all other calls to
+   * katran
+   */
+  void refreshForwardingCores();
+
+  /**
+   * splits lru memory between forwarding cores according to their load.
+   * serialized w/ all other calls to katran
+   */
+  void rebalanceLrus();
+
  private:
   ::katran::KatranLb lb_;
 
@@ -28,6 +28,8 @@ struct Vip {
   1: string address,
   2: i32 port,
   3: i32 protocol,
+  // if not 0: vip is defined over the range of ports [port, lastPort]
+  4: i32 lastPort,
 }
 
 struct VipMeta {
@@ -18,6 +18,7 @@
 
 #include <glog/logging.h>
 
+#include "katran/lib/KatranMetrics.h"
 #include "katran/lib/MacHelpers.h"
 
 using grpc::Server;
@@ -36,6 +37,7 @@ using Guard = std::lock_guard<std::mutex>;
   vk.address = vip.address();
   vk.port = vip.port();
   vk.proto = vip.protocol();
+  vk.lastPort = vip.last_port();
   return vk;
 }
 
@@ -125,6 +127,7 @@ Status KatranGrpcService::getAllVips(ServerContext *context,
     vip.set_address(v.address);
     vip.set_port(v.port);
     vip.set_protocol(v.proto);
+    vip.set_last_port(v.lastPort);
     auto rvip = response->add_vips();
     *rvip = vip;
   }
@@ -415,5 +418,20 @@ Status KatranGrpcService::getHealthcheckersDst(ServerContext *context,
   return Status::OK;
 }
 
+void KatranGrpcService::collectMetrics(::katran::MetricsBuilder &builder) {
+  Guard lock(giant_);
+  ::katran::collectKatranLbMetrics(lb_, builder, true, hcForwarding_);
+}
+
+void KatranGrpcService::refreshForwardingCores() {
+  Guard lock(giant_);
+  lb_.refreshForwardingCores();
+}
+
+void KatranGrpcService::rebalanceLrus() {
+  Guard lock(giant_);
+  lb_.rebalanceLrus();
+}
+
 } // namespace katran
 } // namespace lb
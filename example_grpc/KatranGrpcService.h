@@ -22,6 +22,7 @@
 
 #include "katran.grpc.pb.h"
 #include "katran/lib/KatranLb.h"
+#include "katran/lib/MetricsExporter.h"
 #include <grpc++/grpc++.h>
 
 using grpc::Server;
@@ -102,6 +103,16 @@ public:
   Status getHealthcheckersDst(ServerContext *context, const Empty *request,
                               hcMap *response) override;
 
+  // collector for metrics endpoint. serialized w/ all other calls to katran
+  void collectMetrics(::katran::MetricsBuilder &builder);
+
+  // picks up forwarding cores changes. serialized w/ all other calls to katran
+  void refreshForwardingCores();
+
+  // splits lru memory between forwarding cores according to their load.
+  // serialized w/ all other calls to katran
+  void rebalanceLrus();
+
 private:
   ::katran::KatranLb lb_;
 
@@ -90,6 +90,22 @@ func (kc *KatranClient) GetMac() {
 	log.Printf("Mac address is %v\n", mac.GetMac())
 }
 
+// parses vip's port. format <port> or <first port>-<last port>
+func parsePorts(ports string, vip *lb_katran.Vip) {
+	first_last := strings.Split(ports, "-")
+	if len(first_last) > 2 {
+		log.Fatalf("invalid port range %v\n", ports)
+	}
+	port, err := strconv.ParseInt(first_last[0], 10, 32)
+	checkError(err)
+	vip.Port = int32(port)
+	if len(first_last) == 2 {
+		last_port, err := strconv.ParseInt(first_last[1], 10, 32)
+		checkError(err)
+		vip.LastPort = int32(last_port)
+	}
+}
+
 func parseToVip(addr string, proto int) lb_katran.Vip {
 	var vip lb_katran.Vip
 	vip.Protocol = int32(proto)
@@ -101,9 +117,7 @@ func parseToVip(addr string, proto int) lb_katran.Vip {
 			log.Fatalf("invalid v6 address %v\n", addr)
 		}
 		vip.Address = addr_port[1]
-		port, err := strconv.ParseInt(addr_port[2], 10, 32)
-		vip.Port = int32(port)
-		checkError(err)
+		parsePorts(addr_port[2], &vip)
 	} else {
 		// v4 address. format <addr>:<port>
 		addr_port := strings.Split(addr, ":")
@@ -111,9 +125,7 @@ func parseToVip(addr string, proto int) lb_katran.Vip {
 			log.Fatalf("incorrect v4 address: %v\n", addr)
 		}
 		vip.Address = addr_port[0]
-		port, err := strconv.ParseInt(addr_port[1], 10, 32)
-		vip.Port = int32(port)
-		checkError(err)
+		parsePorts(addr_port[1], &vip)
 	}
 	return vip
 }
@@ -289,9 +301,13 @@ func (kc *KatranClient) ListVipAndReals(vip *lb_katran.Vip) {
 	} else {
 		proto = "udp"
 	}
+	port := fmt.Sprint(vip.Port)
+	if vip.LastPort != 0 {
+		port = fmt.Sprintf("%v-%v", vip.Port, vip.LastPort)
+	}
 	fmt.Printf("VIP: %20v Port: %6v Protocol: %v\n",
 		vip.Address,
-		vip.Port,
+		port,
 		proto)
 	flags := kc.GetFlags(vip)
 	fmt.Printf("Vip's flags: %v\n", parseFlags(flags))
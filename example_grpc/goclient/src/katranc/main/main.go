@@ -35,9 +35,9 @@ var (
 	editServer  = flag.Bool("e", false, "Edit real server")
 	delServer   = flag.Bool("d", false, "Delete real server")
 	tcpService  = flag.String("t", "",
-		"Tcp service address. must be in format: <addr>:<port>")
+		"Tcp service address. must be in format: <addr>:<port>[-<last port>]")
 	udpService = flag.String("u", "",
-		"Udp service addr. must be in format: <addr>:<port>")
+		"Udp service addr. must be in format: <addr>:<port>[-<last port>]")
 	realServer    = flag.String("r", "", "Address of the real server")
 	realWeight    = flag.Int64("w", 1, "Weight (capacity) of real server")
 	showStats     = flag.Bool("s", false, "Show stats/counters")
@@ -22,6 +22,7 @@
 #include <thread>
 
 #include <folly/Conv.h>
+#include <folly/experimental/FunctionScheduler.h>
 #include <folly/init/Init.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/String.h>
@@ -31,6 +32,7 @@
 #include "KatranGrpcService.h"
 #include "GrpcSignalHandler.h"
 #include "katran/lib/MacHelpers.h"
+#include "katran/lib/MetricsExporter.h"
 
 
 using grpc::Server;
@@ -57,11 +59,39 @@ DEFINE_int32(prog_pos, 2, "katran's position inside root xdp array");
 DEFINE_bool(hc_forwarding, true, "turn on forwarding path for healthchecks");
 DEFINE_int32(shutdown_delay, 10000, "shutdown delay in milliseconds");
 DEFINE_int64(lru_size, 8000000, "size of LRU table");
+DEFINE_int32(max_vips, 512, "maximum number of vips (sizes bpf maps)");
+DEFINE_int32(max_reals, 4096, "maximum number of reals (sizes bpf maps)");
+DEFINE_int32(
+  ch_ring_size,
+  65537,
+  "size of consistent hashing ring per vip. must be a prime number");
 DEFINE_string(forwarding_cores, "", "coma separed list of forwarding cores");
 DEFINE_string(
   numa_nodes,
   "",
   "coma separed list of numa nodes to forwarding cores mapping");
+DEFINE_bool(
+  discover_forwarding_cores,
+  false,
+  "discover forwarding cores from irq affinity if forwarding_cores is empty");
+DEFINE_int32(
+  forwarding_cores_refresh_ms,
+  0,
+  "how often to check for new forwarding cores. 0 - disabled");
+DEFINE_int32(
+  lru_rebalance_ms,
+  0,
+  "how often to split lru memory between cores by load. 0 - disabled");
+DEFINE_int32(
+  metrics_port,
+  0,
+  "port of local prometheus metrics endpoint. 0 - disabled");
+DEFINE_string(metrics_address, "127.0.0.1", "address of metrics endpoint");
+DEFINE_string(
+  metrics_socket,
+  "",
+  "UNIX socket for metrics endpoint. if set - used instead of metrics_port");
+DEFINE_int32(metrics_cache_ms, 1000, "how often metrics are collected");
 
 // routine which parses coma separated string of numbers
 // (e.g. "1,2,3,4,10,11,12,13") to vector of int32_t
@@ -96,6 +126,35 @@ void RunServer(
   // Finally assemble the server.
   std::unique_ptr<Server> server(builder.BuildAndStart());
   std::cout << "Server listening on " << server_address << std::endl;
+  std::unique_ptr<katran::MetricsExporter> exporter;
+  if (FLAGS_metrics_port > 0 || !FLAGS_metrics_socket.empty()) {
+    katran::MetricsExporterConfig metricsConfig;
+    metricsConfig.address = FLAGS_metrics_address;
+    metricsConfig.port = static_cast<uint16_t>(FLAGS_metrics_port);
+    metricsConfig.unixSocketPath = FLAGS_metrics_socket;
+    metricsConfig.cacheTtlMs = static_cast<uint32_t>(FLAGS_metrics_cache_ms);
+    exporter = std::make_unique<katran::MetricsExporter>(metricsConfig);
+    exporter->addCollector([&service](katran::MetricsBuilder& metrics) {
+      service.collectMetrics(metrics);
+    });
+    if (!exporter->start()) {
+      LOG(ERROR) << "can't start metrics endpoint";
+    }
+  }
+  folly::FunctionScheduler scheduler;
+  if (FLAGS_forwarding_cores_refresh_ms > 0) {
+    scheduler.addFunction(
+        [&service]() { service.refreshForwardingCores(); },
+        std::chrono::milliseconds(FLAGS_forwarding_cores_refresh_ms),
+        "refresh_forwarding_cores");
+  }
+  if (FLAGS_lru_rebalance_ms > 0) {
+    scheduler.addFunction(
+        [&service]() { service.rebalanceLrus(); },
+        std::chrono::milliseconds(FLAGS_lru_rebalance_ms),
+        "rebalance_lrus");
+  }
+  scheduler.start();
   lb::katran::GrpcSignalHandler grpcSigHandler(evb, server.get(), delay);
   grpcSigHandler.registerSignalHandler(SIGINT);
   grpcSigHandler.registerSignalHandler(SIGTERM);
@@ -126,8 +185,12 @@ int main(int argc, char** argv) {
     .enableHc = FLAGS_hc_forwarding,
   };
   config.LruSize = static_cast<uint64_t>(FLAGS_lru_size);
+  config.maxVips = static_cast<uint32_t>(FLAGS_max_vips);
+  config.maxReals = static_cast<uint32_t>(FLAGS_max_reals);
+  config.chRingSize = static_cast<uint32_t>(FLAGS_ch_ring_size);
   config.forwardingCores = forwardingCores;
   config.numaNodes = numaNodes;
+  config.discoverForwardingCores = FLAGS_discover_forwarding_cores;
   config.hcInterface = FLAGS_hc_intf;
 
   auto evb = std::make_shared<folly::EventBase>();
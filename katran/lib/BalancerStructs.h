@@ -35,6 +35,15 @@ struct hc_mac {
   uint8_t mac[6];
 };
 
+// forwarding data for healthchecks: main interface's ifindex, somark's base
+// (for array based hc_reals_map) and src/dst macs
+struct hc_ctrl_data {
+  uint32_t ifindex;
+  uint32_t somark_base;
+  struct hc_mac src;
+  struct hc_mac dst;
+};
+
 // vip's definition for lookup
 struct vip_definition {
   union {
@@ -52,6 +61,17 @@ struct event_metadata {
   uint32_t data_len;
 } __attribute__((__packed__));
 
+// what katran has done w/ the packet. sent in front of packet's data
+// in PACKET_VERDICT event
+struct verdict_info {
+  uint32_t action;
+  uint32_t reason;
+  uint32_t vip_num;
+  uint32_t real_index;
+  uint8_t lru_hit;
+  uint8_t pad[3];
+} __attribute__((__packed__));
+
 // result of vip's lookup
 struct vip_meta {
   uint32_t flags;
@@ -98,4 +118,22 @@ struct v6_lpm_key {
     uint32_t prefixlen;
     uint32_t addr[4];
 };
+
+// key for port range vips lookups
+struct vip_port_lpm_key {
+  uint32_t prefixlen;
+  union {
+    uint32_t vip;
+    uint32_t vipv6[4];
+  };
+  uint8_t proto;
+  uint8_t pad;
+  uint16_t port;
+};
+
+// limits w/ which forwarding maps have been sized
+struct lb_limits {
+  uint32_t max_vips;
+  uint32_t ring_size;
+};
 } // namespace katran
@@ -24,6 +24,7 @@
 #include <folly/String.h>
 #include <glog/logging.h>
 #include <libmnl/libmnl.h>
+#include <algorithm>
 #include <array>
 #include <cerrno>
 #include <cstdio>
@@ -56,6 +57,8 @@ constexpr unsigned TCA_BPF_PRIO_1 = 1;
 constexpr int kMaxProgsToQuery = 1024;
 std::array<const char, 5> kTcActKind = {"gact"};
 constexpr int kMaxPathLen = 255;
+constexpr size_t kRawProgLogSize = 1024 * 1024;
+constexpr char kRawProgLicense[] = "GPL";
 constexpr folly::StringPiece kPossibleCpusFile(
     "/sys/devices/system/cpu/possible");
 constexpr folly::StringPiece kOnlineCpusFile("/sys/devices/system/cpu/online");
@@ -91,11 +94,18 @@ struct perf_event_sample {
 #define IFLA_XDP_FLAGS (3)
 #endif
 
+// kernel's internal errno, returned for unsupported map operations
+#ifndef ENOTSUPP
+#define ENOTSUPP (524)
+#endif
+
 namespace {
 constexpr int kNoMap = -1;
 constexpr int kError = -1;
 constexpr int kMaxIndex = 1;
 constexpr int kMinIndex = 0;
+// number of entries read by single batch lookup
+constexpr uint32_t kMapBatchSize = 8192;
 
 int perf_event_open(
     struct perf_event_attr* attr,
@@ -284,6 +294,42 @@ int BpfAdapter::createNamedBpfMap(
       numa_node);
 }
 
+int BpfAdapter::createBpfMapInMap(
+    unsigned int type,
+    unsigned int key_size,
+    int inner_map_fd,
+    unsigned int max_entries,
+    unsigned int map_flags) {
+  return bpf_create_map_in_map(
+      static_cast<enum bpf_map_type>(type),
+      nullptr,
+      key_size,
+      inner_map_fd,
+      max_entries,
+      map_flags);
+}
+
+int BpfAdapter::loadRawBpfProg(
+    const std::vector<struct bpf_insn>& insns,
+    const bpf_prog_type type,
+    std::string& log) {
+  std::vector<char> logBuf(kRawProgLogSize);
+  auto fd = bpf_load_program(
+      type,
+      insns.data(),
+      insns.size(),
+      kRawProgLicense,
+      0 /* kern_version */,
+      logBuf.data(),
+      logBuf.size());
+  if (fd < 0) {
+    log = std::string(logBuf.data());
+    LOG(ERROR) << "Error while loading raw bpf prog: "
+               << folly::errnoStr(errno);
+  }
+  return fd;
+}
+
 int BpfAdapter::setInnerMapPrototype(const std::string& name, int map_fd) {
   return loader_.setInnerMapPrototype(name, map_fd);
 }
@@ -296,6 +342,30 @@ int BpfAdapter::updateSharedMap(const std::string& name, int fd) {
   return loader_.updateSharedMap(name, fd);
 }
 
+int BpfAdapter::setMapMaxEntries(
+    const std::string& name,
+    uint32_t maxEntries) {
+  return loader_.setMapMaxEntries(name, maxEntries);
+}
+
+int BpfAdapter::stageBpfProg(
+    const std::string& bpf_prog,
+    const bpf_prog_type type) {
+  return loader_.stageBpfFile(bpf_prog, type);
+}
+
+int BpfAdapter::getStagedProgFdByName(const std::string& name) {
+  return loader_.getStagedProgFdByName(name);
+}
+
+int BpfAdapter::commitStagedBpfProg() {
+  return loader_.commitStagedBpfObject();
+}
+
+void BpfAdapter::abortStagedBpfProg() {
+  loader_.abortStagedBpfObject();
+}
+
 int BpfAdapter::bpfUpdateMap(
     int map_fd,
     void* key,
@@ -316,6 +386,36 @@ int BpfAdapter::bpfMapLookupElement(int map_fd, void* key, void* value) {
   return bpfError;
 }
 
+int BpfAdapter::bpfMapLookupBatch(
+    int map_fd,
+    void* in_batch,
+    void* out_batch,
+    void* keys,
+    void* values,
+    uint32_t* count) {
+  auto bpfError = bpf_map_lookup_batch(
+      map_fd, in_batch, out_batch, keys, values, count, nullptr);
+  if (bpfError && errno != ENOENT) {
+    VLOG(4) << "Error while batch reading from map: "
+            << folly::errnoStr(errno);
+  }
+  return bpfError;
+}
+
+int BpfAdapter::bpfMapUpdateBatch(
+    int map_fd,
+    void* keys,
+    void* values,
+    uint32_t* count,
+    unsigned long long flags) {
+  DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts, .elem_flags = flags);
+  auto bpfError = bpf_map_update_batch(map_fd, keys, values, count, &opts);
+  if (bpfError) {
+    VLOG(4) << "Error while batch updating map: " << folly::errnoStr(errno);
+  }
+  return bpfError;
+}
+
 int BpfAdapter::bpfMapDeleteElement(int map_fd, void* key) {
   auto bpfError = bpf_map_delete_elem(map_fd, key);
   if (bpfError) {
@@ -346,6 +446,29 @@ int BpfAdapter::bpfMapGetFdById(uint32_t map_id) {
   return bpf_map_get_fd_by_id(map_id);
 }
 
+int BpfAdapter::bpfMapGetNextId(uint32_t start_id, uint32_t* next_id) {
+  return bpf_map_get_next_id(start_id, next_id);
+}
+
+int BpfAdapter::bpfMapGetFdByName(const std::string& name) {
+  // kernel keeps only first BPF_OBJ_NAME_LEN - 1 chars of the map's name
+  auto kernelName = name.substr(0, BPF_OBJ_NAME_LEN - 1);
+  uint32_t id = 0;
+  while (!bpfMapGetNextId(id, &id)) {
+    int fd = bpfMapGetFdById(id);
+    if (fd < 0) {
+      // map could be removed since we got its id
+      continue;
+    }
+    struct bpf_map_info info = {};
+    if (!getBpfMapInfo(fd, &info) && kernelName == info.name) {
+      return fd;
+    }
+    ::close(fd);
+  }
+  return -1;
+}
+
 int BpfAdapter::bpfProgGetFdById(uint32_t map_id) {
   return bpf_prog_get_fd_by_id(map_id);
 }
@@ -380,35 +503,86 @@ int BpfAdapter::getBpfMapMaxSize(const std::string& name) {
 }
 
 int BpfAdapter::getBpfMapUsedSize(const std::string& name) {
-  int num_entries = 0, err = 0;
-  void* prev_key = nullptr;
-  struct bpf_map_info info;
   int fd = getMapFdByName(name);
   if (fd < 0) {
     LOG(ERROR) << "Error while retrieving fd for " << name << ": " << fd;
     return fd;
   }
-  err = getBpfMapInfo(fd, &info);
+  auto num_entries = getBpfMapUsedSize(fd);
+  if (num_entries >= 0) {
+    VLOG(3) << "Found " << num_entries << " entries for map " << name;
+  }
+  return num_entries;
+}
+
+int BpfAdapter::getBpfMapUsedSize(int map_fd) {
+  int num_entries = 0, err = 0;
+  struct bpf_map_info info = {};
+  err = getBpfMapInfo(map_fd, &info);
   if (err) {
-    LOG(ERROR) << "Error while retrieving map metadata for " << name << ": "
-               << folly::errnoStr(err);
+    LOG(ERROR) << "Error while retrieving map metadata for fd " << map_fd
+               << ": " << folly::errnoStr(err);
     return -1;
   }
 
+  uint32_t value_size = info.value_size;
+  if (info.type == kBpfMapTypePercpuHash ||
+      info.type == kBpfMapTypePercpuArray ||
+      info.type == kBpfMapTypeLruPercpuHash) {
+    // kernel copies value for each possible cpu, each rounded up to 8 bytes
+    value_size = ((value_size + 7) & ~7) * getPossibleCpus();
+  }
+  uint32_t batch_size = std::min(kMapBatchSize, info.max_entries);
+  std::vector<uint8_t> keys(batch_size * info.key_size);
+  std::vector<uint8_t> values(batch_size * value_size);
+  // opaque position in the map. hash and array maps are using u32 for it
+  uint64_t in_batch = 0, out_batch = 0;
+  bool first_batch = true;
+  while (true) {
+    uint32_t count = batch_size;
+    err = bpfMapLookupBatch(
+        map_fd,
+        first_batch ? nullptr : &in_batch,
+        &out_batch,
+        keys.data(),
+        values.data(),
+        &count);
+    if (err && errno != ENOENT) {
+      if ((first_batch &&
+           (errno == EINVAL || errno == ENOTSUPP || errno == EOPNOTSUPP)) ||
+          errno == ENOSPC) {
+        // batch operations are not supported for this map (or bucket is
+        // bigger than the batch); falling back to walk every key
+        break;
+      }
+      LOG(ERROR) << "Error determining size of map w/ fd " << map_fd
+                 << " errno=" << folly::errnoStr(errno);
+      return -errno;
+    }
+    num_entries += count;
+    if (err) {
+      // ENOENT: we reached the end of the map
+      return num_entries;
+    }
+    in_batch = out_batch;
+    first_batch = false;
+  }
+
   // Walk the keys to get the current number of entries
+  num_entries = 0;
+  void* prev_key = nullptr;
   unsigned char key[info.key_size];
-  while (0 == (err = bpf_map_get_next_key(fd, prev_key, &key))) {
+  while (0 == (err = bpf_map_get_next_key(map_fd, prev_key, &key))) {
     num_entries++;
     prev_key = &key;
   }
 
   // Normal case: we reached the last element; err is -1, errno is ENOENT
   if (err == -1 && errno == ENOENT) {
-    VLOG(3) << "Found " << num_entries << " entries for map " << name;
     return num_entries;
   } else {
-    LOG(ERROR) << "Error determining size of " << name << "err=" << err
-               << " errno=" << folly::errnoStr(errno);
+    LOG(ERROR) << "Error determining size of map w/ fd " << map_fd
+               << " err=" << err << " errno=" << folly::errnoStr(errno);
     return -errno;
   }
 }
@@ -560,6 +734,16 @@ int BpfAdapter::modifyXdpProg(
   return NetlinkRoundtrip(msg);
 }
 
+int BpfAdapter::replaceXdpProg(
+    const int prog_fd,
+    const unsigned int ifindex,
+    const int old_prog_fd,
+    const uint32_t flags) {
+  unsigned int seq = static_cast<unsigned int>(std::time(nullptr));
+  auto msg = NetlinkMessage::XDP(seq, prog_fd, ifindex, flags, old_prog_fd);
+  return NetlinkRoundtrip(msg);
+}
+
 int BpfAdapter::modifyTcBpfFilter(
     const int cmd,
     const unsigned int flags,
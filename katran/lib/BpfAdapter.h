@@ -96,6 +96,24 @@ class BpfAdapter {
       const bpf_prog_type type = BPF_PROG_TYPE_UNSPEC,
       bool use_names = false);
 
+  /**
+   * @param bool enabled true if verifier's statistics should be collected
+   *
+   * helper function to enable collection of verifier's statistics for all
+   * bpf programs, which are going to be loaded (requires kernel 5.2+)
+   */
+  void enableVerifierStats(bool enabled) {
+    loader_.enableVerifierStats(enabled);
+  }
+
+  /**
+   * @return vector<BpfProgLoadStats> load time statistics (load and
+   * verification time, processed insns, sizes) of all loaded programs
+   */
+  std::vector<BpfProgLoadStats> getProgsLoadStats() const {
+    return loader_.getProgsLoadStats();
+  }
+
   /**
    * @param string name of the map (as in bpf's .c file)
    * @return int bpf's map descriptor
@@ -154,6 +172,37 @@ class BpfAdapter {
       unsigned int map_flags,
       int numa_node = -1);
 
+  /**
+   * @param unsigned int type of map-in-map to create
+   * @param unsigned int key_size size of the key in a map
+   * @param int inner_map_fd fd of the map, which is used as a prototype
+   * @param unsigned int max_entries maximum entries in the map
+   * @param unsigned int map_flags map's specific flags
+   * @return int -1 on error, map's fd otherwise
+   *
+   * cpp wrapper around bpf_create_map_in_map helper
+   */
+  static int createBpfMapInMap(
+      unsigned int type,
+      unsigned int key_size,
+      int inner_map_fd,
+      unsigned int max_entries,
+      unsigned int map_flags);
+
+  /**
+   * @param vector<bpf_insn> insns instructions of the program
+   * @param bpf_prog_type type of bpf prog to load
+   * @param string& log where verifier's log would be written on failure
+   * @return int -1 on error, prog's fd otherwise
+   *
+   * cpp wrapper around bpf_load_program helper. used to load programs
+   * which are generated at runtime (and not from elf object)
+   */
+  static int loadRawBpfProg(
+      const std::vector<struct bpf_insn>& insns,
+      const bpf_prog_type type,
+      std::string& log);
+
   /**
    * @param string name of map-in-map w/ specified fd as prototype
    * @param int map_fd fd of the prototype map
@@ -212,10 +261,21 @@ class BpfAdapter {
    * @return int >=0 on success; negative on failure
    *
    * helper function to get the current number of entries in a bpf map
-   * O(N) on the map size -- this walks every key in the map
+   * O(N) on the map size -- see getBpfMapUsedSize(int) below
    */
   int getBpfMapUsedSize(const std::string& name);
 
+  /**
+   * @param int map_fd descriptor of the bpf map
+   * @return int >=0 on success; negative on failure
+   *
+   * helper function to get the current number of entries in a bpf map.
+   * still O(N), but entries are read in large batches (few syscalls per
+   * million of entries). for maps, which do not support batch operations
+   * (e.g. lpm trie), falls back to walking every key
+   */
+  static int getBpfMapUsedSize(int map_fd);
+
   /**
    * @param const string& interface name
    * @return int interface index, or 0 if interface can't be found
@@ -301,6 +361,46 @@ class BpfAdapter {
    */
   static int bpfMapLookupElement(int map_fd, void* key, void* value);
 
+  /**
+   * @param int map_fd file descriptor of bpf map
+   * @param void* in_batch position to start from (nullptr - from the start)
+   * @param void* out_batch where position for the next call would be written
+   * @param void* keys pointer to array of keys where we will write keys
+   * @param void* values pointer to array where we will write values. for
+   * per cpu maps each element must have space for values from all cpus
+   * @param uint32_t* count in: max number of elements to read; out: number of
+   * elements which has been read
+   * @return int 0 on success, other val otherwise. errno is set to ENOENT if
+   * end of the map has been reached (count is still valid in this case)
+   *
+   * helper function to read multiple elements of bpf map w/ single syscall
+   */
+  static int bpfMapLookupBatch(
+      int map_fd,
+      void* in_batch,
+      void* out_batch,
+      void* keys,
+      void* values,
+      uint32_t* count);
+
+  /**
+   * @param int map_fd file descriptor of bpf map
+   * @param void* keys pointer to array of keys
+   * @param void* values pointer to array of values
+   * @param uint32_t* count in: number of elements to update; out: number of
+   * elements which has been updated
+   * @param unsigned long long flags flags for update (0 is BPF_ANY)
+   * @return int 0 on success, other val otherwise
+   *
+   * helper function to update multiple elements of bpf map w/ single syscall
+   */
+  static int bpfMapUpdateBatch(
+      int map_fd,
+      void* keys,
+      void* values,
+      uint32_t* count,
+      unsigned long long flags = 0);
+
   /**
    * @param int map_fd file descriptor of bpf map
    * @param void* key pointer to key, which we are going to delete
@@ -345,6 +445,27 @@ class BpfAdapter {
    */
   static int bpfMapGetFdById(uint32_t map_id);
 
+  /**
+   * @param uint32_t start_id id of the bpf map to start from (0 - from the
+   * first one)
+   * @param uint32_t* next_id where id of the next loaded bpf map is written
+   * @return int 0 on success, other val otherwise (errno is set to ENOENT if
+   * there are no more maps)
+   *
+   * helper function to iterate through all bpf maps loaded in the system
+   */
+  static int bpfMapGetNextId(uint32_t start_id, uint32_t* next_id);
+
+  /**
+   * @param string name name of the map as declared in bpf program
+   * @return int fd of the first loaded map w/ this name, -1 if there is
+   * no such map
+   *
+   * helper function to find a map of already loaded bpf program (e.g. one
+   * which is not pinned). caller must close returned fd
+   */
+  static int bpfMapGetFdByName(const std::string& name);
+
   /**
    * @param uint32_t prog_id valid id of a bpf prog
    * @return int fd of the prog if success, -1 on failure
@@ -389,6 +510,23 @@ class BpfAdapter {
       const unsigned int ifindex,
       const uint32_t flags = 0);
 
+  /**
+   *  @param int prog_fd descriptor of the new program
+   *  @param usigned int ifindex of interface
+   *  @param int old_prog_fd descriptor of currently attached program
+   *  @param uint32_t flags optional xdp flags
+   *  @return int 0 on success
+   *
+   *  helper function to atomically replace attached xdp prog. fails
+   *  if currently attached prog is not old_prog_fd (requires kernel
+   *  w/ XDP_FLAGS_REPLACE support)
+   */
+  static int replaceXdpProg(
+      const int prog_fd,
+      const unsigned int ifindex,
+      const int old_prog_fd,
+      const uint32_t flags = 0);
+
   /**
    * @param int prog_fd descriptor of bpf program
    * @param unsigned int ifindex - index of the interface
@@ -552,6 +690,47 @@ class BpfAdapter {
    */
   int updateSharedMap(const std::string& name, int fd);
 
+  /**
+   * @param string name of the map
+   * @param uint32_t maxEntries size of the map
+   * @return 0 on success
+   *
+   * helper function to override size of the map, specified in bpf object.
+   * must be called before bpf prog, which contains this map, is loaded
+   */
+  int setMapMaxEntries(const std::string& name, uint32_t maxEntries);
+
+  /**
+   * @param string bpf_prog path to new version of already loaded bpf program
+   * @param bpf_prog_type type of bpf prog to load
+   * @return int result 0 in case of success, other val otherwise
+   *
+   * helper function to load new version of bpf program, which reuses all
+   * already loaded maps. new program is staged: it does not replace old one
+   * until commitStagedBpfProg is called
+   */
+  int stageBpfProg(
+      const std::string& bpf_prog,
+      const bpf_prog_type type = BPF_PROG_TYPE_UNSPEC);
+
+  /**
+   * @param string name of the prog's section (as SEC("name") in bpf)
+   * @return int bpf's prog descriptor from staged object; -1 on error
+   */
+  int getStagedProgFdByName(const std::string& name);
+
+  /**
+   * @return int 0 on success
+   *
+   * helper function to replace old programs w/ staged ones
+   */
+  int commitStagedBpfProg();
+
+  /**
+   * helper function to unload staged program
+   */
+  void abortStagedBpfProg();
+
   /**
    * @return number of possible cpus used for percpu maps
    *
@@ -17,6 +17,10 @@
 
 #include "BpfLoader.h"
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
 #include <glog/logging.h>
 
 namespace katran {
@@ -28,6 +32,14 @@ constexpr int kPrefixLen = 3;
 constexpr int kStart = 0;
 constexpr int kSuccess = 0;
 constexpr int kMaxSharedMapNameSize = 15;
+// only statistics are written into the log, so it could be small
+constexpr uint32_t kVerifierLogSize = 16 * 1024;
+// BPF_LOG_STATS from kernel's bpf_verifier.h
+constexpr uint32_t kBpfLogStats = 4;
+constexpr char kVerificationTimeStat[] = "verification time ";
+constexpr char kProcessedInsnsStat[] = "processed ";
+constexpr char kTotalStatesStat[] = "total_states ";
+constexpr char kPeakStatesStat[] = "peak_states ";
 } // namespace
 
 namespace {
@@ -64,6 +76,22 @@ int libbpf_print(
   return vfprintf(stderr, format, args);
 }
 
+// helper function to parse "<prefix><number>" from verifier's log. stats
+// are at the end of the log, so last occurrence is used
+bool parseVerifierStat(
+    const std::string& log,
+    const char* prefix,
+    uint64_t& value) {
+  auto pos = log.rfind(prefix);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  auto start = log.c_str() + pos + ::strlen(prefix);
+  char* end;
+  value = ::strtoull(start, &end, 10);
+  return end != start;
+}
+
 } // namespace
 
 BpfLoader::BpfLoader() {
@@ -71,6 +99,7 @@ BpfLoader::BpfLoader() {
 }
 
 BpfLoader::~BpfLoader() {
+  abortStagedBpfObject();
   for (auto& obj : bpfObjects_) {
     closeBpfObject(obj.second);
   }
@@ -124,6 +153,17 @@ int BpfLoader::setInnerMapPrototype(const std::string& name, int fd) {
   return kSuccess;
 }
 
+int BpfLoader::setMapMaxEntries(
+    const std::string& name,
+    uint32_t maxEntries) {
+  if (maxEntries == 0) {
+    LOG(ERROR) << "max_entries of map " << name << " must be non zero";
+    return kError;
+  }
+  mapsMaxEntries_[name] = maxEntries;
+  return kSuccess;
+}
+
 int BpfLoader::loadBpfFile(
     const std::string& path,
     const bpf_prog_type type,
@@ -147,28 +187,8 @@ int BpfLoader::loadBpfFromBuffer(
   return loadBpfObject(obj, "buffer", type);
 }
 
-int BpfLoader::loadBpfObject(
-    ::bpf_object* obj,
-    const std::string& name,
-    const bpf_prog_type type) {
-  if (bpfObjects_.find(name) != bpfObjects_.end()) {
-    LOG(ERROR) << "collision while trying to load bpf object w/ name " << name;
-    return closeBpfObject(obj);
-  }
-
-  ::bpf_program* prog;
+int BpfLoader::prepareMaps(::bpf_object* obj, bool reuseLoaded) {
   ::bpf_map* map;
-
-  bpf_object__for_each_program(prog, obj) {
-    if (progs_.find(::bpf_program__title(prog, false)) != progs_.end()) {
-      LOG(ERROR) << "bpf's program name collision: "
-                 << ::bpf_program__title(prog, false);
-      return closeBpfObject(obj);
-    }
-    auto prog_type = normalizeBpfProgType(prog, type);
-    ::bpf_program__set_type(prog, prog_type);
-  }
-
   bpf_map__for_each(map, obj) {
     auto map_name = ::bpf_map__name(map);
     auto shared_map_iter = sharedMaps_.find(map_name);
@@ -177,13 +197,37 @@ int BpfLoader::loadBpfObject(
       if (::bpf_map__reuse_fd(map, shared_map_iter->second)) {
         LOG(ERROR) << "error while trying to set fd of shared map: "
                    << shared_map_iter->first;
-        return closeBpfObject(obj);
+        return kError;
       }
       continue;
     }
-    if (maps_.find(map_name) != maps_.end()) {
-      LOG(ERROR) << "bpf's map name collision";
-      return closeBpfObject(obj);
+    auto max_entries_iter = mapsMaxEntries_.find(map_name);
+    if (max_entries_iter != mapsMaxEntries_.end()) {
+      VLOG(2) << "setting max_entries for map: " << max_entries_iter->first
+              << " to: " << max_entries_iter->second;
+      if (::bpf_map__set_max_entries(map, max_entries_iter->second)) {
+        LOG(ERROR) << "error while trying to set max_entries for map: "
+                   << max_entries_iter->first;
+        return kError;
+      }
+    }
+    auto loaded_map_iter = maps_.find(map_name);
+    if (loaded_map_iter != maps_.end()) {
+      if (!reuseLoaded) {
+        LOG(ERROR) << "bpf's map name collision";
+        return kError;
+      }
+      if (!isMapCompatible(map, loaded_map_iter->second)) {
+        LOG(ERROR) << "layout of map: " << map_name
+                   << " is not compatible w/ already loaded one";
+        return kError;
+      }
+      VLOG(2) << "reusing already loaded map: " << map_name;
+      if (::bpf_map__reuse_fd(map, loaded_map_iter->second)) {
+        LOG(ERROR) << "error while trying to reuse fd of map: " << map_name;
+        return kError;
+      }
+      continue;
     }
     auto inner_map_iter = innerMapsProto_.find(map_name);
     if (inner_map_iter != innerMapsProto_.end()) {
@@ -193,16 +237,61 @@ int BpfLoader::loadBpfObject(
         LOG(ERROR) << "error while trying to set inner map fd for: "
                    << inner_map_iter->first
                    << " fd: " << inner_map_iter->second;
-        return closeBpfObject(obj);
+        return kError;
       }
     }
   }
+  return kSuccess;
+}
+
+bool BpfLoader::isMapCompatible(::bpf_map* map, int fd) {
+  ::bpf_map_info info = {};
+  uint32_t info_len = sizeof(info);
+  if (::bpf_obj_get_info_by_fd(fd, &info, &info_len)) {
+    LOG(ERROR) << "can't get info for map w/ fd: " << fd;
+    return false;
+  }
+  return info.type == ::bpf_map__type(map) &&
+      info.key_size == ::bpf_map__key_size(map) &&
+      info.value_size == ::bpf_map__value_size(map) &&
+      info.max_entries == ::bpf_map__max_entries(map) &&
+      info.map_flags == ::bpf_map__map_flags(map);
+}
 
-  if (::bpf_object__load(obj)) {
-    LOG(ERROR) << "error while trying to load bpf object: " << name;
+int BpfLoader::loadBpfObject(
+    ::bpf_object* obj,
+    const std::string& name,
+    const bpf_prog_type type) {
+  if (bpfObjects_.find(name) != bpfObjects_.end()) {
+    LOG(ERROR) << "collision while trying to load bpf object w/ name " << name;
     return closeBpfObject(obj);
   }
 
+  ::bpf_program* prog;
+  ::bpf_map* map;
+
+  bpf_object__for_each_program(prog, obj) {
+    if (progs_.find(::bpf_program__title(prog, false)) != progs_.end()) {
+      LOG(ERROR) << "bpf's program name collision: "
+                 << ::bpf_program__title(prog, false);
+      return closeBpfObject(obj);
+    }
+    auto prog_type = normalizeBpfProgType(prog, type);
+    ::bpf_program__set_type(prog, prog_type);
+  }
+
+  if (prepareMaps(obj, false)) {
+    return closeBpfObject(obj);
+  }
+
+  std::vector<BpfProgLoadStats> stats;
+  if (loadObjectWithStats(obj, name, stats)) {
+    return closeBpfObject(obj);
+  }
+  for (auto& progStats : stats) {
+    progsLoadStats_[progStats.name] = std::move(progStats);
+  }
+
   bpf_object__for_each_program(prog, obj) {
     VLOG(4) << "adding bpf program: " << ::bpf_program__title(prog, false)
             << " with fd: " << ::bpf_program__fd(prog);
@@ -219,4 +308,212 @@ int BpfLoader::loadBpfObject(
   return kSuccess;
 }
 
+int BpfLoader::stageBpfFile(
+    const std::string& path,
+    const bpf_prog_type type) {
+  if (stagedObject_ != nullptr) {
+    LOG(ERROR) << "bpf object " << stagedObjectName_ << " is already staged";
+    return kError;
+  }
+  auto obj = ::bpf_object__open(path.c_str());
+  if (obj == nullptr) {
+    return kError;
+  }
+
+  ::bpf_program* prog;
+  bpf_object__for_each_program(prog, obj) {
+    auto prog_type = normalizeBpfProgType(prog, type);
+    ::bpf_program__set_type(prog, prog_type);
+  }
+
+  if (prepareMaps(obj, true)) {
+    return closeBpfObject(obj);
+  }
+
+  std::vector<BpfProgLoadStats> stats;
+  if (loadObjectWithStats(obj, path, stats)) {
+    return closeBpfObject(obj);
+  }
+  stagedLoadStats_ = std::move(stats);
+  stagedObject_ = obj;
+  stagedObjectName_ = path;
+  return kSuccess;
+}
+
+int BpfLoader::getStagedProgFdByName(const std::string& name) {
+  if (stagedObject_ == nullptr) {
+    LOG(ERROR) << "there is no staged bpf object";
+    return kNotExists;
+  }
+  ::bpf_program* prog;
+  bpf_object__for_each_program(prog, stagedObject_) {
+    if (name == ::bpf_program__title(prog, false)) {
+      return ::bpf_program__fd(prog);
+    }
+  }
+  LOG(ERROR) << "Can't find staged prog with name: " << name;
+  return kNotExists;
+}
+
+int BpfLoader::commitStagedBpfObject() {
+  if (stagedObject_ == nullptr) {
+    LOG(ERROR) << "there is no staged bpf object";
+    return kError;
+  }
+  ::bpf_program* prog;
+  ::bpf_map* map;
+  std::unordered_map<std::string, int> staged_progs;
+  bpf_object__for_each_program(prog, stagedObject_) {
+    staged_progs[::bpf_program__title(prog, false)] = ::bpf_program__fd(prog);
+  }
+
+  // closing objects, which programs are replaced by staged ones. maps are
+  // refcounted by kernel, so reused maps are still alive after that
+  for (auto it = bpfObjects_.begin(); it != bpfObjects_.end();) {
+    bool replaced = false;
+    bpf_object__for_each_program(prog, it->second) {
+      if (staged_progs.find(::bpf_program__title(prog, false)) !=
+          staged_progs.end()) {
+        replaced = true;
+        break;
+      }
+    }
+    if (replaced) {
+      VLOG(2) << "closing replaced bpf object: " << it->first;
+      bpf_object__for_each_program(prog, it->second) {
+        progs_.erase(::bpf_program__title(prog, false));
+        progsLoadStats_.erase(::bpf_program__title(prog, false));
+      }
+      bpf_map__for_each(map, it->second) {
+        // reused maps would be re-added from staged object below
+        maps_.erase(::bpf_map__name(map));
+      }
+      closeBpfObject(it->second);
+      it = bpfObjects_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  for (const auto& staged_prog : staged_progs) {
+    VLOG(4) << "adding bpf program: " << staged_prog.first
+            << " with fd: " << staged_prog.second;
+    progs_[staged_prog.first] = staged_prog.second;
+  }
+  bpf_map__for_each(map, stagedObject_) {
+    VLOG(4) << "adding bpf map: " << ::bpf_map__name(map)
+            << " with fd: " << ::bpf_map__fd(map);
+    maps_[::bpf_map__name(map)] = ::bpf_map__fd(map);
+  }
+  for (auto& progStats : stagedLoadStats_) {
+    progsLoadStats_[progStats.name] = std::move(progStats);
+  }
+  stagedLoadStats_.clear();
+  bpfObjects_[stagedObjectName_] = stagedObject_;
+  stagedObject_ = nullptr;
+  stagedObjectName_.clear();
+  return kSuccess;
+}
+
+void BpfLoader::abortStagedBpfObject() {
+  if (stagedObject_ != nullptr) {
+    closeBpfObject(stagedObject_);
+    stagedObject_ = nullptr;
+    stagedObjectName_.clear();
+    stagedLoadStats_.clear();
+  }
+}
+
+int BpfLoader::loadObjectWithStats(
+    ::bpf_object* obj,
+    const std::string& name,
+    std::vector<BpfProgLoadStats>& stats) {
+  ::bpf_program* prog;
+  // per program buffers for verifier's log. must be alive during the load
+  std::vector<std::vector<char>> logs;
+  if (verifierStats_) {
+    bpf_object__for_each_program(prog, obj) {
+      logs.emplace_back(kVerifierLogSize, 0);
+      if (::bpf_program__set_log_buf(
+              prog, logs.back().data(), logs.back().size()) ||
+          ::bpf_program__set_log_level(prog, kBpfLogStats)) {
+        LOG(ERROR) << "can't enable verifier stats for prog: "
+                   << ::bpf_program__title(prog, false);
+        return kError;
+      }
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto err = ::bpf_object__load(obj);
+  uint64_t loadTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  if (err) {
+    LOG(ERROR) << "error while trying to load bpf object: " << name
+               << " (load took " << loadTimeUs << " us)";
+    return kError;
+  }
+
+  size_t prog_idx = 0;
+  bpf_object__for_each_program(prog, obj) {
+    BpfProgLoadStats progStats;
+    progStats.name = ::bpf_program__title(prog, false);
+    progStats.object = name;
+    progStats.objectLoadTimeUs = loadTimeUs;
+    progStats.insnCnt = ::bpf_program__size(prog) / sizeof(struct bpf_insn);
+    if (verifierStats_ &&
+        !parseVerifierStats(logs[prog_idx].data(), progStats)) {
+      VLOG(2) << "no verifier stats in the log of prog: " << progStats.name;
+    }
+    prog_idx++;
+    ::bpf_prog_info info = {};
+    uint32_t info_len = sizeof(info);
+    if (!::bpf_obj_get_info_by_fd(::bpf_program__fd(prog), &info, &info_len)) {
+      progStats.xlatedSize = info.xlated_prog_len;
+      progStats.jitedSize = info.jited_prog_len;
+      if (!progStats.processedInsns) {
+        progStats.processedInsns = info.verified_insns;
+      }
+    }
+    LOG(INFO) << "bpf prog " << progStats.name << " from " << name
+              << " loaded. object load time: " << loadTimeUs
+              << " us, verification time: " << progStats.verificationTimeUs
+              << " us, processed insns: " << progStats.processedInsns
+              << ", insns: " << progStats.insnCnt
+              << ", xlated size: " << progStats.xlatedSize
+              << ", jited size: " << progStats.jitedSize;
+    stats.push_back(std::move(progStats));
+  }
+  return kSuccess;
+}
+
+std::vector<BpfProgLoadStats> BpfLoader::getProgsLoadStats() const {
+  std::vector<BpfProgLoadStats> stats;
+  for (const auto& progStats : progsLoadStats_) {
+    stats.push_back(progStats.second);
+  }
+  return stats;
+}
+
+bool BpfLoader::parseVerifierStats(
+    const std::string& log,
+    BpfProgLoadStats& stats) {
+  uint64_t value;
+  if (!parseVerifierStat(log, kProcessedInsnsStat, value)) {
+    return false;
+  }
+  stats.processedInsns = value;
+  if (parseVerifierStat(log, kVerificationTimeStat, value)) {
+    stats.verificationTimeUs = value;
+  }
+  if (parseVerifierStat(log, kTotalStatesStat, value)) {
+    stats.totalStates = value;
+  }
+  if (parseVerifierStat(log, kPeakStatesStat, value)) {
+    stats.peakStates = value;
+  }
+  return true;
+}
+
 } // namespace katran
@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 extern "C" {
 #include <bpf/libbpf.h>
@@ -25,6 +27,37 @@ extern "C" {
 
 namespace katran {
 
+/**
+ * @param string name of the bpf program
+ * @param string object name of bpf object (path) where program is defined
+ * @param uint64_t objectLoadTimeUs time spent in loading of the whole object
+ * (maps creation and verification of all programs)
+ * @param uint64_t verificationTimeUs time spent by verifier on this program
+ * @param uint32_t processedInsns number of instructions processed by verifier
+ * @param uint32_t totalStates number of states verifier has created
+ * @param uint32_t peakStates max number of states verifier kept at once
+ * @param uint32_t insnCnt number of instructions in the object file
+ * @param uint32_t xlatedSize size of the program after verifier's rewrites
+ * @param uint32_t jitedSize size of jited image
+ *
+ * load time statistics of bpf program. verifier's counters (verificationTimeUs,
+ * processedInsns and states) are collected only if verifier stats are
+ * enabled in the loader. processedInsns is taken from bpf_prog_info if
+ * verifier's log is not available, but kernel reports it (5.16+)
+ */
+struct BpfProgLoadStats {
+  std::string name;
+  std::string object;
+  uint64_t objectLoadTimeUs{0};
+  uint64_t verificationTimeUs{0};
+  uint32_t processedInsns{0};
+  uint32_t totalStates{0};
+  uint32_t peakStates{0};
+  uint32_t insnCnt{0};
+  uint32_t xlatedSize{0};
+  uint32_t jitedSize{0};
+};
+
 /**
  * This is a helper class which implements routines to load a bpf program
  * from object file into kernel.
@@ -102,6 +135,84 @@ class BpfLoader {
    */
   int updateSharedMap(const std::string& name, int fd);
 
+  /**
+   * @param string name of the map
+   * @param uint32_t maxEntries size of the map
+   * @return int 0 on success
+   *
+   * helper function to override max_entries of the map (which is specified
+   * in bpf object). override is applied during the load of every bpf object,
+   * which contains map w/ specified name (shared maps are not affected)
+   */
+  int setMapMaxEntries(const std::string& name, uint32_t maxEntries);
+
+  /**
+   * @param string path to new version of already loaded bpf object file
+   * @param bpf_prog_type type of bpf program to load.
+   * @return int 0 on success
+   *
+   * helper function to load new version of bpf object, w/o unloading the
+   * old one. all maps, which are already loaded, are reused by the new
+   * object (their layout must be the same: type, key/value sizes, max
+   * entries and flags), new maps are created as usual.
+   * loaded object is staged: its programs are available only thru
+   * getStagedProgFdByName, until commitStagedBpfObject is called.
+   * only one object could be staged at a time.
+   */
+  int stageBpfFile(
+      const std::string& path,
+      const bpf_prog_type type = BPF_PROG_TYPE_UNSPEC);
+
+  /**
+   * @param string name of the bpf program
+   * @return int negative on failure, prog's fd on success
+   *
+   * helper function to get descriptor of program from staged object
+   */
+  int getStagedProgFdByName(const std::string& name);
+
+  /**
+   * @return int 0 on success
+   *
+   * helper function to replace old programs w/ the programs from staged
+   * object. bpf objects, which programs have been replaced, are closed
+   */
+  int commitStagedBpfObject();
+
+  /**
+   * helper function to close staged object w/o touching loaded ones
+   */
+  void abortStagedBpfObject();
+
+  /**
+   * @param bool enabled true if verifier should report its statistics
+   *
+   * if enabled - programs are loaded w/ stats log level (requires kernel 5.2+,
+   * on older kernels load would fail), so verification time, number of
+   * processed instructions and states are available in getProgsLoadStats()
+   */
+  void enableVerifierStats(bool enabled) {
+    verifierStats_ = enabled;
+  }
+
+  /**
+   * @return vector<BpfProgLoadStats> load time statistics of all loaded
+   * (and committed) programs
+   */
+  std::vector<BpfProgLoadStats> getProgsLoadStats() const;
+
+  /**
+   * @param string log verifier's log
+   * @param BpfProgLoadStats stats where parsed counters would be written
+   * @return bool true if statistics have been found in the log
+   *
+   * helper function to parse statistics, which verifier is writing at the
+   * end of the log (verification time, processed insns, states)
+   */
+  static bool parseVerifierStats(
+      const std::string& log,
+      BpfProgLoadStats& stats);
+
  private:
   /**
    * helper function to load bpf object
@@ -111,11 +222,34 @@ class BpfLoader {
       const std::string& name,
       const bpf_prog_type type = BPF_PROG_TYPE_UNSPEC);
 
+  /**
+   * helper function to load bpf object into the kernel and to collect
+   * load time statistics of its programs. returns 0 on success
+   */
+  int loadObjectWithStats(
+      ::bpf_object* obj,
+      const std::string& name,
+      std::vector<BpfProgLoadStats>& stats);
+
   /**
    * helper function to close bpf object and return error.
    */
   int closeBpfObject(::bpf_object* obj);
 
+  /**
+   * helper function to set shared/inner map's fds and max_entries overrides
+   * before object is loaded. if reuseLoaded is true - already loaded maps
+   * w/ the same name (and compatible layout) are reused.
+   * returns 0 on success
+   */
+  int prepareMaps(::bpf_object* obj, bool reuseLoaded);
+
+  /**
+   * helper function to check that layout of map in bpf object is the same
+   * as layout of already loaded map w/ specified fd
+   */
+  bool isMapCompatible(::bpf_map* map, int fd);
+
   /**
    * dict of path to bpf objects mapping
    */
@@ -139,6 +273,32 @@ class BpfLoader {
    * map of prototypes for inner map.
    */
   std::unordered_map<std::string, int> innerMapsProto_;
+
+  /**
+   * dict of map's name to max_entries overrides.
+   */
+  std::unordered_map<std::string, uint32_t> mapsMaxEntries_;
+
+  /**
+   * staged (loaded, but not yet committed) bpf object and its name
+   */
+  ::bpf_object* stagedObject_{nullptr};
+  std::string stagedObjectName_;
+
+  /**
+   * dict of prog's name to its load time statistics
+   */
+  std::unordered_map<std::string, BpfProgLoadStats> progsLoadStats_;
+
+  /**
+   * load time statistics of programs from staged object
+   */
+  std::vector<BpfProgLoadStats> stagedLoadStats_;
+
+  /**
+   * flag which shows if verifier's statistics should be collected
+   */
+  bool verifierStats_{false};
 };
 
 } // namespace katran
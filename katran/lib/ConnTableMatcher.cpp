@@ -0,0 +1,153 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "katran/lib/ConnTableMatcher.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <folly/Format.h>
+#include <folly/lang/Bits.h>
+
+#include "katran/lib/IpHelpers.h"
+
+namespace katran {
+
+namespace {
+constexpr uint8_t kV6DAddr = 1;
+constexpr size_t kV6AddrSize = 16;
+
+std::array<uint32_t, 4> toV6Addr(const uint32_t* addr) {
+  std::array<uint32_t, 4> result;
+  std::copy(addr, addr + result.size(), result.begin());
+  return result;
+}
+} // namespace
+
+ConnTableMatcher::ConnTableMatcher(
+    const KatranConnTableFilter& filter,
+    const std::unordered_map<folly::IPAddress, uint32_t>& vipAddrs,
+    const std::unordered_map<uint32_t, folly::IPAddress>& reals)
+    : reals_(reals), proto_(filter.proto) {
+  for (const auto& vip : vipAddrs) {
+    auto addr = IpHelpers::parseAddrToBe(vip.first);
+    if ((addr.flags & kV6DAddr) > 0) {
+      v6Vips_.insert(toV6Addr(addr.v6daddr));
+    } else {
+      v4Vips_.insert(addr.daddr);
+    }
+  }
+  if (!filter.vip.empty()) {
+    if (!folly::IPAddress::validate(filter.vip)) {
+      throw std::invalid_argument(
+          folly::sformat("invalid vip address: {}", filter.vip));
+    }
+    auto addr = IpHelpers::parseAddrToBe(filter.vip);
+    filterVip_ = true;
+    vipV6_ = (addr.flags & kV6DAddr) > 0;
+    vipAddr_ = vipV6_ ? toV6Addr(addr.v6daddr) : V6Addr{addr.daddr, 0, 0, 0};
+  }
+  vipPort_ = folly::Endian::big(filter.vipPort);
+  if (!filter.real.empty()) {
+    if (!folly::IPAddress::validate(filter.real)) {
+      throw std::invalid_argument(
+          folly::sformat("invalid real address: {}", filter.real));
+    }
+    folly::IPAddress real(filter.real);
+    filterReal_ = true;
+    // no flows could be pinned to unknown real
+    canMatch_ = false;
+    for (const auto& num_to_real : reals) {
+      if (num_to_real.second == real) {
+        realNum_ = num_to_real.first;
+        canMatch_ = true;
+        break;
+      }
+    }
+  }
+  if (!filter.srcPrefix.empty()) {
+    auto prefix = folly::IPAddress::tryCreateNetwork(filter.srcPrefix);
+    if (prefix.hasError()) {
+      throw std::invalid_argument(
+          folly::sformat("invalid source prefix: {}", filter.srcPrefix));
+    }
+    filterSrc_ = true;
+    srcPrefix_ = prefix.value();
+  }
+}
+
+bool ConnTableMatcher::isV6Flow(const flow_key& key) const {
+  bool upper_words =
+      key.dstv6[1] || key.dstv6[2] || key.dstv6[3] || key.srcv6[1] ||
+      key.srcv6[2] || key.srcv6[3];
+  if (!upper_words && v4Vips_.count(key.dst)) {
+    return false;
+  }
+  if (v6Vips_.count(toV6Addr(key.dstv6))) {
+    return true;
+  }
+  return upper_words;
+}
+
+bool ConnTableMatcher::match(
+    const flow_key& key,
+    const real_pos_lru& value,
+    KatranConnEntry& entry) const {
+  if (!canMatch_) {
+    return false;
+  }
+  if (filterReal_ && value.pos != realNum_) {
+    return false;
+  }
+  if (proto_ && key.proto != proto_) {
+    return false;
+  }
+  if (vipPort_ && key.port16[1] != vipPort_) {
+    return false;
+  }
+  bool is_v6 = isV6Flow(key);
+  if (filterVip_) {
+    if (vipV6_ != is_v6) {
+      return false;
+    }
+    if (vipV6_ ? toV6Addr(key.dstv6) != vipAddr_ : key.dst != vipAddr_[0]) {
+      return false;
+    }
+  }
+  folly::IPAddress src = is_v6
+      ? folly::IPAddress(folly::IPAddressV6::fromBinary(folly::ByteRange(
+            reinterpret_cast<const uint8_t*>(key.srcv6), kV6AddrSize)))
+      : folly::IPAddress(folly::IPAddressV4::fromLong(key.src));
+  if (filterSrc_ && !src.inSubnet(srcPrefix_.first, srcPrefix_.second)) {
+    return false;
+  }
+  entry.src = src.str();
+  entry.dst = is_v6
+      ? folly::IPAddressV6::fromBinary(
+            folly::ByteRange(
+                reinterpret_cast<const uint8_t*>(key.dstv6), kV6AddrSize))
+            .str()
+      : folly::IPAddressV4::fromLong(key.dst).str();
+  entry.srcPort = folly::Endian::big(key.port16[0]);
+  entry.dstPort = folly::Endian::big(key.port16[1]);
+  entry.proto = key.proto;
+  auto real_iter = reals_.find(value.pos);
+  entry.real = real_iter != reals_.end() ? real_iter->second.str() : "";
+  entry.atime = value.atime;
+  return true;
+}
+
+} // namespace katran
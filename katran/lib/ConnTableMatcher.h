@@ -0,0 +1,106 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <folly/IPAddress.h>
+
+#include "katran/lib/BalancerStructs.h"
+#include "katran/lib/KatranLbStructs.h"
+
+namespace katran {
+
+/**
+ * This class translates entries of connection table (lru) into
+ * KatranConnEntry and matches them against KatranConnTableFilter. filter is
+ * converted into lru's representation once, so per entry checks are mostly
+ * memory comparisons.
+ */
+class ConnTableMatcher {
+ public:
+  /**
+   * @param KatranConnTableFilter filter of flows
+   * @param unordered_map<IPAddress, uint32_t> vipAddrs addresses of
+   * configured vips (to their number of vips)
+   * @param unordered_map<uint32_t, IPAddress> reals real's num to address
+   *
+   * could throw std::invalid_argument if filter is malformed
+   */
+  ConnTableMatcher(
+      const KatranConnTableFilter& filter,
+      const std::unordered_map<folly::IPAddress, uint32_t>& vipAddrs,
+      const std::unordered_map<uint32_t, folly::IPAddress>& reals);
+
+  /**
+   * @return bool false if there is no flow, which could match the filter
+   * (e.g. filter's real is unknown)
+   */
+  bool canMatch() const {
+    return canMatch_;
+  }
+
+  /**
+   * @param flow_key key of lru entry
+   * @param real_pos_lru value of lru entry
+   * @param KatranConnEntry entry where flow would be written (core is not
+   * set)
+   * @return bool true if flow matches the filter
+   */
+  bool match(
+      const flow_key& key,
+      const real_pos_lru& value,
+      KatranConnEntry& entry) const;
+
+  /**
+   * @param flow_key key of lru entry
+   * @return bool true if it is a v6 flow
+   *
+   * flow_key does not carry address family, so family of the flow is the
+   * family of configured vip w/ flow's dst. only for flows toward vips which
+   * are not configured anymore: v4 flows are the ones w/ only the first word
+   * of the addresses set (forwarding plane zeroes the rest of the key)
+   */
+  bool isV6Flow(const flow_key& key) const;
+
+ private:
+  using V6Addr = std::array<uint32_t, 4>;
+
+  const std::unordered_map<uint32_t, folly::IPAddress>& reals_;
+  bool canMatch_{true};
+  bool filterVip_{false};
+  bool vipV6_{false};
+  V6Addr vipAddr_{};
+  uint16_t vipPort_{0};
+  uint8_t proto_{0};
+  bool filterReal_{false};
+  uint32_t realNum_{0};
+  bool filterSrc_{false};
+  folly::CIDRNetwork srcPrefix_;
+
+  /**
+   * addresses of configured vips in lru's representation
+   */
+  std::unordered_set<uint32_t> v4Vips_;
+  std::set<V6Addr> v6Vips_;
+};
+
+} // namespace katran
@@ -0,0 +1,504 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "katran/lib/ConnTableSync.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+extern "C" {
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+}
+
+namespace katran {
+
+namespace {
+constexpr int kListenBacklog = 16;
+constexpr int kPeerTimeoutSec = 1;
+constexpr int kPollTimeoutMs = 100;
+constexpr size_t kRecvBufSize = 65536;
+// so corrupted (or malicious) header could not make us buffer gigabytes
+constexpr uint32_t kMaxMessageEntries = 65536;
+constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+constexpr uint64_t kFnvPrime = 0x100000001b3ULL;
+
+// fills sockaddr from address string and port. returns socklen or 0
+socklen_t makeSockaddr(
+    const std::string& address,
+    uint16_t port,
+    struct sockaddr_storage& storage) {
+  storage = {};
+  auto addr4 = reinterpret_cast<struct sockaddr_in*>(&storage);
+  auto addr6 = reinterpret_cast<struct sockaddr_in6*>(&storage);
+  if (::inet_pton(AF_INET, address.c_str(), &addr4->sin_addr) == 1) {
+    addr4->sin_family = AF_INET;
+    addr4->sin_port = htons(port);
+    return sizeof(*addr4);
+  }
+  if (::inet_pton(AF_INET6, address.c_str(), &addr6->sin6_addr) == 1) {
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = htons(port);
+    return sizeof(*addr6);
+  }
+  return 0;
+}
+
+// address in inet_ntop format. v4 mapped v6 addresses (connections from v4
+// hosts to v6 socket) are returned as v4 ones
+std::string canonicalAddress(const struct sockaddr_storage& storage) {
+  char buf[INET6_ADDRSTRLEN] = {};
+  if (storage.ss_family == AF_INET) {
+    auto addr4 = reinterpret_cast<const struct sockaddr_in*>(&storage);
+    ::inet_ntop(AF_INET, &addr4->sin_addr, buf, sizeof(buf));
+  } else if (storage.ss_family == AF_INET6) {
+    auto addr6 = reinterpret_cast<const struct sockaddr_in6*>(&storage);
+    if (IN6_IS_ADDR_V4MAPPED(&addr6->sin6_addr)) {
+      ::inet_ntop(AF_INET, &addr6->sin6_addr.s6_addr[12], buf, sizeof(buf));
+    } else {
+      ::inet_ntop(AF_INET6, &addr6->sin6_addr, buf, sizeof(buf));
+    }
+  }
+  return buf;
+}
+
+uint64_t fnv1a(const void* data, size_t len, uint64_t hash = kFnvOffsetBasis) {
+  auto bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+// hash of the flow (everything but real and atime) in the record
+uint64_t hashFlow(const ConnTableRecord& record) {
+  auto hash = fnv1a(&record.family, sizeof(record.family));
+  hash = fnv1a(&record.proto, sizeof(record.proto), hash);
+  hash = fnv1a(&record.srcPort, sizeof(record.srcPort), hash);
+  hash = fnv1a(&record.dstPort, sizeof(record.dstPort), hash);
+  hash = fnv1a(&record.core, sizeof(record.core), hash);
+  hash = fnv1a(record.src, sizeof(record.src), hash);
+  return fnv1a(record.dst, sizeof(record.dst), hash);
+}
+
+uint64_t hashReal(const ConnTableRecord& record) {
+  auto hash = fnv1a(&record.realFamily, sizeof(record.realFamily));
+  return fnv1a(record.real, sizeof(record.real), hash);
+}
+
+bool writeAll(int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    auto res = ::send(
+        fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += res;
+  }
+  return true;
+}
+
+uint64_t realtimeNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+ConnTableSync::ConnTableSync(
+    const ConnTableSyncConfig& config,
+    ConnTableExporter exporter,
+    ConnTableImporter importer)
+    : config_(config),
+      exporter_(std::move(exporter)),
+      importer_(std::move(importer)) {
+  if (config_.sampleRate == 0 || config_.maxBatchSize == 0 ||
+      config_.maxBatchSize > kMaxMessageEntries) {
+    throw std::invalid_argument("invalid conn table sync config");
+  }
+  for (const auto& peer : config_.peers) {
+    auto pos = peer.rfind(':');
+    if (pos == std::string::npos || pos + 1 == peer.size()) {
+      throw std::invalid_argument("invalid peer address: " + peer);
+    }
+    Peer p;
+    p.address = peer.substr(0, pos);
+    if (p.address.size() > 2 && p.address.front() == '[' &&
+        p.address.back() == ']') {
+      p.address = p.address.substr(1, p.address.size() - 2);
+    }
+    auto port = std::stoul(peer.substr(pos + 1));
+    struct sockaddr_storage storage;
+    if (port > UINT16_MAX || !makeSockaddr(p.address, port, storage)) {
+      throw std::invalid_argument("invalid peer address: " + peer);
+    }
+    p.port = port;
+    allowedPeers_.insert(canonicalAddress(storage));
+    peers_.push_back(std::move(p));
+  }
+}
+
+ConnTableSync::~ConnTableSync() {
+  stop();
+  for (auto& peer : peers_) {
+    if (peer.fd >= 0) {
+      ::close(peer.fd);
+    }
+  }
+}
+
+bool ConnTableSync::createSocket() {
+  struct sockaddr_storage storage;
+  auto addr_len =
+      makeSockaddr(config_.listenAddress, config_.listenPort, storage);
+  if (!addr_len) {
+    LOG(ERROR) << "invalid address for conn table sync: "
+               << config_.listenAddress;
+    return false;
+  }
+  auto addr = reinterpret_cast<struct sockaddr*>(&storage);
+  listenFd_ = ::socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd_ < 0) {
+    return false;
+  }
+  int one = 1;
+  ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (::bind(listenFd_, addr, addr_len)) {
+    LOG(ERROR) << "can't bind conn table sync socket to "
+               << config_.listenAddress << ":" << config_.listenPort << ": "
+               << ::strerror(errno);
+    return false;
+  }
+  ::getsockname(listenFd_, addr, &addr_len);
+  port_ = storage.ss_family == AF_INET
+      ? ntohs(reinterpret_cast<struct sockaddr_in*>(addr)->sin_port)
+      : ntohs(reinterpret_cast<struct sockaddr_in6*>(addr)->sin6_port);
+  if (::listen(listenFd_, kListenBacklog)) {
+    LOG(ERROR) << "can't listen on conn table sync socket: "
+               << ::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool ConnTableSync::start() {
+  if (running_) {
+    return true;
+  }
+  if (!config_.listenAddress.empty() && !createSocket()) {
+    if (listenFd_ >= 0) {
+      ::close(listenFd_);
+      listenFd_ = -1;
+    }
+    return false;
+  }
+  running_ = true;
+  if (!peers_.empty()) {
+    sendThread_ = std::thread([this]() { sendLoop(); });
+  }
+  if (listenFd_ >= 0) {
+    receiveThread_ = std::thread([this]() { receiveLoop(); });
+  }
+  return true;
+}
+
+void ConnTableSync::stop() {
+  if (!running_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(stopLock_);
+    running_ = false;
+  }
+  stopCv_.notify_all();
+  if (sendThread_.joinable()) {
+    sendThread_.join();
+  }
+  if (receiveThread_.joinable()) {
+    receiveThread_.join();
+  }
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+    listenFd_ = -1;
+  }
+}
+
+bool ConnTableSync::connectPeer(Peer& peer) {
+  struct sockaddr_storage storage;
+  auto addr_len = makeSockaddr(peer.address, peer.port, storage);
+  int fd = ::socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  // connect() honors SO_SNDTIMEO as well, so unreachable peer would not
+  // stall export cycle for too long
+  struct timeval timeout = {.tv_sec = kPeerTimeoutSec, .tv_usec = 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  if (::connect(fd, reinterpret_cast<struct sockaddr*>(&storage), addr_len)) {
+    VLOG(2) << "can't connect to conn table sync peer " << peer.address << ":"
+            << peer.port << ": " << ::strerror(errno);
+    ::close(fd);
+    return false;
+  }
+  peer.fd = fd;
+  // new connection could be to restarted peer w/ empty connection table
+  peer.synced = false;
+  return true;
+}
+
+uint64_t ConnTableSync::sendBatch(
+    std::string& batch,
+    uint32_t count,
+    bool unsyncedOnly) {
+  ConnTableSyncHeader header;
+  header.magic = kConnSyncMagic;
+  header.count = count;
+  header.sentNs = realtimeNs();
+  std::memcpy(&batch[0], &header, sizeof(header));
+  uint64_t sent = 0;
+  for (auto& peer : peers_) {
+    if (peer.fd < 0 || (unsyncedOnly && peer.synced)) {
+      continue;
+    }
+    if (!writeAll(peer.fd, batch)) {
+      // would reconnect (and get whole table) on next cycle
+      sendErrors_++;
+      ::close(peer.fd);
+      peer.fd = -1;
+      continue;
+    }
+    sent = count;
+  }
+  entriesSent_ += sent;
+  return sent;
+}
+
+uint64_t ConnTableSync::sync() {
+  std::lock_guard<std::mutex> guard(syncLock_);
+  bool connected = false;
+  bool full_sync = false;
+  for (auto& peer : peers_) {
+    if (peer.fd < 0 && !connectPeer(peer)) {
+      sendErrors_++;
+      continue;
+    }
+    connected = true;
+    full_sync |= !peer.synced;
+  }
+  if (!connected) {
+    // peers would get whole table after reconnect anyway
+    return 0;
+  }
+  generation_++;
+  uint64_t sent = 0;
+  // new or changed flows go to every peer; unchanged ones only to peers
+  // which are not synced yet
+  uint32_t changed_count = 0, unchanged_count = 0;
+  std::string changed(sizeof(ConnTableSyncHeader), 0);
+  std::string unchanged(sizeof(ConnTableSyncHeader), 0);
+  auto append = [&](std::string& batch,
+                    uint32_t& count,
+                    bool unsyncedOnly,
+                    const ConnTableRecord& record) {
+    batch.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    if (++count == config_.maxBatchSize) {
+      sent += sendBatch(batch, count, unsyncedOnly);
+      batch.resize(sizeof(ConnTableSyncHeader));
+      count = 0;
+    }
+  };
+  exporter_([&](const KatranConnEntry& entry) {
+    ConnTableRecord record;
+    if (!makeConnTableRecord(entry, record)) {
+      return true;
+    }
+    auto flow_hash = hashFlow(record);
+    if (flow_hash % config_.sampleRate != 0) {
+      return true;
+    }
+    auto real_hash = hashReal(record);
+    auto& flow = sentFlows_[flow_hash];
+    bool is_changed = flow.generation == 0 || flow.realHash != real_hash;
+    flow.realHash = real_hash;
+    flow.generation = generation_;
+    if (is_changed) {
+      append(changed, changed_count, false, record);
+    } else if (full_sync) {
+      append(unchanged, unchanged_count, true, record);
+    }
+    return true;
+  });
+  if (changed_count) {
+    sent += sendBatch(changed, changed_count, false);
+  }
+  if (unchanged_count) {
+    sent += sendBatch(unchanged, unchanged_count, true);
+  }
+  // flows which have been evicted from connection table. if they show up
+  // again - they are going to be sent as new ones
+  for (auto it = sentFlows_.begin(); it != sentFlows_.end();) {
+    if (it->second.generation != generation_) {
+      it = sentFlows_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto& peer : peers_) {
+    if (peer.fd >= 0) {
+      peer.synced = true;
+    }
+  }
+  return sent;
+}
+
+bool ConnTableSync::processBuffer(Client& client) {
+  size_t offset = 0;
+  while (client.buffer.size() - offset >= sizeof(ConnTableSyncHeader)) {
+    ConnTableSyncHeader header;
+    std::memcpy(&header, client.buffer.data() + offset, sizeof(header));
+    if (header.magic != kConnSyncMagic || header.count > kMaxMessageEntries) {
+      LOG(ERROR) << "malformed conn table sync message";
+      return false;
+    }
+    size_t len = sizeof(header) + header.count * sizeof(ConnTableRecord);
+    if (client.buffer.size() - offset < len) {
+      break;
+    }
+    std::vector<KatranConnEntry> entries;
+    entries.reserve(header.count);
+    auto records = client.buffer.data() + offset + sizeof(header);
+    for (uint32_t i = 0; i < header.count; i++) {
+      ConnTableRecord record;
+      std::memcpy(
+          &record, records + i * sizeof(ConnTableRecord), sizeof(record));
+      KatranConnEntry entry;
+      if (parseConnTableRecord(record, entry)) {
+        entries.push_back(std::move(entry));
+      }
+    }
+    entriesReceived_ += header.count;
+    entriesImported_ += importer_(entries);
+    auto now = realtimeNs();
+    lagMs_.set(now > header.sentNs ? (now - header.sentNs) / 1000000 : 0);
+    offset += len;
+  }
+  client.buffer.erase(0, offset);
+  return true;
+}
+
+void ConnTableSync::sendLoop() {
+  std::unique_lock<std::mutex> lock(stopLock_);
+  while (running_) {
+    lock.unlock();
+    sync();
+    lock.lock();
+    stopCv_.wait_for(lock, std::chrono::milliseconds(config_.intervalMs));
+  }
+}
+
+void ConnTableSync::receiveLoop() {
+  std::vector<Client> clients;
+  std::vector<struct pollfd> fds;
+  char buf[kRecvBufSize];
+  while (running_) {
+    fds.clear();
+    fds.push_back({.fd = listenFd_, .events = POLLIN, .revents = 0});
+    for (const auto& client : clients) {
+      fds.push_back({.fd = client.fd, .events = POLLIN, .revents = 0});
+    }
+    // w/ timeout, so we would notice stop() in reasonable time
+    auto res = ::poll(fds.data(), fds.size(), kPollTimeoutMs);
+    if (res <= 0) {
+      if (res < 0 && errno != EINTR) {
+        LOG(ERROR) << "error while polling conn table sync sockets: "
+                   << ::strerror(errno);
+        break;
+      }
+      continue;
+    }
+    // fds[i + 1] belongs to clients[i]; going backward, so erase is safe
+    for (size_t i = clients.size(); i > 0; i--) {
+      if (!fds[i].revents) {
+        continue;
+      }
+      auto& client = clients[i - 1];
+      auto len = ::recv(client.fd, buf, sizeof(buf), 0);
+      if (len < 0 && errno == EINTR) {
+        continue;
+      }
+      bool ok = len > 0;
+      if (ok) {
+        client.buffer.append(buf, len);
+        ok = processBuffer(client);
+      }
+      if (!ok) {
+        ::close(client.fd);
+        clients.erase(clients.begin() + (i - 1));
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      struct sockaddr_storage addr = {};
+      socklen_t addr_len = sizeof(addr);
+      int fd = ::accept4(
+          listenFd_,
+          reinterpret_cast<struct sockaddr*>(&addr),
+          &addr_len,
+          SOCK_CLOEXEC);
+      if (fd >= 0) {
+        if (isAllowedPeer(addr)) {
+          clients.push_back({fd, std::string()});
+        } else {
+          LOG(ERROR) << "rejected conn table sync connection from "
+                     << canonicalAddress(addr);
+          rejectedConnections_++;
+          ::close(fd);
+        }
+      }
+    }
+  }
+  for (const auto& client : clients) {
+    ::close(client.fd);
+  }
+}
+
+bool ConnTableSync::isAllowedPeer(const struct sockaddr_storage& addr) {
+  return allowedPeers_.count(canonicalAddress(addr)) > 0;
+}
+
+ConnTableSyncStats ConnTableSync::getStats() {
+  ConnTableSyncStats stats;
+  stats.entriesSent = entriesSent_.get();
+  stats.entriesReceived = entriesReceived_.get();
+  stats.entriesImported = entriesImported_.get();
+  stats.sendErrors = sendErrors_.get();
+  stats.rejectedConnections = rejectedConnections_.get();
+  stats.lagMs = lagMs_.get();
+  return stats;
+}
+
+} // namespace katran
@@ -0,0 +1,294 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "katran/lib/ConnTableWriter.h"
+#include "katran/lib/KatranLbStructs.h"
+#include "katran/lib/StatsCounters.h"
+
+namespace katran {
+
+namespace {
+constexpr uint16_t kDefaultConnSyncPort = 9112;
+constexpr uint32_t kDefaultConnSyncIntervalMs = 1000;
+constexpr uint32_t kDefaultConnSyncBatchSize = 1024;
+constexpr uint32_t kConnSyncMagic = 0x4b435331; // "KCS1"
+} // namespace
+
+/**
+ * @param vector<string> peers list of "address:port" (or "[v6]:port") of
+ * other katran instances where local flows would be sent to. flows are
+ * received only from these addresses as well
+ * @param string listenAddress local address where flows from peers would be
+ * received. if empty - instance is not receiving anything
+ * @param uint16_t listenPort local port where flows would be received
+ * @param uint32_t intervalMs how often connection table is checked for new
+ * or changed flows
+ * @param uint32_t sampleRate export only 1 of sampleRate flows (1 - all).
+ * flows are sampled by hash, so the same flows are exported on every cycle
+ * @param uint32_t maxBatchSize max number of flows in single message
+ *
+ * config of connection table's sync
+ */
+struct ConnTableSyncConfig {
+  std::vector<std::string> peers;
+  std::string listenAddress;
+  uint16_t listenPort{kDefaultConnSyncPort};
+  uint32_t intervalMs{kDefaultConnSyncIntervalMs};
+  uint32_t sampleRate{1};
+  uint32_t maxBatchSize{kDefaultConnSyncBatchSize};
+};
+
+/**
+ * header of every sync message. it is followed by count ConnTableRecord.
+ * all fields are in host byte order, so peers must have the same endianness
+ * (which is checked w/ the magic)
+ */
+struct ConnTableSyncHeader {
+  uint32_t magic;
+  uint32_t count;
+  // CLOCK_REALTIME of the sender, in ns
+  uint64_t sentNs;
+} __attribute__((__packed__));
+
+/**
+ * @param uint64_t entriesSent number of flows sent to peers
+ * @param uint64_t entriesReceived number of flows received from peers
+ * @param uint64_t entriesImported number of received flows, which have been
+ * imported into local connection table
+ * @param uint64_t sendErrors number of failed connects/sends to peers
+ * @param uint64_t rejectedConnections number of connections from hosts,
+ * which are not configured as peers
+ * @param uint64_t lagMs age of the last received message (sender's to
+ * receiver's wall clock, so it includes clocks skew)
+ *
+ * conn table sync's related counters
+ */
+struct ConnTableSyncStats {
+  uint64_t entriesSent{0};
+  uint64_t entriesReceived{0};
+  uint64_t entriesImported{0};
+  uint64_t sendErrors{0};
+  uint64_t rejectedConnections{0};
+  uint64_t lagMs{0};
+};
+
+/**
+ * exporter is called w/ the callback, which must be called for each flow
+ * from local connection table (e.g. it could be bound to
+ * KatranLb::dumpConnectionTable)
+ */
+using ConnTableExporter = std::function<void(const KatranConnTableCallback&)>;
+
+/**
+ * importer is called w/ the flows received from the peer and returns number
+ * of imported flows (e.g. it could be bound to
+ * KatranLb::importConnectionTable)
+ */
+using ConnTableImporter =
+    std::function<uint64_t(const std::vector<KatranConnEntry>&)>;
+
+/**
+ * This class implements sharing of connection table between katran
+ * instances, so flows which are rerouted (e.g. by ECMP change) to another
+ * instance would still land on the same real, even if ch ring has been
+ * changed since. one background thread periodically walks local connection
+ * table and sends (optionally sampled) flows, which are new or pinned to
+ * another real since the previous cycle, in batches over tcp to each peer.
+ * peer gets the whole table once after each (re)connect. another thread
+ * receives flows from peers and hands em to the importer.
+ * exporter and importer are called from background threads and are
+ * responsible for synchronization w/ KatranLb.
+ */
+class ConnTableSync {
+ public:
+  ConnTableSync(
+      const ConnTableSyncConfig& config,
+      ConnTableExporter exporter,
+      ConnTableImporter importer);
+
+  ~ConnTableSync();
+
+  ConnTableSync(const ConnTableSync&) = delete;
+  ConnTableSync& operator=(const ConnTableSync&) = delete;
+
+  /**
+   * @return true on success
+   *
+   * starts sending and (if listenAddress is configured) receiving threads.
+   * returns false if listening socket could not be created
+   */
+  bool start();
+
+  /**
+   * stops all threads and closes all sockets
+   */
+  void stop();
+
+  /**
+   * @return uint64_t number of flows, which have been sent to peers
+   *
+   * runs single export cycle: new and changed flows are sent to every peer,
+   * unchanged ones only to peers w/o full copy of the table (e.g. just
+   * connected). connection to peers is (re)established if needed
+   */
+  uint64_t sync();
+
+  /**
+   * @return uint16_t port where flows are received (useful if configured
+   * port was 0)
+   */
+  uint16_t getPort() const {
+    return port_;
+  }
+
+  /**
+   * @return ConnTableSyncStats counters of this instance
+   */
+  ConnTableSyncStats getStats();
+
+ private:
+  /**
+   * state of the connection to single peer
+   */
+  struct Peer {
+    std::string address;
+    uint16_t port;
+    int fd{-1};
+    // true if peer has received whole table over current connection
+    bool synced{false};
+  };
+
+  /**
+   * flow which has been sent to peers
+   */
+  struct SentFlow {
+    // hash of flow's real; flow is sent again if it has been changed
+    uint64_t realHash{0};
+    // export cycle, on which flow has been seen in connection table
+    uint64_t generation{0};
+  };
+
+  /**
+   * state of the connection from single peer
+   */
+  struct Client {
+    int fd;
+    std::string buffer;
+  };
+
+  /**
+   * helper function to create listening socket
+   */
+  bool createSocket();
+
+  /**
+   * helper function to connect to the peer. returns false on failure
+   */
+  bool connectPeer(Peer& peer);
+
+  /**
+   * helper function to send serialized batch to all connected peers (or only
+   * to the ones w/o full copy of the table if unsyncedOnly is true)
+   */
+  uint64_t sendBatch(std::string& batch, uint32_t count, bool unsyncedOnly);
+
+  /**
+   * helper function which returns true if connection from this address
+   * must be accepted (address belongs to one of configured peers)
+   */
+  bool isAllowedPeer(const struct sockaddr_storage& addr);
+
+  /**
+   * helper function to parse all complete messages in client's buffer.
+   * returns false if stream is corrupted
+   */
+  bool processBuffer(Client& client);
+
+  void sendLoop();
+
+  void receiveLoop();
+
+  ConnTableSyncConfig config_;
+
+  ConnTableExporter exporter_;
+
+  ConnTableImporter importer_;
+
+  std::vector<Peer> peers_;
+
+  int listenFd_{-1};
+
+  uint16_t port_{0};
+
+  /**
+   * canonical (inet_ntop) addresses of configured peers
+   */
+  std::unordered_set<std::string> allowedPeers_;
+
+  /**
+   * hash of flow to state of the flow, which has been sent to peers. flows
+   * which are not in connection table anymore are removed at the end of
+   * each cycle
+   */
+  std::unordered_map<uint64_t, SentFlow> sentFlows_;
+
+  /**
+   * number of current export cycle
+   */
+  uint64_t generation_{0};
+
+  /**
+   * lock which serializes export cycles (peers_, sentFlows_ and generation_)
+   */
+  std::mutex syncLock_;
+
+  std::atomic<bool> running_{false};
+
+  std::mutex stopLock_;
+
+  std::condition_variable stopCv_;
+
+  std::thread sendThread_;
+
+  std::thread receiveThread_;
+
+  /**
+   * lock free counters; ConnTableSyncStats is a snapshot of em
+   */
+  StatsCounter entriesSent_{"conntable_sync.entries_sent"};
+  StatsCounter entriesReceived_{"conntable_sync.entries_received"};
+  StatsCounter entriesImported_{"conntable_sync.entries_imported"};
+  StatsCounter sendErrors_{"conntable_sync.send_errors"};
+  StatsCounter rejectedConnections_{"conntable_sync.rejected_connections"};
+  StatsCounter lagMs_{"conntable_sync.lag_ms"};
+};
+
+} // namespace katran
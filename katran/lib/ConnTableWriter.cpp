@@ -0,0 +1,119 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "katran/lib/ConnTableWriter.h"
+
+#include <cstring>
+
+extern "C" {
+#include <arpa/inet.h>
+#include <sys/socket.h>
+}
+
+namespace katran {
+
+namespace {
+// returns family of the address, 0 if address is empty or invalid
+uint8_t addrToBinary(const std::string& addr, uint8_t* out) {
+  if (addr.empty()) {
+    return 0;
+  }
+  if (::inet_pton(AF_INET, addr.c_str(), out) == 1) {
+    return kConnTableRecordV4;
+  }
+  if (::inet_pton(AF_INET6, addr.c_str(), out) == 1) {
+    return kConnTableRecordV6;
+  }
+  return 0;
+}
+
+bool binaryToAddr(uint8_t family, const uint8_t* addr, std::string& out) {
+  char buf[INET6_ADDRSTRLEN];
+  int af;
+  if (family == kConnTableRecordV4) {
+    af = AF_INET;
+  } else if (family == kConnTableRecordV6) {
+    af = AF_INET6;
+  } else {
+    return false;
+  }
+  if (::inet_ntop(af, addr, buf, sizeof(buf)) == nullptr) {
+    return false;
+  }
+  out = buf;
+  return true;
+}
+} // namespace
+
+KatranConnTableCallback makeConnTableTextWriter(std::ostream& out) {
+  return [&out](const KatranConnEntry& entry) {
+    bool v6 = entry.src.find(':') != std::string::npos;
+    out << entry.core << " " << static_cast<uint32_t>(entry.proto) << " "
+        << (v6 ? "[" : "") << entry.src << (v6 ? "]:" : ":") << entry.srcPort
+        << " " << (v6 ? "[" : "") << entry.dst << (v6 ? "]:" : ":")
+        << entry.dstPort << " " << (entry.real.empty() ? "-" : entry.real)
+        << " " << entry.atime << "\n";
+    return out.good();
+  };
+}
+
+bool makeConnTableRecord(
+    const KatranConnEntry& entry,
+    ConnTableRecord& record) {
+  record = {};
+  record.family = addrToBinary(entry.src, record.src);
+  if (addrToBinary(entry.dst, record.dst) != record.family) {
+    return false;
+  }
+  record.realFamily = addrToBinary(entry.real, record.real);
+  record.proto = entry.proto;
+  record.srcPort = entry.srcPort;
+  record.dstPort = entry.dstPort;
+  record.core = entry.core;
+  record.atime = entry.atime;
+  return record.family != 0;
+}
+
+KatranConnTableCallback makeConnTableBinaryWriter(std::ostream& out) {
+  return [&out](const KatranConnEntry& entry) {
+    ConnTableRecord record;
+    makeConnTableRecord(entry, record);
+    out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    return out.good();
+  };
+}
+
+bool parseConnTableRecord(
+    const ConnTableRecord& record,
+    KatranConnEntry& entry) {
+  if (!binaryToAddr(record.family, record.src, entry.src) ||
+      !binaryToAddr(record.family, record.dst, entry.dst)) {
+    return false;
+  }
+  entry.real.clear();
+  if (record.realFamily &&
+      !binaryToAddr(record.realFamily, record.real, entry.real)) {
+    return false;
+  }
+  entry.proto = record.proto;
+  entry.srcPort = record.srcPort;
+  entry.dstPort = record.dstPort;
+  entry.core = record.core;
+  entry.atime = record.atime;
+  return true;
+}
+
+} // namespace katran
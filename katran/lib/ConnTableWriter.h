@@ -0,0 +1,80 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+#include "katran/lib/KatranLbStructs.h"
+
+namespace katran {
+
+namespace {
+constexpr uint8_t kConnTableRecordV4 = 4;
+constexpr uint8_t kConnTableRecordV6 = 6;
+} // namespace
+
+/**
+ * fixed size record of binary connection table's dump. addresses are in
+ * network byte order (v4 address occupies first 4 bytes), ports and the rest
+ * of the fields are in host byte order.
+ */
+struct ConnTableRecord {
+  uint8_t family;
+  uint8_t realFamily;
+  uint8_t proto;
+  uint8_t pad;
+  uint16_t srcPort;
+  uint16_t dstPort;
+  int32_t core;
+  uint8_t src[16];
+  uint8_t dst[16];
+  uint8_t real[16];
+  uint64_t atime;
+} __attribute__((__packed__));
+
+/**
+ * @param ostream& out stream where entries would be written to
+ * @return KatranConnTableCallback callback which writes one line per flow:
+ * "core proto src:sport dst:dport real atime"
+ */
+KatranConnTableCallback makeConnTableTextWriter(std::ostream& out);
+
+/**
+ * @param ostream& out stream where entries would be written to
+ * @return KatranConnTableCallback callback which writes one ConnTableRecord
+ * per flow
+ */
+KatranConnTableCallback makeConnTableBinaryWriter(std::ostream& out);
+
+/**
+ * @param KatranConnEntry& entry to serialize
+ * @param ConnTableRecord& record where serialized entry would be stored
+ * @return true if entry's addresses are valid
+ */
+bool makeConnTableRecord(const KatranConnEntry& entry, ConnTableRecord& record);
+
+/**
+ * @param ConnTableRecord& record from binary dump
+ * @param KatranConnEntry& entry where parsed record would be stored
+ * @return true if record is valid
+ */
+bool parseConnTableRecord(
+    const ConnTableRecord& record,
+    KatranConnEntry& entry);
+
+} // namespace katran
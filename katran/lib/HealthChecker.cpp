@@ -0,0 +1,435 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "katran/lib/HealthChecker.h"
+
+#include <stdexcept>
+
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/Random.h>
+#include <folly/SocketAddress.h>
+#include <folly/String.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventHandler.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <glog/logging.h>
+
+#include "katran/lib/KatranLb.h"
+
+extern "C" {
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+namespace katran {
+
+namespace {
+constexpr int kNoFd = -1;
+constexpr size_t kMaxReplySize = 512;
+constexpr folly::StringPiece kHttpVersionPrefix = "HTTP/1.";
+constexpr int kHttpMinOkCode = 200;
+constexpr int kHttpMaxOkCode = 399;
+} // namespace
+
+/**
+ * single healthcheck's probe. all methods (except constructor) must be called
+ * from the event base thread, to which this probe is attached.
+ */
+class HcProbe : public folly::EventHandler {
+ public:
+  HcProbe(
+      folly::EventBase* evb,
+      HealthChecker* checker,
+      const std::string& key,
+      const HealthCheck& hc)
+      : folly::EventHandler(evb),
+        checker_(checker),
+        key_(key),
+        hc_(hc),
+        addr_(hc.dst, hc.port) {
+    timer_ = folly::AsyncTimeout::make(*evb, [this]() noexcept { onTimer(); });
+  }
+
+  ~HcProbe() override {
+    closeSocket();
+  }
+
+  /**
+   * schedule first probe. we are adding random jitter, so probes for
+   * different reals would be spread over the interval
+   */
+  void start() {
+    state_ = State::IDLE;
+    timer_->scheduleTimeout(folly::Random::rand32(hc_.intervalMs + 1));
+  }
+
+  void stop() {
+    timer_->cancelTimeout();
+    closeSocket();
+    state_ = State::STOPPED;
+  }
+
+  void handlerReady(uint16_t events) noexcept override {
+    switch (state_) {
+      case State::CONNECTING:
+        onConnected();
+        break;
+      case State::WAITING_REPLY:
+        if (events & READ) {
+          onReadable();
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+ private:
+  enum class State {
+    IDLE,
+    CONNECTING,
+    WAITING_REPLY,
+    STOPPED,
+  };
+
+  void onTimer() {
+    if (state_ == State::IDLE) {
+      runProbe();
+    } else if (state_ != State::STOPPED) {
+      VLOG(4) << "healthcheck " << key_ << " timed out";
+      finishProbe(false);
+    }
+  }
+
+  void runProbe() {
+    buffer_.clear();
+    checker_->onProbeSent();
+    auto sock_type = hc_.proto == HealthCheckProto::UDP ? SOCK_DGRAM
+                                                        : SOCK_STREAM;
+    fd_ = ::socket(
+        addr_.getFamily(), sock_type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+      LOG(ERROR) << "can't create socket for healthcheck " << key_
+                 << ", error: " << folly::errnoStr(errno);
+      finishProbe(false);
+      return;
+    }
+    if (hc_.somark) {
+      if (::setsockopt(
+              fd_, SOL_SOCKET, SO_MARK, &hc_.somark, sizeof(hc_.somark))) {
+        LOG(ERROR) << "can't set SO_MARK for healthcheck " << key_
+                   << ", error: " << folly::errnoStr(errno);
+        finishProbe(false);
+        return;
+      }
+    }
+    struct sockaddr_storage saddr;
+    auto saddr_len = addr_.getAddress(&saddr);
+    timer_->scheduleTimeout(hc_.timeoutMs);
+    auto res = ::connect(
+        fd_, reinterpret_cast<struct sockaddr*>(&saddr), saddr_len);
+    if (res && errno != EINPROGRESS) {
+      VLOG(4) << "connect for healthcheck " << key_
+              << " failed: " << folly::errnoStr(errno);
+      finishProbe(false);
+      return;
+    }
+    changeHandlerFD(folly::NetworkSocket::fromFd(fd_));
+    if (hc_.proto == HealthCheckProto::UDP) {
+      // connected udp socket would report icmp unreachable as ECONNREFUSED
+      sendRequest(hc_.request);
+      return;
+    }
+    state_ = State::CONNECTING;
+    if (!registerHandler(WRITE)) {
+      finishProbe(false);
+    }
+  }
+
+  void onConnected() {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len) || err) {
+      VLOG(4) << "healthcheck " << key_
+              << " can't connect: " << folly::errnoStr(err);
+      finishProbe(false);
+      return;
+    }
+    unregisterHandler();
+    if (hc_.proto == HealthCheckProto::TCP) {
+      finishProbe(true);
+      return;
+    }
+    sendRequest(folly::sformat(
+        "GET {} HTTP/1.0\r\nHost: {}\r\nConnection: close\r\n\r\n",
+        hc_.request,
+        hc_.dst));
+  }
+
+  void sendRequest(const std::string& request) {
+    // requests are tiny, so they would always fit into empty socket buffer
+    auto res = ::send(fd_, request.data(), request.size(), MSG_NOSIGNAL);
+    if (res != static_cast<ssize_t>(request.size())) {
+      VLOG(4) << "can't send request for healthcheck " << key_;
+      finishProbe(false);
+      return;
+    }
+    state_ = State::WAITING_REPLY;
+    if (!registerHandler(READ | PERSIST)) {
+      finishProbe(false);
+    }
+  }
+
+  void onReadable() {
+    char buf[kMaxReplySize];
+    auto res = ::recv(fd_, buf, sizeof(buf), 0);
+    if (res < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return;
+      }
+      finishProbe(false);
+      return;
+    }
+    if (hc_.proto == HealthCheckProto::UDP) {
+      // any reply from udp server is considered as a success
+      finishProbe(true);
+      return;
+    }
+    buffer_.append(buf, res);
+    auto eol = buffer_.find("\r\n");
+    if (eol == std::string::npos && res != 0 &&
+        buffer_.size() < kMaxReplySize) {
+      // status line is not yet fully received
+      return;
+    }
+    finishProbe(isHttpOk(folly::StringPiece(buffer_).subpiece(0, eol)));
+  }
+
+  static bool isHttpOk(folly::StringPiece status_line) {
+    // status line format: HTTP/1.x <code> <reason>
+    if (!status_line.startsWith(kHttpVersionPrefix)) {
+      return false;
+    }
+    auto code_pos = status_line.find(' ');
+    if (code_pos == folly::StringPiece::npos) {
+      return false;
+    }
+    auto code = folly::tryTo<int>(status_line.subpiece(code_pos + 1, 3));
+    return code.hasValue() && code.value() >= kHttpMinOkCode &&
+        code.value() <= kHttpMaxOkCode;
+  }
+
+  void closeSocket() {
+    if (fd_ != kNoFd) {
+      unregisterHandler();
+      changeHandlerFD(folly::NetworkSocket());
+      ::close(fd_);
+      fd_ = kNoFd;
+    }
+  }
+
+  void finishProbe(bool success) {
+    timer_->cancelTimeout();
+    closeSocket();
+    state_ = State::IDLE;
+    checker_->onProbeResult(key_, success);
+    timer_->scheduleTimeout(hc_.intervalMs);
+  }
+
+  HealthChecker* checker_;
+  std::string key_;
+  HealthCheck hc_;
+  folly::SocketAddress addr_;
+  std::unique_ptr<folly::AsyncTimeout> timer_;
+  State state_{State::IDLE};
+  int fd_{kNoFd};
+  std::string buffer_;
+};
+
+HealthChecker::HealthChecker(const HealthCheckerConfig& config)
+    : config_(config) {
+  if (config_.threads == 0) {
+    throw std::invalid_argument("healthchecker requires at least one thread");
+  }
+  for (uint32_t i = 0; i < config_.threads; i++) {
+    workers_.push_back(std::make_unique<folly::ScopedEventBaseThread>(
+        folly::sformat("katran_hc_{}", i)));
+  }
+}
+
+HealthChecker::~HealthChecker() {
+  std::unordered_map<std::string, HcState> checks;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    checks.swap(checks_);
+  }
+  for (auto& check : checks) {
+    auto probe = check.second.probe;
+    workers_[check.second.worker]->getEventBase()->runInEventBaseThreadAndWait(
+        [probe]() { probe->stop(); });
+  }
+}
+
+std::string HealthChecker::makeKey(
+    const VipKey& vip,
+    const std::string& real) {
+  return folly::sformat("{}:{}:{}/{}", vip.address, vip.port, vip.proto, real);
+}
+
+bool HealthChecker::addHealthCheck(
+    const VipKey& vip,
+    const NewReal& real,
+    const HealthCheck& hc) {
+  if (!folly::IPAddress::validate(hc.dst)) {
+    LOG(ERROR) << "invalid healthcheck destination: " << hc.dst;
+    return false;
+  }
+  auto key = makeKey(vip, real.address);
+  std::shared_ptr<HcProbe> probe;
+  uint32_t worker;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (checks_.find(key) != checks_.end()) {
+      LOG(INFO) << "trying to add already existing healthcheck " << key;
+      return false;
+    }
+    worker = nextWorker_;
+    nextWorker_ = (nextWorker_ + 1) % workers_.size();
+    auto evb = workers_[worker]->getEventBase();
+    probe = std::make_shared<HcProbe>(evb, this, key, hc);
+    HcState state;
+    state.vip = vip;
+    state.real = real;
+    state.worker = worker;
+    state.rise = hc.rise;
+    state.fall = hc.fall;
+    state.probe = probe;
+    checks_.emplace(key, std::move(state));
+  }
+  VLOG(2) << "adding healthcheck " << key;
+  workers_[worker]->getEventBase()->runInEventBaseThread(
+      [probe]() { probe->start(); });
+  return true;
+}
+
+bool HealthChecker::delHealthCheck(
+    const VipKey& vip,
+    const std::string& real) {
+  auto key = makeKey(vip, real);
+  std::shared_ptr<HcProbe> probe;
+  uint32_t worker;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto check_iter = checks_.find(key);
+    if (check_iter == checks_.end()) {
+      LOG(INFO) << "trying to delete non-existing healthcheck " << key;
+      return false;
+    }
+    probe = check_iter->second.probe;
+    worker = check_iter->second.worker;
+    checks_.erase(check_iter);
+  }
+  VLOG(2) << "deleting healthcheck " << key;
+  // we must not hold the lock here, as probe's thread could be waiting on it
+  workers_[worker]->getEventBase()->runInEventBaseThreadAndWait(
+      [probe]() { probe->stop(); });
+  return true;
+}
+
+bool HealthChecker::isHealthy(const VipKey& vip, const std::string& real) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto check_iter = checks_.find(makeKey(vip, real));
+  if (check_iter == checks_.end()) {
+    throw std::invalid_argument(
+        folly::sformat("healthcheck for real {} does not exist", real));
+  }
+  return check_iter->second.healthy;
+}
+
+void HealthChecker::onProbeSent() {
+  probesSent_++;
+}
+
+void HealthChecker::onProbeResult(const std::string& key, bool success) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto check_iter = checks_.find(key);
+  if (check_iter == checks_.end()) {
+    // healthcheck has been deleted while probe was in flight
+    return;
+  }
+  auto& state = check_iter->second;
+  if (success) {
+    state.failures = 0;
+    state.successes++;
+    if (!state.healthy && state.successes >= state.rise) {
+      VLOG(2) << "real " << key << " is healthy";
+      state.healthy = true;
+      state.changed = !state.changed;
+      stateChanges_++;
+    }
+  } else {
+    probesFailed_++;
+    state.successes = 0;
+    state.failures++;
+    if (state.healthy && state.failures >= state.fall) {
+      VLOG(2) << "real " << key << " is unhealthy";
+      state.healthy = false;
+      state.changed = !state.changed;
+      stateChanges_++;
+    }
+  }
+}
+
+uint32_t HealthChecker::applyStateChanges(KatranLb& lb) {
+  std::unordered_map<VipKey, std::vector<NewReal>, VipKeyHasher> updates;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto& check : checks_) {
+      auto& state = check.second;
+      if (!state.changed) {
+        continue;
+      }
+      state.changed = false;
+      NewReal real = state.real;
+      if (!state.healthy) {
+        real.weight = 0;
+      }
+      updates[state.vip].push_back(real);
+    }
+  }
+  uint32_t changed = 0;
+  for (const auto& update : updates) {
+    if (lb.modifyRealsForVip(ModifyAction::ADD, update.second, update.first)) {
+      changed += update.second.size();
+    } else {
+      LOG(ERROR) << "can't apply healthcheck results for vip "
+                 << update.first.address;
+    }
+  }
+  return changed;
+}
+
+HealthCheckerStats HealthChecker::getStats() {
+  HealthCheckerStats stats;
+  stats.probesSent = probesSent_.get();
+  stats.probesFailed = probesFailed_.get();
+  stats.stateChanges = stateChanges_.get();
+  return stats;
+}
+
+} // namespace katran
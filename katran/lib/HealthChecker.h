@@ -0,0 +1,241 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/IPAddress.h>
+
+#include "katran/lib/KatranLbStructs.h"
+#include "katran/lib/StatsCounters.h"
+
+namespace folly {
+class ScopedEventBaseThread;
+}
+
+namespace katran {
+
+class KatranLb;
+class HcProbe;
+
+namespace {
+constexpr uint32_t kDefaultHcThreads = 2;
+constexpr uint32_t kDefaultHcIntervalMs = 1000;
+constexpr uint32_t kDefaultHcTimeoutMs = 500;
+constexpr uint32_t kDefaultHcRise = 2;
+constexpr uint32_t kDefaultHcFall = 3;
+} // namespace
+
+/**
+ * types of supported healthchecks
+ */
+enum class HealthCheckProto {
+  TCP,
+  HTTP,
+  UDP,
+};
+
+/**
+ * @param string dst address where probe is going to be sent
+ * @param uint16_t port destination port of the probe
+ * @param HealthCheckProto proto type of the probe
+ * @param uint32_t somark SO_MARK for probe's socket (0 - don't set)
+ * @param string request http path for HTTP or payload for UDP probes
+ * @param uint32_t intervalMs how often to run the probe
+ * @param uint32_t timeoutMs how long to wait for the reply
+ * @param uint32_t rise consecutive successes before real is marked healthy
+ * @param uint32_t fall consecutive failures before real is marked unhealthy
+ *
+ * definition of a single healthcheck. usually dst is a vip's address and
+ * somark is the one which has been configured w/ addHealthcheckerDst, so
+ * probe would be encapsulated by the healthchecking bpf program toward the
+ * real.
+ */
+struct HealthCheck {
+  std::string dst;
+  uint16_t port;
+  HealthCheckProto proto{HealthCheckProto::TCP};
+  uint32_t somark{0};
+  std::string request{"/"};
+  uint32_t intervalMs{kDefaultHcIntervalMs};
+  uint32_t timeoutMs{kDefaultHcTimeoutMs};
+  uint32_t rise{kDefaultHcRise};
+  uint32_t fall{kDefaultHcFall};
+};
+
+/**
+ * @param uint32_t threads number of event base threads to run probes in
+ *
+ * healthchecker's config
+ */
+struct HealthCheckerConfig {
+  uint32_t threads{kDefaultHcThreads};
+};
+
+/**
+ * @param uint64_t probesSent total number of probes which has been started
+ * @param uint64_t probesFailed number of failed (or timed out) probes
+ * @param uint64_t stateChanges number of debounced state transitions
+ *
+ * healthchecker's related counters
+ */
+struct HealthCheckerStats {
+  uint64_t probesSent{0};
+  uint64_t probesFailed{0};
+  uint64_t stateChanges{0};
+};
+
+/**
+ * This class implements asynchronous healthchecking engine. probes are
+ * running in small pool of event base threads w/ non blocking sockets, so
+ * thousands of reals could be checked concurrently. results are debounced
+ * (w/ rise/fall counters) and state changes are stored until they are
+ * applied to KatranLb by applyStateChanges.
+ * All public methods are thread safe.
+ */
+class HealthChecker {
+ public:
+  HealthChecker() = delete;
+
+  explicit HealthChecker(const HealthCheckerConfig& config);
+
+  ~HealthChecker();
+
+  /**
+   * @param VipKey vip to which real belongs
+   * @param NewReal real (w/ the weight it should have when healthy)
+   * @param HealthCheck hc probe definition
+   * @return true on success
+   *
+   * helper function to start healthchecking of specified real for
+   * specified vip. returns false if such check already exists or
+   * hc's dst can't be parsed.
+   */
+  bool addHealthCheck(
+      const VipKey& vip,
+      const NewReal& real,
+      const HealthCheck& hc);
+
+  /**
+   * @param VipKey vip to which real belongs
+   * @param string address of the real
+   * @return true on success
+   *
+   * helper function to stop healthchecking of specified real.
+   * returns false if such check does not exist
+   */
+  bool delHealthCheck(const VipKey& vip, const std::string& real);
+
+  /**
+   * @param VipKey vip to which real belongs
+   * @param string address of the real
+   * @return true if real is currently considered healthy.
+   *
+   * could throw std::invalid_argument if such check does not exist
+   */
+  bool isHealthy(const VipKey& vip, const std::string& real);
+
+  /**
+   * @param KatranLb lb instance where healthcheck results should be applied
+   * @return uint32_t number of reals which weight has been changed
+   *
+   * helper function to apply all pending state changes to the load balancer.
+   * all changes for the same vip are coalesced into single
+   * modifyRealsForVip call: healthy reals get their configured weight back,
+   * unhealthy ones are set to zero weight (and removed from the ch ring).
+   * must be called from the thread which owns KatranLb.
+   */
+  uint32_t applyStateChanges(KatranLb& lb);
+
+  /**
+   * @return HealthCheckerStats counters of this healthchecker
+   */
+  HealthCheckerStats getStats();
+
+  /**
+   * callback from probe; called in probe's event base thread when new probe
+   * is started
+   */
+  void onProbeSent();
+
+  /**
+   * callback from probe; called in probe's event base thread on every
+   * finished probe w/ it's result
+   */
+  void onProbeResult(const std::string& key, bool success);
+
+ private:
+  /**
+   * internal state of single configured healthcheck
+   */
+  struct HcState {
+    VipKey vip;
+    NewReal real;
+    uint32_t worker;
+    bool healthy{true};
+    bool changed{false};
+    uint32_t successes{0};
+    uint32_t failures{0};
+    uint32_t rise;
+    uint32_t fall;
+    std::shared_ptr<HcProbe> probe;
+  };
+
+  /**
+   * helper function to create unique key for vip/real pair
+   */
+  static std::string makeKey(const VipKey& vip, const std::string& real);
+
+  /**
+   * main config
+   */
+  HealthCheckerConfig config_;
+
+  /**
+   * event base threads which run all the probes
+   */
+  std::vector<std::unique_ptr<folly::ScopedEventBaseThread>> workers_;
+
+  /**
+   * worker, where next healthcheck is going to be scheduled
+   */
+  uint32_t nextWorker_{0};
+
+  /**
+   * lock which protects checks_
+   */
+  std::mutex lock_;
+
+  /**
+   * dict of vip/real key to healthcheck's state
+   */
+  std::unordered_map<std::string, HcState> checks_;
+
+  /**
+   * lock free counters; HealthCheckerStats is a snapshot of em
+   */
+  StatsCounter probesSent_{"healthchecker.probes_sent"};
+  StatsCounter probesFailed_{"healthchecker.probes_failed"};
+  StatsCounter stateChanges_{"healthchecker.state_changes"};
+};
+
+} // namespace katran
@@ -0,0 +1,210 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "katran/lib/IrqHelpers.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+extern "C" {
+#include <dirent.h>
+}
+
+namespace katran {
+
+namespace {
+constexpr char kSysNetPath[] = "/sys/class/net/";
+constexpr char kMsiIrqsSuffix[] = "/device/msi_irqs";
+// e.g. virtio net device, where msi irqs belong to the parent pci device
+constexpr char kParentMsiIrqsSuffix[] = "/device/../msi_irqs";
+constexpr char kProcInterrupts[] = "/proc/interrupts";
+constexpr char kProcIrqPath[] = "/proc/irq/";
+// effective affinity is only available since 4.15; if it's missing we
+// fallback to configured one
+constexpr char kEffectiveAffinityList[] = "/effective_affinity_list";
+constexpr char kAffinityList[] = "/smp_affinity_list";
+constexpr char kSysCpuPath[] = "/sys/devices/system/cpu/cpu";
+constexpr char kNodePrefix[] = "node";
+constexpr int32_t kUnknownNode = -1;
+
+bool readLine(const std::string& path, std::string& line) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::getline(file, line);
+  return true;
+}
+
+bool parseNum(const std::string& str, int32_t& num) {
+  if (str.empty() ||
+      !std::all_of(str.begin(), str.end(), [](char c) {
+        return c >= '0' && c <= '9';
+      })) {
+    return false;
+  }
+  try {
+    num = std::stoi(str);
+  } catch (const std::out_of_range&) {
+    return false;
+  }
+  return true;
+}
+
+// action is either interface's name or "<ifname>-<queue>". substring match
+// would pick irqs of e.g. eth10 or veth0 for eth0
+bool isInterfaceAction(const std::string& action, const std::string& ifname) {
+  return action == ifname ||
+      (action.size() > ifname.size() &&
+       action.compare(0, ifname.size(), ifname) == 0 &&
+       action[ifname.size()] == '-');
+}
+} // namespace
+
+std::vector<int32_t> IrqHelpers::parseCpuList(const std::string& list) {
+  std::set<int32_t> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    // trailing newline or spaces
+    range.erase(
+        std::remove_if(
+            range.begin(),
+            range.end(),
+            [](char c) { return c == ' ' || c == '\n'; }),
+        range.end());
+    if (range.empty()) {
+      continue;
+    }
+    auto pos = range.find('-');
+    int32_t first, last;
+    if (pos == std::string::npos) {
+      if (!parseNum(range, first)) {
+        return {};
+      }
+      last = first;
+    } else if (
+        !parseNum(range.substr(0, pos), first) ||
+        !parseNum(range.substr(pos + 1), last) || last < first) {
+      return {};
+    }
+    for (auto cpu = first; cpu <= last; cpu++) {
+      cpus.insert(cpu);
+    }
+  }
+  return std::vector<int32_t>(cpus.begin(), cpus.end());
+}
+
+std::vector<int32_t> IrqHelpers::getInterfaceIrqs(
+    const std::string& ifname,
+    const std::string& root) {
+  std::vector<int32_t> irqs;
+  for (auto suffix : {kMsiIrqsSuffix, kParentMsiIrqsSuffix}) {
+    auto msi_path = root + kSysNetPath + ifname + suffix;
+    auto dir = ::opendir(msi_path.c_str());
+    if (dir == nullptr) {
+      continue;
+    }
+    struct dirent* entry;
+    while ((entry = ::readdir(dir)) != nullptr) {
+      int32_t irq;
+      if (parseNum(entry->d_name, irq)) {
+        irqs.push_back(irq);
+      }
+    }
+    ::closedir(dir);
+    if (!irqs.empty()) {
+      break;
+    }
+  }
+  if (irqs.empty()) {
+    std::ifstream interrupts(root + kProcInterrupts);
+    std::string line;
+    while (std::getline(interrupts, line)) {
+      // "  42:  0  1  IR-PCI-MSI 524288-edge  eth0-TxRx-0"
+      auto pos = line.find(':');
+      if (pos == std::string::npos) {
+        continue;
+      }
+      std::stringstream actions(line.substr(pos + 1));
+      std::vector<std::string> tokens(
+          (std::istream_iterator<std::string>(actions)),
+          std::istream_iterator<std::string>());
+      // action (device) name is the last token
+      if (tokens.empty() || !isInterfaceAction(tokens.back(), ifname)) {
+        continue;
+      }
+      auto irq_str = line.substr(0, pos);
+      irq_str.erase(0, irq_str.find_first_not_of(' '));
+      int32_t irq;
+      if (parseNum(irq_str, irq)) {
+        irqs.push_back(irq);
+      }
+    }
+  }
+  std::sort(irqs.begin(), irqs.end());
+  return irqs;
+}
+
+std::vector<int32_t> IrqHelpers::getIrqsAffinity(
+    const std::vector<int32_t>& irqs,
+    const std::string& root) {
+  std::set<int32_t> cpus;
+  for (auto irq : irqs) {
+    auto irq_path = root + kProcIrqPath + std::to_string(irq);
+    std::string list;
+    if (!readLine(irq_path + kEffectiveAffinityList, list) || list.empty()) {
+      if (!readLine(irq_path + kAffinityList, list)) {
+        continue;
+      }
+    }
+    auto irq_cpus = parseCpuList(list);
+    cpus.insert(irq_cpus.begin(), irq_cpus.end());
+  }
+  return std::vector<int32_t>(cpus.begin(), cpus.end());
+}
+
+std::vector<int32_t> IrqHelpers::getInterfaceCpus(
+    const std::string& ifname,
+    const std::string& root) {
+  return getIrqsAffinity(getInterfaceIrqs(ifname, root), root);
+}
+
+int32_t IrqHelpers::getCpuNumaNode(int32_t cpu, const std::string& root) {
+  auto cpu_path = root + kSysCpuPath + std::to_string(cpu);
+  auto dir = ::opendir(cpu_path.c_str());
+  if (dir == nullptr) {
+    return kUnknownNode;
+  }
+  int32_t node = kUnknownNode;
+  struct dirent* entry;
+  // cpu's dir contains "node<N>" symlink to it's numa node
+  while ((entry = ::readdir(dir)) != nullptr) {
+    std::string name(entry->d_name);
+    if (name.compare(0, sizeof(kNodePrefix) - 1, kNodePrefix) == 0 &&
+        parseNum(name.substr(sizeof(kNodePrefix) - 1), node)) {
+      break;
+    }
+  }
+  ::closedir(dir);
+  return node;
+}
+
+} // namespace katran
@@ -0,0 +1,80 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace katran {
+
+/**
+ * helpers to find out which cpus are handling NIC's interrupts (and
+ * therefore are running xdp program for the packets from this NIC).
+ * all functions take optional root path, so they could be pointed to fake
+ * sysfs/procfs in tests.
+ */
+class IrqHelpers {
+ public:
+  /**
+   * @param string list of cpus in kernel's cpulist format (e.g. "0-3,8")
+   * @return vector<int32_t> sorted list of cpus. empty if list is malformed
+   */
+  static std::vector<int32_t> parseCpuList(const std::string& list);
+
+  /**
+   * @param string ifname name of the interface
+   * @param string root prefix of /sys and /proc
+   * @return vector<int32_t> irqs of the interface's device
+   *
+   * irqs are taken from device's (or it's parent's, e.g. for virtio) msi_irqs
+   * in sysfs. if device does not have em - /proc/interrupts is searched for
+   * the lines which contain interface's name
+   */
+  static std::vector<int32_t> getInterfaceIrqs(
+      const std::string& ifname,
+      const std::string& root = "");
+
+  /**
+   * @param vector<int32_t> irqs to check
+   * @param string root prefix of /proc
+   * @return vector<int32_t> sorted list of cpus, where any of given irqs
+   * could be delivered to
+   */
+  static std::vector<int32_t> getIrqsAffinity(
+      const std::vector<int32_t>& irqs,
+      const std::string& root = "");
+
+  /**
+   * @param string ifname name of the interface
+   * @param string root prefix of /sys and /proc
+   * @return vector<int32_t> sorted list of cpus which handle interface's irqs.
+   * empty if they could not be discovered
+   */
+  static std::vector<int32_t> getInterfaceCpus(
+      const std::string& ifname,
+      const std::string& root = "");
+
+  /**
+   * @param int32_t cpu to check
+   * @param string root prefix of /sys
+   * @return int32_t numa node of the cpu; -1 if unknown
+   */
+  static int32_t getCpuNumaNode(int32_t cpu, const std::string& root = "");
+};
+
+} // namespace katran
@@ -15,6 +15,9 @@
  */
 #include "katran/lib/KatranEventReader.h"
 
+#include <array>
+
+#include <folly/Format.h>
 #include <folly/io/async/EventBase.h>
 #include <unistd.h>
 
@@ -23,11 +26,30 @@
 
 namespace katran {
 
+namespace {
+// from introspection.h
+constexpr uint32_t kPacketVerdictEvent = 2;
+constexpr std::array<const char*, 5> kXdpActions = {
+    "XDP_ABORTED", "XDP_DROP", "XDP_PASS", "XDP_TX", "XDP_REDIRECT"};
+// VERDICT_REASON_* from introspection.h
+constexpr std::array<const char*, 8> kVerdictReasons = {
+    "parse",
+    "decap",
+    "not_vip",
+    "toobig",
+    "lookup",
+    "no_real",
+    "encap",
+    "forwarded"};
+constexpr char kUnknown[] = "unknown";
+} // namespace
+
 KatranEventReader::KatranEventReader(
     int pages,
     int cpu,
-    std::shared_ptr<folly::MPMCQueue<PcapMsgMeta>> queue)
-    : pages_(pages), cpu_(cpu), queue_(queue) {
+    std::shared_ptr<folly::MPMCQueue<PcapMsgMeta>> queue,
+    bool logVerdicts)
+    : pages_(pages), cpu_(cpu), queue_(queue), logVerdicts_(logVerdicts) {
   pageSize_ = ::getpagesize();
 }
 
@@ -70,8 +92,24 @@ void KatranEventReader::handlePerfEvent(
     return;
   }
   auto mdata = (struct event_metadata*)data;
-  PcapMsg pcap_msg(
-      data + sizeof(struct event_metadata), mdata->pkt_size, mdata->data_len);
+  const char* pckt = data + sizeof(struct event_metadata);
+  std::string comment;
+  if (mdata->event == kPacketVerdictEvent) {
+    if (size < sizeof(struct event_metadata) + sizeof(struct verdict_info)) {
+      return;
+    }
+    auto verdict = (const struct verdict_info*)pckt;
+    pckt += sizeof(struct verdict_info);
+    comment = describeVerdict(*verdict);
+    if (logVerdicts_) {
+      LOG(INFO) << "katran verdict: " << comment
+                << " pkt_size: " << mdata->pkt_size;
+    }
+  }
+  PcapMsg pcap_msg(pckt, mdata->pkt_size, mdata->data_len);
+  if (!comment.empty()) {
+    pcap_msg.setComment(std::move(comment));
+  }
   PcapMsgMeta pcap_msg_meta(std::move(pcap_msg), mdata->event);
   auto res = queue_->write(std::move(pcap_msg_meta));
   if (!res) {
@@ -79,4 +117,16 @@ void KatranEventReader::handlePerfEvent(
   }
 }
 
+std::string KatranEventReader::describeVerdict(
+    const struct verdict_info& info) {
+  return folly::sformat(
+      "action: {} reason: {} vip: {} real: {} lru: {}",
+      info.action < kXdpActions.size() ? kXdpActions[info.action] : kUnknown,
+      info.reason < kVerdictReasons.size() ? kVerdictReasons[info.reason]
+                                           : kUnknown,
+      info.vip_num,
+      info.real_index,
+      info.lru_hit ? "hit" : "miss");
+}
+
 } // namespace katran
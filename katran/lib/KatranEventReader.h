@@ -19,6 +19,7 @@
 #include <folly/io/async/EventHandler.h>
 #include <folly/MPMCQueue.h>
 
+#include "katran/lib/BalancerStructs.h"
 #include "katran/lib/PcapMsgMeta.h"
 
 extern "C" {
@@ -33,7 +34,10 @@ namespace katran {
 class KatranEventReader : public folly::EventHandler {
  public:
   KatranEventReader(
-    int pages, int cpu, std::shared_ptr<folly::MPMCQueue<PcapMsgMeta>> queue);
+    int pages,
+    int cpu,
+    std::shared_ptr<folly::MPMCQueue<PcapMsgMeta>> queue,
+    bool logVerdicts = false);
   ~KatranEventReader() override;
 
   /**
@@ -53,6 +57,14 @@ class KatranEventReader : public folly::EventHandler {
    */
   void handlerReady(uint16_t events) noexcept override;
 
+  /**
+   * @param verdict_info info katran's verdict from PACKET_VERDICT event
+   * @return string human readable description of the verdict
+   *
+   * e.g. "action: XDP_DROP reason: no_real vip: 1 real: 0 lru: miss"
+   */
+  static std::string describeVerdict(const struct verdict_info& info);
+
  private:
   /**
    * @param const char* data received from the XDP prog.
@@ -89,5 +101,10 @@ class KatranEventReader : public folly::EventHandler {
    * queue toward PcapWriter
    */
   std::shared_ptr<folly::MPMCQueue<PcapMsgMeta>> queue_;
+
+  /**
+   * if true: each received verdict is logged as well
+   */
+  bool logVerdicts_;
 };
 } // namespace katran
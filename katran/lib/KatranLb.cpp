@@ -18,19 +18,37 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <iterator>
+#include <limits>
+#include <numeric>
+#include <set>
 #include <stdexcept>
 
 #include <folly/Format.h>
 #include <folly/lang/Bits.h>
 #include <glog/logging.h>
 
+#include "katran/lib/ConnTableMatcher.h"
+#include "katran/lib/IrqHelpers.h"
 #include "katran/lib/KatranMonitor.h"
+#include "katran/lib/LruSizing.h"
+
+extern "C" {
+#include <unistd.h>
+}
 
 namespace katran {
 
 namespace {
 constexpr uint8_t V6DADDR = 1;
+constexpr uint8_t kRealDown = 1 << 1;
+constexpr uint32_t kDropUnknownPorts = 1;
+// must be in sync w/ VIP_PORT_LPM_ADDR_BITS in balancer_consts.h
+constexpr uint32_t kVipPortLpmAddrBits = 144;
+constexpr uint32_t kPortBits = 16;
+// port range is split into at most 2 * 16 - 2 prefixes
+constexpr uint32_t kMaxPortRangePrefixes = 30;
 constexpr int kDeleteXdpProg = -1;
 constexpr int kMacBytes = 6;
 constexpr int kCtlMapSize = 16;
@@ -44,8 +62,26 @@ constexpr folly::StringPiece kEmptyString = "";
 constexpr uint32_t kSrcV4Pos = 0;
 constexpr uint32_t kSrcV6Pos = 1;
 constexpr uint32_t kRecirculationIndex = 0;
-constexpr uint32_t kHcSrcMacPos = 0;
-constexpr uint32_t kHcDstMacPos = 1;
+constexpr uint32_t kHcCtrlDataPos = 0;
+constexpr uint32_t kLbLimitsPos = 0;
+constexpr uint32_t kConnTableBatchSize = 8192;
+constexpr uint8_t kUdpProto = 17;
+// LRU of the core never shrinks below 1/kLruMinShareDivisor of even share
+constexpr uint64_t kLruMinShareDivisor = 4;
+// LRU is not resized if it's size would change less than this fraction
+constexpr double kLruResizeThreshold = 0.25;
+// must be in sync w/ MAX_NUMA_NODES in balancer_consts.h
+constexpr size_t kMaxNumaReplicas = 8;
+// slot 0 of per numa node map-in-maps means "no replica"
+constexpr uint32_t kFirstReplicaPos = 1;
+// replicas are named "<map>_n<node>" (or "<map>_nany" if cores' numa node
+// is unknown), so tools which look up maps by name (e.g. katran_mapdump)
+// still find the only map w/ the original name
+constexpr char kReplicaNameSuffix[] = "_n";
+constexpr char kAnyNodeName[] = "any";
+constexpr int32_t kFallbackLruCore = -1;
+// XDP_FLAGS_UPDATE_IF_NOEXIST could not be combined w/ XDP_FLAGS_REPLACE
+constexpr uint32_t kXdpFlagsUpdateIfNoExist = 1;
 } // namespace
 
 KatranLb::KatranLb(const KatranConfig& config)
@@ -55,7 +91,21 @@ KatranLb::KatranLb(const KatranConfig& config)
       standalone_(true),
       forwardingCores_(config.forwardingCores),
       numaNodes_(config.numaNodes),
-      lruMapsFd_(kMaxForwardingCores) {
+      lruMapsFd_(kMaxForwardingCores),
+      lruMapsSize_(kMaxForwardingCores),
+      lastLruInserts_(kMaxForwardingCores),
+      lruInsertsBase_(kMaxForwardingCores) {
+  if (config_.maxVips == 0 || config_.maxReals == 0 ||
+      config_.chRingSize == 0) {
+    throw std::invalid_argument(
+        "maxVips, maxReals and chRingSize must be non zero");
+  }
+  if (static_cast<uint64_t>(config_.maxVips) * config_.chRingSize >
+      std::numeric_limits<uint32_t>::max()) {
+    throw std::invalid_argument(
+        "maxVips * chRingSize does not fit into ch_rings map");
+  }
+
   for (uint32_t i = 0; i < config_.maxVips; i++) {
     vipNums_.push_back(i);
   }
@@ -72,6 +122,26 @@ KatranLb::KatranLb(const KatranConfig& config)
     config_.hcInterface = config_.mainInterface;
   }
 
+  if (config_.discoverForwardingCores && forwardingCores_.empty() &&
+      !config_.testing && !config_.disableForwarding) {
+    for (auto core : IrqHelpers::getInterfaceCpus(config_.mainInterface)) {
+      if (core < kMaxForwardingCores) {
+        forwardingCores_.push_back(core);
+      }
+    }
+    if (forwardingCores_.empty()) {
+      LOG(ERROR) << "can't discover forwarding cores for "
+                 << config_.mainInterface;
+    } else if (!numaNodes_.empty()) {
+      // configured nodes can't be matched w/ discovered cores, so node of
+      // each core is resolved from sysfs instead
+      numaNodes_.clear();
+      for (auto core : forwardingCores_) {
+        numaNodes_.push_back(IrqHelpers::getCpuNumaNode(core));
+      }
+    }
+  }
+
   if (!config_.testing) {
     ctl_value ctl;
     int res;
@@ -186,6 +256,7 @@ void KatranLb::initialSanityChecking() {
     maps.push_back("stats");
     maps.push_back("lru_maps_mapping");
     maps.push_back("quic_mapping");
+    maps.push_back("lb_limits_map");
 
     res = getKatranProgFd();
     if (res < 0) {
@@ -219,7 +290,12 @@ void KatranLb::initialSanityChecking() {
   }
 }
 
-int KatranLb::createLruMap(int size, int flags, int numaNode) {
+int KatranLb::createLruMap(uint64_t size, int flags, int numaNode) {
+  if (size > std::numeric_limits<uint32_t>::max()) {
+    LOG(ERROR) << "lru size " << size << " is bigger than max map size";
+    errno = EINVAL;
+    return kError;
+  }
   return bpfAdapter_.createNamedBpfMap(
       "katran_lru",
       kBpfMapTypeLruHash,
@@ -233,7 +309,6 @@ int KatranLb::createLruMap(int size, int flags, int numaNode) {
 void KatranLb::initLrus() {
   bool forwarding_cores_specified{false};
   bool numa_mapping_specified{false};
-  int lru_map_flags = 0;
   int lru_proto_fd;
   int res;
   if (forwardingCores_.size() != 0) {
@@ -244,31 +319,28 @@ void KatranLb::initLrus() {
       }
       numa_mapping_specified = true;
     }
-    int lru_fd, numa_node;
-    auto per_core_lru_size = config_.LruSize / forwardingCores_.size();
-    VLOG(2) << "per core lru size: " << per_core_lru_size;
+    int numa_node;
+    perCoreLruSize_ = config_.LruSize / forwardingCores_.size();
+    VLOG(2) << "per core lru size: " << perCoreLruSize_;
     for (int i = 0; i < forwardingCores_.size(); i++) {
       auto core = forwardingCores_[i];
-      if ((core > kMaxForwardingCores) || core < 0) {
+      if ((core >= kMaxForwardingCores) || core < 0) {
         LOG(FATAL) << "got core# " << core
                    << " which is not in supported range: [ 0: "
-                   << kMaxForwardingCores << " ]";
+                   << kMaxForwardingCores << " )";
         throw std::runtime_error("unsuported number of forwarding cores");
       }
       if (numa_mapping_specified) {
         numa_node = numaNodes_[i];
-        lru_map_flags |= kMapNumaNode;
       } else {
         numa_node = kNoNuma;
       }
-      lru_fd = createLruMap(per_core_lru_size, lru_map_flags, numa_node);
-      if (lru_fd < 0) {
+      if (createLruForCore(core, numa_node, perCoreLruSize_) < 0) {
         LOG(FATAL) << "can't creat lru for core: " << core;
         throw std::runtime_error(folly::sformat(
             "can't create LRU for forwarding core, error: {}",
             folly::errnoStr(errno)));
       }
-      lruMapsFd_[core] = lru_fd;
     }
     forwarding_cores_specified = true;
   }
@@ -282,7 +354,10 @@ void KatranLb::initLrus() {
   } else {
     // creating prototype for LRU's map-in-map. this code path would be hit
     // only during unit tests, where we dont specify forwarding cores
+    // (or if forwarding cores could not be discovered)
     lru_proto_fd = createLruMap();
+    // inner maps must match the prototype
+    perCoreLruSize_ = kFallbackLruSize;
 
     if (lru_proto_fd < 0) {
       throw std::runtime_error("can't create prototype map for test lru");
@@ -296,6 +371,213 @@ void KatranLb::initLrus() {
   }
 }
 
+bool KatranLb::isLruResizeSupported() {
+  // kernels before 5.10 are rejecting inner maps w/ max_entries, which differs
+  // from the prototype. checking it on the scratch map-in-map
+  uint32_t key = 0;
+  auto proto_fd = createLruMap();
+  auto outer_fd = proto_fd < 0 ? kError
+                               : BpfAdapter::createBpfMapInMap(
+                                     kBpfMapTypeArrayOfMaps,
+                                     sizeof(key),
+                                     proto_fd,
+                                     1,
+                                     kMapNoFlags);
+  auto inner_fd = createLruMap(2 * kFallbackLruSize);
+  bool supported = outer_fd >= 0 && inner_fd >= 0 &&
+      !bpfAdapter_.bpfUpdateMap(outer_fd, &key, &inner_fd);
+  for (auto fd : {inner_fd, outer_fd, proto_fd}) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+  return supported;
+}
+
+int32_t KatranLb::getForwardingCoreNumaNode(size_t pos) {
+  if (pos < numaNodes_.size()) {
+    return numaNodes_[pos];
+  }
+  return IrqHelpers::getCpuNumaNode(forwardingCores_[pos]);
+}
+
+void KatranLb::initNumaReplicas() {
+  std::set<int32_t> nodes;
+  for (size_t i = 0; i < forwardingCores_.size(); i++) {
+    auto node = getForwardingCoreNumaNode(i);
+    if (node != kNoNuma) {
+      nodes.insert(node);
+    }
+  }
+  if (nodes.size() < 2) {
+    // bpf prog still expects prototypes for map-in-maps; single replica
+    // is created anyway
+    LOG(WARNING) << "forwarding cores are not spread across numa nodes, "
+                 << "numa replicas are useless";
+    if (nodes.empty()) {
+      nodes.insert(kNoNuma);
+    }
+  }
+  if (nodes.size() > kMaxNumaReplicas) {
+    throw std::invalid_argument(folly::sformat(
+        "too many numa nodes: {}, max supported: {}",
+        nodes.size(),
+        kMaxNumaReplicas));
+  }
+  struct ReplicaDef {
+    std::string name;
+    unsigned int type;
+    unsigned int keySize;
+    unsigned int valueSize;
+    unsigned int maxEntries;
+  };
+  std::vector<ReplicaDef> defs = {
+      {"vip_map",
+       kBpfMapTypeHash,
+       sizeof(struct vip_definition),
+       sizeof(struct vip_meta),
+       config_.maxVips},
+      {"ch_rings",
+       kBpfMapTypeArray,
+       sizeof(uint32_t),
+       sizeof(uint32_t),
+       config_.maxVips * config_.chRingSize},
+      {"reals",
+       kBpfMapTypeArray,
+       sizeof(uint32_t),
+       sizeof(struct beaddr),
+       config_.maxReals},
+  };
+  for (auto node : nodes) {
+    auto suffix = kReplicaNameSuffix +
+        (node == kNoNuma ? std::string(kAnyNodeName) : std::to_string(node));
+    for (const auto& def : defs) {
+      auto fd = bpfAdapter_.createNamedBpfMap(
+          def.name + suffix,
+          def.type,
+          def.keySize,
+          def.valueSize,
+          def.maxEntries,
+          node == kNoNuma ? kMapNoFlags : kMapNumaNode,
+          node);
+      if (fd < 0) {
+        throw std::runtime_error(folly::sformat(
+            "can't create replica of {} on numa node {}, error: {}",
+            def.name,
+            node,
+            folly::errnoStr(errno)));
+      }
+      numaReplicasFds_[def.name].push_back(fd);
+    }
+    replicaNodes_.push_back(node);
+  }
+  for (const auto& def : defs) {
+    // all replicas are the same, so any of em could be a prototype
+    auto res = bpfAdapter_.setInnerMapPrototype(
+        def.name + "_numa", numaReplicasFds_[def.name][kFirstElem]);
+    if (res < 0) {
+      throw std::runtime_error(folly::sformat(
+          "can't set prototype for {}_numa, error: {}",
+          def.name,
+          folly::errnoStr(errno)));
+    }
+  }
+}
+
+void KatranLb::attachNumaReplicas() {
+  if (replicaNodes_.empty()) {
+    return;
+  }
+  if (!features_.numaReplicas) {
+    LOG(WARNING) << "bpf prog has been built w/o NUMA_REPLICAS, "
+                 << "numa replicas are not going to be used";
+    for (const auto& replicas : numaReplicasFds_) {
+      for (auto fd : replicas.second) {
+        ::close(fd);
+      }
+    }
+    numaReplicasFds_.clear();
+    replicaNodes_.clear();
+    return;
+  }
+  for (const auto& replicas : numaReplicasFds_) {
+    auto map_fd = bpfAdapter_.getMapFdByName(replicas.first + "_numa");
+    for (uint32_t i = 0; i < replicas.second.size(); i++) {
+      uint32_t key = i + kFirstReplicaPos;
+      auto fd = replicas.second[i];
+      if (bpfAdapter_.bpfUpdateMap(map_fd, &key, &fd)) {
+        throw std::runtime_error(folly::sformat(
+            "can't attach numa replica of {}, error: {}",
+            replicas.first,
+            folly::errnoStr(errno)));
+      }
+    }
+  }
+  auto cpu_map_fd = bpfAdapter_.getMapFdByName("cpu_numa_map");
+  for (size_t i = 0; i < forwardingCores_.size(); i++) {
+    auto node_iter = std::find(
+        replicaNodes_.begin(),
+        replicaNodes_.end(),
+        getForwardingCoreNumaNode(i));
+    if (node_iter == replicaNodes_.end()) {
+      // core would use main maps
+      continue;
+    }
+    uint32_t key = forwardingCores_[i];
+    uint32_t pos =
+        std::distance(replicaNodes_.begin(), node_iter) + kFirstReplicaPos;
+    if (bpfAdapter_.bpfUpdateMap(cpu_map_fd, &key, &pos)) {
+      throw std::runtime_error(folly::sformat(
+          "can't map core {} to numa replica, error: {}",
+          key,
+          folly::errnoStr(errno)));
+    }
+  }
+}
+
+std::vector<int> KatranLb::getMapAndReplicasFds(const std::string& name) {
+  std::vector<int> fds = {bpfAdapter_.getMapFdByName(name)};
+  auto replicas_iter = numaReplicasFds_.find(name);
+  if (replicas_iter != numaReplicasFds_.end()) {
+    fds.insert(
+        fds.end(), replicas_iter->second.begin(), replicas_iter->second.end());
+  }
+  return fds;
+}
+
+int KatranLb::createLruForCore(
+    int32_t core,
+    int32_t numaNode,
+    uint64_t size) {
+  int lru_map_flags = numaNode == kNoNuma ? kMapNoFlags : kMapNumaNode;
+  auto lru_fd = createLruMap(size, lru_map_flags, numaNode);
+  if (lru_fd >= 0) {
+    lruMapsFd_[core] = lru_fd;
+    lruMapsSize_[core] = size;
+    lruInsertsBase_[core] = getLruInsertsForCore(core);
+  }
+  return lru_fd;
+}
+
+uint64_t KatranLb::getLruInsertsForCore(int32_t core) {
+  if (!progsLoaded_) {
+    // counters are zero until bpf program is loaded
+    return 0;
+  }
+  int nr_cpus = BpfAdapter::getPossibleCpus();
+  if (nr_cpus < 0 || core >= nr_cpus) {
+    return 0;
+  }
+  std::vector<lb_stats> inserts(nr_cpus);
+  uint32_t key = config_.maxVips + kLruInsertOffset;
+  if (bpfAdapter_.bpfMapLookupElement(
+          bpfAdapter_.getMapFdByName("stats"), &key, inserts.data())) {
+    lbStats_.bpfFailedCalls++;
+    return 0;
+  }
+  return inserts[core].v1;
+}
+
 void KatranLb::attachLrus() {
   if (!progsLoaded_) {
     throw std::runtime_error("can't attach lru when bpf progs are not loaded");
@@ -376,22 +658,46 @@ void KatranLb::setupHcEnvironment() {
     LOG(ERROR) << "Empty IPV6 address provided to use as source in healthcheck";
   }
 
-  std::array<struct hc_mac, 2> macs;
-  // populating mac addresses for healthchecking
+  // populating ifindex and mac addresses for healthchecking
   if (config_.localMac.size() != 6) {
     throw std::invalid_argument("src mac's size is not equal to six byte");
   }
+  hcCtrlData_.ifindex = ctlValues_[kMainIntfPos].ifindex;
+  hcCtrlData_.somark_base = config_.hcSomarkBase;
   for (int i = 0; i < 6; i++) {
-    macs[kHcSrcMacPos].mac[i] = config_.localMac[i];
-    macs[kHcDstMacPos].mac[i] = config_.defaultMac[i];
+    hcCtrlData_.src.mac[i] = config_.localMac[i];
+    hcCtrlData_.dst.mac[i] = config_.defaultMac[i];
   }
-  for (auto position : {kHcSrcMacPos, kHcDstMacPos}) {
-    auto res = bpfAdapter_.bpfUpdateMap(
-        bpfAdapter_.getMapFdByName("hc_pckt_macs"), &position, &macs[position]);
-    if (res < 0) {
-      throw std::runtime_error("can not update healthchecks mac address");
-    }
+  if (!updateHcCtrlData()) {
+    throw std::runtime_error("can not update healthchecks ctrl data");
+  }
+}
+
+bool KatranLb::updateHcCtrlData() {
+  uint32_t key = kHcCtrlDataPos;
+  auto res = bpfAdapter_.bpfUpdateMap(
+      bpfAdapter_.getMapFdByName("hc_ctrl_data_map"), &key, &hcCtrlData_);
+  if (res != 0) {
+    LOG(ERROR) << "can't update hc_ctrl_data_map, error: "
+               << folly::errnoStr(errno);
+    return false;
   }
+  return true;
+}
+
+bool KatranLb::hcSomarkToKey(const uint32_t somark, uint32_t& key) {
+  if (somark < config_.hcSomarkBase) {
+    LOG(ERROR) << "healthcheck's somark " << somark
+               << " is less than configured base " << config_.hcSomarkBase;
+    return false;
+  }
+  key = somark - config_.hcSomarkBase;
+  if (features_.hcRealsArray && key >= config_.maxReals) {
+    LOG(ERROR) << "healthcheck's somark " << somark
+               << " is out of range for array based hc_reals_map";
+    return false;
+  }
+  return true;
 }
 
 bool KatranLb::addSrcIpForPcktEncap(const folly::IPAddress& src) {
@@ -458,6 +764,34 @@ void KatranLb::featureDiscovering() {
     VLOG(2) << "Direct healthchecking is enabled";
     features_.directHealthchecking = true;
   }
+  res = bpfAdapter_.getMapFdByName("cpu_numa_map");
+  if (res >= 0) {
+    VLOG(2) << "numa replicas of read mostly maps are supported";
+    features_.numaReplicas = true;
+  }
+  res = bpfAdapter_.getMapFdByName("vip_addrs");
+  if (res >= 0) {
+    VLOG(2) << "vip address prefilter is enabled";
+    features_.vipAddrPrefilter = true;
+  }
+  res = bpfAdapter_.getMapFdByName("vip_port_ranges");
+  if (res >= 0) {
+    VLOG(2) << "port range vips are supported";
+    features_.vipPortRanges = true;
+  }
+  if (!config_.disableForwarding && isLruResizeSupported()) {
+    VLOG(2) << "resizing of per core lrus is supported";
+    features_.lruResize = true;
+  }
+  res = bpfAdapter_.getMapFdByName("hc_reals_map");
+  if (res >= 0) {
+    struct bpf_map_info info = {};
+    if (!bpfAdapter_.getBpfMapInfo(res, &info) &&
+        info.type == kBpfMapTypeArray) {
+      VLOG(2) << "Array based hc_reals_map is enabled";
+      features_.hcRealsArray = true;
+    }
+  }
 }
 
 void KatranLb::startIntrospectionRoutines() {
@@ -467,11 +801,58 @@ void KatranLb::startIntrospectionRoutines() {
   monitor_ = std::make_shared<KatranMonitor>(monitor_config);
 }
 
+void KatranLb::setMapsSizes() {
+  uint32_t stats_size =
+      config_.maxVips + std::max(config_.maxVips, kGlobalCntrsSize);
+  // maps which are not in bpf object (e.g. because of disabled feature)
+  // are simply ignored by loader
+  std::vector<std::pair<std::string, uint32_t>> sizes = {
+      {"vip_map", config_.maxVips},
+      {"vip_addrs", config_.maxVips},
+      {"vip_port_ranges", config_.maxVips * kMaxPortRangePrefixes},
+      {"ch_rings", config_.maxVips * config_.chRingSize},
+      {"reals", config_.maxReals},
+      {"reals_stats", config_.maxReals},
+      {"stats", stats_size},
+      {"lpm_src_v4", config_.maxLpmSrcSize},
+      {"lpm_src_v6", config_.maxLpmSrcSize},
+      {"decap_dst", config_.maxDecapDst},
+      {"hc_reals_map", config_.maxReals},
+      {"hc_reals_stats_map", config_.maxReals},
+  };
+  for (const auto& size : sizes) {
+    if (bpfAdapter_.setMapMaxEntries(size.first, size.second)) {
+      throw std::invalid_argument(folly::sformat(
+          "can't set size {} for map {}", size.second, size.first));
+    }
+  }
+}
+
+void KatranLb::setupLbLimits() {
+  struct lb_limits limits = {};
+  limits.max_vips = config_.maxVips;
+  limits.ring_size = config_.chRingSize;
+  uint32_t key = kLbLimitsPos;
+  auto res = bpfAdapter_.bpfUpdateMap(
+      bpfAdapter_.getMapFdByName("lb_limits_map"), &key, &limits);
+  if (res < 0) {
+    throw std::invalid_argument(folly::sformat(
+        "can't update lb limits for main program, error: {}",
+        folly::errnoStr(errno)));
+  }
+}
+
 void KatranLb::loadBpfProgs() {
   int res;
 
+  setMapsSizes();
+  bpfAdapter_.enableVerifierStats(config_.verifierStats);
+
   if (!config_.disableForwarding) {
     initLrus();
+    if (config_.numaReplicas) {
+      initNumaReplicas();
+    }
     res = bpfAdapter_.loadBpfProg(config_.balancerProgPath);
     if (res) {
       throw std::invalid_argument("can't load main bpf program");
@@ -490,6 +871,10 @@ void KatranLb::loadBpfProgs() {
   initialSanityChecking();
   featureDiscovering();
 
+  if (!config_.disableForwarding) {
+    setupLbLimits();
+  }
+
   if (!config_.disableForwarding && features_.gueEncap) {
     setupGueEnvironment();
   }
@@ -543,6 +928,7 @@ void KatranLb::loadBpfProgs() {
 
   if (!config_.disableForwarding) {
     attachLrus();
+    attachNumaReplicas();
   }
 }
 
@@ -603,6 +989,83 @@ void KatranLb::attachBpfProgs() {
   progsAttached_ = true;
 }
 
+bool KatranLb::upgradeBalancerProg(const std::string& path) {
+  if (!progsLoaded_ || config_.disableForwarding) {
+    LOG(ERROR) << "can't upgrade balancer prog: forwarding prog is not loaded";
+    return false;
+  }
+  auto old_fd = getKatranProgFd();
+  if (bpfAdapter_.stageBpfProg(path)) {
+    LOG(ERROR) << "can't load new version of balancer prog: " << path;
+    lbStats_.bpfFailedCalls++;
+    return false;
+  }
+  auto new_fd = bpfAdapter_.getStagedProgFdByName("xdp-balancer");
+  if (new_fd < 0) {
+    bpfAdapter_.abortStagedBpfProg();
+    return false;
+  }
+  if (!config_.testing && progsAttached_) {
+    int res;
+    if (standalone_) {
+      res = bpfAdapter_.replaceXdpProg(
+          new_fd,
+          ctlValues_[kMainIntfPos].ifindex,
+          old_fd,
+          config_.xdpAttachFlags & ~kXdpFlagsUpdateIfNoExist);
+    } else {
+      // update of prog array's element is atomic for the root xdp prog
+      res = bpfAdapter_.bpfUpdateMap(rootMapFd_, &config_.rootMapPos, &new_fd);
+    }
+    if (res != 0) {
+      LOG(ERROR) << folly::sformat(
+          "can't replace attached balancer prog, error: {}",
+          folly::errnoStr(errno));
+      bpfAdapter_.abortStagedBpfProg();
+      lbStats_.bpfFailedCalls++;
+      return false;
+    }
+  }
+  if (bpfAdapter_.commitStagedBpfProg()) {
+    // new prog is already attached; we are not able to get here unless
+    // there is a bug in the loader
+    LOG(ERROR) << "can't commit new version of balancer prog";
+    lbStats_.bpfFailedCalls++;
+    return false;
+  }
+  config_.balancerProgPath = path;
+
+  // new version could have different set of features. maps which existed
+  // before are reused w/ all their content, but new ones must be set up
+  features_.srcRouting = false;
+  features_.inlineDecap = false;
+  features_.introspection = false;
+  features_.gueEncap = false;
+  featureDiscovering();
+  try {
+    setupLbLimits();
+    if (features_.gueEncap) {
+      setupGueEnvironment();
+    }
+    if (features_.inlineDecap) {
+      // recirculation's prog array must point to the new prog
+      enableRecirculation();
+    }
+    attachNumaReplicas();
+    if (features_.introspection) {
+      // readers must be attached to event pipe of the new prog (which
+      // could have been just created, if old one was w/o introspection)
+      monitor_.reset();
+      startIntrospectionRoutines();
+    }
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "can't setup upgraded balancer prog: " << e.what();
+    lbStats_.bpfFailedCalls++;
+    return false;
+  }
+  return true;
+}
+
 bool KatranLb::changeMac(const std::vector<uint8_t> newMac) {
   uint32_t key = kMacAddrPos;
 
@@ -628,12 +1091,10 @@ bool KatranLb::changeMac(const std::vector<uint8_t> newMac) {
     }
 
     if (features_.directHealthchecking) {
-      key = kHcDstMacPos;
-      auto res = bpfAdapter_.bpfUpdateMap(
-          bpfAdapter_.getMapFdByName("hc_pckt_macs"),
-          &key,
-          &ctlValues_[kMacAddrPos].mac);
-      if (res != 0) {
+      for (int i = 0; i < kMacBytes; i++) {
+        hcCtrlData_.dst.mac[i] = newMac[i];
+      }
+      if (!updateHcCtrlData()) {
         lbStats_.bpfFailedCalls++;
         VLOG(4) << "can't add new mac address for direct healthchecks";
         return false;
@@ -670,9 +1131,18 @@ bool KatranLb::addVip(const VipKey& vip, const uint32_t flags) {
     LOG(INFO) << "trying to add already existing vip";
     return false;
   }
+  if (vip.lastPort != 0 && !validatePortRange(vip)) {
+    return false;
+  }
   auto vip_num = vipNums_[0];
   vipNums_.pop_front();
   vips_.emplace(vip, Vip(vip_num, flags, config_.chRingSize));
+  // address must be in prefilter before the vip itself
+  if (!updateVipAddrs(ModifyAction::ADD, vip.address)) {
+    vips_.erase(vip);
+    vipNums_.push_front(vip_num);
+    return false;
+  }
   if (!config_.testing) {
     vip_meta meta;
     meta.vip_num = vip_num;
@@ -707,6 +1177,7 @@ bool KatranLb::delVip(const VipKey& vip) {
   if (!config_.testing) {
     updateVipMap(ModifyAction::DEL, vip);
   }
+  updateVipAddrs(ModifyAction::DEL, vip.address);
   vips_.erase(vip_iter);
   return true;
 }
@@ -862,16 +1333,17 @@ bool KatranLb::modifyRealsForVip(
   auto ch_positions = vip_iter->second.batchRealsUpdate(ureals);
   auto vip_num = vip_iter->second.getVipNum();
   if (!config_.testing) {
-    auto ch_fd = bpfAdapter_.getMapFdByName("ch_rings");
     uint32_t key;
     int res;
-    for (auto pos : ch_positions) {
-      key = vip_num * config_.chRingSize + pos.pos;
-      res = bpfAdapter_.bpfUpdateMap(ch_fd, &key, &pos.real);
-      if (res != 0) {
-        lbStats_.bpfFailedCalls++;
-        LOG(INFO) << "can't update ch ring"
-                  << ", error: " << folly::errnoStr(errno);
+    for (auto ch_fd : getMapAndReplicasFds("ch_rings")) {
+      for (auto pos : ch_positions) {
+        key = vip_num * config_.chRingSize + pos.pos;
+        res = bpfAdapter_.bpfUpdateMap(ch_fd, &key, &pos.real);
+        if (res != 0) {
+          lbStats_.bpfFailedCalls++;
+          LOG(INFO) << "can't update ch ring"
+                    << ", error: " << folly::errnoStr(errno);
+        }
       }
     }
   }
@@ -916,6 +1388,28 @@ int64_t KatranLb::getIndexForReal(const std::string& real) {
   return kError;
 }
 
+bool KatranLb::setRealDown(const std::string& real, bool down) {
+  if (config_.disableForwarding) {
+    LOG(ERROR) << "setRealDown called on non-forwarding instance";
+    return false;
+  }
+  if (validateAddress(real) == AddressType::INVALID) {
+    LOG(ERROR) << "invalid real's address: " << real;
+    return false;
+  }
+  folly::IPAddress raddr(real);
+  auto real_iter = reals_.find(raddr);
+  if (real_iter == reals_.end()) {
+    LOG(INFO) << "trying to mark non-existing real: " << real;
+    return false;
+  }
+  real_iter->second.down = down;
+  if (config_.testing) {
+    return true;
+  }
+  return updateRealsMap(raddr, real_iter->second.num, down);
+}
+
 int KatranLb::addSrcRoutingRule(
     const std::vector<std::string>& srcs,
     const std::string& dst) {
@@ -1163,6 +1657,31 @@ bool KatranLb::restartKatranMonitor(uint32_t limit) {
   return true;
 }
 
+bool KatranLb::setKatranMonitorVerdictSampling(
+    uint32_t sampleRate,
+    bool withHeaders) {
+  if (!features_.introspection || config_.disableForwarding) {
+    return false;
+  }
+  auto ctlFd = bpfAdapter_.getMapFdByName("ctl_array");
+  uint32_t key = kVerdictHeadersPos;
+  struct ctl_value value = {};
+  value.value = withHeaders ? 1 : 0;
+  auto res = bpfAdapter_.bpfUpdateMap(ctlFd, &key, &value);
+  if (res == 0) {
+    key = kVerdictSamplingPos;
+    // random u32 is compared against it in forwarding plane
+    value.value = sampleRate > 0 ? kVerdictSampleRange / sampleRate : 0;
+    res = bpfAdapter_.bpfUpdateMap(ctlFd, &key, &value);
+  }
+  if (res != 0) {
+    LOG(INFO) << "can't change sampling of katran's verdicts";
+    lbStats_.bpfFailedCalls++;
+    return false;
+  }
+  return true;
+}
+
 KatranMonitorStats KatranLb::getKatranMonitorStats() {
   struct KatranMonitorStats stats;
   if (!features_.introspection || config_.disableForwarding) {
@@ -1444,6 +1963,10 @@ lb_stats KatranLb::getQuicRoutingStats() {
   return getLbStats(config_.maxVips + kQuicRoutingOffset);
 }
 
+lb_stats KatranLb::getDownRealStats() {
+  return getLbStats(config_.maxVips + kDownRealOffset);
+}
+
 lb_stats KatranLb::getSrcRoutingStats() {
   return getLbStats(config_.maxVips + kLpmSrcOffset);
 }
@@ -1484,6 +2007,75 @@ lb_stats KatranLb::getLbStats(uint32_t position, const std::string& map) {
   return sum_stat;
 }
 
+KatranForwardingStats KatranLb::getForwardingStats() {
+  KatranForwardingStats result;
+  if (config_.disableForwarding) {
+    LOG(ERROR) << "getForwardingStats called on non-forwarding instance";
+    return result;
+  }
+  int nr_cpus = BpfAdapter::getPossibleCpus();
+  if (nr_cpus < 0) {
+    LOG(ERROR) << "Error while getting number of possible cpus";
+    return result;
+  }
+  // per vip counters are followed by global ones
+  uint32_t total = config_.maxVips + kGlobalCntrsSize;
+  std::vector<uint32_t> keys(total);
+  std::vector<lb_stats> values(total * nr_cpus);
+  bool batched = !config_.testing;
+  if (batched) {
+    auto map_fd = bpfAdapter_.getMapFdByName("stats");
+    uint32_t in_batch = 0, out_batch = 0, read = 0;
+    while (read < total) {
+      uint32_t count = total - read;
+      auto res = bpfAdapter_.bpfMapLookupBatch(
+          map_fd,
+          read == 0 ? nullptr : &in_batch,
+          &out_batch,
+          &keys[read],
+          &values[read * nr_cpus],
+          &count);
+      read += count;
+      in_batch = out_batch;
+      if (res) {
+        if (errno != ENOENT) {
+          // e.g. kernel w/o batch ops support
+          batched = false;
+        }
+        break;
+      }
+    }
+    if (batched && read < total) {
+      LOG(ERROR) << "stats map is smaller than expected: " << read;
+      batched = false;
+    }
+  }
+  auto sum = [&](uint32_t position) {
+    if (!batched) {
+      return getLbStats(position);
+    }
+    lb_stats sum_stat = {};
+    for (int cpu = 0; cpu < nr_cpus; cpu++) {
+      sum_stat.v1 += values[position * nr_cpus + cpu].v1;
+      sum_stat.v2 += values[position * nr_cpus + cpu].v2;
+    }
+    return sum_stat;
+  };
+  for (auto& vip : vips_) {
+    result.vips.emplace_back(vip.first, sum(vip.second.getVipNum()));
+  }
+  result.lru = sum(config_.maxVips + kLruCntrOffset);
+  result.lruMiss = sum(config_.maxVips + kLruMissOffset);
+  result.lruFallback = sum(config_.maxVips + kLruFallbackOffset);
+  result.icmpTooBig = sum(config_.maxVips + kIcmpTooBigOffset);
+  result.srcRouting = sum(config_.maxVips + kLpmSrcOffset);
+  result.inlineDecap = sum(config_.maxVips + kInlineDecapOffset);
+  result.quicRouting = sum(config_.maxVips + kQuicRoutingOffset);
+  result.lruInserts = sum(config_.maxVips + kLruInsertOffset);
+  result.downReals = sum(config_.maxVips + kDownRealOffset);
+  return result;
+}
+
 HealthCheckProgStats KatranLb::getStatsForHealthCheckProgram() {
   unsigned int nr_cpus = BpfAdapter::getPossibleCpus();
   if (nr_cpus < 0) {
@@ -1510,6 +2102,127 @@ HealthCheckProgStats KatranLb::getStatsForHealthCheckProgram() {
   return total_stats;
 }
 
+std::unordered_map<uint32_t, HealthCheckRealStats>
+KatranLb::getHealthcheckStatsPerReal() {
+  std::unordered_map<uint32_t, HealthCheckRealStats> result;
+  // hc_reals_map's key to somark
+  std::unordered_map<uint32_t, uint32_t> somarks;
+  uint32_t max_key = 0;
+  for (const auto& hc : hcReals_) {
+    result[hc.first] = {};
+    uint32_t key;
+    if (hcSomarkToKey(hc.first, key)) {
+      somarks[key] = hc.first;
+      max_key = std::max(max_key, key);
+    }
+  }
+  if (config_.testing || somarks.empty()) {
+    return result;
+  }
+  int nr_cpus = BpfAdapter::getPossibleCpus();
+  if (nr_cpus < 0) {
+    LOG(ERROR) << "Error while getting number of possible cpus";
+    return result;
+  }
+  auto stats_fd = bpfAdapter_.getMapFdByName("hc_reals_stats_map");
+  if (stats_fd < 0) {
+    return result;
+  }
+  // array is read up to the largest used key; hash contains only used keys
+  uint32_t total = features_.hcRealsArray ? max_key + 1 : somarks.size();
+  std::vector<uint32_t> keys(total);
+  std::vector<HealthCheckRealStats> values(total * nr_cpus);
+  uint32_t in_batch = 0, out_batch = 0, read = 0;
+  bool batched = true;
+  while (read < total) {
+    uint32_t count = total - read;
+    auto res = bpfAdapter_.bpfMapLookupBatch(
+        stats_fd,
+        read == 0 ? nullptr : &in_batch,
+        &out_batch,
+        &keys[read],
+        &values[read * nr_cpus],
+        &count);
+    read += count;
+    in_batch = out_batch;
+    if (res) {
+      // ENOENT - end of the map has been reached
+      batched = errno == ENOENT;
+      break;
+    }
+  }
+  if (batched) {
+    keys.resize(read);
+    values.resize(read * nr_cpus);
+    aggregateHcRealStats(somarks, keys, values, nr_cpus, result);
+    return result;
+  }
+  // e.g. kernel w/o batch ops support
+  std::vector<HealthCheckRealStats> stats(nr_cpus);
+  for (const auto& somark : somarks) {
+    uint32_t key = somark.first;
+    if (bpfAdapter_.bpfMapLookupElement(stats_fd, &key, stats.data())) {
+      lbStats_.bpfFailedCalls++;
+      continue;
+    }
+    aggregateHcRealStats(somarks, {key}, stats, nr_cpus, result);
+  }
+  return result;
+}
+
+void KatranLb::aggregateHcRealStats(
+    const std::unordered_map<uint32_t, uint32_t>& somarks,
+    const std::vector<uint32_t>& keys,
+    const std::vector<HealthCheckRealStats>& values,
+    int nrCpus,
+    std::unordered_map<uint32_t, HealthCheckRealStats>& result) {
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto somark_iter = somarks.find(keys[i]);
+    if (somark_iter == somarks.end()) {
+      // unused entry of the array
+      continue;
+    }
+    auto& total_stats = result[somark_iter->second];
+    for (int cpu = 0; cpu < nrCpus; cpu++) {
+      const auto& stats = values[i * nrCpus + cpu];
+      total_stats.packetsEncaped += stats.packetsEncaped;
+      total_stats.bytesEncaped += stats.bytesEncaped;
+      total_stats.packetsDropped += stats.packetsDropped;
+      total_stats.bytesDropped += stats.bytesDropped;
+    }
+  }
+}
+
+bool KatranLb::updateHcRealStats(
+    const ModifyAction action,
+    const uint32_t key) {
+  auto stats_fd = bpfAdapter_.getMapFdByName("hc_reals_stats_map");
+  if (stats_fd < 0) {
+    // healthchecking prog w/o per real counters
+    return true;
+  }
+  int nr_cpus = BpfAdapter::getPossibleCpus();
+  if (nr_cpus < 0) {
+    LOG(ERROR) << "Error while getting number of possible cpus";
+    return false;
+  }
+  uint32_t stats_key = key;
+  int res;
+  if (action == ModifyAction::DEL && !features_.hcRealsArray) {
+    res = bpfAdapter_.bpfMapDeleteElement(stats_fd, &stats_key);
+  } else {
+    std::vector<HealthCheckRealStats> stats(nr_cpus);
+    res = bpfAdapter_.bpfUpdateMap(stats_fd, &stats_key, stats.data());
+  }
+  if (res) {
+    LOG(INFO) << "can't update hc_reals_stats_map, error: "
+              << folly::errnoStr(errno);
+    lbStats_.bpfFailedCalls++;
+    return false;
+  }
+  return true;
+}
+
 KatranBpfMapStats KatranLb::getBpfMapStats(const std::string& map) {
   KatranBpfMapStats map_stats = {0};
   int res = bpfAdapter_.getBpfMapMaxSize(map);
@@ -1531,6 +2244,500 @@ KatranBpfMapStats KatranLb::getBpfMapStats(const std::string& map) {
   return map_stats;
 }
 
+int KatranLb::rebalanceLrus() {
+  if (config_.disableForwarding || config_.testing || !progsLoaded_ ||
+      !features_.lruResize || forwardingCores_.size() < 2) {
+    return 0;
+  }
+  int nr_cpus = BpfAdapter::getPossibleCpus();
+  if (nr_cpus < 0) {
+    LOG(ERROR) << "Error while getting number of possible cpus";
+    return kError;
+  }
+  std::vector<lb_stats> inserts(nr_cpus);
+  uint32_t key = config_.maxVips + kLruInsertOffset;
+  if (bpfAdapter_.bpfMapLookupElement(
+          bpfAdapter_.getMapFdByName("stats"), &key, inserts.data())) {
+    lbStats_.bpfFailedCalls++;
+    return kError;
+  }
+  std::vector<LruCoreLoad> load;
+  for (const auto& core : forwardingCores_) {
+    uint64_t core_inserts = core < nr_cpus ? inserts[core].v1 : 0;
+    LruCoreLoad core_load = {};
+    core_load.currentSize = lruMapsSize_[core];
+    // counters are reset if bpf program has been reloaded
+    core_load.inserts = core_inserts >= lastLruInserts_[core]
+        ? core_inserts - lastLruInserts_[core]
+        : core_inserts;
+    lastLruInserts_[core] = core_inserts;
+    load.push_back(core_load);
+  }
+  auto min_size = config_.LruSize / forwardingCores_.size() /
+      kLruMinShareDivisor;
+  auto sizes = LruSizing::computeLruSizes(
+      load, config_.LruSize, min_size, kLruResizeThreshold);
+
+  // shrinking first, so total size of LRUs stays within the budget
+  std::vector<size_t> order(sizes.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_partition(order.begin(), order.end(), [&](size_t i) {
+    return sizes[i] < load[i].currentSize;
+  });
+  int resized = 0;
+  for (auto i : order) {
+    if (sizes[i] == load[i].currentSize) {
+      continue;
+    }
+    if (!resizeLru(forwardingCores_[i], sizes[i])) {
+      return kError;
+    }
+    resized++;
+  }
+  return resized;
+}
+
+bool KatranLb::resizeLru(int32_t core, uint64_t size) {
+  auto numa_node = kNoNuma;
+  auto core_iter =
+      std::find(forwardingCores_.begin(), forwardingCores_.end(), core);
+  auto core_pos = std::distance(forwardingCores_.begin(), core_iter);
+  if (static_cast<size_t>(core_pos) < numaNodes_.size()) {
+    numa_node = numaNodes_[core_pos];
+  }
+  auto old_fd = lruMapsFd_[core];
+  auto old_size = lruMapsSize_[core];
+  auto old_inserts_base = lruInsertsBase_[core];
+  if (createLruForCore(core, numa_node, size) < 0) {
+    LOG(ERROR) << "can't create lru of size " << size << " for core " << core;
+    return false;
+  }
+  auto new_fd = lruMapsFd_[core];
+
+  std::vector<flow_key> keys;
+  std::vector<real_pos_lru> values;
+  // there is no point to copy more flows than new lru could fit
+  dumpLruMap(
+      old_fd, core, [&](const flow_key& key, const real_pos_lru& value) {
+        keys.push_back(key);
+        values.push_back(value);
+        return keys.size() < size;
+      });
+  bool success = bulkUpdateLru(new_fd, keys, values) == keys.size();
+  if (success &&
+      bpfAdapter_.bpfUpdateMap(
+          bpfAdapter_.getMapFdByName("lru_maps_mapping"), &core, &new_fd)) {
+    LOG(ERROR) << "can't swap lru of core " << core
+               << ", error: " << folly::errnoStr(errno);
+    lbStats_.bpfFailedCalls++;
+    success = false;
+  }
+  if (!success) {
+    ::close(new_fd);
+    lruMapsFd_[core] = old_fd;
+    lruMapsSize_[core] = old_size;
+    lruInsertsBase_[core] = old_inserts_base;
+    return false;
+  }
+  VLOG(2) << "lru of core " << core << " has been resized from " << old_size
+          << " to " << size << ", " << keys.size() << " flows copied";
+  ::close(old_fd);
+  return true;
+}
+
+bool KatranLb::validateNumaReplicas() {
+  if (replicaNodes_.empty()) {
+    return true;
+  }
+  // value of the key in the main map (or it's absence) must be the same in
+  // every replica
+  auto in_sync = [this](const std::vector<int>& fds, void* key, size_t size) {
+    std::vector<uint8_t> main_value(size);
+    std::vector<uint8_t> replica_value(size);
+    bool main_found = !bpfAdapter_.bpfMapLookupElement(
+        fds[kFirstElem], key, main_value.data());
+    for (size_t i = kFirstElem + 1; i < fds.size(); i++) {
+      bool found = !bpfAdapter_.bpfMapLookupElement(
+          fds[i], key, replica_value.data());
+      if (found != main_found || (found && main_value != replica_value)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  auto vip_fds = getMapAndReplicasFds("vip_map");
+  auto main_entries = BpfAdapter::getBpfMapUsedSize(vip_fds[kFirstElem]);
+  for (size_t i = kFirstElem + 1; i < vip_fds.size(); i++) {
+    if (BpfAdapter::getBpfMapUsedSize(vip_fds[i]) != main_entries) {
+      LOG(ERROR) << "number of vips in replica " << i
+                 << " differs from vip_map";
+      return false;
+    }
+  }
+  vip_definition key = {}, next_key = {};
+  void* prev_key = nullptr;
+  while (!bpfAdapter_.bpfMapGetNextKey(
+      vip_fds[kFirstElem], prev_key, &next_key)) {
+    key = next_key;
+    prev_key = &key;
+    if (!in_sync(vip_fds, &key, sizeof(vip_meta))) {
+      LOG(ERROR) << "vip_map replicas are out of sync";
+      return false;
+    }
+  }
+
+  auto reals_fds = getMapAndReplicasFds("reals");
+  for (auto& real : numToReals_) {
+    auto num = real.first;
+    if (!in_sync(reals_fds, &num, sizeof(beaddr))) {
+      LOG(ERROR) << "reals replicas are out of sync for real " << real.second;
+      return false;
+    }
+  }
+
+  auto ch_fds = getMapAndReplicasFds("ch_rings");
+  for (auto& vip : vips_) {
+    for (uint32_t pos = 0; pos < config_.chRingSize; pos++) {
+      uint32_t key = vip.second.getVipNum() * config_.chRingSize + pos;
+      if (!in_sync(ch_fds, &key, sizeof(uint32_t))) {
+        LOG(ERROR) << "ch_rings replicas are out of sync for vip "
+                   << vip.first.address;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int KatranLb::refreshForwardingCores() {
+  if (config_.disableForwarding || config_.testing || !progsLoaded_) {
+    return 0;
+  }
+  auto fallback_hits = getLruFallbackStats().v1;
+  if (fallback_hits > lastLruFallbackHits_) {
+    LOG(ERROR) << fallback_hits - lastLruFallbackHits_
+               << " packets have been processed on cores w/o LRU";
+    lbStats_.lruFallbackAlerts++;
+  }
+  lastLruFallbackHits_ = fallback_hits;
+
+  int added = 0;
+  auto lru_mapping_fd = bpfAdapter_.getMapFdByName("lru_maps_mapping");
+  for (auto core : IrqHelpers::getInterfaceCpus(config_.mainInterface)) {
+    if (core >= kMaxForwardingCores) {
+      LOG(ERROR) << "core# " << core << " is not in supported range";
+      continue;
+    }
+    if (std::find(forwardingCores_.begin(), forwardingCores_.end(), core) !=
+        forwardingCores_.end()) {
+      continue;
+    }
+    auto numa_node = kNoNuma;
+    if (!numaNodes_.empty()) {
+      numa_node = IrqHelpers::getCpuNumaNode(core);
+    }
+    if (createLruForCore(core, numa_node, perCoreLruSize_) < 0) {
+      LOG(ERROR) << "can't create lru for core: " << core;
+      return kError;
+    }
+    if (bpfAdapter_.bpfUpdateMap(
+            lru_mapping_fd, &core, &lruMapsFd_[core])) {
+      LOG(ERROR) << "can't attach lru to forwarding core: " << core;
+      lbStats_.bpfFailedCalls++;
+      ::close(lruMapsFd_[core]);
+      lruMapsFd_[core] = 0;
+      lruMapsSize_[core] = 0;
+      return kError;
+    }
+    LOG(INFO) << "lru has been added for new forwarding core " << core;
+    forwardingCores_.push_back(core);
+    if (!numaNodes_.empty()) {
+      numaNodes_.push_back(numa_node);
+    }
+    added++;
+  }
+  if (added > 0 && !replicaNodes_.empty()) {
+    try {
+      attachNumaReplicas();
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "can't map new cores to numa replicas: " << e.what();
+      return kError;
+    }
+  }
+  return added;
+}
+
+std::vector<KatranLruFillStats> KatranLb::getLruFillStats(bool exact) {
+  std::vector<KatranLruFillStats> result;
+  if (config_.disableForwarding || config_.testing ||
+      forwardingCores_.empty()) {
+    return result;
+  }
+  int nr_cpus = BpfAdapter::getPossibleCpus();
+  if (nr_cpus < 0) {
+    LOG(ERROR) << "Error while getting number of possible cpus";
+    return result;
+  }
+  std::vector<lb_stats> inserts(nr_cpus);
+  uint32_t key = config_.maxVips + kLruInsertOffset;
+  auto res = bpfAdapter_.bpfMapLookupElement(
+      bpfAdapter_.getMapFdByName("stats"), &key, inserts.data());
+  if (res) {
+    lbStats_.bpfFailedCalls++;
+    return result;
+  }
+  for (const auto& core : forwardingCores_) {
+    KatranLruFillStats fill = {};
+    fill.core = core;
+    fill.maxEntries = lruMapsSize_[core];
+    // lrus are per cpu, so are counters of inserts. only inserts into
+    // current lru of the core are counted (counter is reset to 0 if bpf
+    // program has been reloaded)
+    if (core < nr_cpus) {
+      auto core_inserts = inserts[core].v1;
+      fill.inserts = core_inserts >= lruInsertsBase_[core]
+          ? core_inserts - lruInsertsBase_[core]
+          : core_inserts;
+    }
+    fill.entries = std::min<uint64_t>(fill.inserts, fill.maxEntries);
+    if (exact) {
+      auto entries = BpfAdapter::getBpfMapUsedSize(lruMapsFd_[core]);
+      if (entries < 0) {
+        lbStats_.bpfFailedCalls++;
+      } else {
+        fill.entries = entries;
+      }
+    }
+    result.push_back(fill);
+  }
+  return result;
+}
+
+bool KatranLb::dumpLruMap(
+    int mapFd,
+    int32_t core,
+    const std::function<bool(const flow_key&, const real_pos_lru&)>&
+        processEntry) {
+  std::vector<flow_key> keys(kConnTableBatchSize);
+  std::vector<real_pos_lru> values(kConnTableBatchSize);
+  uint32_t in_batch = 0, out_batch = 0;
+  bool first_batch = true;
+  while (true) {
+    uint32_t count = kConnTableBatchSize;
+    auto res = bpfAdapter_.bpfMapLookupBatch(
+        mapFd,
+        first_batch ? nullptr : &in_batch,
+        &out_batch,
+        keys.data(),
+        values.data(),
+        &count);
+    if (res && errno != ENOENT) {
+      if (first_batch) {
+        // e.g. kernel w/o batch ops support. walking lru key by key
+        break;
+      }
+      LOG(ERROR) << "can't read lru of core " << core
+                 << ", error: " << folly::errnoStr(errno);
+      lbStats_.bpfFailedCalls++;
+      return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      if (!processEntry(keys[i], values[i])) {
+        return false;
+      }
+    }
+    if (res) {
+      // ENOENT: end of the map
+      return true;
+    }
+    in_batch = out_batch;
+    first_batch = false;
+  }
+
+  flow_key key = {}, next_key = {};
+  real_pos_lru value = {};
+  flow_key* prev_key = nullptr;
+  while (!bpfAdapter_.bpfMapGetNextKey(mapFd, prev_key, &next_key)) {
+    key = next_key;
+    prev_key = &key;
+    if (bpfAdapter_.bpfMapLookupElement(mapFd, &key, &value)) {
+      // entry has been evicted while we were walking the map
+      continue;
+    }
+    if (!processEntry(key, value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t KatranLb::dumpConnectionTable(
+    const KatranConnTableFilter& filter,
+    const KatranConnTableCallback& callback) {
+  uint64_t dumped = 0;
+  if (config_.disableForwarding || !progsLoaded_) {
+    LOG(ERROR) << "dumpConnectionTable called on non-forwarding instance";
+    return dumped;
+  }
+
+  std::unique_ptr<ConnTableMatcher> matcher;
+  try {
+    matcher = std::make_unique<ConnTableMatcher>(
+        filter, vipAddrs_, numToReals_);
+  } catch (const std::invalid_argument& e) {
+    LOG(ERROR) << "invalid connection table filter: " << e.what();
+    return dumped;
+  }
+  if (!matcher->canMatch()) {
+    return dumped;
+  }
+
+  int32_t current_core;
+  auto process_entry = [&](const flow_key& key, const real_pos_lru& value) {
+    KatranConnEntry entry;
+    if (!matcher->match(key, value, entry)) {
+      return true;
+    }
+    entry.core = current_core;
+    dumped++;
+    return callback(entry);
+  };
+
+  for (const auto& core : forwardingCores_) {
+    current_core = core;
+    if (!dumpLruMap(lruMapsFd_[core], core, process_entry)) {
+      return dumped;
+    }
+  }
+  current_core = kFallbackLruCore;
+  dumpLruMap(
+      bpfAdapter_.getMapFdByName("fallback_lru_cache"),
+      current_core,
+      process_entry);
+  return dumped;
+}
+
+uint64_t KatranLb::importConnectionTable(
+    const std::vector<KatranConnEntry>& entries) {
+  if (config_.disableForwarding) {
+    LOG(ERROR) << "importConnectionTable called on non-forwarding instance";
+    return 0;
+  }
+  // flows are grouped by lru where they are going to be added: lru of the
+  // core which has exported the flow or fallback lru (if there is no such
+  // forwarding core here)
+  std::unordered_map<int32_t, std::vector<flow_key>> keys;
+  std::unordered_map<int32_t, std::vector<real_pos_lru>> values;
+  // vips_ is hashed by exact port, so range vips are checked one by one
+  std::vector<VipKey> range_vips;
+  for (const auto& vip : vips_) {
+    if (vip.first.lastPort != 0) {
+      range_vips.push_back(vip.first);
+    }
+  }
+  // steady_clock is CLOCK_MONOTONIC, same as bpf_ktime_get_ns(). so imported
+  // udp flows would not be treated as expired
+  uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count();
+  for (const auto& entry : entries) {
+    VipKey vip;
+    vip.address = entry.dst;
+    vip.port = entry.dstPort;
+    vip.proto = entry.proto;
+    // same order of lookups as in forwarding plane. flows to range vip
+    // keep their dst port in lru's key
+    bool is_range_vip = std::any_of(
+        range_vips.begin(), range_vips.end(), [&](const VipKey& range_vip) {
+          return range_vip.address == entry.dst &&
+              range_vip.proto == entry.proto &&
+              range_vip.port <= entry.dstPort &&
+              entry.dstPort <= range_vip.lastPort;
+        });
+    if (vips_.find(vip) == vips_.end() && !is_range_vip) {
+      // lru's key of the flow to vip w/o port has dst port zeroed
+      vip.port = 0;
+      if (vips_.find(vip) == vips_.end()) {
+        continue;
+      }
+    }
+    if (!folly::IPAddress::validate(entry.src) ||
+        !folly::IPAddress::validate(entry.real)) {
+      continue;
+    }
+    auto real_iter = reals_.find(folly::IPAddress(entry.real));
+    if (real_iter == reals_.end()) {
+      continue;
+    }
+    flow_key key = {};
+    auto src = IpHelpers::parseAddrToBe(entry.src);
+    auto dst = IpHelpers::parseAddrToBe(entry.dst);
+    if ((src.flags & V6DADDR) != (dst.flags & V6DADDR)) {
+      continue;
+    }
+    if ((src.flags & V6DADDR) > 0) {
+      std::memcpy(key.srcv6, src.v6daddr, 16);
+      std::memcpy(key.dstv6, dst.v6daddr, 16);
+    } else {
+      key.src = src.daddr;
+      key.dst = dst.daddr;
+    }
+    key.port16[0] = folly::Endian::big(entry.srcPort);
+    key.port16[1] = folly::Endian::big(entry.dstPort);
+    key.proto = entry.proto;
+    real_pos_lru value = {};
+    value.pos = real_iter->second.num;
+    if (entry.proto == kUdpProto) {
+      value.atime = now_ns;
+    }
+    auto core = kFallbackLruCore;
+    if (std::find(
+            forwardingCores_.begin(), forwardingCores_.end(), entry.core) !=
+        forwardingCores_.end()) {
+      core = entry.core;
+    }
+    keys[core].push_back(key);
+    values[core].push_back(value);
+  }
+  uint64_t imported = 0;
+  for (auto& core_keys : keys) {
+    auto core = core_keys.first;
+    if (config_.testing) {
+      imported += core_keys.second.size();
+      continue;
+    }
+    auto map_fd = core == kFallbackLruCore
+        ? bpfAdapter_.getMapFdByName("fallback_lru_cache")
+        : lruMapsFd_[core];
+    imported += bulkUpdateLru(map_fd, core_keys.second, values[core]);
+  }
+  return imported;
+}
+
+uint64_t KatranLb::bulkUpdateLru(
+    int mapFd,
+    std::vector<flow_key>& keys,
+    std::vector<real_pos_lru>& values) {
+  uint32_t count = keys.size();
+  if (count == 0 ||
+      !bpfAdapter_.bpfMapUpdateBatch(
+          mapFd, keys.data(), values.data(), &count)) {
+    return keys.size();
+  }
+  // e.g. kernel w/o batch ops support. count is not reliable in this case,
+  // but updates are idempotent, so starting from the beginning
+  uint64_t updated = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (bpfAdapter_.bpfUpdateMap(mapFd, &keys[i], &values[i])) {
+      lbStats_.bpfFailedCalls++;
+      continue;
+    }
+    updated++;
+  }
+  return updated;
+}
+
 bool KatranLb::addHealthcheckerDst(
     const uint32_t somark,
     const std::string& dst) {
@@ -1544,9 +2751,13 @@ bool KatranLb::addHealthcheckerDst(
   VLOG(4) << folly::format(
       "adding healtcheck with so_mark {} to dst {}", somark, dst);
   folly::IPAddress hcaddr(dst);
-  uint32_t key = somark;
+  uint32_t key;
   beaddr addr;
 
+  if (!hcSomarkToKey(somark, key)) {
+    return false;
+  }
+
   auto hc_iter = hcReals_.find(somark);
   if (hc_iter == hcReals_.end() && hcReals_.size() == config_.maxReals) {
     LOG(INFO) << "healthchecker's reals space exhausted";
@@ -1559,6 +2770,13 @@ bool KatranLb::addHealthcheckerDst(
     addr = IpHelpers::parseAddrToBe(hcaddr);
   }
   if (!config_.testing) {
+    // counters of new real must not include ones of the previous owner of
+    // the somark (either removed or re-pointed one). entry must exist
+    // before real is added into hc_reals_map
+    if ((hc_iter == hcReals_.end() || hc_iter->second != hcaddr) &&
+        !updateHcRealStats(ModifyAction::ADD, key)) {
+      return false;
+    }
     auto res = bpfAdapter_.bpfUpdateMap(
         bpfAdapter_.getMapFdByName("hc_reals_map"), &key, &addr);
     if (res != 0) {
@@ -1578,22 +2796,32 @@ bool KatranLb::delHealthcheckerDst(const uint32_t somark) {
   }
   VLOG(4) << folly::format("deleting healtcheck with so_mark {}", somark);
 
-  uint32_t key = somark;
+  uint32_t key;
 
   auto hc_iter = hcReals_.find(somark);
-  if (hc_iter == hcReals_.end()) {
+  if (hc_iter == hcReals_.end() || !hcSomarkToKey(somark, key)) {
     LOG(INFO) << "trying to remove non-existing healthcheck";
     return false;
   }
   if (!config_.testing) {
-    auto res = bpfAdapter_.bpfMapDeleteElement(
-        bpfAdapter_.getMapFdByName("hc_reals_map"), &key);
+    int res;
+    if (features_.hcRealsArray) {
+      // elements of array could not be deleted. zeroed entry is the one
+      // which is skipped by healthchecking bpf program
+      beaddr addr = {};
+      res = bpfAdapter_.bpfUpdateMap(
+          bpfAdapter_.getMapFdByName("hc_reals_map"), &key, &addr);
+    } else {
+      res = bpfAdapter_.bpfMapDeleteElement(
+          bpfAdapter_.getMapFdByName("hc_reals_map"), &key);
+    }
     if (res) {
       LOG(INFO) << "can't remove hc w/ somark: " << key
                 << ", error: " << folly::errnoStr(errno);
       lbStats_.bpfFailedCalls++;
       return false;
     }
+    updateHcRealStats(ModifyAction::DEL, key);
   }
   hcReals_.erase(hc_iter);
   return true;
@@ -1634,39 +2862,211 @@ bool KatranLb::updateVipMap(
   }
   vip_def.port = folly::Endian::big(vip.port);
   vip_def.proto = vip.proto;
+  if (vip.lastPort != 0) {
+    return updatePortRangeMap(action, vip, meta);
+  }
+  // update is applied to every replica even if some of them failed, so
+  // replicas diverge only by the entries which have not been updated
+  bool success = true;
+  for (auto vip_map_fd : getMapAndReplicasFds("vip_map")) {
+    if (action == ModifyAction::ADD) {
+      auto res = bpfAdapter_.bpfUpdateMap(vip_map_fd, &vip_def, meta);
+      if (res != 0) {
+        LOG(INFO) << "can't add new element into vip_map, error: "
+                  << folly::errnoStr(errno);
+        lbStats_.bpfFailedCalls++;
+        success = false;
+      }
+    } else {
+      auto res = bpfAdapter_.bpfMapDeleteElement(vip_map_fd, &vip_def);
+      if (res != 0) {
+        LOG(INFO) << "can't delete element from vip_map, error: "
+                  << folly::errnoStr(errno);
+        lbStats_.bpfFailedCalls++;
+        success = false;
+      }
+    }
+  }
+  return success;
+}
+
+bool KatranLb::updateVipAddrs(
+    const ModifyAction action,
+    const std::string& address) {
+  folly::IPAddress addr(address);
   if (action == ModifyAction::ADD) {
-    auto res = bpfAdapter_.bpfUpdateMap(
-        bpfAdapter_.getMapFdByName("vip_map"), &vip_def, meta);
-    if (res != 0) {
-      LOG(INFO) << "can't add new element into vip_map, error: "
-                << folly::errnoStr(errno);
-      lbStats_.bpfFailedCalls++;
+    if (vipAddrs_[addr]++ > 0) {
+      return true;
+    }
+  } else {
+    auto addr_iter = vipAddrs_.find(addr);
+    if (addr_iter == vipAddrs_.end() || --addr_iter->second > 0) {
+      return true;
+    }
+    vipAddrs_.erase(addr_iter);
+  }
+  if (config_.testing || !features_.vipAddrPrefilter) {
+    return true;
+  }
+  auto vip_addr = IpHelpers::parseAddrToBe(addr);
+  vip_definition vip_def = {};
+  if ((vip_addr.flags & V6DADDR) > 0) {
+    std::memcpy(vip_def.vipv6, vip_addr.v6daddr, 16);
+  } else {
+    vip_def.vip = vip_addr.daddr;
+  }
+  auto map_fd = bpfAdapter_.getMapFdByName("vip_addrs");
+  int res;
+  if (action == ModifyAction::ADD) {
+    uint32_t flags = config_.dropUnknownVipPorts ? kDropUnknownPorts : 0;
+    res = bpfAdapter_.bpfUpdateMap(map_fd, &vip_def, &flags);
+  } else {
+    res = bpfAdapter_.bpfMapDeleteElement(map_fd, &vip_def);
+  }
+  if (res != 0) {
+    LOG(INFO) << "can't update vip_addrs, error: " << folly::errnoStr(errno);
+    lbStats_.bpfFailedCalls++;
+    if (action == ModifyAction::ADD) {
+      // address is not in prefilter; next vip w/ it must try again
+      vipAddrs_.erase(addr);
+    }
+    return false;
+  }
+  return true;
+}
+
+bool KatranLb::validatePortRange(const VipKey& vip) {
+  if (!config_.testing && !features_.vipPortRanges) {
+    LOG(ERROR) << "port range vips are not supported by forwarding plane";
+    return false;
+  }
+  if (vip.port == 0 || vip.port >= vip.lastPort) {
+    LOG(ERROR) << "invalid port range: " << vip.port << "-" << vip.lastPort;
+    return false;
+  }
+  for (const auto& existing : vips_) {
+    const auto& other = existing.first;
+    if (other.lastPort != 0 && other.address == vip.address &&
+        other.proto == vip.proto && vip.port <= other.lastPort &&
+        other.port <= vip.lastPort) {
+      LOG(ERROR) << folly::format(
+          "port range {}-{} overlaps w/ existing vip's range {}-{}",
+          vip.port,
+          vip.lastPort,
+          other.port,
+          other.lastPort);
       return false;
     }
+  }
+  return true;
+}
+
+std::vector<std::pair<uint16_t, uint8_t>> KatranLb::getPortRangePrefixes(
+    uint16_t firstPort,
+    uint16_t lastPort) {
+  std::vector<std::pair<uint16_t, uint8_t>> prefixes;
+  uint32_t start = firstPort;
+  while (start <= lastPort) {
+    // largest block of ports which is aligned at start and fits the range
+    uint32_t size = 1;
+    uint32_t prefixLen = kPortBits;
+    while (prefixLen > 0 && (start & ((size << 1) - 1)) == 0 &&
+           start + (size << 1) - 1 <= lastPort) {
+      size <<= 1;
+      prefixLen--;
+    }
+    prefixes.emplace_back(start, prefixLen);
+    start += size;
+  }
+  return prefixes;
+}
+
+bool KatranLb::updatePortRangeMap(
+    const ModifyAction action,
+    const VipKey& vip,
+    vip_meta* meta) {
+  auto vip_addr = IpHelpers::parseAddrToBe(vip.address);
+  vip_port_lpm_key key = {};
+  if ((vip_addr.flags & V6DADDR) > 0) {
+    std::memcpy(key.vipv6, vip_addr.v6daddr, 16);
   } else {
-    auto res = bpfAdapter_.bpfMapDeleteElement(
-        bpfAdapter_.getMapFdByName("vip_map"), &vip_def);
+    key.vip = vip_addr.daddr;
+  }
+  key.proto = vip.proto;
+  auto map_fd = bpfAdapter_.getMapFdByName("vip_port_ranges");
+  // prefixes written so far w/ their previous values (if there were any; e.g.
+  // when flags of existing vip are changed), so failed ADD could be undone
+  struct WrittenPrefix {
+    vip_port_lpm_key key;
+    bool existed;
+    vip_meta oldMeta;
+  };
+  std::vector<WrittenPrefix> written;
+  bool success = true;
+  for (const auto& prefix : getPortRangePrefixes(vip.port, vip.lastPort)) {
+    key.prefixlen = kVipPortLpmAddrBits + prefix.second;
+    key.port = folly::Endian::big(prefix.first);
+    int res;
+    if (action == ModifyAction::ADD) {
+      WrittenPrefix prefix_state = {};
+      prefix_state.key = key;
+      prefix_state.existed = !bpfAdapter_.bpfMapLookupElement(
+          map_fd, &key, &prefix_state.oldMeta);
+      res = bpfAdapter_.bpfUpdateMap(map_fd, &key, meta);
+      if (res == 0) {
+        written.push_back(prefix_state);
+      }
+    } else {
+      // rest of the prefixes are still deleted, so vip would not be
+      // partially reachable
+      res = bpfAdapter_.bpfMapDeleteElement(map_fd, &key);
+    }
     if (res != 0) {
-      LOG(INFO) << "can't delete element from vip_map, error: "
+      LOG(INFO) << "can't update vip_port_ranges, error: "
                 << folly::errnoStr(errno);
       lbStats_.bpfFailedCalls++;
-      return false;
+      success = false;
+      if (action == ModifyAction::ADD) {
+        break;
+      }
     }
   }
-  return true;
+  if (!success && action == ModifyAction::ADD) {
+    for (auto& entry : written) {
+      int res;
+      if (entry.existed) {
+        res = bpfAdapter_.bpfUpdateMap(map_fd, &entry.key, &entry.oldMeta);
+      } else {
+        res = bpfAdapter_.bpfMapDeleteElement(map_fd, &entry.key);
+      }
+      if (res != 0) {
+        LOG(ERROR) << "can't roll back vip_port_ranges, error: "
+                   << folly::errnoStr(errno);
+        lbStats_.bpfFailedCalls++;
+      }
+    }
+  }
+  return success;
 }
 
-bool KatranLb::updateRealsMap(const folly::IPAddress& real, uint32_t num) {
+bool KatranLb::updateRealsMap(
+    const folly::IPAddress& real,
+    uint32_t num,
+    bool down) {
   auto real_addr = IpHelpers::parseAddrToBe(real);
-  auto res = bpfAdapter_.bpfUpdateMap(
-      bpfAdapter_.getMapFdByName("reals"), &num, &real_addr);
-  if (res != 0) {
-    LOG(INFO) << "can't add new real, error: " << folly::errnoStr(errno);
-    lbStats_.bpfFailedCalls++;
-    return false;
-  } else {
-    return true;
+  if (down) {
+    real_addr.flags |= kRealDown;
+  }
+  bool success = true;
+  for (auto reals_fd : getMapAndReplicasFds("reals")) {
+    auto res = bpfAdapter_.bpfUpdateMap(reals_fd, &num, &real_addr);
+    if (res != 0) {
+      LOG(INFO) << "can't add new real, error: " << folly::errnoStr(errno);
+      lbStats_.bpfFailedCalls++;
+      success = false;
+    }
   }
+  return success;
 };
 
 void KatranLb::decreaseRefCountForReal(const folly::IPAddress& real) {
@@ -21,6 +21,7 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <folly/IPAddress.h>
@@ -31,6 +32,7 @@
 #include "katran/lib/IpHelpers.h"
 #include "katran/lib/KatranLbStructs.h"
 #include "katran/lib/KatranSimulator.h"
+#include "katran/lib/StatsCounters.h"
 #include "katran/lib/Vip.h"
 
 namespace katran {
@@ -46,6 +48,10 @@ constexpr int kIpv6TunPos = 2;
 constexpr int kMainIntfPos = 3;
 constexpr int kHcIntfPos = 4;
 constexpr int kIntrospectionGkPos = 5;
+constexpr int kVerdictSamplingPos = 6;
+constexpr int kVerdictHeadersPos = 7;
+// verdicts' sampling rate N is stored as kVerdictSampleRange / N
+constexpr uint64_t kVerdictSampleRange = 1ULL << 32;
 
 /**
  * constants are from balancer_consts.h
@@ -57,6 +63,10 @@ constexpr uint32_t kIcmpTooBigOffset = 4;
 constexpr uint32_t kLpmSrcOffset = 5;
 constexpr uint32_t kInlineDecapOffset = 6;
 constexpr uint32_t kQuicRoutingOffset = 7;
+constexpr uint32_t kLruInsertOffset = 8;
+constexpr uint32_t kDownRealOffset = 9;
+// number of global counters, located after per vip stats
+constexpr uint32_t kGlobalCntrsSize = kDownRealOffset + 1;
 
 /**
  * LRU map related constants
@@ -104,6 +114,19 @@ class KatranLb {
    */
   void attachBpfProgs();
 
+  /**
+   * @param string path to new version of balancer's bpf program
+   * @return true on success
+   *
+   * helper function to upgrade forwarding plane w/o losing packets or
+   * connection table state. new program reuses all maps of the running one
+   * (load fails if their layout is not compatible) and atomically replaces
+   * it: either in root array (in shared mode) or on the interface
+   * (w/ XDP_FLAGS_REPLACE, in standalone mode). on failure old program is
+   * left attached and untouched.
+   */
+  bool upgradeBalancerProg(const std::string& path);
+
   /**
    * @param std::vector<uint8_t> newMac for default router
    * @return true on success
@@ -128,6 +151,9 @@ class KatranLb {
    *
    * helper function to add new vip. it returns false if maximum number of
    * vips has been reached.
+   * vip w/ lastPort set is matched for every port in [port, lastPort] (if
+   * there is no vip for exact port), all of the ports share one ring and
+   * stats. such vip must not overlap w/ other port range vips
    * could throw if specified address can't be parsed to v4 or v6
    */
   bool addVip(const VipKey& vip, const uint32_t flags = 0);
@@ -224,6 +250,19 @@ class KatranLb {
    */
   int64_t getIndexForReal(const std::string& real);
 
+  /**
+   * @param string address of the real
+   * @param bool down true if real must be marked as down, false to bring
+   * it back
+   * @return bool true on success
+   *
+   * marks real as down in forwarding plane w/ single write into reals map
+   * (w/o touching ch rings): flows which are found in lru or hashed to this
+   * real are moved to other reals of the vip. real still should be removed
+   * from vips' rings by the usual means later on.
+   */
+  bool setRealDown(const std::string& real, bool down);
+
   /**
    * @param ModifyAction action. either ADD or DEL
    * @param std::vector<QuicReal> reals to be modified
@@ -338,6 +377,16 @@ class KatranLb {
     return lpmSrcMapping_;
   }
 
+  /**
+   * @return const map<IPAddress, uint32_t>& of vip's address to number of vips
+   *
+   * helper function to get const reference for internal per address refcount
+   * of vips (addresses in vip_addrs prefilter).
+   */
+  const std::unordered_map<folly::IPAddress, uint32_t>& getVipAddrs() {
+    return vipAddrs_;
+  }
+
   /**
    * @return const map<uint32_t, str>& of internal index to real mapping
    *
@@ -404,6 +453,15 @@ class KatranLb {
    */
   lb_stats getQuicRoutingStats();
 
+  /**
+   * @return struct lb_stats w/ statistic of flows moved from down reals
+   *
+   * helper function which returns how many packets were moved from the reals
+   * marked as down (see setRealDown): because real was found in lru (v1)
+   * or in ch ring (v2)
+   */
+  lb_stats getDownRealStats();
+
   /**
    * @return struct lb_stats w/ src routing related statistics
    *
@@ -490,6 +548,20 @@ class KatranLb {
    */
   bool restartKatranMonitor(uint32_t limit);
 
+  /**
+   * @param uint32_t sampleRate verdict would be reported for one of
+   * sampleRate packets in average (0 - disabled)
+   * @param bool withHeaders if true: packet's headers would be reported
+   * alongside the verdict
+   * @return false if introspection is not enabled or on failure
+   *
+   * configures reporting of katran's verdicts (xdp action, drop reason, vip,
+   * real and lru hit/miss) for processed packets. requires balancer's prog
+   * built w/ KATRAN_VERDICT_INTROSPECTION. verdicts are reported only while
+   * katran monitor is running
+   */
+  bool setKatranMonitorVerdictSampling(uint32_t sampleRate, bool withHeaders);
+
   /**
    * @param int event monitoring event it. see balancer_consts.h
    * @return unique_ptr<IOBuf> on success or nullptr otherwise
@@ -517,14 +589,60 @@ class KatranLb {
    * userspace counterpart
    */
   KatranLbStats getKatranLbStats() {
-    return lbStats_;
+    KatranLbStats stats;
+    stats.bpfFailedCalls = lbStats_.bpfFailedCalls.get();
+    stats.addrValidationFailed = lbStats_.addrValidationFailed.get();
+    stats.lruFallbackAlerts = lbStats_.lruFallbackAlerts.get();
+    return stats;
   }
 
+  /**
+   * @return KatranForwardingStats all per vip and global counters
+   *
+   * helper function to read whole bpf stats map at once. uses batched map
+   * lookups (single syscall for all vips and global counters), if they are
+   * supported by the kernel, and falls back to per element lookups otherwise.
+   */
+  KatranForwardingStats getForwardingStats();
+
   /**
    * record packet level counters for relevant events in health-check program
    */
   HealthCheckProgStats getStatsForHealthCheckProgram();
 
+  /**
+   * @return unordered_map<uint32_t, HealthCheckRealStats> somark to counters
+   *
+   * helper function to get per real packet level counters of health-check
+   * program for all configured healthcheckers dsts. counters are summed
+   * over all cpus. counters of all reals are read w/ batched lookups
+   * (w/ fallback to per real lookups on kernels w/o batch ops). counters
+   * are reset when healthchecker dst is added, removed or changed
+   */
+  std::unordered_map<uint32_t, HealthCheckRealStats>
+  getHealthcheckStatsPerReal();
+
+  /**
+   * @param unordered_map<uint32_t, uint32_t> somarks hc_reals_stats_map's key
+   * to somark mapping
+   * @param vector<uint32_t> keys of hc_reals_stats_map which have been read
+   * @param vector<HealthCheckRealStats> values per cpu values for each key
+   * (nrCpus values per key)
+   * @param int nrCpus number of possible cpus
+   * @param unordered_map<uint32_t, HealthCheckRealStats> result somark to
+   * counters, which are summed over all cpus
+   *
+   * helper function which adds per cpu counters read from
+   * hc_reals_stats_map to the counters of the somark. keys w/o somark
+   * (unused entries of the array) are skipped
+   */
+  static void aggregateHcRealStats(
+      const std::unordered_map<uint32_t, uint32_t>& somarks,
+      const std::vector<uint32_t>& keys,
+      const std::vector<HealthCheckRealStats>& values,
+      int nrCpus,
+      std::unordered_map<uint32_t, HealthCheckRealStats>& result);
+
   /**
    * @param map string name of the bpf map
    * @return KatranBpfMapStats struct holding the max and current entry count
@@ -532,6 +650,90 @@ class KatranLb {
    */
   KatranBpfMapStats getBpfMapStats(const std::string& map);
 
+  /**
+   * @return vector<BpfProgLoadStats> load time statistics of loaded bpf
+   * programs: load and verification time, number of instructions processed
+   * by verifier and sizes of the programs. verifier's counters are
+   * collected only if config's verifierStats is set
+   */
+  std::vector<BpfProgLoadStats> getBpfProgLoadStats() {
+    return bpfAdapter_.getProgsLoadStats();
+  }
+
+  /**
+   * @param bool exact if true - count actual entries of each lru (O(N), but
+   * w/ batched reads); otherwise estimate them from per cpu counter of
+   * inserts, maintained by forwarding plane (O(1))
+   * @return vector<KatranLruFillStats> fill level of each forwarding core's
+   * lru. empty if forwarding cores are not specified
+   */
+  std::vector<KatranLruFillStats> getLruFillStats(bool exact = false);
+
+  /**
+   * @return int number of forwarding cores which have been added; -1 on error
+   *
+   * helper function to re-discover forwarding cores from irq affinity of
+   * mainInterface (e.g. after NIC reconfiguration or irq rebalancing) and to
+   * create and attach LRUs for new ones. LRUs of cores which are not handling
+   * irqs anymore are kept, so flows are not lost if irqs come back.
+   * it also checks fallback LRU's counter: if any packet has been processed
+   * on a core w/o LRU since the last call - it is logged and counted in
+   * lruFallbackAlerts. supposed to be called periodically
+   */
+  int refreshForwardingCores();
+
+  /**
+   * @return int number of LRUs which have been resized; -1 on error
+   *
+   * helper function to split LRU memory (config's LruSize) between
+   * forwarding cores proportionally to the number of new flows (LRU inserts)
+   * seen by each core since the previous call. LRU is resized by creating
+   * the new one, seeding it w/ the flows from the old one and swapping it in
+   * lru_maps_mapping; flows which are added to the old LRU while it is
+   * being copied are lost. requires kernel which allows inner maps of
+   * different sizes (5.10+), noop on older ones. supposed to be called
+   * periodically
+   */
+  int rebalanceLrus();
+
+  /**
+   * @return bool true if numa replicas of read mostly maps (vip_map, ch_rings
+   * and reals) are in sync w/ the main maps (or if there are no replicas)
+   *
+   * helper function to validate that every update has been applied to all
+   * numa replicas (e.g. after failed update). it compares entries of
+   * configured vips and reals one by one, so it is supposed to be used for
+   * testing and debugging only
+   */
+  bool validateNumaReplicas();
+
+  /**
+   * @param KatranConnTableFilter filter of flows to dump
+   * @param KatranConnTableCallback callback which is called for each flow,
+   * which matches the filter. if it returns false - dump is stopped
+   * @return uint64_t number of dumped flows
+   *
+   * helper function to dump content of connection table (all per core lrus
+   * plus fallback lru). lrus are read in large batches, so full dump of
+   * multi million entries table takes seconds. as forwarding plane keeps
+   * updating lrus - dump is not an atomic snapshot
+   */
+  uint64_t dumpConnectionTable(
+      const KatranConnTableFilter& filter,
+      const KatranConnTableCallback& callback);
+
+  /**
+   * @param vector<KatranConnEntry> entries flows to import (e.g. from peer)
+   * @return uint64_t number of imported flows
+   *
+   * helper function to add flows into connection table. reals are matched
+   * by address, flows to unknown vips or reals are skipped. flow is added
+   * into lru of the core, which has exported it (peers are expected to
+   * have the same NIC's RSS setup), or into fallback lru if there is no
+   * such forwarding core. in testing mode flows are only validated
+   */
+  uint64_t importConnectionTable(const std::vector<KatranConnEntry>& entries);
+
   /**
    * @param KatranFlow 5 tuple which describes a flow
    * @return string address of the real.
@@ -561,6 +763,19 @@ class KatranLb {
     return monitor_;
   }
 
+  /**
+   * @param uint16_t firstPort first port of the range
+   * @param uint16_t lastPort last port of the range
+   * @return vector<pair<uint16_t, uint8_t>> first port and length of each
+   * prefix
+   *
+   * helper function which splits range of ports into minimal set of
+   * prefixes, which are used as keys of vip_port_ranges map
+   */
+  static std::vector<std::pair<uint16_t, uint8_t>> getPortRangePrefixes(
+      uint16_t firstPort,
+      uint16_t lastPort);
+
  private:
   /**
    * update vipmap(add or remove vip) in forwarding plane
@@ -571,9 +786,35 @@ class KatranLb {
       vip_meta* meta = nullptr);
 
   /**
-   * update(add or remove) reals map in forwarding plane
+   * update(add or remove) vip's address in vip_addrs prefilter. address is
+   * removed from forwarding plane only when there is no more vips w/ it
+   */
+  bool updateVipAddrs(const ModifyAction action, const std::string& address);
+
+  /**
+   * update(add or remove) all prefixes of port range vip in vip_port_ranges.
+   * failed add restores prefixes which have been already written; remove
+   * deletes as many prefixes as possible and fails if any of em failed
+   */
+  bool updatePortRangeMap(
+      const ModifyAction action,
+      const VipKey& vip,
+      vip_meta* meta = nullptr);
+
+  /**
+   * @return bool true if port range of the vip is valid and does not overlap
+   * w/ port ranges of already existing vips
+   */
+  bool validatePortRange(const VipKey& vip);
+
+  /**
+   * update(add or remove) reals map in forwarding plane. down - real must be
+   * marked as down (see setRealDown)
    */
-  bool updateRealsMap(const folly::IPAddress& real, uint32_t num);
+  bool updateRealsMap(
+      const folly::IPAddress& real,
+      uint32_t num,
+      bool down = false);
 
   /**
    * helper function to get stats from counter on specified possition
@@ -599,6 +840,29 @@ class KatranLb {
    */
   void initialSanityChecking();
 
+  /**
+   * helper function to size forwarding and healthchecking maps according to
+   * KatranConfig. must be called before bpf programs are loaded.
+   * throws on failure
+   */
+  void setMapsSizes();
+
+  /**
+   * helper function to pass limits, w/ which maps have been sized, to the
+   * forwarding plane. throws on failure
+   */
+  void setupLbLimits();
+
+  /**
+   * helper function to dump single lru map w/ specified fd.
+   * returns false if dump must be stopped (error or callback's request)
+   */
+  bool dumpLruMap(
+      int mapFd,
+      int32_t core,
+      const std::function<bool(const flow_key&, const real_pos_lru&)>&
+          processEntry);
+
   /**
    * helper function to create/initialize LRUs.
    * we must init LRUs before we are going to load bpf program.
@@ -613,6 +877,61 @@ class KatranLb {
    */
   void attachLrus();
 
+  /**
+   * helper function to create per numa node replicas of read mostly maps and
+   * to set em as prototypes of map-in-maps. must be done before we are going
+   * to load bpf program
+   */
+  void initNumaReplicas();
+
+  /**
+   * helper function to put numa replicas into map-in-maps and to point each
+   * forwarding core to the replica from it's numa node
+   */
+  void attachNumaReplicas();
+
+  /**
+   * helper function to get numa node of forwarding core on specified position
+   */
+  int32_t getForwardingCoreNumaNode(size_t pos);
+
+  /**
+   * @param string name of the map (vip_map, ch_rings or reals)
+   * @return vector<int> fds of the map and all of it's numa replicas
+   *
+   * every update of such map must be applied to all returned fds
+   */
+  std::vector<int> getMapAndReplicasFds(const std::string& name);
+
+  /**
+   * helper function to create LRU for forwarding core. it also rebases
+   * core's LRU inserts counter (see lruInsertsBase_)
+   */
+  int createLruForCore(int32_t core, int32_t numaNode, uint64_t size);
+
+  /**
+   * @param int32_t core forwarding core
+   * @return uint64_t current value of core's LRU inserts counter. 0 if bpf
+   * progs are not loaded or counter could not be read
+   */
+  uint64_t getLruInsertsForCore(int32_t core);
+
+  /**
+   * helper function to replace LRU of the core w/ the new one of specified
+   * size. new LRU is seeded w/ the flows from the old one
+   */
+  bool resizeLru(int32_t core, uint64_t size);
+
+  /**
+   * helper function to add flows into LRU map w/ batched update (or one by
+   * one, if kernel does not support batch ops). returns number of flows
+   * which have been added
+   */
+  uint64_t bulkUpdateLru(
+      int mapFd,
+      std::vector<flow_key>& keys,
+      std::vector<real_pos_lru>& values);
+
   /**
    * helper function to enable everything related to introspection/events
    * reporting. it will set up perf pipe and all routines to read from them
@@ -624,7 +943,7 @@ class KatranLb {
    * returns fd on success, -1 on failure.
    */
   int createLruMap(
-      int size = kFallbackLruSize,
+      uint64_t size = kFallbackLruSize,
       int flags = kMapNoFlags,
       int numaNode = kNoNuma);
 
@@ -633,6 +952,12 @@ class KatranLb {
    */
   void featureDiscovering();
 
+  /**
+   * helper function to check if kernel allows inner maps of LRU's map-in-map
+   * to differ in size from the prototype (which is required to resize LRUs)
+   */
+  bool isLruResizeSupported();
+
   /**
    * helper function to validate that specified string is a valid ip address
    * (or network prefix if allowNetAddr is equal to true)
@@ -687,6 +1012,29 @@ class KatranLb {
    */
   void setupHcEnvironment();
 
+  /**
+   * @param uint32_t somark of the healthcheck
+   * @param uint32_t& key where key for hc_reals_map would be written
+   * @return true if somark could be stored in hc_reals_map
+   *
+   * helper function to translate somark into hc_reals_map's key (offset from
+   * configured somark's base). for array based hc_reals_map also checks
+   * that somark is inside [base, base + maxReals)
+   */
+  bool hcSomarkToKey(const uint32_t somark, uint32_t& key);
+
+  /**
+   * creates (ADD) or removes (DEL) zeroed per real counters of healthcheck
+   * w/ specified hc_reals_map's key. for array based map entry is zeroed
+   * in both cases
+   */
+  bool updateHcRealStats(const ModifyAction action, const uint32_t key);
+
+  /**
+   * helper function to write hcCtrlData_ into hc_ctrl_data_map
+   */
+  bool updateHcCtrlData();
+
   /**
    * enableRecirculation enables katran to use recirculation technics, where
    * some codepaths inside xdp forwarding plane, after packets monipulation,
@@ -718,11 +1066,21 @@ class KatranLb {
   std::deque<uint32_t> vipNums_;
   std::deque<uint32_t> realNums_;
 
+  /**
+   * number of vips for each vip's address (for vip_addrs prefilter)
+   */
+  std::unordered_map<folly::IPAddress, uint32_t> vipAddrs_;
+
   /**
    * vector of control elements (such as default's mac; ifindexes etc)
    */
   std::vector<ctl_value> ctlValues_;
 
+  /**
+   * ifindex, macs and somark's base for healthchecking bpf program
+   */
+  struct hc_ctrl_data hcCtrlData_ = {};
+
   /**
    * dict of so_mark to real mapping; for healthchecking
    */
@@ -791,9 +1149,55 @@ class KatranLb {
   std::vector<int> lruMapsFd_;
 
   /**
-   * userspace library stats
+   * size of each per core LRU on startup. LRUs of cores, which are added at
+   * runtime, have the same size
+   */
+  uint64_t perCoreLruSize_{0};
+
+  /**
+   * vector of LRU maps sizes (could differ from perCoreLruSize_ after
+   * rebalanceLrus)
+   */
+  std::vector<uint64_t> lruMapsSize_;
+
+  /**
+   * per core value of LRU inserts counter on last rebalanceLrus() call
+   */
+  std::vector<uint64_t> lastLruInserts_;
+
+  /**
+   * per core value of LRU inserts counter when core's current LRU has been
+   * created (on startup, when core has been added or LRU has been resized).
+   * fill estimate of the LRU counts only inserts after it
+   */
+  std::vector<uint64_t> lruInsertsBase_;
+
+  /**
+   * numa nodes which have replicas of read mostly maps. replica of node on
+   * position i is stored in slot i + 1 of map-in-maps
+   */
+  std::vector<int32_t> replicaNodes_;
+
+  /**
+   * dict of map name to fds of it's replicas (in replicaNodes_ order)
+   */
+  std::unordered_map<std::string, std::vector<int>> numaReplicasFds_;
+
+  /**
+   * value of fallback LRU's counter on last refreshForwardingCores() call
+   */
+  uint64_t lastLruFallbackHits_{0};
+
+  /**
+   * userspace library counters. lock free and registered in StatsRegistry;
+   * KatranLbStats is a snapshot of em
    */
-  KatranLbStats lbStats_;
+  struct LbCounters {
+    StatsCounter bpfFailedCalls{"katran.bpf_failed_calls"};
+    StatsCounter addrValidationFailed{"katran.addr_validation_failed"};
+    StatsCounter lruFallbackAlerts{"katran.lru_fallback_alerts"};
+  };
+  LbCounters lbStats_;
 };
 
 } // namespace katran
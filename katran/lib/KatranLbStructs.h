@@ -19,8 +19,11 @@
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "katran/lib/BalancerStructs.h"
+
 namespace katran {
 
 namespace {
@@ -38,6 +41,7 @@ constexpr uint32_t kDefaultMonitorSnapLen = 128;
 constexpr uint32_t kDefaultMonitorMaxEvents = 4;
 constexpr unsigned int kDefaultLruSize = 8000000;
 constexpr uint32_t kNoFlags = 0;
+constexpr uint32_t kDefaultHcSomarkBase = 0;
 std::string kNoExternalMap = "";
 std::string kDefaultHcInterface = "";
 std::string kAddressNotSpecified = "";
@@ -58,6 +62,11 @@ struct RealMeta {
    * only when refcount would be equal to zero
    */
   uint32_t refCount;
+
+  /**
+   * real has been marked as down (see KatranLb::setRealDown)
+   */
+  bool down{false};
 };
 
 /**
@@ -103,6 +112,9 @@ enum class PcapStorageFormat {
  * @param uint32_t snapLen maximum number of bytes from packet to write.
  * @param uint32_t maxEvents maximum supported events/pcap writers
  * @param std::string path where pcap outputs are going to be stored
+ * @param bool pcapng write pcapng instead of pcap (verdicts reported by
+ * -DKATRAN_VERDICT_INTROSPECTION are written as packets' comments)
+ * @param bool logVerdicts log each received verdict
  *
  * katran monitoring config. being used if katran's bpf code was build w/
  * introspection enabled (-DKATRAN_INTROSPECTION)
@@ -118,6 +130,8 @@ struct KatranMonitorConfig {
   std::string path{"/tmp/katran_pcap"};
   PcapStorageFormat storage{PcapStorageFormat::FILE};
   uint32_t bufferSize{0};
+  bool pcapng{false};
+  bool logVerdicts{false};
 };
 
 /**
@@ -136,6 +150,9 @@ struct KatranMonitorConfig {
  * @param uint32_t maxVips maximum allowed vips to configure
  * @param uint32_t maxReals maximum allowed reals to configure
  * @param uint32_t chRingSize size of ch ring for each real
+ * (maxVips, maxReals, chRingSize, maxLpmSrcSize and maxDecapDst are used to
+ * size bpf maps at load time; they do not need to match compile time
+ * constants in balancer_consts.h)
  * @param bool testing flag, if true - don't program forwarding
  * @param uint64_t LruSize size of connection table
  * @param std::vector<int32_t> forwardingCores responsible for forwarding
@@ -148,6 +165,21 @@ struct KatranMonitorConfig {
  * @param katranSrcV4 string ipv4 source address for GUE packets
  * @param katranSrcV6 string ipv6 source address for GUE packets
  * @param std::vector<uint8_t> localMac mac address of local server
+ * @param uint32_t hcSomarkBase first somark of healthchecks. hc_reals_map is
+ * keyed by (somark - hcSomarkBase); if bpf prog has been built w/
+ * -DHC_REALS_ARRAY somarks must be in [hcSomarkBase, hcSomarkBase + maxReals)
+ * @param bool discoverForwardingCores if true and forwardingCores is empty -
+ * forwarding cores are discovered from irq affinity of mainInterface. if
+ * numaNodes is not empty - numa node of each discovered core is read from
+ * sysfs
+ * @param bool numaReplicas create replicas of vip_map, ch_rings and reals on
+ * each numa node of forwarding cores. must be set if bpf prog has been built
+ * w/ -DNUMA_REPLICAS
+ * @param bool verifierStats collect verifier's statistics (verification time,
+ * processed insns) while loading bpf programs. requires kernel 5.2+
+ * @param bool dropUnknownVipPorts drop (instead of passing to the kernel)
+ * packets to vip's address on ports w/o configured vip. bpf prog must be
+ * built w/ -DVIP_ADDR_PREFILTER
  *
  * note about rootMapPath and rootMapPos:
  * katran has two modes of operation.
@@ -195,6 +227,11 @@ struct KatranConfig {
   std::string katranSrcV4 = kAddressNotSpecified;
   std::string katranSrcV6 = kAddressNotSpecified;
   std::vector<uint8_t> localMac;
+  uint32_t hcSomarkBase = kDefaultHcSomarkBase;
+  bool discoverForwardingCores = false;
+  bool numaReplicas = false;
+  bool verifierStats = false;
+  bool dropUnknownVipPorts = false;
 };
 
 /**
@@ -224,6 +261,8 @@ struct KatranBpfMapStats {
 /**
  * @param uint64_t bpfFailedCalls number of failed syscalls
  * @param uint64_t addrValidationFailed times provided ipaddress was invalid
+ * @param uint64_t lruFallbackAlerts times packets have been seen on cores
+ * w/o LRU (checked by refreshForwardingCores)
  *
  * generic userspace related stats to track internals of katran library
  * such as number of failed bpf syscalls (could happens if we are trying to add
@@ -232,6 +271,7 @@ struct KatranBpfMapStats {
 struct KatranLbStats {
   uint64_t bpfFailedCalls{0};
   uint64_t addrValidationFailed{0};
+  uint64_t lruFallbackAlerts{0};
 };
 
 /**
@@ -252,6 +292,26 @@ struct HealthCheckProgStats {
   uint64_t packetsTooBig{0};
 };
 
+/**
+ * @param uint64_t packetsEncaped number of healthchecks encapsulated toward
+ * the real
+ * @param uint64_t bytesEncaped bytes of encapsulated healthchecks (before
+ * encapsulation)
+ * @param uint64_t packetsDropped number of healthchecks for the real which
+ * has been dropped by the healthchecking prog
+ * @param uint64_t bytesDropped bytes of dropped healthchecks
+ *
+ * per real (somark) packet level counters of health-check program
+ * NOTE: this must be kept in sync with 'hc_real_stats' in
+ * healthchecking_structs.h
+ */
+struct HealthCheckRealStats {
+  uint64_t packetsEncaped{0};
+  uint64_t bytesEncaped{0};
+  uint64_t packetsDropped{0};
+  uint64_t bytesDropped{0};
+};
+
 /**
  * @param srcRouting flag which indicates that source based routing feature has
  * been enabled/compiled in bpf forwarding plane
@@ -262,6 +322,16 @@ struct HealthCheckProgStats {
  * @param gueEncap flag which indicates that GUE instead of IPIP should be used
  * @param directHealthchecking flag which inidcates that hc encapsulation would
  * be directly created instead of using tunnel interfaces
+ * @param hcRealsArray flag which indicates that hc_reals_map is an array
+ * indexed by somark's offset from the base instead of a hash
+ * @param numaReplicas flag which indicates that forwarding plane reads
+ * read mostly maps from per numa node replicas
+ * @param vipAddrPrefilter flag which indicates that packets to non vip
+ * addresses are filtered before the vip lookup
+ * @param vipPortRanges flag which indicates that vips could be defined over
+ * port ranges
+ * @param lruResize flag which indicates that kernel allows to replace LRU of
+ * the forwarding core w/ the one of different size (kernel 5.10+)
  */
 struct KatranFeatures {
   bool srcRouting{false};
@@ -269,10 +339,16 @@ struct KatranFeatures {
   bool introspection{false};
   bool gueEncap{false};
   bool directHealthchecking{false};
+  bool hcRealsArray{false};
+  bool numaReplicas{false};
+  bool vipAddrPrefilter{false};
+  bool vipPortRanges{false};
+  bool lruResize{false};
 };
 
 /**
- * class which identifies vip
+ * class which identifies vip. if lastPort is not 0: vip is defined over
+ * the range of ports [port, lastPort]
  */
 
 class VipKey {
@@ -280,20 +356,122 @@ class VipKey {
   std::string address;
   uint16_t port;
   uint8_t proto;
+  uint16_t lastPort{0};
 
   bool operator==(const VipKey& other) const {
     return (
-        address == other.address && port == other.port && proto == other.proto);
+        address == other.address && port == other.port &&
+        proto == other.proto && lastPort == other.lastPort);
   };
 };
 
 struct VipKeyHasher {
   std::size_t operator()(const VipKey& k) const {
-    return ((std::hash<std::string>()(k.address) ^
-             (std::hash<uint16_t>()(k.port) << 1)) >>
+    return ((((std::hash<std::string>()(k.address) ^
+               (std::hash<uint16_t>()(k.port) << 1)) >>
+              1) ^
+             (std::hash<uint8_t>()(k.proto) << 1)) >>
             1) ^
-        (std::hash<uint8_t>()(k.proto) << 1);
+        (std::hash<uint16_t>()(k.lastPort) << 1);
   };
 };
 
+/**
+ * @param vector<pair<VipKey, lb_stats>> vips packets (v1) and bytes (v2) per vip
+ * @param lb_stats lru total packets (v1) and lru misses (v2)
+ * @param lb_stats lruMiss lru misses because of tcp syns (v1) or non syns (v2)
+ * @param lb_stats lruFallback fallback lru hits (v1)
+ * @param lb_stats icmpTooBig generated icmp (v1) and icmpv6 (v2) too big
+ * @param lb_stats srcRouting packets to local (v1) and remote (v2) backends
+ * @param lb_stats inlineDecap inline decapsulated packets (v1)
+ * @param lb_stats quicRouting quic packets routed by ch (v1) and conn-id (v2)
+ * @param lb_stats lruInserts new entries added to lrus (v1)
+ * @param lb_stats downReals flows moved from down reals found in lru (v1)
+ * or in ch ring (v2)
+ *
+ * all counters of forwarding plane, which are stored in bpf stats map.
+ * summed over all cpus.
+ */
+struct KatranForwardingStats {
+  std::vector<std::pair<VipKey, lb_stats>> vips;
+  lb_stats lru{};
+  lb_stats lruMiss{};
+  lb_stats lruFallback{};
+  lb_stats icmpTooBig{};
+  lb_stats srcRouting{};
+  lb_stats inlineDecap{};
+  lb_stats quicRouting{};
+  lb_stats lruInserts{};
+  lb_stats downReals{};
+};
+
+/**
+ * @param int32_t core forwarding core, which owns the lru
+ * @param uint32_t maxEntries size of the core's lru
+ * @param uint64_t inserts new entries, added to the lru by forwarding plane
+ * since the lru has been created (or resized)
+ * @param uint32_t entries number of entries in the lru. either estimate
+ * (min(inserts, maxEntries)) or, if exact count has been requested, actual
+ * number of entries. estimate is insert only: forwarding plane never deletes
+ * entries from the lru and kernel evicts them only when the lru is full, so
+ * there are no deletes to account for. entries added from userspace (e.g.
+ * imported connection table or flows copied on resize) are not included into
+ * the estimate
+ *
+ * fill level of per core connection table (lru)
+ */
+struct KatranLruFillStats {
+  int32_t core;
+  uint32_t maxEntries;
+  uint64_t inserts;
+  uint32_t entries;
+};
+
+/**
+ * @param string vip if not empty - only flows to this vip address
+ * @param uint16_t vipPort if not 0 - only flows to this destination port
+ * @param uint8_t proto if not 0 - only flows w/ this protocol
+ * @param string real if not empty - only flows pinned to this real
+ * @param string srcPrefix if not empty - only flows from this prefix
+ * (e.g. "10.0.0.0/8" or single address)
+ *
+ * filter for connection table's dump
+ */
+struct KatranConnTableFilter {
+  std::string vip;
+  uint16_t vipPort{0};
+  uint8_t proto{0};
+  std::string real;
+  std::string srcPrefix;
+};
+
+/**
+ * @param string src source address of the flow
+ * @param string dst destination (vip) address of the flow
+ * @param uint16_t srcPort source port (0 for vips which ignore src port)
+ * @param uint16_t dstPort destination port (0 for vips w/o port)
+ * @param uint8_t proto protocol of the flow
+ * @param string real address of the real where flow is pinned to
+ * @param int32_t core forwarding core, which lru contains the flow
+ * (-1 for fallback lru)
+ * @param uint64_t atime last access time (ns, monotonic); only for udp
+ *
+ * single entry of connection table (lru)
+ */
+struct KatranConnEntry {
+  std::string src;
+  std::string dst;
+  uint16_t srcPort;
+  uint16_t dstPort;
+  uint8_t proto;
+  std::string real;
+  int32_t core;
+  uint64_t atime;
+};
+
+/**
+ * callback for connection table's dump. returning false stops the dump
+ */
+using KatranConnTableCallback = std::function<bool(const KatranConnEntry&)>;
+
 } // namespace katran
@@ -0,0 +1,192 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "katran/lib/KatranMetrics.h"
+
+#include <string>
+
+#include <glog/logging.h>
+
+namespace katran {
+
+namespace {
+void addMapMetrics(
+    KatranLb& lb,
+    MetricsBuilder& builder,
+    const std::string& map) {
+  try {
+    auto mapStats = lb.getBpfMapStats(map);
+    MetricLabels labels = {{"map", map}};
+    builder.add(
+        "katran_bpf_map_entries",
+        mapStats.currentEntries,
+        labels,
+        MetricType::GAUGE);
+    builder.add(
+        "katran_bpf_map_max_entries",
+        mapStats.maxEntries,
+        labels,
+        MetricType::GAUGE);
+  } catch (const std::exception& e) {
+    VLOG(4) << "can't collect stats for map " << map << ": " << e.what();
+  }
+}
+
+void addProgMetrics(
+    MetricsBuilder& builder,
+    int progFd,
+    const std::string& progName) {
+  if (progFd < 0) {
+    return;
+  }
+  ::bpf_prog_info info = {};
+  if (BpfAdapter::getBpfProgInfo(progFd, info)) {
+    VLOG(2) << "can't get info for bpf prog " << progName;
+    return;
+  }
+  MetricLabels labels = {{"prog", progName}};
+  builder.add(
+      "katran_bpf_prog_run_time_ns",
+      info.run_time_ns,
+      labels,
+      MetricType::COUNTER,
+      "total run time of bpf program (requires kernel.bpf_stats_enabled)");
+  builder.add(
+      "katran_bpf_prog_run_count",
+      info.run_cnt,
+      labels,
+      MetricType::COUNTER,
+      "number of bpf program runs (requires kernel.bpf_stats_enabled)");
+}
+
+void addProgLoadMetrics(KatranLb& lb, MetricsBuilder& builder) {
+  for (const auto& stats : lb.getBpfProgLoadStats()) {
+    MetricLabels labels = {{"prog", stats.name}};
+    builder.add(
+        "katran_bpf_prog_load_time_us",
+        stats.objectLoadTimeUs,
+        labels,
+        MetricType::GAUGE,
+        "time spent in loading of bpf object w/ this program");
+    builder.add(
+        "katran_bpf_prog_verification_time_us",
+        stats.verificationTimeUs,
+        labels,
+        MetricType::GAUGE);
+    builder.add(
+        "katran_bpf_prog_processed_insns",
+        stats.processedInsns,
+        labels,
+        MetricType::GAUGE,
+        "number of instructions processed by verifier");
+    builder.add(
+        "katran_bpf_prog_xlated_size",
+        stats.xlatedSize,
+        labels,
+        MetricType::GAUGE);
+    builder.add(
+        "katran_bpf_prog_jited_size",
+        stats.jitedSize,
+        labels,
+        MetricType::GAUGE);
+  }
+}
+} // namespace
+
+void collectKatranLbMetrics(
+    KatranLb& lb,
+    MetricsBuilder& builder,
+    bool forwarding,
+    bool healthchecking) {
+  auto progFd = forwarding ? lb.getKatranProgFd() : -1;
+  if (progFd >= 0) {
+    auto stats = lb.getForwardingStats();
+    for (const auto& vip : stats.vips) {
+      MetricLabels labels = {
+          {"vip", vip.first.address},
+          {"port", std::to_string(vip.first.port)},
+          {"proto", std::to_string(vip.first.proto)},
+      };
+      builder.add(
+          "katran_vip_packets", vip.second.v1, labels, MetricType::COUNTER,
+          "packets sent to vip");
+      builder.add(
+          "katran_vip_bytes", vip.second.v2, labels, MetricType::COUNTER,
+          "bytes sent to vip");
+    }
+    builder.add("katran_lru_packets", stats.lru.v1);
+    builder.add("katran_lru_misses", stats.lru.v2);
+    builder.add("katran_lru_tcp_misses", stats.lruMiss.v1, {{"type", "syn"}});
+    builder.add(
+        "katran_lru_tcp_misses", stats.lruMiss.v2, {{"type", "non_syn"}});
+    builder.add("katran_lru_fallback_hits", stats.lruFallback.v1);
+    builder.add("katran_icmp_toobig", stats.icmpTooBig.v1, {{"family", "v4"}});
+    builder.add("katran_icmp_toobig", stats.icmpTooBig.v2, {{"family", "v6"}});
+    builder.add(
+        "katran_src_routing_packets", stats.srcRouting.v1, {{"dst", "local"}});
+    builder.add(
+        "katran_src_routing_packets", stats.srcRouting.v2, {{"dst", "remote"}});
+    builder.add("katran_inline_decap_packets", stats.inlineDecap.v1);
+    builder.add(
+        "katran_quic_routing_packets", stats.quicRouting.v1, {{"by", "ch"}});
+    builder.add(
+        "katran_quic_routing_packets",
+        stats.quicRouting.v2,
+        {{"by", "conn_id"}});
+    builder.add(
+        "katran_down_real_moved_packets", stats.downReals.v1, {{"by", "lru"}});
+    builder.add(
+        "katran_down_real_moved_packets", stats.downReals.v2, {{"by", "ch"}});
+    addProgMetrics(builder, progFd, "xdp-balancer");
+    builder.add("katran_lru_inserts", stats.lruInserts.v1);
+    // walking lru maps is too expensive; exporting O(1) estimates instead
+    for (const auto& fill : lb.getLruFillStats()) {
+      MetricLabels labels = {{"core", std::to_string(fill.core)}};
+      builder.add(
+          "katran_lru_entries",
+          fill.entries,
+          labels,
+          MetricType::GAUGE,
+          "estimated number of entries in per core lru");
+      builder.add(
+          "katran_lru_max_entries", fill.maxEntries, labels, MetricType::GAUGE);
+    }
+    addMapMetrics(lb, builder, "vip_map");
+
+    auto monitorStats = lb.getKatranMonitorStats();
+    builder.add(
+        "katran_monitor_limit", monitorStats.limit, {}, MetricType::GAUGE);
+    builder.add(
+        "katran_monitor_packets", monitorStats.amount, {}, MetricType::GAUGE);
+  }
+
+  if (forwarding || healthchecking) {
+    addProgLoadMetrics(lb, builder);
+  }
+
+  auto hcProgFd = healthchecking ? lb.getHealthcheckerProgFd() : -1;
+  if (hcProgFd >= 0) {
+    auto hcStats = lb.getStatsForHealthCheckProgram();
+    builder.add("katran_hc_packets_processed", hcStats.packetsProcessed);
+    builder.add("katran_hc_packets_dropped", hcStats.packetsDropped);
+    builder.add("katran_hc_packets_skipped", hcStats.packetsSkipped);
+    builder.add("katran_hc_packets_too_big", hcStats.packetsTooBig);
+    addProgMetrics(builder, hcProgFd, "cls-hc");
+    addMapMetrics(lb, builder, "hc_reals_map");
+  }
+}
+
+} // namespace katran
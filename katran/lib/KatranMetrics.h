@@ -0,0 +1,45 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include "katran/lib/KatranLb.h"
+#include "katran/lib/MetricsExporter.h"
+
+namespace katran {
+
+/**
+ * @param KatranLb& lb to collect metrics from
+ * @param MetricsBuilder& builder where metrics would be added
+ * @param bool forwarding should forwarding plane's metrics be collected
+ * @param bool healthchecking should healthchecking prog's metrics be collected
+ *
+ * helper function to export katran's counters as prometheus metrics:
+ * per vip and global forwarding plane stats (read w/ single batched lookup),
+ * healthchecking prog stats, introspection stats, occupancy of small maps and
+ * run time of loaded bpf programs (run time is only accounted by the kernel
+ * if kernel.bpf_stats_enabled sysctl is set).
+ * userspace counters are exported by MetricsExporter itself (from
+ * StatsRegistry). KatranLb is not thread safe; caller must serialize this
+ * call w/ all other calls to lb.
+ */
+void collectKatranLbMetrics(
+    KatranLb& lb,
+    MetricsBuilder& builder,
+    bool forwarding = true,
+    bool healthchecking = true);
+
+} // namespace katran
@@ -29,6 +29,7 @@ namespace katran {
 
 namespace {
 constexpr uint32_t kNoSample = 1;
+constexpr char kPcapngInterface[] = "katran";
 }
 
 KatranMonitor::KatranMonitor(const KatranMonitorConfig& config)
@@ -38,8 +39,8 @@ KatranMonitor::KatranMonitor(const KatranMonitorConfig& config)
     config_.queueSize);
   auto evb = scopedEvb_->getEventBase();
   for (int cpu = 0; cpu < config_.nCpus; cpu++) {
-    auto reader =
-        std::make_unique<KatranEventReader>(config_.pages, cpu, queue_);
+    auto reader = std::make_unique<KatranEventReader>(
+        config_.pages, cpu, queue_, config_.logVerdicts);
     if (!reader->open(config_.mapFd, evb, kNoSample)) {
       LOG(ERROR) << "Perf event queue init failed for cpu: " << cpu;
     } else {
@@ -66,6 +67,10 @@ std::vector<std::shared_ptr<DataWriter>> data_writers;
 
   writer_ = std::make_shared<PcapWriter>(
       data_writers, config_.pcktLimit, config_.snapLen);
+  if (config_.pcapng) {
+    // verdicts of the packets are written as comments of pcapng's records
+    writer_->enablePcapng({kPcapngInterface});
+  }
   writerThread_ = std::thread([this](){writer_->runMulti(queue_);});
 }
 
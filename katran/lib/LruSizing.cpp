@@ -0,0 +1,92 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "katran/lib/LruSizing.h"
+
+#include <cstddef>
+
+namespace katran {
+
+namespace {
+// splits budget between cores proportionally to the inserts; each core gets
+// at least minSize. budget must be >= minSize * number of cores
+void splitBudget(
+    const std::vector<LruCoreLoad>& load,
+    const std::vector<bool>& selected,
+    uint64_t budget,
+    uint64_t minSize,
+    std::vector<uint64_t>& sizes) {
+  uint64_t total_inserts = 0;
+  uint64_t count = 0;
+  for (size_t i = 0; i < load.size(); i++) {
+    if (selected[i]) {
+      total_inserts += load[i].inserts;
+      count++;
+    }
+  }
+  auto available = budget - minSize * count;
+  for (size_t i = 0; i < load.size(); i++) {
+    if (!selected[i]) {
+      continue;
+    }
+    // w/ double, as available * inserts could overflow uint64_t
+    auto share = total_inserts == 0
+        ? 1.0 / count
+        : static_cast<double>(load[i].inserts) / total_inserts;
+    sizes[i] = minSize + static_cast<uint64_t>(available * share);
+  }
+}
+} // namespace
+
+std::vector<uint64_t> LruSizing::computeLruSizes(
+    const std::vector<LruCoreLoad>& load,
+    uint64_t budget,
+    uint64_t minSize,
+    double threshold) {
+  std::vector<uint64_t> sizes;
+  uint64_t total_inserts = 0;
+  for (const auto& core : load) {
+    sizes.push_back(core.currentSize);
+    total_inserts += core.inserts;
+  }
+  if (total_inserts == 0 || budget < minSize * load.size()) {
+    return sizes;
+  }
+
+  std::vector<bool> selected(load.size(), true);
+  std::vector<uint64_t> ideal(load.size());
+  splitBudget(load, selected, budget, minSize, ideal);
+
+  uint64_t unchanged_size = 0;
+  uint64_t changed = 0;
+  for (size_t i = 0; i < load.size(); i++) {
+    auto current = load[i].currentSize;
+    auto diff = ideal[i] > current ? ideal[i] - current : current - ideal[i];
+    selected[i] = diff > threshold * current;
+    if (selected[i]) {
+      changed++;
+    } else {
+      unchanged_size += current;
+    }
+  }
+  if (changed == 0 || unchanged_size + minSize * changed > budget) {
+    return sizes;
+  }
+  splitBudget(load, selected, budget - unchanged_size, minSize, sizes);
+  return sizes;
+}
+
+} // namespace katran
@@ -0,0 +1,62 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace katran {
+
+/**
+ * @param uint64_t currentSize current max entries of core's LRU
+ * @param uint64_t inserts number of new flows seen by the core since the
+ * last rebalancing
+ *
+ * observed load of single per core LRU
+ */
+struct LruCoreLoad {
+  uint64_t currentSize;
+  uint64_t inserts;
+};
+
+/**
+ * This class implements helpers to split LRU memory between forwarding cores
+ * proportionally to the rate of new flows which each core is seeing.
+ */
+class LruSizing {
+ public:
+  /**
+   * @param vector<LruCoreLoad> load of each core's LRU
+   * @param uint64_t budget total number of entries in all per core LRUs
+   * @param uint64_t minSize minimal size of single LRU
+   * @param double threshold relative change of the size, below which LRU is
+   * not resized (so we would not rebuild LRUs on each small fluctuation)
+   * @return vector<uint64_t> new sizes of LRUs (in the same order as load).
+   *
+   * LRUs which are not resized keep their current size, and the rest of the
+   * budget is split between resized ones, so sum of returned sizes never
+   * exceeds the budget (unless current sizes already do). if there is no
+   * traffic or budget is too small - current sizes are returned.
+   */
+  static std::vector<uint64_t> computeLruSizes(
+      const std::vector<LruCoreLoad>& load,
+      uint64_t budget,
+      uint64_t minSize,
+      double threshold);
+};
+
+} // namespace katran
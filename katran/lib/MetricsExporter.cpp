@@ -0,0 +1,337 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "katran/lib/MetricsExporter.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <glog/logging.h>
+
+#include "katran/lib/StatsCounters.h"
+
+extern "C" {
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+
+namespace katran {
+
+namespace {
+constexpr int kListenBacklog = 16;
+constexpr size_t kMaxRequestSize = 4096;
+constexpr int kRequestTimeoutSec = 1;
+constexpr int kAcceptErrorBackoffMs = 100;
+constexpr char kMetricsPrefix[] = "katran_";
+
+std::string escapeLabelValue(const std::string& value) {
+  std::string escaped;
+  for (auto c : value) {
+    if (c == '\\' || c == '"') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (c == '\n') {
+      escaped.append("\\n");
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+bool writeAll(int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    auto res = ::send(
+        fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += res;
+  }
+  return true;
+}
+} // namespace
+
+void MetricsBuilder::add(
+    const std::string& name,
+    uint64_t value,
+    const MetricLabels& labels,
+    MetricType type,
+    const std::string& help) {
+  auto& family = families_[sanitizeName(name)];
+  if (family.samples.empty()) {
+    family.type = type;
+    family.help = help;
+  }
+  std::string sample = sanitizeName(name);
+  if (!labels.empty()) {
+    sample.push_back('{');
+    bool first = true;
+    for (const auto& label : labels) {
+      if (!first) {
+        sample.push_back(',');
+      }
+      first = false;
+      sample.append(sanitizeName(label.first));
+      sample.append("=\"");
+      sample.append(escapeLabelValue(label.second));
+      sample.push_back('"');
+    }
+    sample.push_back('}');
+  }
+  sample.push_back(' ');
+  sample.append(std::to_string(value));
+  family.samples.push_back(std::move(sample));
+}
+
+std::string MetricsBuilder::build() const {
+  std::string page;
+  for (const auto& family : families_) {
+    if (!family.second.help.empty()) {
+      page.append("# HELP ").append(family.first).append(" ");
+      page.append(family.second.help).append("\n");
+    }
+    page.append("# TYPE ").append(family.first);
+    page.append(
+        family.second.type == MetricType::COUNTER ? " counter\n" : " gauge\n");
+    for (const auto& sample : family.second.samples) {
+      page.append(sample).append("\n");
+    }
+  }
+  return page;
+}
+
+std::string MetricsBuilder::sanitizeName(const std::string& name) {
+  std::string sanitized = name;
+  for (size_t i = 0; i < sanitized.size(); i++) {
+    auto c = sanitized[i];
+    bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        c == '_' || (i != 0 && c >= '0' && c <= '9');
+    if (!valid) {
+      sanitized[i] = '_';
+    }
+  }
+  return sanitized;
+}
+
+MetricsExporter::MetricsExporter(const MetricsExporterConfig& config)
+    : config_(config) {}
+
+MetricsExporter::~MetricsExporter() {
+  stop();
+}
+
+void MetricsExporter::addCollector(MetricsCollector collector) {
+  collectors_.push_back(std::move(collector));
+}
+
+bool MetricsExporter::createSocket() {
+  if (!config_.unixSocketPath.empty()) {
+    struct sockaddr_un addr = {};
+    if (config_.unixSocketPath.size() >= sizeof(addr.sun_path)) {
+      LOG(ERROR) << "metrics socket path is too long";
+      return false;
+    }
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) {
+      return false;
+    }
+    addr.sun_family = AF_UNIX;
+    ::strncpy(
+        addr.sun_path,
+        config_.unixSocketPath.c_str(),
+        sizeof(addr.sun_path) - 1);
+    // removing stale socket from previous run
+    ::unlink(config_.unixSocketPath.c_str());
+    if (::bind(
+            listenFd_,
+            reinterpret_cast<struct sockaddr*>(&addr),
+            sizeof(addr))) {
+      LOG(ERROR) << "can't bind metrics socket to " << config_.unixSocketPath
+                 << ": " << ::strerror(errno);
+      return false;
+    }
+  } else {
+    struct sockaddr_in6 addr6 = {};
+    struct sockaddr_in addr4 = {};
+    struct sockaddr* addr;
+    socklen_t addr_len;
+    int family;
+    if (::inet_pton(AF_INET, config_.address.c_str(), &addr4.sin_addr) == 1) {
+      family = addr4.sin_family = AF_INET;
+      addr4.sin_port = htons(config_.port);
+      addr = reinterpret_cast<struct sockaddr*>(&addr4);
+      addr_len = sizeof(addr4);
+    } else if (
+        ::inet_pton(AF_INET6, config_.address.c_str(), &addr6.sin6_addr) ==
+        1) {
+      family = addr6.sin6_family = AF_INET6;
+      addr6.sin6_port = htons(config_.port);
+      addr = reinterpret_cast<struct sockaddr*>(&addr6);
+      addr_len = sizeof(addr6);
+    } else {
+      LOG(ERROR) << "invalid address for metrics endpoint: "
+                 << config_.address;
+      return false;
+    }
+    listenFd_ = ::socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) {
+      return false;
+    }
+    int one = 1;
+    ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(listenFd_, addr, addr_len)) {
+      LOG(ERROR) << "can't bind metrics socket to " << config_.address << ":"
+                 << config_.port << ": " << ::strerror(errno);
+      return false;
+    }
+    ::getsockname(listenFd_, addr, &addr_len);
+    port_ = family == AF_INET ? ntohs(addr4.sin_port) : ntohs(addr6.sin6_port);
+  }
+  if (::listen(listenFd_, kListenBacklog)) {
+    LOG(ERROR) << "can't listen on metrics socket: " << ::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool MetricsExporter::start() {
+  if (running_) {
+    return true;
+  }
+  if (!createSocket()) {
+    if (listenFd_ >= 0) {
+      ::close(listenFd_);
+      listenFd_ = -1;
+    }
+    return false;
+  }
+  running_ = true;
+  // so first scrape would not see an empty page
+  collect();
+  collectorThread_ = std::thread([this]() { collectorLoop(); });
+  serveThread_ = std::thread([this]() { serveLoop(); });
+  return true;
+}
+
+void MetricsExporter::stop() {
+  if (!running_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(stopLock_);
+    running_ = false;
+  }
+  stopCv_.notify_all();
+  // unblocks accept() in serving thread
+  ::shutdown(listenFd_, SHUT_RDWR);
+  if (collectorThread_.joinable()) {
+    collectorThread_.join();
+  }
+  if (serveThread_.joinable()) {
+    serveThread_.join();
+  }
+  ::close(listenFd_);
+  listenFd_ = -1;
+  if (!config_.unixSocketPath.empty()) {
+    ::unlink(config_.unixSocketPath.c_str());
+  }
+}
+
+void MetricsExporter::collect() {
+  MetricsBuilder builder;
+  for (const auto& counter : StatsRegistry::get().snapshot()) {
+    auto name = counter.first;
+    if (name.compare(0, sizeof(kMetricsPrefix) - 1, kMetricsPrefix) != 0) {
+      name = kMetricsPrefix + name;
+    }
+    builder.add(name, counter.second);
+  }
+  for (const auto& collector : collectors_) {
+    collector(builder);
+  }
+  auto page = builder.build();
+  std::lock_guard<std::mutex> guard(cacheLock_);
+  cache_.swap(page);
+}
+
+std::string MetricsExporter::getMetrics() {
+  std::lock_guard<std::mutex> guard(cacheLock_);
+  return cache_;
+}
+
+void MetricsExporter::collectorLoop() {
+  std::unique_lock<std::mutex> lock(stopLock_);
+  while (running_) {
+    stopCv_.wait_for(lock, std::chrono::milliseconds(config_.cacheTtlMs));
+    if (!running_) {
+      break;
+    }
+    lock.unlock();
+    collect();
+    lock.lock();
+  }
+}
+
+void MetricsExporter::serveLoop() {
+  char request[kMaxRequestSize];
+  while (running_) {
+    int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (!running_) {
+        // listening socket has been shut down by stop()
+        break;
+      }
+      if (errno != EINTR) {
+        // e.g. EMFILE or ECONNABORTED. endpoint keeps serving; backing off
+        // so it would not spin while error persists
+        LOG(ERROR) << "error while accepting metrics connection: "
+                   << ::strerror(errno);
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(kAcceptErrorBackoffMs));
+      }
+      continue;
+    }
+    // so slow client could not block the endpoint
+    struct timeval timeout = {.tv_sec = kRequestTimeoutSec, .tv_usec = 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    // we do not care about request itself; every request gets metrics page.
+    // still need to read it, so client would not get RST on close
+    ::recv(fd, request, sizeof(request), 0);
+    auto body = getMetrics();
+    std::string response =
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " +
+        std::to_string(body.size()) + "\r\n\r\n" + body;
+    if (!writeAll(fd, response)) {
+      VLOG(2) << "can't write metrics response: " << ::strerror(errno);
+    }
+    ::close(fd);
+  }
+}
+
+} // namespace katran
@@ -0,0 +1,196 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace katran {
+
+namespace {
+constexpr uint16_t kDefaultMetricsPort = 9111;
+constexpr uint32_t kDefaultMetricsCacheTtlMs = 1000;
+} // namespace
+
+/**
+ * @param string address local address where metrics endpoint would listen
+ * @param uint16_t port where metrics endpoint would listen
+ * @param string unixSocketPath if not empty - endpoint would listen on this
+ * UNIX socket instead of tcp address:port
+ * @param uint32_t cacheTtlMs how often collectors are run. scrapes are served
+ * from the cache, so they never touch bpf maps directly
+ *
+ * config of metrics exporter
+ */
+struct MetricsExporterConfig {
+  std::string address{"127.0.0.1"};
+  uint16_t port{kDefaultMetricsPort};
+  std::string unixSocketPath;
+  uint32_t cacheTtlMs{kDefaultMetricsCacheTtlMs};
+};
+
+/**
+ * types of metrics in prometheus exposition format
+ */
+enum class MetricType {
+  COUNTER,
+  GAUGE,
+};
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * helper class to build metrics page in prometheus text exposition format.
+ * samples of the same metric are grouped together under single HELP/TYPE
+ * header, regardless of the order in which they have been added.
+ */
+class MetricsBuilder {
+ public:
+  /**
+   * @param string name of the metric
+   * @param uint64_t value of the sample
+   * @param MetricLabels labels of the sample
+   * @param MetricType type of the metric
+   * @param string help description of the metric
+   */
+  void add(
+      const std::string& name,
+      uint64_t value,
+      const MetricLabels& labels = {},
+      MetricType type = MetricType::COUNTER,
+      const std::string& help = "");
+
+  /**
+   * @return string all added metrics in prometheus text format
+   */
+  std::string build() const;
+
+  /**
+   * @param string name of the metric or counter (e.g. from StatsRegistry)
+   * @return string name w/ all chars, which are not allowed in prometheus
+   * metric name, replaced by '_'
+   */
+  static std::string sanitizeName(const std::string& name);
+
+ private:
+  struct MetricFamily {
+    MetricType type;
+    std::string help;
+    std::vector<std::string> samples;
+  };
+
+  std::map<std::string, MetricFamily> families_;
+};
+
+using MetricsCollector = std::function<void(MetricsBuilder&)>;
+
+/**
+ * local metrics endpoint. single background thread periodically runs all
+ * registered collectors (plus exports every counter from StatsRegistry) and
+ * caches the result; scrapes (plain http GET on tcp or UNIX socket) are
+ * answered from the cache by the serving thread.
+ */
+class MetricsExporter {
+ public:
+  explicit MetricsExporter(const MetricsExporterConfig& config);
+
+  ~MetricsExporter();
+
+  MetricsExporter(const MetricsExporter&) = delete;
+  MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+  /**
+   * @param MetricsCollector collector to run on each collection cycle
+   *
+   * collectors must be added before start() is called. collector is
+   * responsible for synchronization w/ the subsystem it collects from
+   */
+  void addCollector(MetricsCollector collector);
+
+  /**
+   * @return true on success
+   *
+   * starts collector and serving threads. returns false if endpoint's socket
+   * could not be created
+   */
+  bool start();
+
+  /**
+   * stops all threads and closes endpoint's socket
+   */
+  void stop();
+
+  /**
+   * @return string cached metrics page
+   */
+  std::string getMetrics();
+
+  /**
+   * @return uint16_t port where endpoint is listening (useful if configured
+   * port was 0)
+   */
+  uint16_t getPort() const {
+    return port_;
+  }
+
+  /**
+   * runs all collectors and updates the cache
+   */
+  void collect();
+
+ private:
+  /**
+   * helper function to create listening socket
+   */
+  bool createSocket();
+
+  void collectorLoop();
+
+  void serveLoop();
+
+  MetricsExporterConfig config_;
+
+  std::vector<MetricsCollector> collectors_;
+
+  int listenFd_{-1};
+
+  uint16_t port_{0};
+
+  std::atomic<bool> running_{false};
+
+  std::mutex cacheLock_;
+
+  std::string cache_;
+
+  std::mutex stopLock_;
+
+  std::condition_variable stopCv_;
+
+  std::thread collectorThread_;
+
+  std::thread serveThread_;
+};
+
+} // namespace katran
@@ -34,6 +34,14 @@ extern "C" {
 #define TCA_BPF_FLAG_ACT_DIRECT (1 << 0)
 #endif
 
+// from linux/if_link.h. atomic replace of xdp prog (kernel 5.7+)
+#ifndef IFLA_XDP_EXPECTED_FD
+#define IFLA_XDP_EXPECTED_FD (8)
+#endif
+#ifndef XDP_FLAGS_REPLACE
+#define XDP_FLAGS_REPLACE (1U << 4)
+#endif
+
 namespace {
 // netlink/tc magic constants (from iproute2/tc source code)
 std::array<const char, 4> kBpfKind = {"bpf"};
@@ -221,7 +229,8 @@ NetlinkMessage NetlinkMessage::XDP(
     unsigned seq,
     int prog_fd,
     unsigned ifindex,
-    uint32_t flags) {
+    uint32_t flags,
+    int expected_fd) {
   NetlinkMessage ret;
   unsigned char* buf = ret.buf_.data();
 
@@ -244,6 +253,10 @@ NetlinkMessage NetlinkMessage::XDP(
   {
     struct nlattr* xdp_atr = mnl_attr_nest_start(nlh, IFLA_XDP);
     mnl_attr_put_u32(nlh, IFLA_XDP_FD, prog_fd);
+    if (expected_fd >= 0) {
+      flags |= XDP_FLAGS_REPLACE;
+      mnl_attr_put_u32(nlh, IFLA_XDP_EXPECTED_FD, expected_fd);
+    }
     if (flags > 0) {
       mnl_attr_put_u32(nlh, IFLA_XDP_FLAGS, flags);
     }
@@ -63,9 +63,16 @@ class NetlinkMessage {
    * @param prog_fd    FD for the BPF program.
    * @param ifindex    Network interface index
    * @param flags      Optional XDP flags.
+   * @param expected_fd  FD of the program which is expected to be attached.
+   *                     if specified - program is replaced only if currently
+   *                     attached one is the same (XDP_FLAGS_REPLACE)
    */
-  static NetlinkMessage
-  XDP(unsigned seq, int prog_fd, unsigned ifindex, uint32_t flags);
+  static NetlinkMessage XDP(
+      unsigned seq,
+      int prog_fd,
+      unsigned ifindex,
+      uint32_t flags,
+      int expected_fd = -1);
 
   const uint8_t* data() const {
     return buf_.data();
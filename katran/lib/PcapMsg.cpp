@@ -35,11 +35,19 @@ PcapMsg& PcapMsg::operator=(PcapMsg&& msg) noexcept {
   pckt_ = std::move(msg.pckt_);
   origLen_ = msg.origLen_;
   capturedLen_ = msg.capturedLen_;
+  interfaceId_ = msg.interfaceId_;
+  packetId_ = msg.packetId_;
+  flags_ = msg.flags_;
+  comment_ = std::move(msg.comment_);
   return *this;
 }
 
 PcapMsg::PcapMsg(PcapMsg&& msg) noexcept
     : pckt_(std::move(msg.pckt_)),
       origLen_(msg.origLen_),
-      capturedLen_(msg.capturedLen_) {}
+      capturedLen_(msg.capturedLen_),
+      interfaceId_(msg.interfaceId_),
+      packetId_(msg.packetId_),
+      flags_(msg.flags_),
+      comment_(std::move(msg.comment_)) {}
 } // namespace katran
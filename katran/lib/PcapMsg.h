@@ -17,6 +17,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include <folly/io/IOBuf.h>
 
@@ -70,6 +71,35 @@ class PcapMsg {
     return capturedLen_ = std::min(capturedLen_, snaplen);
   }
 
+  /**
+   * optional annotations of the packet. they are written only if
+   * PcapWriter is in pcapng mode
+   */
+  void setInterfaceId(uint32_t interfaceId) {
+    interfaceId_ = interfaceId;
+  }
+  uint32_t getInterfaceId() const {
+    return interfaceId_;
+  }
+  void setPacketId(uint64_t packetId) {
+    packetId_ = packetId;
+  }
+  uint64_t getPacketId() const {
+    return packetId_;
+  }
+  void setFlags(uint32_t flags) {
+    flags_ = flags;
+  }
+  uint32_t getFlags() const {
+    return flags_;
+  }
+  void setComment(std::string comment) {
+    comment_ = std::move(comment);
+  }
+  const std::string& getComment() const {
+    return comment_;
+  }
+
  private:
   /**
    * IOBuf which contains chunk of the captured packet
@@ -84,6 +114,19 @@ class PcapMsg {
    * of the packet
    */
   uint32_t capturedLen_{0};
+  /**
+   * index of pcapng's interface where this packet has been captured
+   */
+  uint32_t interfaceId_{0};
+  /**
+   * id which correlates captures of the same packet (0 - not set)
+   */
+  uint64_t packetId_{0};
+  /**
+   * pcapng's epb_flags (e.g. direction of the packet)
+   */
+  uint32_t flags_{0};
+  std::string comment_;
 };
 
 } // namespace katran
@@ -37,4 +37,37 @@ struct pcaprec_hdr_s {
   uint32_t orig_len; /* actual length of packet */
 };
 
+// reference to pcapng format:
+// https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-02.html
+struct pcapng_block_hdr {
+  uint32_t block_type;
+  uint32_t block_total_length;
+};
+
+struct pcapng_shb {
+  uint32_t byte_order_magic;
+  uint16_t major_version;
+  uint16_t minor_version;
+  int64_t section_length;
+};
+
+struct pcapng_idb {
+  uint16_t linktype;
+  uint16_t reserved;
+  uint32_t snaplen;
+};
+
+struct pcapng_epb {
+  uint32_t interface_id;
+  uint32_t ts_high;
+  uint32_t ts_low;
+  uint32_t captured_len;
+  uint32_t orig_len;
+};
+
+struct pcapng_opt_hdr {
+  uint16_t code;
+  uint16_t length;
+};
+
 } // namespace katran
@@ -17,6 +17,7 @@
 #include "katran/lib/PcapWriter.h"
 
 #include <chrono>
+#include <cstring>
 #include "katran/lib/PcapStructs.h"
 
 using Guard = std::lock_guard<std::mutex>;
@@ -32,6 +33,68 @@ constexpr uint32_t kAccuracy = 0;
 constexpr uint32_t kMaxSnapLen = 0xFFFF; // 65535
 constexpr uint32_t kEthernet = 1;
 constexpr uint32_t kDefaultWriter = 0;
+constexpr uint32_t kPcapngShb = 0x0A0D0D0A;
+constexpr uint32_t kPcapngIdb = 0x00000001;
+constexpr uint32_t kPcapngEpb = 0x00000006;
+constexpr uint32_t kPcapngByteOrderMagic = 0x1A2B3C4D;
+constexpr uint16_t kPcapngVersionMajor = 1;
+constexpr uint16_t kPcapngVersionMinor = 0;
+constexpr int64_t kPcapngUnknownSectionLen = -1;
+constexpr uint16_t kOptEndOfOpt = 0;
+constexpr uint16_t kOptComment = 1;
+constexpr uint16_t kOptIfName = 2;
+constexpr uint16_t kOptEpbFlags = 2;
+constexpr uint16_t kOptEpbPacketId = 5;
+constexpr std::size_t kPcapngAlign = 4;
+// size of trailing block_total_length
+constexpr std::size_t kPcapngTrailerSize = sizeof(uint32_t);
+
+std::size_t pcapngPadded(std::size_t len) {
+  return (len + kPcapngAlign - 1) & ~(kPcapngAlign - 1);
+}
+
+std::size_t pcapngOptionSize(std::size_t len) {
+  return sizeof(pcapng_opt_hdr) + pcapngPadded(len);
+}
+
+void appendData(std::string& block, const void* data, std::size_t len) {
+  block.append(reinterpret_cast<const char*>(data), len);
+  block.append(pcapngPadded(len) - len, '\0');
+}
+
+void appendOption(
+    std::string& block,
+    uint16_t code,
+    const void* data,
+    std::size_t len) {
+  pcapng_opt_hdr opt{.code = code, .length = static_cast<uint16_t>(len)};
+  block.append(reinterpret_cast<const char*>(&opt), sizeof(opt));
+  appendData(block, data, len);
+}
+
+/**
+ * finalizes pcapng's block: writes end of options (if there are any),
+ * trailing total length and patches it in the header
+ */
+void finalizeBlock(std::string& block, bool hasOptions) {
+  if (hasOptions) {
+    appendOption(block, kOptEndOfOpt, nullptr, 0);
+  }
+  uint32_t len = block.size() + kPcapngTrailerSize;
+  block.append(reinterpret_cast<const char*>(&len), sizeof(len));
+  std::memcpy(
+      &block[offsetof(pcapng_block_hdr, block_total_length)],
+      &len,
+      sizeof(len));
+}
+
+std::string pcapngBlock(uint32_t type, const void* body, std::size_t len) {
+  std::string block;
+  pcapng_block_hdr hdr{.block_type = type, .block_total_length = 0};
+  block.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+  block.append(reinterpret_cast<const char*>(body), len);
+  return block;
+}
 } // namespace
 
 PcapWriter::PcapWriter(
@@ -53,7 +116,108 @@ PcapWriter::PcapWriter(
   }
 }
 
+void PcapWriter::enablePcapng(std::vector<std::string> interfaces) {
+  pcapng_ = true;
+  interfaces_ = std::move(interfaces);
+}
+
+std::size_t PcapWriter::recordSize(const PcapMsg& msg) {
+  if (!pcapng_) {
+    return msg.getCapturedLen() + sizeof(pcaprec_hdr_s);
+  }
+  std::size_t size = sizeof(pcapng_block_hdr) + sizeof(pcapng_epb) +
+      pcapngPadded(msg.getCapturedLen()) + kPcapngTrailerSize;
+  bool hasOptions = false;
+  if (msg.getFlags()) {
+    size += pcapngOptionSize(sizeof(uint32_t));
+    hasOptions = true;
+  }
+  if (msg.getPacketId()) {
+    size += pcapngOptionSize(sizeof(uint64_t));
+    hasOptions = true;
+  }
+  if (!msg.getComment().empty()) {
+    size += pcapngOptionSize(msg.getComment().size());
+    hasOptions = true;
+  }
+  if (hasOptions) {
+    size += pcapngOptionSize(0);
+  }
+  return size;
+}
+
+void PcapWriter::writePcapngPacket(const PcapMsg& msg, uint32_t writerId) {
+  uint64_t unix_usec =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::high_resolution_clock::now().time_since_epoch())
+          .count();
+  // default resolution of pcapng's timestamps is usec
+  pcapng_epb epb{
+      .interface_id = msg.getInterfaceId(),
+      .ts_high = static_cast<uint32_t>(unix_usec >> 32),
+      .ts_low = static_cast<uint32_t>(unix_usec),
+      .captured_len = msg.getCapturedLen(),
+      .orig_len = msg.getOrigLen(),
+  };
+  auto block = pcapngBlock(kPcapngEpb, &epb, sizeof(epb));
+  appendData(block, msg.getRawBuffer(), msg.getCapturedLen());
+  bool hasOptions = false;
+  if (msg.getFlags()) {
+    uint32_t flags = msg.getFlags();
+    appendOption(block, kOptEpbFlags, &flags, sizeof(flags));
+    hasOptions = true;
+  }
+  if (msg.getPacketId()) {
+    uint64_t packetId = msg.getPacketId();
+    appendOption(block, kOptEpbPacketId, &packetId, sizeof(packetId));
+    hasOptions = true;
+  }
+  if (!msg.getComment().empty()) {
+    appendOption(
+        block,
+        kOptComment,
+        msg.getComment().data(),
+        msg.getComment().size());
+    hasOptions = true;
+  }
+  finalizeBlock(block, hasOptions);
+  dataWriters_[writerId]->writeData(block.data(), block.size());
+}
+
+bool PcapWriter::writePcapngHeader(uint32_t writerId) {
+  pcapng_shb shb{
+      .byte_order_magic = kPcapngByteOrderMagic,
+      .major_version = kPcapngVersionMajor,
+      .minor_version = kPcapngVersionMinor,
+      .section_length = kPcapngUnknownSectionLen,
+  };
+  auto header = pcapngBlock(kPcapngShb, &shb, sizeof(shb));
+  finalizeBlock(header, false);
+  for (const auto& name : interfaces_) {
+    pcapng_idb idb{
+        .linktype = kEthernet,
+        .reserved = 0,
+        .snaplen = snaplen_ ?: kMaxSnapLen,
+    };
+    auto block = pcapngBlock(kPcapngIdb, &idb, sizeof(idb));
+    appendOption(block, kOptIfName, name.data(), name.size());
+    finalizeBlock(block, true);
+    header += block;
+  }
+  if (!dataWriters_[writerId]->available(header.size())) {
+    LOG(ERROR) << "DataWriter failed to write a header. Not enough space.";
+    return false;
+  }
+  dataWriters_[writerId]->writeData(header.data(), header.size());
+  headerExists_[writerId] = true;
+  return true;
+}
+
 void PcapWriter::writePacket(const PcapMsg& msg, uint32_t writerId) {
+  if (pcapng_ && writerId < dataWriters_.size()) {
+    writePcapngPacket(msg, writerId);
+    return;
+  }
   auto unix_usec =
       std::chrono::duration_cast<std::chrono::microseconds>(
           std::chrono::high_resolution_clock::now().time_since_epoch())
@@ -85,6 +249,9 @@ bool PcapWriter::writePcapHeader(uint32_t writerId) {
     VLOG(4) << "header already exists";
     return true;
   }
+  if (pcapng_) {
+    return writePcapngHeader(writerId);
+  }
   if (!dataWriters_[writerId]->available(sizeof(struct pcap_hdr_s))) {
     LOG(ERROR) << "DataWriter failed to write a header. Not enough space.";
     return false;
@@ -106,7 +273,7 @@ void PcapWriter::run(std::shared_ptr<folly::MPMCQueue<PcapMsg>> queue) {
     return;
   }
   PcapMsg msg(nullptr, 0, 0);
-  while (packetLimit_ == 0 || packetAmount_ < packetLimit_) {
+  while (packetLimit_ == 0 || packetAmount_.get() < packetLimit_) {
     queue->blockingRead(msg);
     Guard lock(cntrLock_);
     msg.trim(snaplen);
@@ -114,8 +281,7 @@ void PcapWriter::run(std::shared_ptr<folly::MPMCQueue<PcapMsg>> queue) {
       LOG(INFO) << "Empty message was received. Writer thread is stopping.";
       break;
     }
-    if (!dataWriters_[kDefaultWriter]->available(
-            msg.getCapturedLen() + sizeof(pcaprec_hdr_s))) {
+    if (!dataWriters_[kDefaultWriter]->available(recordSize(msg))) {
       ++bufferFull_;
       break;
     }
@@ -126,10 +292,9 @@ void PcapWriter::run(std::shared_ptr<folly::MPMCQueue<PcapMsg>> queue) {
 
 PcapWriterStats PcapWriter::getStats() {
   PcapWriterStats stats;
-  Guard lock(cntrLock_);
   stats.limit = packetLimit_;
-  stats.amount = packetAmount_;
-  stats.bufferFull = bufferFull_;
+  stats.amount = packetAmount_.get();
+  stats.bufferFull = bufferFull_.get();
   return stats;
 }
 
@@ -145,7 +310,7 @@ void PcapWriter::restartWriters(uint32_t packetLimit) {
   }
 
   packetLimit_ = packetLimit;
-  packetAmount_ = 0;
+  packetAmount_.set(0);
 }
 
 void PcapWriter::stopWriters() {
@@ -153,7 +318,7 @@ void PcapWriter::stopWriters() {
     writer->stop();
   }
   packetLimit_ = 0;
-  packetAmount_ = packetLimit_;
+  packetAmount_.set(0);
 }
 
 void PcapWriter::runMulti(
@@ -174,7 +339,7 @@ void PcapWriter::runMulti(
       }
       continue;
     }
-    if (packetAmount_ >= packetLimit_) {
+    if (packetAmount_.get() >= packetLimit_) {
       continue;
     }
     if (!writePcapHeader(msg.getEventId())) {
@@ -183,7 +348,7 @@ void PcapWriter::runMulti(
     }
     msg.getPcapMsg().trim(snaplen);
     if (!dataWriters_[msg.getEventId()]->available(
-            msg.getPcapMsg().getCapturedLen() + sizeof(pcaprec_hdr_s))) {
+            recordSize(msg.getPcapMsg()))) {
       ++bufferFull_;
       continue;
     }
@@ -16,13 +16,16 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <folly/MPMCQueue.h>
 
 #include "katran/lib/DataWriter.h"
 #include "katran/lib/PcapMsgMeta.h"
+#include "katran/lib/StatsCounters.h"
 
 struct PcapWriterStats {
   uint32_t limit{0};
@@ -98,15 +101,25 @@ class PcapWriter {
    */
   void runMulti(std::shared_ptr<folly::MPMCQueue<PcapMsg>> queue);
 
+  /**
+   * @param vector<string> interfaces names of pcapng's interfaces
+   *
+   * switches writer to pcapng format. each packet is written on the
+   * interface w/ PcapMsg's interface id, along w/ its flags, packet id and
+   * comment. must be called before writer is started
+   */
+  void enablePcapng(std::vector<std::string> interfaces);
+
   /**
    * Get number of captured packets
    */
   uint32_t packetsCaptured() const {
-    return packetAmount_;
+    return packetAmount_.get();
   }
 
   /**
-   * return PcapWriter related statistics
+   * return PcapWriter related statistics. lock free, so it never waits
+   * for writer's I/O
    */
   PcapWriterStats getStats();
 
@@ -119,11 +132,26 @@ class PcapWriter {
    */
   void writePacket(const PcapMsg& msg, uint32_t writerId);
 
+  /**
+   * helper function which writes packet as pcapng's enhanced packet block
+   */
+  void writePcapngPacket(const PcapMsg& msg, uint32_t writerId);
+
   /**
    * helper function to write pcap header
    */
   bool writePcapHeader(uint32_t writerId);
 
+  /**
+   * helper function to write pcapng's section header and interface blocks
+   */
+  bool writePcapngHeader(uint32_t writerId);
+
+  /**
+   * @return size_t size of the record of this packet in the output
+   */
+  std::size_t recordSize(const PcapMsg& msg);
+
   /**
    * helper which restart writers
    */
@@ -148,18 +176,18 @@ class PcapWriter {
   /**
    * Amount of packets that have been written in PcapWriter.
    */
-  uint32_t packetAmount_{0};
+  StatsCounter packetAmount_{"pcap_writer.packets_written"};
 
   /**
    * Max number of packets that can be written in a single batch
    */
-  uint32_t packetLimit_{0};
+  std::atomic<uint32_t> packetLimit_{0};
 
   /**
    * Number of bufferFull events: when writer does not have enough
    * space to write packet
    */
-  uint32_t bufferFull_{0};
+  StatsCounter bufferFull_{"pcap_writer.buffer_full"};
 
   /**
    * Max number of bytes to be stored.
@@ -167,7 +195,18 @@ class PcapWriter {
   const uint32_t snaplen_{0};
 
   /**
-   * lock which protects counters, such as packetAmount_ and packetLimit_
+   * true if output is in pcapng format
+   */
+  bool pcapng_{false};
+
+  /**
+   * names of pcapng's interfaces
+   */
+  std::vector<std::string> interfaces_;
+
+  /**
+   * lock which serializes writes w/ restart/stop of the writers. counters
+   * are lock free and could be read w/o it
    */
   std::mutex cntrLock_;
 };
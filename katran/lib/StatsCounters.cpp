@@ -0,0 +1,62 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "katran/lib/StatsCounters.h"
+
+using Guard = std::lock_guard<std::mutex>;
+
+namespace katran {
+
+StatsCounter::StatsCounter(const std::string& name) : name_(name) {
+  StatsRegistry::get().registerCounter(this);
+}
+
+StatsCounter::~StatsCounter() {
+  if (!name_.empty()) {
+    StatsRegistry::get().unregisterCounter(this);
+  }
+}
+
+StatsRegistry& StatsRegistry::get() {
+  // never destroyed, so counters in static objects could safely unregister
+  // themselves at exit
+  static auto registry = new StatsRegistry();
+  return *registry;
+}
+
+void StatsRegistry::registerCounter(const StatsCounter* counter) {
+  if (counter->getName().empty()) {
+    return;
+  }
+  Guard lock(lock_);
+  counters_.insert(counter);
+}
+
+void StatsRegistry::unregisterCounter(const StatsCounter* counter) {
+  Guard lock(lock_);
+  counters_.erase(counter);
+}
+
+std::map<std::string, uint64_t> StatsRegistry::snapshot() {
+  std::map<std::string, uint64_t> result;
+  Guard lock(lock_);
+  for (const auto counter : counters_) {
+    result[counter->getName()] += counter->get();
+  }
+  return result;
+}
+
+} // namespace katran
@@ -0,0 +1,131 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace katran {
+
+namespace {
+constexpr size_t kCacheLineSize = 64;
+} // namespace
+
+/**
+ * lock free counter. all operations are relaxed atomics, so it could be
+ * updated from any thread and read (e.g. by stats exporter) w/o taking any
+ * locks. counter is padded, so two counters next to each other never share
+ * the same cache line (and writers on different cores are not contending).
+ *
+ * if counter has a name - it is registered in StatsRegistry for it's whole
+ * lifetime.
+ */
+class StatsCounter {
+ public:
+  StatsCounter() = default;
+
+  /**
+   * @param string name under which counter is going to be registered
+   */
+  explicit StatsCounter(const std::string& name);
+
+  ~StatsCounter();
+
+  StatsCounter(const StatsCounter&) = delete;
+  StatsCounter& operator=(const StatsCounter&) = delete;
+
+  void add(uint64_t value = 1) {
+    value_.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void set(uint64_t value) {
+    value_.store(value, std::memory_order_relaxed);
+  }
+
+  uint64_t get() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+  StatsCounter& operator++() {
+    add();
+    return *this;
+  }
+
+  void operator++(int) {
+    add();
+  }
+
+  StatsCounter& operator+=(uint64_t value) {
+    add(value);
+    return *this;
+  }
+
+  const std::string& getName() const {
+    return name_;
+  }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+  char pad_[kCacheLineSize - sizeof(std::atomic<uint64_t>)];
+  std::string name_;
+};
+
+/**
+ * process wide registry of named counters. subsystems are registering their
+ * counters there (implicitly, by creating named StatsCounter), so exporter
+ * could enumerate all of em w/o knowing about each subsystem.
+ * counters w/ the same name (e.g. from two instances of the same class) are
+ * summed up in the snapshot.
+ * lock inside registry is only taken on counter's creation/deletion and
+ * while taking a snapshot; updates of counters never touch it.
+ */
+class StatsRegistry {
+ public:
+  /**
+   * @return StatsRegistry& process wide instance of the registry
+   */
+  static StatsRegistry& get();
+
+  /**
+   * @param StatsCounter* counter to register (must have a name)
+   */
+  void registerCounter(const StatsCounter* counter);
+
+  /**
+   * @param StatsCounter* counter to remove from the registry
+   */
+  void unregisterCounter(const StatsCounter* counter);
+
+  /**
+   * @return map<string, uint64_t> current values of all registered counters,
+   * sorted by name
+   */
+  std::map<std::string, uint64_t> snapshot();
+
+ private:
+  StatsRegistry() = default;
+
+  std::mutex lock_;
+
+  std::unordered_set<const StatsCounter*> counters_;
+};
+
+} // namespace katran
@@ -42,6 +42,10 @@
 #define IPV4_PLUS_ICMP_HDR 28
 #define IPV6_PLUS_ICMP_HDR 48
 
+// MAX_VIPS, MAX_REALS, RING_SIZE and MAX_LPM_SRC are only defaults now:
+// userspace resizes maps before the load (w/ sizes from KatranConfig) and
+// passes matching limits to the datapath through lb_limits_map
+
 //consistent hashing ring size
 #ifndef RING_SIZE
 #define RING_SIZE 65537
@@ -62,6 +66,17 @@
 #define MAX_LPM_SRC 3000000
 #endif
 
+// maximum number of port prefixes of all port range vips. each range is
+// split into at most 30 prefixes
+#ifndef MAX_VIP_PORT_RANGES
+#define MAX_VIP_PORT_RANGES 16384
+#endif
+
+// address and proto of vip_port_lpm_key are always matched fully:
+// prefixlen of the key is VIP_PORT_LPM_ADDR_BITS + length of port prefix
+#define VIP_PORT_LPM_ADDR_BITS 144
+#define VIP_PORT_LPM_FULL_PREFIXLEN 160
+
 #ifndef MAX_DECAP_DST
 #define MAX_DECAP_DST 6
 #endif
@@ -71,12 +86,19 @@
 
 #define CTL_MAP_SIZE 16
 
+// position of the only entry in lb_limits_map
+#define LB_LIMITS_POS 0
+
 // size of internal prog array
 #define SUBPROGRAMS_ARRAY_SIZE 1
 // position where katran would register itself in prog array
 // for recirculation
 #define RECIRCULATION_INDEX 0
 
+// size of prog array w/ exit hooks; index is xdp verdict of the balancer
+// (XDP_ABORTED, XDP_DROP, XDP_PASS and XDP_TX)
+#define EXIT_HOOK_ARRAY_SIZE 4
+
 #define CH_RINGS_SIZE (MAX_VIPS * RING_SIZE)
 #define STATS_MAP_SIZE (MAX_VIPS * 2)
 
@@ -85,6 +107,12 @@
 #define MAX_SUPPORTED_CPUS 128
 #endif
 
+// max number of numa nodes w/ replicas of read mostly maps (NUMA_REPLICAS).
+// slot 0 of per node map-in-maps is never used (it means "no replica")
+#ifndef MAX_NUMA_NODES
+#define MAX_NUMA_NODES 8
+#endif
+
 // default lru is a fallback lru, which will be used when forwarding cpu/core
 // cannot find per core lru in lrus map-in-map.
 // we should only have a hit in this default lru while running unittests.
@@ -102,6 +130,8 @@
 // real_definition flags:
 // address is ipv6
 #define F_IPV6 (1 << 0)
+// real is down: flows, which land on it, are moved to other reals
+#define F_REAL_DOWN (1 << 1)
 // vip_meta flags
 // dont use client's port for hash calculation
 #define F_HASH_NO_SRC_PORT (1 << 0)
@@ -113,6 +143,9 @@
 #define F_HASH_DPORT_ONLY (1 << 3)
 // check if src based routing should be used
 #define F_SRC_ROUTING (1 << 4)
+// vip_addrs flags:
+// drop packets to the address on ports (protocols) w/o configured vip
+#define F_DROP_UNKNOWN_PORTS (1 << 0)
 // packet_description flags:
 // the description has been created from icmp msg
 #define F_ICMP (1 << 0)
@@ -182,6 +215,20 @@
 // if we go beyond this value - we will bypass lru update.
 // offset of QUIC routing related stats
 #define QUIC_ROUTE_STATS 7
+// offset of per cpu counter of new entries in lru (v1). as lrus are per
+// cpu - it is an O(1) estimate of the fill of each lru. there is no counter
+// of deletes: forwarding plane never deletes from lru, and entries are
+// evicted by kernel only when lru is full (estimate is capped by its size)
+#define LRU_INSERT_CNTR 8
+// offset of counters of flows moved from down reals: found in lru (v1) and
+// hashed to down real in ch ring (v2)
+#define DOWN_REAL_CNTR 9
+// how many next positions of ch ring we check when packet is hashed to
+// the real which is down
+#ifndef DOWN_REAL_PROBES
+#define DOWN_REAL_PROBES 4
+#endif
+
 #ifndef MAX_CONN_RATE
 #define MAX_CONN_RATE 125000
 #endif
@@ -260,7 +307,28 @@
  *
  * KATRAN_INTROSPECTION - katran will start to perfpipe packet's header which
  * have triggered specific events
+ *
+ * KATRAN_VERDICT_INTROSPECTION - katran reports PACKET_VERDICT event for
+ * (sampled) packets: xdp action, drop reason, vip, real and lru hit/miss.
+ * implies KATRAN_INTROSPECTION
+ *
+ * NUMA_REPLICAS - vip_map, ch_rings and reals are read from the replica
+ * located on forwarding core's numa node (if userspace has configured one)
+ *
+ * VIP_ADDR_PREFILTER - packets are checked against set of vips' addresses
+ * (vip_addrs map) before vip_map lookups; packets to other destinations are
+ * passed after single lookup. packets to vip's address on port w/o vip could
+ * be dropped (F_DROP_UNKNOWN_PORTS)
+ *
+ * VIP_PORT_RANGES - vips could be defined over port range (vip_port_ranges
+ * map). range is matched if there is no vip for exact port
  */
+#ifdef KATRAN_VERDICT_INTROSPECTION
+#ifndef KATRAN_INTROSPECTION
+#define KATRAN_INTROSPECTION
+#endif
+#endif // of KATRAN_VERDICT_INTROSPECTION
+
 #ifdef LPM_SRC_LOOKUP
 #ifndef INLINE_DECAP
 #ifndef INLINE_DECAP_GUE
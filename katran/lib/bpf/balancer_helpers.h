@@ -68,6 +68,48 @@ static inline void submit_event(struct xdp_md *ctx, void *map,
 }
 #endif
 
+#ifdef KATRAN_VERDICT_INTROSPECTION
+/**
+ * helper to report katran's verdict for the packet. reported for one of
+ * N packets in average and w/ packet's headers if it was requested. ctl_array
+ * holds 2^32 / N (precomputed in userspace; 0 - disabled), so sampling is a
+ * single compare w/ random u32
+ */
+__attribute__((__always_inline__))
+static inline void submit_verdict_event(struct xdp_md *ctx, void *map,
+                                        __u32 action,
+                                        struct verdict_info *info) {
+  struct ctl_value *ctl;
+  __u32 introspection_gk_pos = 5;
+  __u32 sampling_pos = 6;
+  __u32 headers_pos = 7;
+  ctl = bpf_map_lookup_elem(&ctl_array, &introspection_gk_pos);
+  if (!ctl || ctl->value == 0) {
+    return;
+  }
+  ctl = bpf_map_lookup_elem(&ctl_array, &sampling_pos);
+  if (!ctl || ctl->value == 0) {
+    return;
+  }
+  if (bpf_get_prandom_u32() >= ctl->value) {
+    return;
+  }
+  struct verdict_event event = {};
+  __u64 flags = BPF_F_CURRENT_CPU;
+  __u32 size = ctx->data_end - ctx->data;
+  event.md.event = PACKET_VERDICT;
+  event.md.pkt_size = size;
+  info->action = action;
+  memcpy(&event.info, info, sizeof(struct verdict_info));
+  ctl = bpf_map_lookup_elem(&ctl_array, &headers_pos);
+  if (ctl && ctl->value) {
+    event.md.data_len = min_helper(size, MAX_EVENT_SIZE);
+    flags |= (__u64) event.md.data_len << 32;
+  }
+  bpf_perf_event_output(ctx, map, flags, &event, sizeof(struct verdict_event));
+}
+#endif // of KATRAN_VERDICT_INTROSPECTION
+
 #ifdef INLINE_DECAP_GENERIC
 __attribute__((__always_inline__))
 static inline int recirculate(struct xdp_md *ctx) {
@@ -33,8 +33,65 @@ static inline __u32 get_packet_hash(struct packet_description *pckt,
 }
 
 __attribute__((__always_inline__))
-static inline bool is_under_flood(__u64 *cur_time) {
-  __u32 conn_rate_key = MAX_VIPS + NEW_CONN_RATE_CNTR;
+static inline void get_lb_limits(struct lb_limits *limits) {
+  __u32 key = LB_LIMITS_POS;
+  struct lb_limits *runtime_limits = bpf_map_lookup_elem(
+    &lb_limits_map, &key);
+  if (runtime_limits && runtime_limits->max_vips &&
+      runtime_limits->ring_size) {
+    *limits = *runtime_limits;
+  } else {
+    // limits were not provided by userspace. maps have been sized w/
+    // compile time defaults
+    limits->max_vips = MAX_VIPS;
+    limits->ring_size = RING_SIZE;
+  }
+}
+
+#ifdef VIP_PORT_RANGES
+// looks up vip, which port range contains vip->port
+__attribute__((__always_inline__))
+static inline struct vip_meta *port_range_vip_lookup(
+    struct vip_definition *vip) {
+  struct vip_port_lpm_key key = {};
+  key.prefixlen = VIP_PORT_LPM_FULL_PREFIXLEN;
+  memcpy(key.vipv6, vip->vipv6, 16);
+  key.proto = vip->proto;
+  key.port = vip->port;
+  return bpf_map_lookup_elem(&vip_port_ranges, &key);
+}
+#endif // of VIP_PORT_RANGES
+
+__attribute__((__always_inline__))
+static inline void get_lb_maps(struct lb_maps *maps) {
+  maps->vip_map = &vip_map;
+  maps->ch_rings = &ch_rings;
+  maps->reals = &reals;
+#ifdef NUMA_REPLICAS
+  __u32 cpu_num = bpf_get_smp_processor_id();
+  __u32 *replica_idx = bpf_map_lookup_elem(&cpu_numa_map, &cpu_num);
+  if (!replica_idx || !*replica_idx) {
+    return;
+  }
+  void *replica = bpf_map_lookup_elem(&vip_map_numa, replica_idx);
+  if (replica) {
+    maps->vip_map = replica;
+  }
+  replica = bpf_map_lookup_elem(&ch_rings_numa, replica_idx);
+  if (replica) {
+    maps->ch_rings = replica;
+  }
+  replica = bpf_map_lookup_elem(&reals_numa, replica_idx);
+  if (replica) {
+    maps->reals = replica;
+  }
+#endif // of NUMA_REPLICAS
+}
+
+__attribute__((__always_inline__))
+static inline bool is_under_flood(__u64 *cur_time,
+                                  struct lb_limits *limits) {
+  __u32 conn_rate_key = limits->max_vips + NEW_CONN_RATE_CNTR;
   struct lb_stats *conn_rate_stats = bpf_map_lookup_elem(
     &stats, &conn_rate_key);
   if (!conn_rate_stats) {
@@ -59,12 +116,49 @@ static inline bool is_under_flood(__u64 *cur_time) {
   return false;
 }
 
+/**
+ * packet has been hashed to the real, which is down. checks next positions
+ * of vip's ch ring and picks first alive real. returns false if there is
+ * none (real is left unchanged)
+ */
+__attribute__((__always_inline__))
+static inline bool probe_alive_real(struct real_definition **real,
+                                    __u32 *real_pos,
+                                    __u32 hash,
+                                    struct vip_meta *vip_info,
+                                    struct lb_limits *limits,
+                                    struct lb_maps *maps) {
+  struct real_definition *probe;
+  __u32 *pos;
+  __u32 key;
+
+  #pragma clang loop unroll(full)
+  for (int i = 1; i <= DOWN_REAL_PROBES; i++) {
+    key = limits->ring_size * (vip_info->vip_num) +
+      (hash + i) % limits->ring_size;
+    pos = bpf_map_lookup_elem(maps->ch_rings, &key);
+    if (!pos) {
+      return false;
+    }
+    key = *pos;
+    probe = bpf_map_lookup_elem(maps->reals, &key);
+    if (probe && !(probe->flags & F_REAL_DOWN)) {
+      *real = probe;
+      *real_pos = key;
+      return true;
+    }
+  }
+  return false;
+}
+
 __attribute__((__always_inline__))
 static inline bool get_packet_dst(struct real_definition **real,
                                   struct packet_description *pckt,
                                   struct vip_meta *vip_info,
                                   bool is_ipv6,
-                                  void *lru_map) {
+                                  void *lru_map,
+                                  struct lb_limits *limits,
+                                  struct lb_maps *maps) {
 
   // to update lru w/ new connection
   struct real_pos_lru new_dst_lru = {};
@@ -72,10 +166,10 @@ static inline bool get_packet_dst(struct real_definition **real,
   bool src_found = false;
   __u32 *real_pos;
   __u64 cur_time = 0;
-  __u32 hash;
+  __u32 hash = 0;
   __u32 key;
 
-  under_flood = is_under_flood(&cur_time);
+  under_flood = is_under_flood(&cur_time, limits);
 
   #ifdef LPM_SRC_LOOKUP
   if ((vip_info->flags & F_SRC_ROUTING) && !under_flood) {
@@ -94,8 +188,14 @@ static inline bool get_packet_dst(struct real_definition **real,
     if (lpm_val) {
       src_found = true;
       key = *lpm_val;
+      struct real_definition *src_real = bpf_map_lookup_elem(
+        maps->reals, &key);
+      if (src_real && (src_real->flags & F_REAL_DOWN)) {
+        // falling back to ch
+        src_found = false;
+      }
     }
-    __u32 stats_key = MAX_VIPS + LPM_SRC_CNTRS;
+    __u32 stats_key = limits->max_vips + LPM_SRC_CNTRS;
     struct lb_stats *data_stats = bpf_map_lookup_elem(&stats, &stats_key);
     if (data_stats) {
       if (src_found) {
@@ -116,26 +216,42 @@ static inline bool get_packet_dst(struct real_definition **real,
       pckt->flow.port16[0] = pckt->flow.port16[1];
       memset(pckt->flow.srcv6, 0, 16);
     }
-    hash = get_packet_hash(pckt, hash_16bytes) % RING_SIZE;
-    key = RING_SIZE * (vip_info->vip_num) + hash;
+    hash = get_packet_hash(pckt, hash_16bytes) % limits->ring_size;
+    key = limits->ring_size * (vip_info->vip_num) + hash;
 
-    real_pos = bpf_map_lookup_elem(&ch_rings, &key);
+    real_pos = bpf_map_lookup_elem(maps->ch_rings, &key);
     if(!real_pos) {
       return false;
     }
     key = *real_pos;
   }
-  pckt->real_index = key;
-  *real = bpf_map_lookup_elem(&reals, &key);
+  *real = bpf_map_lookup_elem(maps->reals, &key);
   if (!(*real)) {
     return false;
   }
+  if (!src_found && ((*real)->flags & F_REAL_DOWN) &&
+      probe_alive_real(real, &key, hash, vip_info, limits, maps)) {
+    __u32 down_stats_key = limits->max_vips + DOWN_REAL_CNTR;
+    struct lb_stats *down_stats = bpf_map_lookup_elem(
+      &stats, &down_stats_key);
+    if (down_stats) {
+      down_stats->v2 += 1;
+    }
+  }
+  pckt->real_index = key;
   if (!(vip_info->flags & F_LRU_BYPASS) && !under_flood) {
     if (pckt->flow.proto == IPPROTO_UDP) {
       new_dst_lru.atime = cur_time;
     }
     new_dst_lru.pos = key;
-    bpf_map_update_elem(lru_map, &pckt->flow, &new_dst_lru, BPF_ANY);
+    if (!bpf_map_update_elem(lru_map, &pckt->flow, &new_dst_lru, BPF_ANY)) {
+      __u32 insert_stats_key = limits->max_vips + LRU_INSERT_CNTR;
+      struct lb_stats *insert_stats = bpf_map_lookup_elem(
+        &stats, &insert_stats_key);
+      if (insert_stats) {
+        insert_stats->v1 += 1;
+      }
+    }
   }
   return true;
 }
@@ -143,7 +259,8 @@ static inline bool get_packet_dst(struct real_definition **real,
 __attribute__((__always_inline__))
 static inline void connection_table_lookup(struct real_definition **real,
                                            struct packet_description *pckt,
-                                           void *lru_map) {
+                                           void *lru_map,
+                                           struct lb_maps *maps) {
 
   struct real_pos_lru *dst_lru;
   __u64 cur_time;
@@ -161,7 +278,7 @@ static inline void connection_table_lookup(struct real_definition **real,
   }
   key = dst_lru->pos;
   pckt->real_index = key;
-  *real = bpf_map_lookup_elem(&reals, &key);
+  *real = bpf_map_lookup_elem(maps->reals, &key);
   return;
 }
 
@@ -239,7 +356,8 @@ static inline int process_l3_headers(struct packet_description *pckt,
 #ifdef INLINE_DECAP_GENERIC
 __attribute__((__always_inline__))
 static inline int check_decap_dst(struct packet_description *pckt,
-                                  bool is_ipv6, bool *pass) {
+                                  bool is_ipv6, bool *pass,
+                                  struct lb_limits *limits) {
     struct address dst_addr = {};
     struct lb_stats *data_stats;
 
@@ -252,7 +370,7 @@ static inline int check_decap_dst(struct packet_description *pckt,
 
     if (decap_dst_flags) {
       *pass = false;
-      __u32 stats_key = MAX_VIPS + REMOTE_ENCAP_CNTRS;
+      __u32 stats_key = limits->max_vips + REMOTE_ENCAP_CNTRS;
       data_stats = bpf_map_lookup_elem(&stats, &stats_key);
       if (!data_stats) {
         return XDP_DROP;
@@ -367,11 +485,14 @@ static inline int process_encaped_gue_pckt(void **data, void **data_end,
 
 __attribute__((__always_inline__))
 static inline int process_packet(void *data, __u64 off, void *data_end,
-                                 bool is_ipv6, struct xdp_md *xdp) {
+                                 bool is_ipv6, struct xdp_md *xdp,
+                                 struct verdict_info *verdict) {
 
   struct ctl_value *cval;
   struct real_definition *dst = NULL;
   struct packet_description pckt = {};
+  struct lb_limits limits;
+  struct lb_maps maps;
   struct vip_definition vip = {};
   struct vip_meta *vip_info;
   struct lb_stats *data_stats;
@@ -382,6 +503,7 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
   __u32 vip_num;
   __u32 mac_addr_pos = 0;
   __u16 pkt_bytes;
+  get_lb_limits(&limits);
   action = process_l3_headers(
     &pckt, &protocol, off, &pkt_bytes, data, data_end, is_ipv6);
   if (action >= 0) {
@@ -392,7 +514,8 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
   #ifdef INLINE_DECAP_IPIP
   if (protocol == IPPROTO_IPIP || protocol == IPPROTO_IPV6) {
     bool pass = true;
-    action = check_decap_dst(&pckt, is_ipv6, &pass);
+    SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_DECAP);
+    action = check_decap_dst(&pckt, is_ipv6, &pass, &limits);
     if (action >= 0) {
       return action;
     }
@@ -412,7 +535,8 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
   #ifdef INLINE_DECAP_GUE
     if (pckt.flow.port16[1] == bpf_htons(GUE_DPORT)) {
       bool pass = true;
-      action = check_decap_dst(&pckt, is_ipv6, &pass);
+      SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_DECAP);
+      action = check_decap_dst(&pckt, is_ipv6, &pass, &limits);
       if (action >= 0) {
         return action;
       }
@@ -421,22 +545,43 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
   #endif // of INLINE_DECAP_GUE
   } else {
     // send to tcp/ip stack
+    SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_NOT_VIP);
     return XDP_PASS;
   }
 
+  SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_NOT_VIP);
   if (is_ipv6) {
     memcpy(vip.vipv6, pckt.flow.dstv6, 16);
   } else {
     vip.vip = pckt.flow.dst;
   }
 
+#ifdef VIP_ADDR_PREFILTER
+  // port and proto are still 0
+  __u32 *vip_addr_flags = bpf_map_lookup_elem(&vip_addrs, &vip);
+  if (!vip_addr_flags) {
+    return XDP_PASS;
+  }
+#endif // of VIP_ADDR_PREFILTER
+
   vip.port = pckt.flow.port16[1];
   vip.proto = pckt.flow.proto;
-  vip_info = bpf_map_lookup_elem(&vip_map, &vip);
+  get_lb_maps(&maps);
+  vip_info = bpf_map_lookup_elem(maps.vip_map, &vip);
+#ifdef VIP_PORT_RANGES
+  if (!vip_info) {
+    vip_info = port_range_vip_lookup(&vip);
+  }
+#endif // of VIP_PORT_RANGES
   if (!vip_info) {
     vip.port = 0;
-    vip_info = bpf_map_lookup_elem(&vip_map, &vip);
+    vip_info = bpf_map_lookup_elem(maps.vip_map, &vip);
     if (!vip_info) {
+#ifdef VIP_ADDR_PREFILTER
+      if (*vip_addr_flags & F_DROP_UNKNOWN_PORTS) {
+        return XDP_DROP;
+      }
+#endif // of VIP_ADDR_PREFILTER
       return XDP_PASS;
     }
 
@@ -446,11 +591,14 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
       pckt.flow.port16[1] = 0;
     }
   }
+  SET_VERDICT_INFO(verdict, vip_num, vip_info->vip_num);
+  SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_LOOKUP);
 
   if (data_end - data > MAX_PCKT_SIZE) {
+    SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_TOOBIG);
     REPORT_PACKET_TOOBIG(xdp, data, data_end - data, false);
 #ifdef ICMP_TOOBIG_GENERATION
-    __u32 stats_key = MAX_VIPS + ICMP_TOOBIG_CNTRS;
+    __u32 stats_key = limits.max_vips + ICMP_TOOBIG_CNTRS;
     data_stats = bpf_map_lookup_elem(&stats, &stats_key);
     if (!data_stats) {
       return XDP_DROP;
@@ -466,7 +614,7 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
 #endif
   }
 
-  __u32 stats_key = MAX_VIPS + LRU_CNTRS;
+  __u32 stats_key = limits.max_vips + LRU_CNTRS;
   data_stats = bpf_map_lookup_elem(&stats, &stats_key);
   if (!data_stats) {
     return XDP_DROP;
@@ -476,7 +624,7 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
   data_stats->v1 += 1;
 
   if ((vip_info->flags & F_QUIC_VIP)) {
-    __u32 quic_stats_key = MAX_VIPS + QUIC_ROUTE_STATS;
+    __u32 quic_stats_key = limits.max_vips + QUIC_ROUTE_STATS;
     struct lb_stats* quic_stats = bpf_map_lookup_elem(&stats, &quic_stats_key);
     if (!quic_stats) {
       return XDP_DROP;
@@ -489,11 +637,17 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
       if (real_pos) {
         key = *real_pos;
         pckt.real_index = key;
-        dst = bpf_map_lookup_elem(&reals, &key);
+        dst = bpf_map_lookup_elem(maps.reals, &key);
         if (!dst) {
           return XDP_DROP;
         }
-        quic_stats->v2 += 1;
+        if (dst->flags & F_REAL_DOWN) {
+          // server from connection id is down. routing by ch
+          dst = NULL;
+          quic_stats->v1 += 1;
+        } else {
+          quic_stats->v2 += 1;
+        }
       } else {
         // increment counter for the CH based routing
         quic_stats->v1 += 1;
@@ -513,7 +667,7 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
     void *lru_map = bpf_map_lookup_elem(&lru_maps_mapping, &cpu_num);
     if (!lru_map) {
       lru_map = &fallback_lru_cache;
-      __u32 lru_stats_key = MAX_VIPS + FALLBACK_LRU_CNTR;
+      __u32 lru_stats_key = limits.max_vips + FALLBACK_LRU_CNTR;
       struct lb_stats *lru_stats = bpf_map_lookup_elem(&stats, &lru_stats_key);
       if (!lru_stats) {
         return XDP_DROP;
@@ -524,13 +678,28 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
       lru_stats->v1 += 1;
     }
 
+    // lru hit for the real, which is marked as down. not a miss for stats
+    bool moved_from_down_real = false;
     if (!(pckt.flags & F_SYN_SET) &&
         !(vip_info->flags & F_LRU_BYPASS)) {
-      connection_table_lookup(&dst, &pckt, lru_map);
+      connection_table_lookup(&dst, &pckt, lru_map, &maps);
+      if (dst && (dst->flags & F_REAL_DOWN)) {
+        // real has been marked as down. flow is moved to another real
+        // (and lru entry is overwritten w/ it by get_packet_dst)
+        dst = NULL;
+        moved_from_down_real = true;
+        __u32 down_stats_key = limits.max_vips + DOWN_REAL_CNTR;
+        struct lb_stats *down_stats = bpf_map_lookup_elem(
+          &stats, &down_stats_key);
+        if (down_stats) {
+          down_stats->v1 += 1;
+        }
+      }
+      SET_VERDICT_INFO(verdict, lru_hit, dst != NULL);
     }
     if (!dst) {
       if (pckt.flow.proto == IPPROTO_TCP) {
-        __u32 lru_stats_key = MAX_VIPS + LRU_MISS_CNTR;
+        __u32 lru_stats_key = limits.max_vips + LRU_MISS_CNTR;
         struct lb_stats *lru_stats = bpf_map_lookup_elem(
           &stats, &lru_stats_key);
         if (!lru_stats) {
@@ -539,7 +708,7 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
         if (pckt.flags & F_SYN_SET) {
           // miss because of new tcp session
           lru_stats->v1 += 1;
-        } else {
+        } else if (!moved_from_down_real) {
           // miss of non-syn tcp packet. could be either because of LRU trashing
           // or because another katran is restarting and all the sessions
           // have been reshuffled
@@ -547,7 +716,9 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
           lru_stats->v2 += 1;
         }
       }
-      if(!get_packet_dst(&dst, &pckt, vip_info, is_ipv6, lru_map)) {
+      SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_NO_REAL);
+      if(!get_packet_dst(
+            &dst, &pckt, vip_info, is_ipv6, lru_map, &limits, &maps)) {
         return XDP_DROP;
       }
       // lru misses (either new connection or lru is full and starts to trash)
@@ -555,6 +726,8 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
     }
   }
 
+  SET_VERDICT_INFO(verdict, real_index, pckt.real_index);
+  SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_ENCAP);
   cval = bpf_map_lookup_elem(&ctl_array, &mac_addr_pos);
 
   if (!cval) {
@@ -570,6 +743,7 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
       return XDP_DROP;
     }
   }
+  SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_FORWARDED);
   vip_num = vip_info->vip_num;
   data_stats = bpf_map_lookup_elem(&stats, &vip_num);
   if (!data_stats) {
@@ -589,8 +763,9 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
   return XDP_TX;
 }
 
-SEC("xdp-balancer")
-int balancer_ingress(struct xdp_md *ctx) {
+__attribute__((__always_inline__))
+static inline int process_frame(struct xdp_md *ctx,
+                                struct verdict_info *verdict) {
   void *data = (void *)(long)ctx->data;
   void *data_end = (void *)(long)ctx->data_end;
   struct eth_hdr *eth = data;
@@ -606,13 +781,26 @@ int balancer_ingress(struct xdp_md *ctx) {
   eth_proto = eth->eth_proto;
 
   if (eth_proto == BE_ETH_P_IP) {
-    return process_packet(data, nh_off, data_end, false, ctx);
+    return process_packet(data, nh_off, data_end, false, ctx, verdict);
   } else if (eth_proto == BE_ETH_P_IPV6) {
-    return process_packet(data, nh_off, data_end, true, ctx);
+    return process_packet(data, nh_off, data_end, true, ctx, verdict);
   } else {
     // pass to tcp/ip stack
+    SET_VERDICT_INFO(verdict, reason, VERDICT_REASON_NOT_VIP);
     return XDP_PASS;
   }
 }
 
+SEC("xdp-balancer")
+int balancer_ingress(struct xdp_md *ctx) {
+  struct verdict_info verdict = {};
+  int action = process_frame(ctx, &verdict);
+  REPORT_PACKET_VERDICT(ctx, action, &verdict);
+#ifdef KATRAN_EXIT_HOOK
+  // no-op if there is no program registered for this verdict
+  bpf_tail_call(ctx, &exit_hook, action);
+#endif
+  return action;
+}
+
 char _license[] SEC("license") = "GPL";
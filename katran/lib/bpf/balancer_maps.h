@@ -38,6 +38,43 @@ struct bpf_map_def SEC("maps") vip_map = {
 };
 BPF_ANNOTATE_KV_PAIR(vip_map, struct vip_definition, struct vip_meta);
 
+#ifdef VIP_ADDR_PREFILTER
+// addresses of all vips (port and proto are 0) w/ F_DROP_UNKNOWN_PORTS flags
+struct bpf_map_def SEC("maps") vip_addrs = {
+  .type = BPF_MAP_TYPE_HASH,
+  .key_size = sizeof(struct vip_definition),
+  .value_size = sizeof(__u32),
+  .max_entries = MAX_VIPS,
+  .map_flags = NO_FLAGS,
+};
+BPF_ANNOTATE_KV_PAIR(vip_addrs, struct vip_definition, __u32);
+#endif // of VIP_ADDR_PREFILTER
+
+#ifdef VIP_PORT_RANGES
+// vips defined over port range. consulted if there is no exact match in
+// vip_map. all prefixes of the range share one vip_meta (and so vip_num)
+struct bpf_map_def SEC("maps") vip_port_ranges = {
+  .type = BPF_MAP_TYPE_LPM_TRIE,
+  .key_size = sizeof(struct vip_port_lpm_key),
+  .value_size = sizeof(struct vip_meta),
+  .max_entries = MAX_VIP_PORT_RANGES,
+  .map_flags = BPF_F_NO_PREALLOC,
+};
+BPF_ANNOTATE_KV_PAIR(
+  vip_port_ranges, struct vip_port_lpm_key, struct vip_meta);
+#endif // of VIP_PORT_RANGES
+
+
+// map w/ runtime limits (max vips and ring size), which userspace has used
+// to size the maps
+struct bpf_map_def SEC("maps") lb_limits_map = {
+  .type = BPF_MAP_TYPE_ARRAY,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(struct lb_limits),
+  .max_entries = 1,
+  .map_flags = NO_FLAGS,
+};
+BPF_ANNOTATE_KV_PAIR(lb_limits_map, __u32, struct lb_limits);
 
 // map which contains cpu core to lru mapping
 struct bpf_map_def SEC("maps") lru_maps_mapping = {
@@ -78,6 +115,44 @@ struct bpf_map_def SEC("maps") reals = {
 };
 BPF_ANNOTATE_KV_PAIR(reals, __u32, struct real_definition);
 
+#ifdef NUMA_REPLICAS
+// cpu to numa replica's index mapping. 0 - no replica (main maps are used)
+struct bpf_map_def SEC("maps") cpu_numa_map = {
+  .type = BPF_MAP_TYPE_ARRAY,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(__u32),
+  .max_entries = MAX_SUPPORTED_CPUS,
+  .map_flags = NO_FLAGS,
+};
+BPF_ANNOTATE_KV_PAIR(cpu_numa_map, __u32, __u32);
+
+// per numa node replicas of vip_map, ch_rings and reals. they are kept in
+// sync w/ the main maps by userspace
+struct bpf_map_def SEC("maps") vip_map_numa = {
+  .type = BPF_MAP_TYPE_ARRAY_OF_MAPS,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(__u32),
+  .max_entries = MAX_NUMA_NODES + 1,
+  .map_flags = NO_FLAGS,
+};
+
+struct bpf_map_def SEC("maps") ch_rings_numa = {
+  .type = BPF_MAP_TYPE_ARRAY_OF_MAPS,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(__u32),
+  .max_entries = MAX_NUMA_NODES + 1,
+  .map_flags = NO_FLAGS,
+};
+
+struct bpf_map_def SEC("maps") reals_numa = {
+  .type = BPF_MAP_TYPE_ARRAY_OF_MAPS,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(__u32),
+  .max_entries = MAX_NUMA_NODES + 1,
+  .map_flags = NO_FLAGS,
+};
+#endif // of NUMA_REPLICAS
+
 // map with per real pps/bps statistic
 struct bpf_map_def SEC("maps") reals_stats = {
   .type = BPF_MAP_TYPE_PERCPU_ARRAY,
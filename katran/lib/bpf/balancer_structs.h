@@ -107,6 +107,19 @@ struct v6_lpm_key {
     __be32 addr[4];
 };
 
+// key for port range vips lookups. address and proto are always matched
+// fully, port - by prefix (vip's port range is split into prefixes)
+struct vip_port_lpm_key {
+  __u32 prefixlen;
+  union {
+    __be32 vip;
+    __be32 vipv6[4];
+  };
+  __u8 proto;
+  __u8 pad;
+  __be16 port;
+};
+
 struct address {
   union {
     __be32 addr;
@@ -114,6 +127,34 @@ struct address {
   };
 };
 
+// limits w/ which maps have been sized by userspace. written once on load.
+// global counters in stats map are located at max_vips + *_CNTR offset
+struct lb_limits {
+  __u32 max_vips;
+  __u32 ring_size;
+};
+
+// read mostly maps, which are used for forwarding decision. either the main
+// ones or replicas from forwarding core's numa node (NUMA_REPLICAS).
+// datapath only
+struct lb_maps {
+  void *vip_map;
+  void *ch_rings;
+  void *reals;
+};
+
+// what katran has done w/ the packet (PACKET_VERDICT event). defined
+// regardless of introspection flags: datapath always passes it around, but
+// fills it only w/ KATRAN_VERDICT_INTROSPECTION
+struct verdict_info {
+  __u32 action;
+  __u32 reason;
+  __u32 vip_num;
+  __u32 real_index;
+  __u8 lru_hit;
+  __u8 pad[3];
+} __attribute__((__packed__));
+
 #ifdef KATRAN_INTROSPECTION
 // metadata about packet, copied to the userspace through event pipe
 struct event_metadata {
@@ -122,5 +163,10 @@ struct event_metadata {
   __u32 data_len;
 } __attribute__((__packed__));
 
+struct verdict_event {
+  struct event_metadata md;
+  struct verdict_info info;
+} __attribute__((__packed__));
+
 #endif
 #endif // of _BALANCER_STRUCTS
@@ -59,7 +59,7 @@ struct bpf_map_def SEC("maps") decap_dst = {
     .type = BPF_MAP_TYPE_HASH,
     .key_size = sizeof(struct address),
     .value_size = sizeof(__u32),
-    .max_entries = MAX_VIPS,
+    .max_entries = MAX_DECAP_DST,
     .map_flags = NO_FLAGS,
 };
 BPF_ANNOTATE_KV_PAIR(decap_dst, struct address, __u32);
@@ -73,6 +73,19 @@ struct bpf_map_def SEC("maps") katran_subprograms = {
 BPF_ANNOTATE_KV_PAIR(katran_subprograms, __u32, __u32);
 #endif
 
+#ifdef KATRAN_EXIT_HOOK
+// programs which are called (e.g. by xdpdump for post-katran capture) after
+// the packet has been processed. index is the verdict; called program is
+// responsible to return it
+struct bpf_map_def SEC("maps") exit_hook = {
+    .type = BPF_MAP_TYPE_PROG_ARRAY,
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(__u32),
+    .max_entries = EXIT_HOOK_ARRAY_SIZE,
+};
+BPF_ANNOTATE_KV_PAIR(exit_hook, __u32, __u32);
+#endif
+
 #ifdef GUE_ENCAP
 // map which src ip address for outer ip packet while using GUE encap
 // NOTE: This is not a stable API. This is to be reworked when static
@@ -42,8 +42,13 @@
 
 #define V6DADDR (1 << 0)
 
-#define HC_SRC_MAC_POS 0
-#define HC_DST_MAC_POS 1
+// position of hc_ctrl_data inside hc_ctrl_data_map
+#define HC_CTRL_DATA_POS 0
+
+// if defined - hc_reals_map is a dense array indexed by (somark - somark_base)
+// instead of a hash. requires so marks to be allocated from contiguous range
+// [somark_base, somark_base + MAX_REALS)
+// #define HC_REALS_ARRAY
 
 
 #endif // of __HEALTHCHECKING_CONSTS_H
@@ -165,4 +165,20 @@ __attribute__((__always_inline__)) static inline bool hc_encap_gue(
 }
 
 
+__attribute__((__always_inline__)) static inline void hc_account_real(
+  struct hc_real_stats *real_stats,
+  __u32 pckt_len,
+  bool dropped) {
+  if (!real_stats) {
+    return;
+  }
+  if (dropped) {
+    real_stats->pckts_dropped += 1;
+    real_stats->bytes_dropped += pckt_len;
+  } else {
+    real_stats->pckts_encaped += 1;
+    real_stats->bytes_encaped += pckt_len;
+  }
+}
+
 #endif // of __HEALTHCHECKING_HELPERS_H
@@ -35,16 +35,17 @@ SEC("cls-hc")
 int healthchecker(struct __sk_buff *skb)
 {
   __u32 stats_key = GENERIC_STATS_INDEX;
-  __u32 key = HC_MAIN_INTF_POSITION;
+  __u32 key = HC_CTRL_DATA_POS;
   __u32 somark = skb->mark;
-  __u32 ifindex = 0;
+  __u32 pckt_len = skb->len;
   __u64 flags = 0;
   bool is_ipv6 = false;
   int adjust_len = 0;
   int ret = 0;
   struct hc_stats* prog_stats;
+  struct hc_ctrl_data* ctrl;
+  struct hc_real_stats* real_stats;
   struct ethhdr* ethh;
-  struct hc_mac *esrc, *edst;
   struct hc_real_definition *src;
   prog_stats = bpf_map_lookup_elem(&hc_stats_map, &stats_key);
   if (!prog_stats) {
@@ -56,45 +57,45 @@ int healthchecker(struct __sk_buff *skb)
     return TC_ACT_UNSPEC;
   }
 
-  struct hc_real_definition *real = bpf_map_lookup_elem(&hc_reals_map,
-                                                     &somark);
+  ctrl = bpf_map_lookup_elem(&hc_ctrl_data_map, &key);
+  if (!ctrl) {
+    // we dont have ifindex and macs for main interface
+    // not much we can do without em. Drop packet so that hc will fail
+    prog_stats->pckts_dropped += 1;
+    return TC_ACT_SHOT;
+  }
+
+  // for array based reals map out of range keys (incl. somark < base, which
+  // would wrap around) are rejected by the lookup itself
+  key = somark - ctrl->somark_base;
+  struct hc_real_definition *real = bpf_map_lookup_elem(&hc_reals_map, &key);
   if(!real) {
     // some strange (w/ fwmark; but not a healthcheck) local packet
     prog_stats->pckts_skipped += 1;
     return TC_ACT_UNSPEC;
   }
+#ifdef HC_REALS_ARRAY
+  if (!real->flags && !real->daddr) {
+    // unused entry of the array
+    prog_stats->pckts_skipped += 1;
+    return TC_ACT_UNSPEC;
+  }
+#endif
+  // could be NULL only if userspace has not created the entry yet.
+  // accounting is skipped
+  real_stats = bpf_map_lookup_elem(&hc_reals_stats_map, &key);
 
-  if (skb->len > HC_MAX_PACKET_SIZE) {
+  if (pckt_len > HC_MAX_PACKET_SIZE) {
     // do not allow packets bigger than the specified size
     prog_stats->pckts_dropped += 1;
     prog_stats->pckts_too_big += 1;
-    return TC_ACT_SHOT;
-  }
-
-  __u32* intf_ifindex = bpf_map_lookup_elem(&hc_ctrl_map, &key);
-  if (!intf_ifindex) {
-    // we dont have ifindex for main interface
-    // not much we can do without it. Drop packet so that hc will fail
-    prog_stats->pckts_dropped += 1;
-    return TC_ACT_SHOT;
-  }
-
-  key = HC_SRC_MAC_POS;
-  esrc = bpf_map_lookup_elem(&hc_pckt_macs, &key);
-  if (!esrc) {
-    prog_stats->pckts_dropped += 1;
-    return TC_ACT_SHOT;
-  }
-
-  key = HC_DST_MAC_POS;
-  edst = bpf_map_lookup_elem(&hc_pckt_macs, &key);
-  if (!edst) {
-    prog_stats->pckts_dropped += 1;
+    hc_account_real(real_stats, pckt_len, true);
     return TC_ACT_SHOT;
   }
 
   if ((skb->data + sizeof(struct ethhdr)) > skb->data_end) {
     prog_stats->pckts_dropped += 1;
+    hc_account_real(real_stats, pckt_len, true);
     return TC_ACT_SHOT;
   }
 
@@ -108,20 +109,23 @@ int healthchecker(struct __sk_buff *skb)
 
   if (!HC_ENCAP(skb, real, ethh, is_ipv6)) {
     prog_stats->pckts_dropped += 1;
+    hc_account_real(real_stats, pckt_len, true);
     return TC_ACT_SHOT;
   }
 
   if (skb->data + sizeof(struct ethhdr) > skb->data_end) {
     prog_stats->pckts_dropped += 1;
+    hc_account_real(real_stats, pckt_len, true);
     return TC_ACT_SHOT;
   }
 
   ethh = (void*)(long)skb->data;
-  memcpy(ethh->h_source, esrc->mac, 6);
-  memcpy(ethh->h_dest, edst->mac, 6);
+  memcpy(ethh->h_source, ctrl->src.mac, 6);
+  memcpy(ethh->h_dest, ctrl->dst.mac, 6);
 
   prog_stats->pckts_processed += 1;
-  return bpf_redirect(*intf_ifindex, REDIRECT_EGRESS);
+  hc_account_real(real_stats, pckt_len, false);
+  return bpf_redirect(ctrl->ifindex, REDIRECT_EGRESS);
 }
 
 char _license[] SEC("license") = "GPL";
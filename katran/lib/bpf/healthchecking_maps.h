@@ -33,7 +33,11 @@ struct bpf_map_def SEC("maps") hc_ctrl_map = {
 BPF_ANNOTATE_KV_PAIR(hc_ctrl_map, __u32, __u32);
 
 struct bpf_map_def SEC("maps") hc_reals_map = {
+#ifdef HC_REALS_ARRAY
+    .type = BPF_MAP_TYPE_ARRAY,
+#else
     .type = BPF_MAP_TYPE_HASH,
+#endif
     .key_size = sizeof(__u32),
     .value_size = sizeof(struct hc_real_definition),
     .max_entries = MAX_REALS,
@@ -49,14 +53,15 @@ struct bpf_map_def SEC("maps") hc_pckt_srcs_map = {
 };
 BPF_ANNOTATE_KV_PAIR(hc_pckt_srcs_map, __u32, struct hc_real_definition);
 
-struct bpf_map_def SEC("maps") hc_pckt_macs = {
+// ifindex of main interface, src/dst macs and somark's base
+struct bpf_map_def SEC("maps") hc_ctrl_data_map = {
   .type = BPF_MAP_TYPE_ARRAY,
   .key_size = sizeof(__u32),
-  .value_size = sizeof(struct hc_mac),
-  .max_entries = 2,
+  .value_size = sizeof(struct hc_ctrl_data),
+  .max_entries = 1,
   .map_flags = NO_FLAGS,
 };
-BPF_ANNOTATE_KV_PAIR(hc_pckt_macs, __u32, struct hc_mac);
+BPF_ANNOTATE_KV_PAIR(hc_ctrl_data_map, __u32, struct hc_ctrl_data);
 
 // map which contains counters for monitoring
 struct bpf_map_def SEC("maps") hc_stats_map = {
@@ -68,6 +73,22 @@ struct bpf_map_def SEC("maps") hc_stats_map = {
 };
 BPF_ANNOTATE_KV_PAIR(hc_stats_map, __u32, struct hc_stats);
 
+// per real counters. indexed by the same key as hc_reals_map
+// (somark - somark_base). for hash based hc_reals_map entries are created
+// (and removed) by userspace together w/ the real
+struct bpf_map_def SEC("maps") hc_reals_stats_map = {
+#ifdef HC_REALS_ARRAY
+    .type = BPF_MAP_TYPE_PERCPU_ARRAY,
+#else
+    .type = BPF_MAP_TYPE_PERCPU_HASH,
+#endif
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(struct hc_real_stats),
+    .max_entries = MAX_REALS,
+    .map_flags = NO_FLAGS,
+};
+BPF_ANNOTATE_KV_PAIR(hc_reals_stats_map, __u32, struct hc_real_stats);
+
 
 
 #endif // of __HEALTHCHECKING_MAPS_H
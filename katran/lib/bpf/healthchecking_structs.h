@@ -33,9 +33,27 @@ struct hc_stats {
   __u64 pckts_too_big;
 };
 
+// per real (somark) counters of healthchecks.
+// bytes are accounted before encapsulation
+struct hc_real_stats {
+  __u64 pckts_encaped;
+  __u64 bytes_encaped;
+  __u64 pckts_dropped;
+  __u64 bytes_dropped;
+};
+
 // struct to store mac address
 struct hc_mac {
   __u8 mac[6];
 };
 
+// everything which is required to forward healthcheck (besides real itself).
+// stored in single array's entry so it could be fetched w/ single lookup
+struct hc_ctrl_data {
+  __u32 ifindex;
+  __u32 somark_base;
+  struct hc_mac src;
+  struct hc_mac dst;
+};
+
 #endif // of __HEALTHCHECKING_STRUCTS_H
@@ -21,6 +21,18 @@
 // constants which does not depend on the introspection flag
 #define TCP_NONSYN_LRUMISS 0
 #define PACKET_TOOBIG 1
+#define PACKET_VERDICT 2
+
+// stage of processing at which packet got its verdict (reported in
+// PACKET_VERDICT event). for dropped packet it is the reason of the drop
+#define VERDICT_REASON_PARSE 0
+#define VERDICT_REASON_DECAP 1
+#define VERDICT_REASON_NOT_VIP 2
+#define VERDICT_REASON_TOOBIG 3
+#define VERDICT_REASON_LOOKUP 4
+#define VERDICT_REASON_NO_REAL 5
+#define VERDICT_REASON_ENCAP 6
+#define VERDICT_REASON_FORWARDED 7
 
 #ifdef KATRAN_INTROSPECTION
 // Introspection enabled, enable helpers
@@ -40,3 +52,13 @@
 #define REPORT_TCP_NONSYN_LRUMISS(...) {}
 #define REPORT_PACKET_TOOBIG(...) {}
 #endif
+
+#ifdef KATRAN_VERDICT_INTROSPECTION
+// records what katran has done w/ the packet; reported on balancer's exit
+#define SET_VERDICT_INFO(info, field, val) ((info)->field = (val))
+#define REPORT_PACKET_VERDICT(xdp, action, info)                 \
+               submit_verdict_event((xdp), &event_pipe, (action), (info))
+#else
+#define SET_VERDICT_INFO(...) {}
+#define REPORT_PACKET_VERDICT(...) {}
+#endif
@@ -90,37 +90,55 @@ void BpfTester::testPcktsFromPcap() {
   uint32_t output_pckt_size{0};
   uint32_t prog_ret_val{0};
   uint64_t pckt_num{1};
+  uint64_t failed{0};
+  std::unordered_map<int, uint64_t> results;
+  folly::ByteRange pckt;
+  // output buffer is reused for all the packets
+  auto buf = folly::IOBuf::create(kMaxXdpPcktSize);
   while (true) {
-    auto buf = folly::IOBuf::create(kMaxXdpPcktSize);
-    auto pckt = parser_.getPacketFromPcap();
-    if (pckt == nullptr) {
+    if (!parser_.getPacketFromPcap(pckt)) {
       VLOG(2) << "we have read all the packets from pcap file";
       break;
     }
+    // pckt points into read only mapping of the input file; kernel only
+    // copies it from there
     auto res = adapter_.testXdpProg(
         config_.bpfProgFd,
         kTestRepeatCount,
-        pckt->writableData(),
-        pckt->length(),
+        const_cast<uint8_t*>(pckt.data()),
+        pckt.size(),
         buf->writableData(),
         &output_pckt_size,
         &prog_ret_val);
     if (res < 0) {
       LOG(INFO) << "failed to run bpf test on pckt #" << pckt_num;
+      ++failed;
       ++pckt_num;
       continue;
     }
     if (prog_ret_val > 3) {
       LOG(INFO) << "unsupported return value: " << prog_ret_val;
     } else {
-      LOG(INFO) << "xdp run's result from pckt #" << pckt_num << " is "
-                << kXdpCodes[prog_ret_val];
+      VLOG(2) << "xdp run's result from pckt #" << pckt_num << " is "
+              << kXdpCodes[prog_ret_val];
+    }
+    ++results[prog_ret_val];
+    if (!config_.outputFileName.empty()) {
+      // adjust IOBuf so data data_end will acount for writen data
+      buf->clear();
+      buf->append(output_pckt_size);
+      writePcapOutput(buf->cloneOne());
     }
-    // adjust IOBuf so data data_end will acount for writen data
-    buf->append(output_pckt_size);
-    writePcapOutput(buf->cloneOne());
     ++pckt_num;
   }
+  LOG(INFO) << "processed " << pckt_num - 1 << " packets from pcap file, "
+            << failed << " failed runs";
+  for (const auto& result : results) {
+    auto code = kXdpCodes.find(result.first);
+    LOG(INFO) << (code != kXdpCodes.end() ? code->second
+                                          : std::to_string(result.first))
+              << ": " << result.second;
+  }
 }
 
 void BpfTester::testFromFixture() {
@@ -134,7 +152,8 @@ void BpfTester::testClsFromFixture(
   for (auto& ctx : ctxs_in) {
     ctxs.push_back(&ctx);
   }
-  runBpfTesterFromFixtures(progFd, kTcCodes, {});
+  runBpfTesterFromFixtures(
+      progFd, kTcCodes, ctxs, sizeof(struct __sk_buff));
 }
 
 void BpfTester::runBpfTesterFromFixtures(
@@ -226,6 +245,32 @@ void BpfTester::resetTestFixtures(
 }
 
 void BpfTester::testPerfFromFixture(uint32_t repeat, const int position) {
+  runPerfTesterFromFixtures(config_.bpfProgFd, repeat, position, {});
+}
+
+void BpfTester::testClsPerfFromFixture(
+    int progFd,
+    std::vector<struct __sk_buff> ctxs_in,
+    uint32_t repeat,
+    const int position) {
+  std::vector<void*> ctxs;
+  for (auto& ctx : ctxs_in) {
+    ctxs.push_back(&ctx);
+  }
+  runPerfTesterFromFixtures(
+      progFd, repeat, position, ctxs, sizeof(struct __sk_buff));
+}
+
+void BpfTester::runPerfTesterFromFixtures(
+    int progFd,
+    uint32_t repeat,
+    const int position,
+    std::vector<void*> ctxs_in,
+    uint32_t ctx_size) {
+  if (ctxs_in.size() != 0 && ctxs_in.size() != config_.inputData.size()) {
+    LOG(INFO) << "ctxs and input datasets must have equal number of elements";
+    return;
+  }
   // for inputData format is <pckt_base64, test description>
   int first_index{0}, last_index{0};
   uint32_t duration{0};
@@ -240,17 +285,20 @@ void BpfTester::testPerfFromFixture(uint32_t repeat, const int position) {
     last_index = first_index + 1;
   }
   for (int i = first_index; i < last_index; i++) {
+    void* ctx_in = ctxs_in.size() != 0 ? ctxs_in[i] : nullptr;
     auto buf = folly::IOBuf::create(kMaxXdpPcktSize);
     auto input_pckt = parser_.getPacketFromBase64(config_.inputData[i].first);
     auto res = adapter_.testXdpProg(
-        config_.bpfProgFd,
+        progFd,
         repeat,
         input_pckt->writableData(),
         input_pckt->length(),
         buf->writableData(),
         nullptr, // output pckt size
         nullptr, // retval
-        &duration);
+        &duration,
+        ctx_in,
+        ctx_size);
     if (res < 0) {
       LOG(INFO) << "failed to run bpf test on pckt #" << pckt_num;
       ++pckt_num;
@@ -78,9 +78,9 @@ class BpfTester {
 
   /**
    * helper function which reads pckts from pcap file, uses em as an input
-   * for bpf program and logs a result of the program's run. optionaly
-   * (if output file is specified) writes modified (after prog's run) packet
-   * to output file.
+   * for bpf program and logs a summary of the program's results (result
+   * for each packet is logged w/ -v=2). optionaly (if output file is
+   * specified) writes modified (after prog's run) packet to output file.
    */
   void testPcktsFromPcap();
 
@@ -124,6 +124,22 @@ class BpfTester {
    */
   void testPerfFromFixture(uint32_t repeat, const int position = -1);
 
+  /**
+   * @param int progFd descriptor of clsact(tc) bpf program
+   * @param std::vector<struct __skb_buff> input contexts for test run
+   * @param int repeat      how many time should we repeat the test
+   * @param int position    of the packet if fixtures vector.
+   * helper function to run perf test for clsact(tc) based bpf program (e.g.
+   * healthchecking one) on specified packet from test fixtures.
+   * if position is negative - run perf tests on every packet in fixtures.
+   * if ctxs are specified - there must be one per packet in fixtures
+   */
+  void testClsPerfFromFixture(
+      int progFd,
+      std::vector<struct __sk_buff> ctxs_in,
+      uint32_t repeat,
+      const int position = -1);
+
   /**
    * @param IOBuf with packet data to write.
    *
@@ -140,6 +156,15 @@ class BpfTester {
       std::vector<void*> ctxs_in,
       uint32_t ctx_size = 0);
 
+  // helper to run perf tests from fixtures. if len of ctxs is not null - it
+  // must be the same as the size of input fixtures
+  void runPerfTesterFromFixtures(
+      int progFd,
+      uint32_t repeat,
+      const int position,
+      std::vector<void*> ctxs_in,
+      uint32_t ctx_size = 0);
+
   TesterConfig config_;
   PcapParser parser_;
   BpfAdapter adapter_;
@@ -43,7 +43,7 @@ namespace testing {
 const std::vector<struct __sk_buff> getInputCtxsForHcTest() {
     std::vector<struct __sk_buff> v;
     for (int i = 0 ; i < 3 ; i++) {
-        struct __sk_buff skb;
+        struct __sk_buff skb = {};
         skb.mark = i;
         v.push_back(skb);
     }
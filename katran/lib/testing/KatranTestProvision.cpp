@@ -149,6 +149,9 @@ void preparePerfTestingLbData(katran::KatranLb& lb) {
   for (auto& dst : kReals) {
     lb.addInlineDecapDst(dst);
   }
+  // so marked packets in hc perf tests would be encapsulated
+  lb.addHealthcheckerDst(1, "10.0.0.1");
+  lb.addHealthcheckerDst(2, "10.0.0.2");
 }
 
 } // namespace testing
@@ -41,14 +41,7 @@ PcapParser::PcapParser(
     const std::string& outputFile)
     : inputFileName_(inputFile), outputFileName_(outputFile) {
   if (!inputFile.empty()) {
-    // readonly by default
-    try {
-      inputFile_ = folly::File(inputFile);
-    } catch (const std::exception& e) {
-      LOG(ERROR) << "exception while opening file " << inputFile << " : "
-                 << e.what();
-      throw;
-    }
+    inputReader_ = std::make_unique<PcapReader>(inputFile);
   }
 
   if (!outputFile.empty()) {
@@ -63,12 +56,6 @@ PcapParser::PcapParser(
 }
 
 PcapParser::~PcapParser() {
-  if (!inputFileName_.empty()) {
-    auto res = inputFile_.closeNoThrow();
-    if (!res) {
-      LOG(INFO) << "error while closing file: " << inputFileName_;
-    }
-  }
   if (!outputFileName_.empty()) {
     auto res = outputFile_.closeNoThrow();
     if (!res) {
@@ -78,56 +65,23 @@ PcapParser::~PcapParser() {
 }
 
 std::unique_ptr<folly::IOBuf> PcapParser::getPacketFromPcap() {
-  const struct pcaprec_hdr_s* pcaprec_hdr;
-  std::string tmpBuf;
-  uint32_t pkt_len;
-  bool res;
-  if (inputFileName_.empty()) {
-    LOG(INFO) << "no input filed specified";
+  folly::ByteRange pckt;
+  if (!getPacketFromPcap(pckt)) {
     return nullptr;
   }
-  auto fd = inputFile_.fd();
-  if (firstRead_) {
-    firstRead_ = false;
-    // read pcap header in the beginning of the file and some sanity checking
-    const struct pcap_hdr_s* pcap_hdr;
-    res = folly::readFile(fd, tmpBuf, sizeof(struct pcap_hdr_s));
-    if (!res || tmpBuf.size() != sizeof(struct pcap_hdr_s)) {
-      LOG(ERROR) << "cant read pcap_hdr_s from input file";
-      return nullptr;
-    }
-    pcap_hdr = reinterpret_cast<const struct pcap_hdr_s*>(tmpBuf.c_str());
-
-    VLOG(2) << "pcap hdr:"
-            << "\nversion major: " << pcap_hdr->version_major
-            << "\nversion minor: " << pcap_hdr->version_minor
-            << "\nmagic number: " << pcap_hdr->magic_number
-            << "\nnetwork: " << pcap_hdr->network;
+  return folly::IOBuf::copyBuffer(pckt.data(), pckt.size());
+}
 
-    snaplen_ = pcap_hdr->snaplen;
-    VLOG(2) << "snaplen: " << snaplen_;
-  }
-  // read per record header and some sanity checking.
-  res = folly::readFile(fd, tmpBuf, sizeof(struct pcaprec_hdr_s));
-  if (!res || tmpBuf.size() != sizeof(struct pcaprec_hdr_s)) {
-    LOG(ERROR) << "cant read pcaprec_hdr_s from input file";
-    return nullptr;
-  }
-  pcaprec_hdr = reinterpret_cast<const struct pcaprec_hdr_s*>(tmpBuf.c_str());
-  pkt_len = pcaprec_hdr->incl_len;
-  VLOG(2) << "pckt len: " << pkt_len;
-  if (pkt_len > snaplen_) {
-    LOG(INFO) << "error in pcap file. incl_len > snaplen";
-    return nullptr;
+bool PcapParser::getPacketFromPcap(folly::ByteRange& pckt) {
+  if (!inputReader_) {
+    LOG(INFO) << "no input filed specified";
+    return false;
   }
-  // read pckt from pcap file
-  res = folly::readFile(fd, tmpBuf, pkt_len);
-  if (!res || tmpBuf.size() != pkt_len) {
-    LOG(ERROR) << "cant read packet from pcap file";
-    return nullptr;
+  if (!inputReader_->next(pckt)) {
+    return false;
   }
-  auto buf = folly::IOBuf::copyBuffer(tmpBuf);
-  return buf;
+  VLOG(2) << "pckt len: " << pckt.size();
+  return true;
 }
 
 std::string PcapParser::getPacketFromPcapBase64() {
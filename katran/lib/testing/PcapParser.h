@@ -20,9 +20,11 @@
 #include <string>
 
 #include <folly/File.h>
+#include <folly/Range.h>
 #include <folly/io/IOBuf.h>
 
 #include "katran/lib/PcapStructs.h"
+#include "katran/lib/testing/PcapReader.h"
 
 namespace katran {
 
@@ -32,7 +34,8 @@ namespace katran {
 class PcapParser {
  public:
   /**
-   * @param string inputFile optional input pcap file to read pckts from
+   * @param string inputFile optional input pcap (or pcapng) file to read
+   * pckts from
    * @param string outputFile optional output file where pckts would be
    * writen in pcap format.
    */
@@ -50,6 +53,15 @@ class PcapParser {
    */
   std::unique_ptr<folly::IOBuf> getPacketFromPcap();
 
+  /**
+   * @param ByteRange& pckt view of the next packet from pcap
+   * @return bool false if there is no more packets left in a file
+   *
+   * zero copy version of getPacketFromPcap: pckt points into the memory
+   * mapped inputFile and stays valid while the parser is alive
+   */
+  bool getPacketFromPcap(folly::ByteRange& pckt);
+
   /**
    * @return string packet from pcap file encoded in base64 format
    *
@@ -89,12 +101,6 @@ class PcapParser {
   bool writePacket(std::unique_ptr<folly::IOBuf> pckt);
 
  private:
-  /**
-   * flag which indicates that this is a first read from pcap file
-   * (so we would need to read generic pcap header first)
-   */
-  bool firstRead_{true};
-
   /**
    * flag which indicates that this is a first write to pcap file (so we would
    * need to write generic pcap header first).
@@ -108,16 +114,14 @@ class PcapParser {
   std::string outputFileName_;
 
   /**
-   * file objects for pcap files
+   * reader of input pcap file
    */
-  folly::File inputFile_;
-  folly::File outputFile_;
+  std::unique_ptr<PcapReader> inputReader_;
 
   /**
-   * maximum packet's size declared in generic pcap header. used for sanity
-   * checking.
+   * file object for output pcap file
    */
-  uint32_t snaplen_{0};
+  folly::File outputFile_;
 };
 
 } // namespace katran
@@ -0,0 +1,270 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "katran/lib/testing/PcapReader.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include <folly/String.h>
+#include <folly/lang/Bits.h>
+#include <glog/logging.h>
+
+#include "katran/lib/PcapStructs.h"
+
+namespace katran {
+
+namespace {
+constexpr uint32_t kPcapMagic = 0xa1b2c3d4;
+constexpr uint32_t kPcapNsecMagic = 0xa1b23c4d;
+constexpr uint32_t kPcapngShb = 0x0A0D0D0A;
+constexpr uint32_t kPcapngIdb = 0x00000001;
+constexpr uint32_t kPcapngSpb = 0x00000003;
+constexpr uint32_t kPcapngEpb = 0x00000006;
+constexpr uint32_t kPcapngByteOrderMagic = 0x1A2B3C4D;
+// block's header + block's total length at the end of the block
+constexpr std::size_t kPcapngMinBlockLen =
+    sizeof(pcapng_block_hdr) + sizeof(uint32_t);
+// pages are released/prefetched in the chunks of this size
+constexpr std::size_t kAdviseWindow = 64 * 1024 * 1024;
+} // namespace
+
+PcapReader::PcapReader(const std::string& fileName) {
+  try {
+    file_ = folly::File(fileName);
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "exception while opening file " << fileName << " : "
+               << e.what();
+    throw;
+  }
+  struct stat st;
+  if (::fstat(file_.fd(), &st)) {
+    throw std::runtime_error(
+        "can't stat " + fileName + ": " + folly::errnoStr(errno));
+  }
+  size_ = st.st_size;
+  if (size_ == 0) {
+    throw std::runtime_error("empty pcap file: " + fileName);
+  }
+  auto data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_.fd(), 0);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error(
+        "can't mmap " + fileName + ": " + folly::errnoStr(errno));
+  }
+  data_ = static_cast<const uint8_t*>(data);
+  // hints are best effort: failure only affects speed
+  ::madvise(data, size_, MADV_SEQUENTIAL);
+  ::madvise(data, std::min(size_, 2 * kAdviseWindow), MADV_WILLNEED);
+  try {
+    parseFileHeader();
+  } catch (const std::exception&) {
+    ::munmap(data, size_);
+    throw;
+  }
+}
+
+PcapReader::~PcapReader() {
+  ::munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+const uint8_t* PcapReader::getData(std::size_t offset, std::size_t len) const {
+  if (offset > size_ || len > size_ - offset) {
+    return nullptr;
+  }
+  return data_ + offset;
+}
+
+uint16_t PcapReader::get16(const uint8_t* ptr) const {
+  uint16_t value;
+  std::memcpy(&value, ptr, sizeof(value));
+  return swapped_ ? folly::Endian::swap(value) : value;
+}
+
+uint32_t PcapReader::get32(const uint8_t* ptr) const {
+  uint32_t value;
+  std::memcpy(&value, ptr, sizeof(value));
+  return swapped_ ? folly::Endian::swap(value) : value;
+}
+
+void PcapReader::parseFileHeader() {
+  auto hdr = getData(0, sizeof(uint32_t));
+  if (!hdr) {
+    throw std::runtime_error("file is too short to be pcap file");
+  }
+  auto magic = get32(hdr);
+  if (magic == kPcapngShb) {
+    // section header block is parsed as any other pcapng's block
+    pcapng_ = true;
+    return;
+  }
+  hdr = getData(0, sizeof(struct pcap_hdr_s));
+  if (!hdr) {
+    throw std::runtime_error("file is too short to be pcap file");
+  }
+  if (magic != kPcapMagic && magic != kPcapNsecMagic) {
+    swapped_ = true;
+    magic = get32(hdr);
+    if (magic != kPcapMagic && magic != kPcapNsecMagic) {
+      throw std::runtime_error("unknown magic number of pcap file");
+    }
+  }
+  snaplen_ = get32(hdr + offsetof(struct pcap_hdr_s, snaplen));
+  VLOG(2) << "pcap hdr:"
+          << "\nversion major: "
+          << get16(hdr + offsetof(struct pcap_hdr_s, version_major))
+          << "\nversion minor: "
+          << get16(hdr + offsetof(struct pcap_hdr_s, version_minor))
+          << "\nmagic number: " << magic
+          << "\nnetwork: " << get32(hdr + offsetof(struct pcap_hdr_s, network))
+          << "\nsnaplen: " << snaplen_;
+  offset_ = sizeof(struct pcap_hdr_s);
+}
+
+bool PcapReader::next(folly::ByteRange& pckt) {
+  advise();
+  auto res = pcapng_ ? nextPcapngPacket(pckt) : nextPcapPacket(pckt);
+  if (res) {
+    ++packetsRead_;
+  }
+  return res;
+}
+
+bool PcapReader::nextPcapPacket(folly::ByteRange& pckt) {
+  if (offset_ == size_) {
+    return false;
+  }
+  auto rec = getData(offset_, sizeof(struct pcaprec_hdr_s));
+  if (!rec) {
+    LOG(ERROR) << "truncated pcaprec_hdr_s at offset " << offset_;
+    return false;
+  }
+  auto pkt_len = get32(rec + offsetof(struct pcaprec_hdr_s, incl_len));
+  if (pkt_len > snaplen_) {
+    LOG(INFO) << "error in pcap file. incl_len > snaplen";
+    return false;
+  }
+  auto data = getData(offset_ + sizeof(struct pcaprec_hdr_s), pkt_len);
+  if (!data) {
+    LOG(ERROR) << "truncated packet at offset " << offset_;
+    return false;
+  }
+  pckt = folly::ByteRange(data, pkt_len);
+  offset_ += sizeof(struct pcaprec_hdr_s) + pkt_len;
+  return true;
+}
+
+bool PcapReader::nextPcapngPacket(folly::ByteRange& pckt) {
+  while (offset_ != size_) {
+    auto block = getData(offset_, kPcapngMinBlockLen);
+    if (!block) {
+      LOG(ERROR) << "truncated pcapng block at offset " << offset_;
+      return false;
+    }
+    auto type = get32(block);
+    if (type == kPcapngShb) {
+      // byte order could differ between sections
+      auto shb = getData(
+          offset_ + sizeof(struct pcapng_block_hdr), sizeof(struct pcapng_shb));
+      if (!shb) {
+        LOG(ERROR) << "truncated section header block at offset " << offset_;
+        return false;
+      }
+      swapped_ = false;
+      if (get32(shb) != kPcapngByteOrderMagic) {
+        swapped_ = true;
+        if (get32(shb) != kPcapngByteOrderMagic) {
+          LOG(ERROR) << "unknown byte order magic at offset " << offset_;
+          return false;
+        }
+      }
+      // interface ids are local to the section
+      snaplens_.clear();
+    }
+    auto len =
+        get32(block + offsetof(struct pcapng_block_hdr, block_total_length));
+    if (len < kPcapngMinBlockLen || len % sizeof(uint32_t) ||
+        !getData(offset_, len)) {
+      LOG(ERROR) << "malformed pcapng block at offset " << offset_;
+      return false;
+    }
+    auto body = block + sizeof(struct pcapng_block_hdr);
+    std::size_t bodyLen = len - kPcapngMinBlockLen;
+    offset_ += len;
+    if (type == kPcapngIdb) {
+      if (bodyLen < sizeof(struct pcapng_idb)) {
+        LOG(ERROR) << "malformed interface description block";
+        return false;
+      }
+      snaplens_.push_back(get32(body + offsetof(struct pcapng_idb, snaplen)));
+    } else if (type == kPcapngEpb) {
+      if (bodyLen < sizeof(struct pcapng_epb)) {
+        LOG(ERROR) << "malformed enhanced packet block";
+        return false;
+      }
+      auto pkt_len = get32(body + offsetof(struct pcapng_epb, captured_len));
+      if (pkt_len > bodyLen - sizeof(struct pcapng_epb)) {
+        LOG(ERROR) << "captured_len is bigger than enhanced packet block";
+        return false;
+      }
+      pckt = folly::ByteRange(body + sizeof(struct pcapng_epb), pkt_len);
+      return true;
+    } else if (type == kPcapngSpb) {
+      if (bodyLen < sizeof(uint32_t) || snaplens_.empty()) {
+        LOG(ERROR) << "malformed simple packet block";
+        return false;
+      }
+      // captured length is not recorded: it is min(orig_len, snaplen)
+      std::size_t pkt_len = get32(body);
+      if (snaplens_[0]) {
+        pkt_len = std::min<std::size_t>(pkt_len, snaplens_[0]);
+      }
+      if (pkt_len > bodyLen - sizeof(uint32_t)) {
+        LOG(ERROR) << "orig_len is bigger than simple packet block";
+        return false;
+      }
+      pckt = folly::ByteRange(body + sizeof(uint32_t), pkt_len);
+      return true;
+    }
+    // skipping blocks w/o packets (statistics, name resolution etc)
+  }
+  return false;
+}
+
+void PcapReader::advise() {
+  if (offset_ < releasedOffset_ + 2 * kAdviseWindow) {
+    return;
+  }
+  // keeping one window behind current offset, as it could contain packets
+  // which have been returned recently. released pages are still valid and
+  // would be read from the file again if touched.
+  auto start = const_cast<uint8_t*>(data_) + releasedOffset_;
+  ::madvise(start, kAdviseWindow, MADV_DONTNEED);
+  releasedOffset_ += kAdviseWindow;
+  auto prefetchOffset = releasedOffset_ + 2 * kAdviseWindow;
+  if (prefetchOffset < size_) {
+    ::madvise(
+        const_cast<uint8_t*>(data_) + prefetchOffset,
+        std::min(kAdviseWindow, size_ - prefetchOffset),
+        MADV_WILLNEED);
+  }
+}
+
+} // namespace katran
@@ -0,0 +1,134 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <folly/File.h>
+#include <folly/Range.h>
+
+namespace katran {
+
+/**
+ * sequential reader of pcap and pcapng files. file is mmap'ed and packets are
+ * returned as views into the mapped memory: there are no reads, copies or
+ * allocations per packet, so even multi-GB captures could be replayed fast.
+ * pages which have been already read are released as reader moves forward
+ * (so memory footprint does not depend on the size of the file).
+ */
+class PcapReader {
+ public:
+  /**
+   * @param string fileName path to pcap or pcapng file
+   *
+   * throws std::runtime_error if file could not be mapped or if it is neither
+   * pcap nor pcapng file
+   */
+  explicit PcapReader(const std::string& fileName);
+
+  ~PcapReader();
+
+  PcapReader(const PcapReader&) = delete;
+  PcapReader& operator=(const PcapReader&) = delete;
+
+  /**
+   * @param ByteRange& pckt view of the next packet in the file. it stays
+   * valid until reader is destroyed
+   * @return bool false if there is no more packets (or file is malformed)
+   */
+  bool next(folly::ByteRange& pckt);
+
+  /**
+   * @return uint64_t number of packets which have been read so far
+   */
+  uint64_t getPacketsRead() const {
+    return packetsRead_;
+  }
+
+  /**
+   * @return bool true if file is in pcapng format
+   */
+  bool isPcapng() const {
+    return pcapng_;
+  }
+
+ private:
+  /**
+   * parses generic header of pcap file or section header block of pcapng one
+   */
+  void parseFileHeader();
+
+  /**
+   * helpers which read next packet record of pcap/pcapng file
+   */
+  bool nextPcapPacket(folly::ByteRange& pckt);
+  bool nextPcapngPacket(folly::ByteRange& pckt);
+
+  /**
+   * @return pointer to len bytes at offset or nullptr if file is too short
+   */
+  const uint8_t* getData(std::size_t offset, std::size_t len) const;
+
+  /**
+   * @return field of the file's header/record in host byte order
+   */
+  uint16_t get16(const uint8_t* ptr) const;
+  uint32_t get32(const uint8_t* ptr) const;
+
+  /**
+   * gives kernel hints about access pattern: releases pages we have already
+   * read and asks to prefetch ones which are going to be read next
+   */
+  void advise();
+
+  folly::File file_;
+
+  /**
+   * start and size of mapped file
+   */
+  const uint8_t* data_{nullptr};
+  std::size_t size_{0};
+
+  /**
+   * offset of the next record to read
+   */
+  std::size_t offset_{0};
+
+  /**
+   * offset up to which pages have been released
+   */
+  std::size_t releasedOffset_{0};
+
+  /**
+   * true if file has been written w/ different byte order than ours
+   */
+  bool swapped_{false};
+
+  bool pcapng_{false};
+
+  /**
+   * max packet's size from pcap header (for pcapng: of each interface)
+   */
+  uint32_t snaplen_{0};
+  std::vector<uint32_t> snaplens_;
+
+  uint64_t packetsRead_{0};
+};
+
+} // namespace katran
@@ -0,0 +1,215 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+
+#include "katran/lib/testing/PcapParser.h"
+#include "katran/lib/testing/PcapReader.h"
+
+extern "C" {
+#include <unistd.h>
+}
+
+namespace katran {
+
+namespace {
+constexpr uint32_t kPcapngShb = 0x0A0D0D0A;
+constexpr uint32_t kPcapngIdb = 0x00000001;
+constexpr uint32_t kPcapngSpb = 0x00000003;
+constexpr uint32_t kPcapngIsb = 0x00000005;
+constexpr uint32_t kPcapngEpb = 0x00000006;
+constexpr uint32_t kPcapngByteOrderMagic = 0x1A2B3C4D;
+constexpr uint32_t kSnapLen = 65535;
+
+void append16(std::string& buf, uint16_t value, bool swapped = false) {
+  if (swapped) {
+    value = __builtin_bswap16(value);
+  }
+  buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append32(std::string& buf, uint32_t value, bool swapped = false) {
+  if (swapped) {
+    value = __builtin_bswap32(value);
+  }
+  buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendBlock(std::string& buf, uint32_t type, const std::string& body) {
+  // body is expected to be padded to 32 bits
+  uint32_t len = body.size() + 3 * sizeof(uint32_t);
+  append32(buf, type);
+  append32(buf, len);
+  buf.append(body);
+  append32(buf, len);
+}
+
+std::string pcapHeader(bool swapped) {
+  std::string hdr;
+  append32(hdr, 0xa1b2c3d4, swapped);
+  append16(hdr, 2, swapped);
+  append16(hdr, 4, swapped);
+  append32(hdr, 0, swapped);
+  append32(hdr, 0, swapped);
+  append32(hdr, kSnapLen, swapped);
+  append32(hdr, 1, swapped);
+  return hdr;
+}
+
+void appendPcapRecord(
+    std::string& buf,
+    const std::string& pckt,
+    bool swapped = false) {
+  append32(buf, 0, swapped);
+  append32(buf, 0, swapped);
+  append32(buf, pckt.size(), swapped);
+  append32(buf, pckt.size(), swapped);
+  buf.append(pckt);
+}
+
+std::string toString(folly::ByteRange range) {
+  return std::string(reinterpret_cast<const char*>(range.data()), range.size());
+}
+} // namespace
+
+class PcapReaderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/pcapreader.XXXXXX";
+    int fd = ::mkstemp(tmpl);
+    ASSERT_GE(fd, 0);
+    ::close(fd);
+    path = tmpl;
+  }
+
+  void TearDown() override {
+    ::unlink(path.c_str());
+  }
+
+  void writeFile(const std::string& content) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << content;
+  }
+
+  std::string path;
+};
+
+TEST_F(PcapReaderTest, testPcap) {
+  {
+    PcapParser writer("", path);
+    ASSERT_TRUE(writer.writePacket(folly::IOBuf::copyBuffer("first pckt")));
+    ASSERT_TRUE(writer.writePacket(folly::IOBuf::copyBuffer("second")));
+  }
+  PcapReader reader(path);
+  folly::ByteRange pckt;
+  ASSERT_FALSE(reader.isPcapng());
+  ASSERT_TRUE(reader.next(pckt));
+  ASSERT_EQ(toString(pckt), "first pckt");
+  ASSERT_TRUE(reader.next(pckt));
+  ASSERT_EQ(toString(pckt), "second");
+  ASSERT_FALSE(reader.next(pckt));
+  ASSERT_EQ(reader.getPacketsRead(), 2);
+}
+
+TEST_F(PcapReaderTest, testSwappedPcap) {
+  auto content = pcapHeader(true);
+  appendPcapRecord(content, "pckt", true);
+  writeFile(content);
+  PcapReader reader(path);
+  folly::ByteRange pckt;
+  ASSERT_TRUE(reader.next(pckt));
+  ASSERT_EQ(toString(pckt), "pckt");
+  ASSERT_FALSE(reader.next(pckt));
+}
+
+TEST_F(PcapReaderTest, testTruncatedPcap) {
+  auto content = pcapHeader(false);
+  appendPcapRecord(content, "full");
+  appendPcapRecord(content, "truncated");
+  content.resize(content.size() - 1);
+  writeFile(content);
+  PcapReader reader(path);
+  folly::ByteRange pckt;
+  ASSERT_TRUE(reader.next(pckt));
+  ASSERT_EQ(toString(pckt), "full");
+  ASSERT_FALSE(reader.next(pckt));
+}
+
+TEST_F(PcapReaderTest, testPcapng) {
+  std::string content;
+  std::string body;
+  append32(body, kPcapngByteOrderMagic);
+  append16(body, 1);
+  append16(body, 0);
+  append32(body, 0xffffffff);
+  append32(body, 0xffffffff);
+  appendBlock(content, kPcapngShb, body);
+  body.clear();
+  append16(body, 1);
+  append16(body, 0);
+  append32(body, 4);
+  appendBlock(content, kPcapngIdb, body);
+  // block w/o packets must be skipped
+  appendBlock(content, kPcapngIsb, std::string(12, '\0'));
+  body.clear();
+  append32(body, 0);
+  append32(body, 0);
+  append32(body, 0);
+  append32(body, 5);
+  append32(body, 5);
+  body.append("epb12\0\0\0", 8);
+  appendBlock(content, kPcapngEpb, body);
+  // captured length of simple packet block is limited by snaplen
+  body.clear();
+  append32(body, 6);
+  body.append("spb123\0\0", 8);
+  appendBlock(content, kPcapngSpb, body);
+  writeFile(content);
+
+  PcapReader reader(path);
+  folly::ByteRange pckt;
+  ASSERT_TRUE(reader.isPcapng());
+  ASSERT_TRUE(reader.next(pckt));
+  ASSERT_EQ(toString(pckt), "epb12");
+  ASSERT_TRUE(reader.next(pckt));
+  ASSERT_EQ(toString(pckt), "spb1");
+  ASSERT_FALSE(reader.next(pckt));
+  ASSERT_EQ(reader.getPacketsRead(), 2);
+}
+
+TEST_F(PcapReaderTest, testUnknownFormat) {
+  writeFile(std::string(64, 'x'));
+  ASSERT_THROW(PcapReader reader(path), std::runtime_error);
+}
+
+TEST_F(PcapReaderTest, testParserCopy) {
+  auto content = pcapHeader(false);
+  appendPcapRecord(content, "pckt");
+  writeFile(content);
+  PcapParser parser(path);
+  auto pckt = parser.getPacketFromPcap();
+  ASSERT_NE(pckt, nullptr);
+  ASSERT_EQ(pckt->moveToFbString().toStdString(), "pckt");
+  ASSERT_EQ(parser.getPacketFromPcap(), nullptr);
+}
+
+} // namespace katran
@@ -0,0 +1,186 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// loads katran's bpf programs w/ verifier stats enabled, prints load time
+// statistics and checks them against limits and (optionally) against
+// the baseline from previous run. used by check_bpf_complexity.sh to track
+// datapath complexity for each combination of compile time features.
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "katran/lib/KatranLb.h"
+#include "katran/lib/testing/KatranTestProvision.h"
+
+using namespace katran::testing;
+
+DEFINE_string(balancer_prog, "./balancer_kern.o", "path to balancer bpf prog");
+DEFINE_string(healthchecking_prog, "", "path to healthchecking bpf prog");
+DEFINE_string(
+    feature_set,
+    "default",
+    "name of compile time features' combination the progs were built with");
+DEFINE_bool(
+    numa_replicas,
+    false,
+    "balancer prog has been built w/ -DNUMA_REPLICAS");
+DEFINE_string(output, "", "csv file where stats would be appended");
+DEFINE_string(
+    baseline,
+    "",
+    "csv file (output of previous run) to compare processed insns with");
+DEFINE_uint32(
+    max_growth_pct,
+    10,
+    "max allowed growth of processed insns compared to baseline");
+DEFINE_uint64(
+    max_processed_insns,
+    1000000,
+    "max allowed number of insns processed by verifier (0 - no limit)");
+DEFINE_uint64(
+    max_load_time_ms,
+    0,
+    "max allowed load time of bpf object (0 - no limit)");
+
+namespace {
+constexpr char kCsvHeader[] =
+    "feature_set,prog,object_load_time_us,verification_time_us,"
+    "processed_insns,total_states,peak_states,insn_cnt,xlated_size,"
+    "jited_size";
+constexpr size_t kFeatureSetField = 0;
+constexpr size_t kProgField = 1;
+constexpr size_t kProcessedInsnsField = 4;
+constexpr uint64_t kPctBase = 100;
+
+// (feature set, prog) -> processed insns
+using Baseline = std::map<std::pair<std::string, std::string>, uint64_t>;
+
+Baseline readBaseline(const std::string& path) {
+  Baseline baseline;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::vector<std::string> fields;
+    folly::split(',', line, fields);
+    if (fields.size() <= kProcessedInsnsField || line == kCsvHeader) {
+      continue;
+    }
+    try {
+      baseline[{fields[kFeatureSetField], fields[kProgField]}] =
+          std::stoull(fields[kProcessedInsnsField]);
+    } catch (const std::exception&) {
+      LOG(WARNING) << "malformed baseline line: " << line;
+    }
+  }
+  return baseline;
+}
+
+std::string toCsv(const katran::BpfProgLoadStats& stats) {
+  return folly::sformat(
+      "{},{},{},{},{},{},{},{},{},{}",
+      FLAGS_feature_set,
+      stats.name,
+      stats.objectLoadTimeUs,
+      stats.verificationTimeUs,
+      stats.processedInsns,
+      stats.totalStates,
+      stats.peakStates,
+      stats.insnCnt,
+      stats.xlatedSize,
+      stats.jitedSize);
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = 1;
+
+  katran::KatranConfig kconfig{kMainInterface,
+                               kV4TunInterface,
+                               kV6TunInterface,
+                               FLAGS_balancer_prog,
+                               FLAGS_healthchecking_prog,
+                               kDefaultMac,
+                               kDefaultPriority,
+                               kNoExternalMap,
+                               kDefaultKatranPos};
+  kconfig.enableHc = !FLAGS_healthchecking_prog.empty();
+  kconfig.verifierStats = true;
+  if (FLAGS_numa_replicas) {
+    kconfig.numaReplicas = true;
+    for (int cpu = 0; cpu < katran::BpfAdapter::getOnlineCpus(); cpu++) {
+      kconfig.forwardingCores.push_back(cpu);
+    }
+  }
+  katran::KatranLb lb(kconfig);
+  lb.loadBpfProgs();
+
+  Baseline baseline;
+  if (!FLAGS_baseline.empty()) {
+    baseline = readBaseline(FLAGS_baseline);
+  }
+  std::ofstream output;
+  if (!FLAGS_output.empty()) {
+    bool exists = std::ifstream(FLAGS_output).good();
+    output.open(FLAGS_output, std::ios::app);
+    if (!exists) {
+      output << kCsvHeader << "\n";
+    }
+  }
+
+  bool failed = false;
+  std::cout << kCsvHeader << "\n";
+  for (const auto& stats : lb.getBpfProgLoadStats()) {
+    auto line = toCsv(stats);
+    std::cout << line << "\n";
+    if (output.is_open()) {
+      output << line << "\n";
+    }
+    if (FLAGS_max_processed_insns &&
+        stats.processedInsns > FLAGS_max_processed_insns) {
+      LOG(ERROR) << stats.name << ": verifier processed "
+                 << stats.processedInsns << " insns; limit is "
+                 << FLAGS_max_processed_insns;
+      failed = true;
+    }
+    if (FLAGS_max_load_time_ms &&
+        stats.objectLoadTimeUs / 1000 > FLAGS_max_load_time_ms) {
+      LOG(ERROR) << stats.name << ": load took " << stats.objectLoadTimeUs
+                 << " us; limit is " << FLAGS_max_load_time_ms << " ms";
+      failed = true;
+    }
+    auto base = baseline.find({FLAGS_feature_set, stats.name});
+    if (base != baseline.end() && base->second &&
+        stats.processedInsns * kPctBase >
+            base->second * (kPctBase + FLAGS_max_growth_pct)) {
+      LOG(ERROR) << stats.name << ": processed insns grew from "
+                 << base->second << " to " << stats.processedInsns
+                 << " (more than " << FLAGS_max_growth_pct << "%)";
+      failed = true;
+    }
+  }
+  return failed ? 1 : 0;
+}
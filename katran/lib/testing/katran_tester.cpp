@@ -14,16 +14,22 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <thread>
 
+#include <sched.h>
+
 #include <folly/File.h>
 #include <folly/FileUtil.h>
+#include <folly/IPAddressV4.h>
 #include <folly/Range.h>
 #include <folly/Conv.h>
+#include <folly/io/IOBuf.h>
 #include <gflags/gflags.h>
 
+#include "katran/lib/testing/Base64Helpers.h"
 #include "katran/lib/testing/BpfTester.h"
 #include "katran/lib/testing/KatranTestProvision.h"
 #include "katran/lib/testing/KatranGueOptionalTestFixtures.h"
@@ -52,6 +58,21 @@ DEFINE_bool(gue, false, "run GUE tests instead of IPIP ones");
 DEFINE_int32(repeat, 1000000, "perf test runs for single packet");
 DEFINE_int32(position, -1, "perf test runs for single packet");
 DEFINE_bool(iobuf_storage, false, "test iobuf storage for katran monitor");
+DEFINE_bool(
+    numa_replicas,
+    false,
+    "use per numa node replicas of read mostly maps (all online cpus are "
+    "forwarding cores). bpf prog must be built w/ -DNUMA_REPLICAS");
+DEFINE_bool(
+    lru_resize_tests,
+    false,
+    "run tests of per core lru resizing (all online cpus are forwarding "
+    "cores). requires kernel 5.10+");
+DEFINE_int32(
+    perf_cpu,
+    -1,
+    "pin perf tests to this cpu (e.g. to compare local and remote numa "
+    "node w/ and w/o numa_replicas). -1 - do not pin");
 
 
 void testSimulator(katran::KatranLb& lb) {
@@ -177,6 +198,21 @@ void testHcFromFixture(katran::KatranLb& lb, katran::BpfTester& tester) {
   tester.testClsFromFixture(lb.getHealthcheckerProgFd(), ctxs);
 }
 
+void testHcPerfFromFixture(katran::KatranLb& lb, katran::BpfTester& tester) {
+  if (lb.getHealthcheckerProgFd() < 0) {
+    LOG(INFO) << "Healthchecking not enabled. Skipping HC perf tests";
+    return;
+  }
+  // 1st packet w/o fwmark shows the cost which healthchecking prog adds to
+  // every non healthcheck's packet on the interface
+  tester.resetTestFixtures(
+      katran::testing::inputHCTestFixtures,
+      katran::testing::outputHCTestFixtures);
+  auto ctxs = katran::testing::getInputCtxsForHcTest();
+  tester.testClsPerfFromFixture(
+      lb.getHealthcheckerProgFd(), ctxs, FLAGS_repeat);
+}
+
 void testOptionalLbCounters(katran::KatranLb& lb) {
   LOG(INFO) << "Testing optional counter's sanity";
   auto stats = lb.getIcmpTooBigStats();
@@ -305,6 +341,168 @@ void testLbCounters(katran::KatranLb& lb) {
   return;
 }
 
+void testNumaReplicas(katran::KatranLb& lb) {
+  LOG(INFO) << "Testing numa replicas. Printing on errors only";
+  if (!lb.validateNumaReplicas()) {
+    LOG(INFO) << "numa replicas are out of sync after provisioning";
+  }
+  // runtime changes must be applied to all replicas as well
+  katran::VipKey vip;
+  vip.address = "10.200.1.1";
+  vip.port = kVipPort;
+  vip.proto = kTcp;
+  katran::NewReal real;
+  real.address = "10.0.0.100";
+  real.weight = 1;
+  lb.addRealForVip(real, vip);
+  vip.port = kVipPort + 1;
+  lb.addVip(vip);
+  lb.addRealForVip(real, vip);
+  if (!lb.validateNumaReplicas()) {
+    LOG(INFO) << "numa replicas are out of sync after adding vip and real";
+  }
+  lb.delVip(vip);
+  vip.port = kVipPort;
+  lb.delRealForVip(real, vip);
+  if (!lb.validateNumaReplicas()) {
+    LOG(INFO) << "numa replicas are out of sync after deleting vip and real";
+  }
+  LOG(INFO) << "Testing of numa replicas is complete";
+}
+
+void testLruResize(katran::KatranLb& lb, katran::BpfTester& tester) {
+  // test runs of bpf prog are executed on the calling cpu, so all new flows
+  // are going to be inserted into the lru of this core
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(0, &cpus);
+  if (::sched_setaffinity(0, sizeof(cpus), &cpus)) {
+    LOG(ERROR) << "can't pin lru resize tests to cpu 0";
+    return;
+  }
+  tester.testFromFixture();
+  auto before = lb.getLruFillStats(true);
+  auto resized = lb.rebalanceLrus();
+  if (resized <= 0) {
+    LOG(INFO) << "lrus have not been resized: " << resized
+              << ". expected on kernels w/o support of inner maps of "
+              << "different sizes";
+    return;
+  }
+  auto after = lb.getLruFillStats(true);
+  LOG(INFO) << "Testing lru resize. Printing on errors only";
+  if (after.size() != before.size()) {
+    LOG(INFO) << "number of forwarding cores has changed after lru resize";
+    return;
+  }
+  for (int i = 0; i < after.size(); i++) {
+    if (after[i].entries != before[i].entries) {
+      VLOG(2) << "entries before: " << before[i].entries
+              << " after: " << after[i].entries;
+      LOG(INFO) << "flows were not copied into resized lru of core "
+                << after[i].core;
+    }
+    if (after[i].core == 0 && after[i].maxEntries <= before[i].maxEntries) {
+      VLOG(2) << "size before: " << before[i].maxEntries
+              << " after: " << after[i].maxEntries;
+      LOG(INFO) << "lru of the core w/ all inserts has not been grown";
+    }
+  }
+  auto lb_stats = lb.getKatranLbStats();
+  if (lb_stats.bpfFailedCalls != 0) {
+    VLOG(2) << "failed bpf calls: " << lb_stats.bpfFailedCalls;
+    LOG(INFO) << "swap of resized lru failed";
+  }
+  LOG(INFO) << "Testing of lru resize is complete";
+}
+
+// rewrites destination of the outer ipv4 header of ipip encapsulated packet
+// (in base64) and recalculates its checksum
+std::string setEncapDst(const std::string& pckt, const std::string& dst) {
+  constexpr size_t kIpOffset = 14;
+  constexpr size_t kIpHdrSize = 20;
+  constexpr size_t kCsumOffset = kIpOffset + 10;
+  constexpr size_t kDstOffset = kIpOffset + 16;
+  auto data = katran::Base64Helpers::base64Decode(pckt);
+  if (data.size() < kIpOffset + kIpHdrSize) {
+    return "";
+  }
+  auto addr = folly::IPAddressV4(dst).toByteArray();
+  std::copy(addr.begin(), addr.end(), data.begin() + kDstOffset);
+  data[kCsumOffset] = 0;
+  data[kCsumOffset + 1] = 0;
+  uint32_t csum = 0;
+  for (size_t i = kIpOffset; i < kIpOffset + kIpHdrSize; i += 2) {
+    csum += (static_cast<uint8_t>(data[i]) << 8) |
+        static_cast<uint8_t>(data[i + 1]);
+  }
+  while (csum >> 16) {
+    csum = (csum & 0xffff) + (csum >> 16);
+  }
+  csum = ~csum & 0xffff;
+  data[kCsumOffset] = csum >> 8;
+  data[kCsumOffset + 1] = csum & 0xff;
+  auto buf = folly::IOBuf::copyBuffer(data);
+  return katran::Base64Helpers::base64Encode(buf.get());
+}
+
+void testRealDown(katran::KatranLb& lb, katran::BpfTester& tester) {
+  // flow of the 2nd packet from fixtures. ch ring maps it to this real
+  const std::string down_real = "10.0.0.3";
+  const auto flow = katran::KatranFlow{
+      .src = "192.168.1.1",
+      .dst = "10.200.1.1",
+      .srcPort = 31337,
+      .dstPort = 80,
+      .proto = kTcp,
+  };
+  LOG(INFO) << "Testing of real marked as down. Printing on errors only";
+  // simulator sends syn: ch ring lookup + probing of next positions. as a
+  // side effect lru entry of the flow is overwritten w/ the real we got
+  lb.setRealDown(down_real, true);
+  auto alive_real = lb.getRealForFlow(flow);
+  lb.setRealDown(down_real, false);
+  if (alive_real.empty() || alive_real == down_real) {
+    VLOG(2) << "real: " << alive_real;
+    LOG(INFO) << "flow has not been moved from the down real by ch ring probe";
+    return;
+  }
+  // pointing flow's lru entry back to the real
+  auto real = lb.getRealForFlow(flow);
+  if (real != down_real) {
+    VLOG(2) << "real: " << real;
+    LOG(INFO) << "ch ring lookup is incorrect after real is up again";
+    return;
+  }
+  lb.setRealDown(down_real, true);
+  auto lru_miss_stats = lb.getLruMissStats();
+  auto down_stats = lb.getDownRealStats();
+  // 1st packet: lru hit on the down real; moved by ch ring probe and lru
+  // entry is overwritten. 2nd one: lru hit on the new real
+  auto expected = setEncapDst(
+      katran::testing::outputTestFixtures[1].first, alive_real);
+  tester.resetTestFixtures(
+      {{katran::testing::inputTestFixtures[1].first,
+        "non syn packet. lru hit on real marked as down"},
+       {katran::testing::inputTestFixtures[1].first,
+        "non syn packet. lru entry moved from down real"}},
+      {{expected, "XDP_TX"}, {expected, "XDP_TX"}});
+  tester.testFromFixture();
+  auto stats = lb.getDownRealStats();
+  if (stats.v1 != down_stats.v1 + 1 || stats.v2 != down_stats.v2 + 1) {
+    VLOG(2) << "moved from lru: " << stats.v1 - down_stats.v1
+            << " from ring: " << stats.v2 - down_stats.v2;
+    LOG(INFO) << "down real counter is incorrect";
+  }
+  stats = lb.getLruMissStats();
+  if (stats.v2 != lru_miss_stats.v2) {
+    VLOG(2) << "TCP non-syns: " << stats.v2 - lru_miss_stats.v2;
+    LOG(INFO) << "flow moved from down real is counted as non-syn lru miss";
+  }
+  lb.setRealDown(down_real, false);
+  LOG(INFO) << "Testing of real marked as down is complete";
+}
+
 int main(int argc, char** argv) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
@@ -349,6 +547,14 @@ int main(int argc, char** argv) {
   kconfig.katranSrcV4 = "10.0.13.37";
   kconfig.katranSrcV6 = "fc00:2307::1337";
   kconfig.localMac = kLocalMac;
+  if (FLAGS_numa_replicas) {
+    kconfig.numaReplicas = true;
+  }
+  if (FLAGS_numa_replicas || FLAGS_lru_resize_tests) {
+    for (int cpu = 0; cpu < katran::BpfAdapter::getOnlineCpus(); cpu++) {
+      kconfig.forwardingCores.push_back(cpu);
+    }
+  }
 
   katran::KatranLb lb(kconfig);
   lb.loadBpfProgs();
@@ -373,6 +579,9 @@ int main(int argc, char** argv) {
       testKatranMonitor(lb);
     }
     testHcFromFixture(lb, tester);
+    if (FLAGS_numa_replicas) {
+      testNumaReplicas(lb);
+    }
     if (FLAGS_optional_tests) {
       prepareOptionalLbData(lb);
       LOG(INFO) << "Running optional tests. they could fail if requirements "
@@ -389,11 +598,29 @@ int main(int argc, char** argv) {
       tester.testFromFixture();
       testOptionalLbCounters(lb);
     }
+    // fixture is built from ipip one and relies on shared (fallback) lru
+    if (!FLAGS_gue && !FLAGS_numa_replicas) {
+      testRealDown(lb, tester);
+    }
+    return 0;
+  } else if (FLAGS_lru_resize_tests) {
+    testLruResize(lb, tester);
     return 0;
   } else if (FLAGS_perf_testing) {
     // for perf tests to work katran must be compiled w -DINLINE_DECAP
     preparePerfTestingLbData(lb);
+    if (FLAGS_perf_cpu >= 0) {
+      // test runs of bpf prog are executed on the calling cpu
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(FLAGS_perf_cpu, &cpus);
+      if (::sched_setaffinity(0, sizeof(cpus), &cpus)) {
+        LOG(ERROR) << "can't pin perf tests to cpu " << FLAGS_perf_cpu;
+        return 1;
+      }
+    }
     tester.testPerfFromFixture(FLAGS_repeat, FLAGS_position);
+    testHcPerfFromFixture(lb, tester);
   }
   return 0;
 }
@@ -0,0 +1,143 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdlib>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/BpfAdapter.h"
+#include "katran/lib/BpfLoader.h"
+
+namespace katran {
+
+namespace {
+// path to balancer's bpf object. tests, which are loading it into the kernel
+// (and so require root), are skipped if it is not set
+constexpr char kBalancerProgEnv[] = "KATRAN_TEST_BALANCER_PROG";
+constexpr char kBalancerProgName[] = "xdp-balancer";
+
+std::string getBalancerProg() {
+  auto path = std::getenv(kBalancerProgEnv);
+  return path == nullptr ? "" : path;
+}
+
+// maps are compared by id: reused map is reachable through another fd
+uint32_t getMapId(int fd) {
+  struct bpf_map_info info = {};
+  if (BpfAdapter::getBpfMapInfo(fd, &info)) {
+    return 0;
+  }
+  return info.id;
+}
+} // namespace
+
+TEST(BpfLoaderTest, testParseVerifierStats) {
+  // output of verifier w/ BPF_LOG_STATS log level
+  std::string log =
+      "verification time 31587 usec\n"
+      "stack depth 0+128+40\n"
+      "processed 25071 insns (limit 1000000) max_states_per_insn 12 "
+      "total_states 1468 peak_states 1131 mark_read 181\n";
+  BpfProgLoadStats stats;
+  ASSERT_TRUE(BpfLoader::parseVerifierStats(log, stats));
+  ASSERT_EQ(stats.verificationTimeUs, 31587);
+  ASSERT_EQ(stats.processedInsns, 25071);
+  ASSERT_EQ(stats.totalStates, 1468);
+  ASSERT_EQ(stats.peakStates, 1131);
+}
+
+TEST(BpfLoaderTest, testParseOldVerifierStats) {
+  // older kernels are reporting only number of processed insns
+  std::string log = "processed 4201 insns (limit 131072), stack depth 40\n";
+  BpfProgLoadStats stats;
+  ASSERT_TRUE(BpfLoader::parseVerifierStats(log, stats));
+  ASSERT_EQ(stats.processedInsns, 4201);
+  ASSERT_EQ(stats.verificationTimeUs, 0);
+  ASSERT_EQ(stats.totalStates, 0);
+}
+
+TEST(BpfLoaderTest, testParseEmptyLog) {
+  BpfProgLoadStats stats;
+  ASSERT_FALSE(BpfLoader::parseVerifierStats("", stats));
+  ASSERT_FALSE(BpfLoader::parseVerifierStats("processed insns\n", stats));
+  ASSERT_EQ(stats.processedInsns, 0);
+}
+
+TEST(BpfLoaderTest, testCommitWithoutStagedObject) {
+  BpfLoader loader;
+  ASSERT_NE(loader.stageBpfFile("/nonexistent/balancer_kern.o"), 0);
+  ASSERT_LT(loader.getStagedProgFdByName(kBalancerProgName), 0);
+  ASSERT_NE(loader.commitStagedBpfObject(), 0);
+  // noop w/o staged object
+  loader.abortStagedBpfObject();
+  ASSERT_LT(loader.getProgFdByName(kBalancerProgName), 0);
+}
+
+TEST(BpfLoaderTest, testStageAndCommit) {
+  auto path = getBalancerProg();
+  if (path.empty()) {
+    GTEST_SKIP() << kBalancerProgEnv << " is not set";
+  }
+  BpfLoader loader;
+  ASSERT_EQ(loader.loadBpfFile(path, BPF_PROG_TYPE_XDP), 0);
+  auto old_prog = loader.getProgFdByName(kBalancerProgName);
+  auto vip_map = getMapId(loader.getMapFdByName("vip_map"));
+  ASSERT_GE(old_prog, 0);
+  ASSERT_NE(vip_map, 0);
+
+  ASSERT_EQ(loader.stageBpfFile(path, BPF_PROG_TYPE_XDP), 0);
+  // only one object could be staged at a time
+  ASSERT_NE(loader.stageBpfFile(path, BPF_PROG_TYPE_XDP), 0);
+  auto new_prog = loader.getStagedProgFdByName(kBalancerProgName);
+  ASSERT_GE(new_prog, 0);
+  ASSERT_NE(new_prog, old_prog);
+  // staged prog is not visible until commit
+  ASSERT_EQ(loader.getProgFdByName(kBalancerProgName), old_prog);
+
+  ASSERT_EQ(loader.commitStagedBpfObject(), 0);
+  ASSERT_EQ(loader.getProgFdByName(kBalancerProgName), new_prog);
+  // maps are reused by the new object
+  ASSERT_EQ(getMapId(loader.getMapFdByName("vip_map")), vip_map);
+  ASSERT_LT(loader.getStagedProgFdByName(kBalancerProgName), 0);
+}
+
+TEST(BpfLoaderTest, testStageFailureKeepsLoadedObject) {
+  auto path = getBalancerProg();
+  if (path.empty()) {
+    GTEST_SKIP() << kBalancerProgEnv << " is not set";
+  }
+  BpfLoader loader;
+  ASSERT_EQ(loader.loadBpfFile(path, BPF_PROG_TYPE_XDP), 0);
+  auto old_prog = loader.getProgFdByName(kBalancerProgName);
+  auto vip_map = getMapId(loader.getMapFdByName("vip_map"));
+  ASSERT_GE(old_prog, 0);
+  ASSERT_NE(vip_map, 0);
+
+  // layout of already loaded vip_map differs from the one in new object
+  ASSERT_EQ(loader.setMapMaxEntries("vip_map", 1), 0);
+  ASSERT_NE(loader.stageBpfFile(path, BPF_PROG_TYPE_XDP), 0);
+  ASSERT_LT(loader.getStagedProgFdByName(kBalancerProgName), 0);
+  ASSERT_NE(loader.commitStagedBpfObject(), 0);
+  ASSERT_EQ(loader.getProgFdByName(kBalancerProgName), old_prog);
+  ASSERT_EQ(getMapId(loader.getMapFdByName("vip_map")), vip_map);
+
+  // nothing is left staged after failed stage
+  ASSERT_NE(loader.stageBpfFile("/nonexistent/balancer_kern.o"), 0);
+  ASSERT_EQ(loader.getProgFdByName(kBalancerProgName), old_prog);
+}
+
+} // namespace katran
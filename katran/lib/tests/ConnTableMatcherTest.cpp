@@ -0,0 +1,185 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstring>
+#include <stdexcept>
+
+#include <folly/lang/Bits.h>
+#include <gtest/gtest.h>
+
+#include "katran/lib/ConnTableMatcher.h"
+#include "katran/lib/IpHelpers.h"
+
+namespace katran {
+
+namespace {
+constexpr uint8_t kTcp = 6;
+constexpr uint8_t kUdp = 17;
+} // namespace
+
+class ConnTableMatcherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    vipAddrs[folly::IPAddress("10.0.0.1")] = 1;
+    // v6 vip w/ all but the first word of address zeroed
+    vipAddrs[folly::IPAddress("fc00::")] = 1;
+    vipAddrs[folly::IPAddress("fc01::1")] = 1;
+    reals[0] = folly::IPAddress("192.168.1.1");
+    reals[1] = folly::IPAddress("fc02::1");
+  }
+
+  flow_key makeKey(
+      const std::string& src,
+      const std::string& dst,
+      uint16_t sport,
+      uint16_t dport,
+      uint8_t proto) {
+    flow_key key = {};
+    auto src_addr = IpHelpers::parseAddrToBe(src);
+    auto dst_addr = IpHelpers::parseAddrToBe(dst);
+    if (folly::IPAddress(src).isV6()) {
+      std::memcpy(key.srcv6, src_addr.v6daddr, 16);
+      std::memcpy(key.dstv6, dst_addr.v6daddr, 16);
+    } else {
+      key.src = src_addr.daddr;
+      key.dst = dst_addr.daddr;
+    }
+    key.port16[0] = folly::Endian::big(sport);
+    key.port16[1] = folly::Endian::big(dport);
+    key.proto = proto;
+    return key;
+  }
+
+  std::unordered_map<folly::IPAddress, uint32_t> vipAddrs;
+  std::unordered_map<uint32_t, folly::IPAddress> reals;
+};
+
+TEST_F(ConnTableMatcherTest, testConvertFlows) {
+  ConnTableMatcher matcher({}, vipAddrs, reals);
+  ASSERT_TRUE(matcher.canMatch());
+  KatranConnEntry entry;
+  real_pos_lru value = {1, 42};
+  ASSERT_TRUE(matcher.match(
+      makeKey("fc03::1", "fc01::1", 31337, 443, kTcp), value, entry));
+  ASSERT_EQ(entry.src, "fc03::1");
+  ASSERT_EQ(entry.dst, "fc01::1");
+  ASSERT_EQ(entry.srcPort, 31337);
+  ASSERT_EQ(entry.dstPort, 443);
+  ASSERT_EQ(entry.proto, kTcp);
+  ASSERT_EQ(entry.real, "fc02::1");
+  ASSERT_EQ(entry.atime, 42);
+
+  value.pos = 0;
+  ASSERT_TRUE(matcher.match(
+      makeKey("172.16.0.1", "10.0.0.1", 1024, 80, kUdp), value, entry));
+  ASSERT_EQ(entry.src, "172.16.0.1");
+  ASSERT_EQ(entry.dst, "10.0.0.1");
+  ASSERT_EQ(entry.real, "192.168.1.1");
+
+  // unknown real
+  value.pos = 100;
+  ASSERT_TRUE(matcher.match(
+      makeKey("172.16.0.1", "10.0.0.1", 1024, 80, kUdp), value, entry));
+  ASSERT_EQ(entry.real, "");
+}
+
+TEST_F(ConnTableMatcherTest, testFlowFamily) {
+  ConnTableMatcher matcher({}, vipAddrs, reals);
+  // v6 flow, which has only the first word of addresses set, is detected
+  // by configured vip
+  auto key = makeKey("fc00::", "fc00::", 1, 2, kTcp);
+  ASSERT_TRUE(matcher.isV6Flow(key));
+  KatranConnEntry entry;
+  ASSERT_TRUE(matcher.match(key, {0, 0}, entry));
+  ASSERT_EQ(entry.src, "fc00::");
+  ASSERT_EQ(entry.dst, "fc00::");
+  ASSERT_FALSE(
+      matcher.isV6Flow(makeKey("172.16.0.1", "10.0.0.1", 1, 2, kTcp)));
+  ASSERT_TRUE(matcher.isV6Flow(makeKey("fc03::1", "fc01::1", 1, 2, kTcp)));
+  // vips which are not configured anymore
+  ASSERT_FALSE(
+      matcher.isV6Flow(makeKey("172.16.0.1", "10.0.0.2", 1, 2, kTcp)));
+  ASSERT_TRUE(matcher.isV6Flow(makeKey("fc03::1", "fc09::1", 1, 2, kTcp)));
+}
+
+TEST_F(ConnTableMatcherTest, testFilters) {
+  KatranConnEntry entry;
+  real_pos_lru value = {0, 0};
+  auto v4_flow = makeKey("172.16.0.1", "10.0.0.1", 1024, 80, kTcp);
+  auto v6_flow = makeKey("fc03::1", "fc01::1", 1024, 443, kUdp);
+
+  KatranConnTableFilter filter;
+  filter.vip = "10.0.0.1";
+  ConnTableMatcher vip_matcher(filter, vipAddrs, reals);
+  ASSERT_TRUE(vip_matcher.match(v4_flow, value, entry));
+  ASSERT_FALSE(vip_matcher.match(v6_flow, value, entry));
+
+  filter = {};
+  filter.vipPort = 443;
+  ConnTableMatcher port_matcher(filter, vipAddrs, reals);
+  ASSERT_FALSE(port_matcher.match(v4_flow, value, entry));
+  ASSERT_TRUE(port_matcher.match(v6_flow, value, entry));
+
+  filter = {};
+  filter.proto = kTcp;
+  ConnTableMatcher proto_matcher(filter, vipAddrs, reals);
+  ASSERT_TRUE(proto_matcher.match(v4_flow, value, entry));
+  ASSERT_FALSE(proto_matcher.match(v6_flow, value, entry));
+
+  filter = {};
+  filter.real = "fc02::1";
+  ConnTableMatcher real_matcher(filter, vipAddrs, reals);
+  ASSERT_TRUE(real_matcher.canMatch());
+  ASSERT_FALSE(real_matcher.match(v4_flow, value, entry));
+  ASSERT_TRUE(real_matcher.match(v4_flow, {1, 0}, entry));
+
+  filter = {};
+  filter.srcPrefix = "172.16.0.0/16";
+  ConnTableMatcher src_matcher(filter, vipAddrs, reals);
+  ASSERT_TRUE(src_matcher.match(v4_flow, value, entry));
+  ASSERT_FALSE(src_matcher.match(v6_flow, value, entry));
+
+  // all filters must match
+  filter.vip = "10.0.0.1";
+  filter.vipPort = 443;
+  ConnTableMatcher all_matcher(filter, vipAddrs, reals);
+  ASSERT_FALSE(all_matcher.match(v4_flow, value, entry));
+}
+
+TEST_F(ConnTableMatcherTest, testInvalidFilters) {
+  KatranConnTableFilter filter;
+  filter.real = "10.10.10.10";
+  ConnTableMatcher unknown_real(filter, vipAddrs, reals);
+  ASSERT_FALSE(unknown_real.canMatch());
+  KatranConnEntry entry;
+  ASSERT_FALSE(unknown_real.match(
+      makeKey("172.16.0.1", "10.0.0.1", 1024, 80, kTcp), {0, 0}, entry));
+
+  filter = {};
+  filter.vip = "aaa";
+  ASSERT_THROW(
+      ConnTableMatcher matcher(filter, vipAddrs, reals), std::invalid_argument);
+  filter = {};
+  filter.real = "aaa";
+  ASSERT_THROW(
+      ConnTableMatcher matcher(filter, vipAddrs, reals), std::invalid_argument);
+  filter = {};
+  filter.srcPrefix = "10.0.0.0/33";
+  ASSERT_THROW(
+      ConnTableMatcher matcher(filter, vipAddrs, reals), std::invalid_argument);
+}
+
+} // namespace katran
@@ -0,0 +1,238 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/ConnTableSync.h"
+#include "katran/lib/KatranLb.h"
+
+namespace katran {
+
+namespace {
+constexpr int kMaxWaitIterations = 100;
+constexpr auto kWaitStep = std::chrono::milliseconds(20);
+} // namespace
+
+class ConnTableSyncTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (int i = 0; i < 3; i++) {
+      KatranConnEntry entry;
+      entry.src = "10.0.0." + std::to_string(i + 1);
+      entry.dst = "10.200.1.1";
+      entry.srcPort = 31337 + i;
+      entry.dstPort = 80;
+      entry.proto = 6;
+      entry.real = "10.0.0.100";
+      entry.core = i;
+      entry.atime = 0;
+      flows.push_back(entry);
+    }
+    // connections are accepted only from peers' addresses
+    receiver = makeReceiver({"127.0.0.1:9"});
+    ASSERT_TRUE(receiver->start());
+  }
+
+  std::unique_ptr<ConnTableSync> makeReceiver(
+      const std::vector<std::string>& peers) {
+    ConnTableSyncConfig config;
+    config.peers = peers;
+    config.listenAddress = "127.0.0.1";
+    config.listenPort = 0;
+    return std::make_unique<ConnTableSync>(
+        config,
+        [](const KatranConnTableCallback&) {},
+        [this](const std::vector<KatranConnEntry>& entries) {
+          std::lock_guard<std::mutex> guard(lock);
+          received.insert(received.end(), entries.begin(), entries.end());
+          return entries.size();
+        });
+  }
+
+  ConnTableExporter makeExporter() {
+    return [this](const KatranConnTableCallback& cb) {
+      for (const auto& flow : flows) {
+        cb(flow);
+      }
+    };
+  }
+
+  // stats are updated after importer returns, so waiting for them
+  // guarantees that received entries are already stored
+  bool waitForImported(uint64_t count) {
+    for (int i = 0; i < kMaxWaitIterations; i++) {
+      if (receiver->getStats().entriesImported == count) {
+        return true;
+      }
+      std::this_thread::sleep_for(kWaitStep);
+    }
+    return false;
+  }
+
+  std::vector<KatranConnEntry> getReceived() {
+    std::lock_guard<std::mutex> guard(lock);
+    return received;
+  }
+
+  std::vector<KatranConnEntry> flows;
+  std::mutex lock;
+  std::vector<KatranConnEntry> received;
+  std::unique_ptr<ConnTableSync> receiver;
+};
+
+TEST_F(ConnTableSyncTest, testInvalidConfig) {
+  ConnTableSyncConfig config;
+  config.peers = {"10.0.0.1"};
+  ASSERT_THROW(ConnTableSync(config, nullptr, nullptr), std::invalid_argument);
+  config.peers = {"aaa:80"};
+  ASSERT_THROW(ConnTableSync(config, nullptr, nullptr), std::invalid_argument);
+  config.peers = {"[fc00::1]:80"};
+  config.sampleRate = 0;
+  ASSERT_THROW(ConnTableSync(config, nullptr, nullptr), std::invalid_argument);
+}
+
+TEST_F(ConnTableSyncTest, testSync) {
+  ConnTableSyncConfig config;
+  config.peers = {"127.0.0.1:" + std::to_string(receiver->getPort())};
+  // so every flow goes in it's own message
+  config.maxBatchSize = 1;
+  ConnTableSync sender(config, makeExporter(), nullptr);
+  ASSERT_EQ(sender.sync(), 3);
+  ASSERT_TRUE(waitForImported(3));
+  auto entries = getReceived();
+  ASSERT_EQ(entries.size(), flows.size());
+  for (size_t i = 0; i < flows.size(); i++) {
+    ASSERT_EQ(entries[i].src, flows[i].src);
+    ASSERT_EQ(entries[i].dst, flows[i].dst);
+    ASSERT_EQ(entries[i].srcPort, flows[i].srcPort);
+    ASSERT_EQ(entries[i].dstPort, flows[i].dstPort);
+    ASSERT_EQ(entries[i].real, flows[i].real);
+  }
+  ASSERT_EQ(sender.getStats().entriesSent, 3);
+}
+
+TEST_F(ConnTableSyncTest, testSampling) {
+  auto flow = flows[0];
+  flows.clear();
+  for (int i = 0; i < 100; i++) {
+    flow.srcPort = 10000 + i;
+    flows.push_back(flow);
+  }
+  ConnTableSyncConfig config;
+  config.peers = {"127.0.0.1:" + std::to_string(receiver->getPort())};
+  config.sampleRate = 2;
+  ConnTableSync sender(config, makeExporter(), nullptr);
+  // flows are sampled by hash
+  auto sent = sender.sync();
+  ASSERT_GT(sent, 0);
+  ASSERT_LT(sent, flows.size());
+  ASSERT_TRUE(waitForImported(sent));
+  // the same flows are sampled on next cycle, and they are already synced
+  ASSERT_EQ(sender.sync(), 0);
+}
+
+TEST_F(ConnTableSyncTest, testSyncChangedOnly) {
+  ConnTableSyncConfig config;
+  config.peers = {"127.0.0.1:" + std::to_string(receiver->getPort())};
+  ConnTableSync sender(config, makeExporter(), nullptr);
+  ASSERT_EQ(sender.sync(), 3);
+  ASSERT_EQ(sender.sync(), 0);
+  // flow has been pinned to another real
+  flows[1].real = "10.0.0.101";
+  ASSERT_EQ(sender.sync(), 1);
+  // new flow
+  auto flow = flows[0];
+  flow.srcPort = 1;
+  flows.push_back(flow);
+  ASSERT_EQ(sender.sync(), 1);
+  // evicted flow is synced again when it shows up
+  flows.pop_back();
+  ASSERT_EQ(sender.sync(), 0);
+  flows.push_back(flow);
+  ASSERT_EQ(sender.sync(), 1);
+  ASSERT_TRUE(waitForImported(6));
+  auto entries = getReceived();
+  ASSERT_EQ(entries[3].src, flows[1].src);
+  ASSERT_EQ(entries[3].real, "10.0.0.101");
+  ASSERT_EQ(sender.getStats().entriesSent, 6);
+}
+
+TEST_F(ConnTableSyncTest, testRejectUnknownPeer) {
+  auto other = makeReceiver({"127.0.0.2:9"});
+  ASSERT_TRUE(other->start());
+  ConnTableSyncConfig config;
+  config.peers = {"127.0.0.1:" + std::to_string(other->getPort())};
+  ConnTableSync sender(config, makeExporter(), nullptr);
+  sender.sync();
+  bool rejected = false;
+  for (int i = 0; i < kMaxWaitIterations && !rejected; i++) {
+    rejected = other->getStats().rejectedConnections > 0;
+    std::this_thread::sleep_for(kWaitStep);
+  }
+  ASSERT_TRUE(rejected);
+  ASSERT_EQ(other->getStats().entriesImported, 0);
+  ASSERT_TRUE(getReceived().empty());
+}
+
+TEST_F(ConnTableSyncTest, testPeerDown) {
+  auto port = receiver->getPort();
+  receiver->stop();
+  ConnTableSyncConfig config;
+  config.peers = {"127.0.0.1:" + std::to_string(port)};
+  ConnTableSync sender(config, makeExporter(), nullptr);
+  ASSERT_EQ(sender.sync(), 0);
+  ASSERT_GT(sender.getStats().sendErrors, 0);
+}
+
+TEST_F(ConnTableSyncTest, testImportIntoLb) {
+  KatranConfig lbConfig;
+  lbConfig.testing = true;
+  lbConfig.enableHc = false;
+  lbConfig.memlockUnlimited = false;
+  KatranLb lb(lbConfig);
+  VipKey vip;
+  vip.address = "10.200.1.1";
+  vip.port = 80;
+  vip.proto = 6;
+  NewReal real;
+  real.address = "10.0.0.100";
+  real.weight = 1;
+  ASSERT_TRUE(lb.addVip(vip));
+  ASSERT_TRUE(lb.addRealForVip(real, vip));
+  ASSERT_EQ(lb.importConnectionTable(flows), 3);
+  // unknown real and unknown vip
+  flows[0].real = "10.0.0.101";
+  flows[1].dst = "10.200.1.2";
+  ASSERT_EQ(lb.importConnectionTable(flows), 1);
+  VipKey range;
+  range.address = "10.200.1.3";
+  range.port = 1000;
+  range.lastPort = 2000;
+  range.proto = 6;
+  ASSERT_TRUE(lb.addVip(range));
+  ASSERT_TRUE(lb.addRealForVip(real, range));
+  flows[2].dst = "10.200.1.3";
+  flows[2].dstPort = 1500;
+  ASSERT_EQ(lb.importConnectionTable(flows), 1);
+  flows[2].dstPort = 2500;
+  ASSERT_EQ(lb.importConnectionTable(flows), 0);
+}
+
+} // namespace katran
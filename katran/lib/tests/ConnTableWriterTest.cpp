@@ -0,0 +1,96 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstring>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/ConnTableWriter.h"
+
+namespace katran {
+
+class ConnTableWriterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    v4Entry.src = "10.0.0.1";
+    v4Entry.dst = "10.200.1.1";
+    v4Entry.srcPort = 31337;
+    v4Entry.dstPort = 80;
+    v4Entry.proto = 6;
+    v4Entry.real = "10.0.0.2";
+    v4Entry.core = 3;
+    v4Entry.atime = 0;
+
+    v6Entry.src = "fc00::1";
+    v6Entry.dst = "fc00:1::1";
+    v6Entry.srcPort = 1337;
+    v6Entry.dstPort = 443;
+    v6Entry.proto = 17;
+    v6Entry.real = "10.0.0.3";
+    v6Entry.core = -1;
+    v6Entry.atime = 12345;
+  }
+
+  KatranConnEntry v4Entry;
+  KatranConnEntry v6Entry;
+};
+
+TEST_F(ConnTableWriterTest, testTextWriter) {
+  std::stringstream out;
+  auto writer = makeConnTableTextWriter(out);
+  ASSERT_TRUE(writer(v4Entry));
+  ASSERT_TRUE(writer(v6Entry));
+  ASSERT_EQ(
+      out.str(),
+      "3 6 10.0.0.1:31337 10.200.1.1:80 10.0.0.2 0\n"
+      "-1 17 [fc00::1]:1337 [fc00:1::1]:443 10.0.0.3 12345\n");
+}
+
+TEST_F(ConnTableWriterTest, testBinaryWriter) {
+  std::stringstream out;
+  auto writer = makeConnTableBinaryWriter(out);
+  ASSERT_TRUE(writer(v4Entry));
+  ASSERT_TRUE(writer(v6Entry));
+  auto data = out.str();
+  ASSERT_EQ(data.size(), 2 * sizeof(ConnTableRecord));
+
+  ConnTableRecord record;
+  KatranConnEntry entry;
+  std::memcpy(&record, data.data(), sizeof(record));
+  ASSERT_TRUE(parseConnTableRecord(record, entry));
+  ASSERT_EQ(entry.src, v4Entry.src);
+  ASSERT_EQ(entry.dst, v4Entry.dst);
+  ASSERT_EQ(entry.srcPort, v4Entry.srcPort);
+  ASSERT_EQ(entry.dstPort, v4Entry.dstPort);
+  ASSERT_EQ(entry.real, v4Entry.real);
+  ASSERT_EQ(entry.core, v4Entry.core);
+
+  std::memcpy(&record, data.data() + sizeof(record), sizeof(record));
+  ASSERT_TRUE(parseConnTableRecord(record, entry));
+  ASSERT_EQ(entry.src, v6Entry.src);
+  ASSERT_EQ(entry.dst, v6Entry.dst);
+  ASSERT_EQ(entry.proto, v6Entry.proto);
+  ASSERT_EQ(entry.real, v6Entry.real);
+  ASSERT_EQ(entry.core, v6Entry.core);
+  ASSERT_EQ(entry.atime, v6Entry.atime);
+
+  // record w/o valid address family
+  record.family = 0;
+  ASSERT_FALSE(parseConnTableRecord(record, entry));
+}
+
+} // namespace katran
@@ -0,0 +1,145 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/HealthChecker.h"
+#include "katran/lib/KatranLb.h"
+
+extern "C" {
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+namespace katran {
+
+namespace {
+constexpr int kMaxWaitIterations = 100;
+constexpr auto kWaitStep = std::chrono::milliseconds(20);
+
+// creates tcp listener on loopback. if port is 0 - on any free port.
+// returns listener's fd and port
+int createListener(uint16_t& port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+  ::listen(fd, 128);
+  socklen_t len = sizeof(addr);
+  ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+  port = ntohs(addr.sin_port);
+  return fd;
+}
+} // namespace
+
+class HealthCheckerTest : public ::testing::Test {
+ protected:
+  HealthCheckerTest() : checker(HealthCheckerConfig{}) {}
+
+  void SetUp() override {
+    vip.address = "10.200.1.1";
+    vip.port = 80;
+    vip.proto = 6;
+    real.address = "10.0.0.1";
+    real.weight = 10;
+    hc.dst = "127.0.0.1";
+    hc.intervalMs = 10;
+    hc.timeoutMs = 100;
+    hc.rise = 1;
+    hc.fall = 1;
+  }
+
+  bool waitForState(bool healthy) {
+    for (int i = 0; i < kMaxWaitIterations; i++) {
+      if (checker.isHealthy(vip, real.address) == healthy) {
+        return true;
+      }
+      std::this_thread::sleep_for(kWaitStep);
+    }
+    return false;
+  }
+
+  HealthChecker checker;
+  VipKey vip;
+  NewReal real;
+  HealthCheck hc;
+};
+
+TEST_F(HealthCheckerTest, testAddDelHealthCheck) {
+  hc.port = 1;
+  ASSERT_TRUE(checker.addHealthCheck(vip, real, hc));
+  // trying to add already existing check
+  ASSERT_FALSE(checker.addHealthCheck(vip, real, hc));
+  ASSERT_TRUE(checker.delHealthCheck(vip, real.address));
+  ASSERT_FALSE(checker.delHealthCheck(vip, real.address));
+  hc.dst = "aaa";
+  ASSERT_FALSE(checker.addHealthCheck(vip, real, hc));
+}
+
+TEST_F(HealthCheckerTest, testTcpHealthCheck) {
+  // real starts as healthy: nobody listens on the port, so probes must fail
+  uint16_t port = 0;
+  int listener = createListener(port);
+  ::close(listener);
+  hc.port = port;
+  ASSERT_TRUE(checker.addHealthCheck(vip, real, hc));
+  ASSERT_TRUE(waitForState(false));
+  auto stats = checker.getStats();
+  ASSERT_GT(stats.probesSent, 0);
+  ASSERT_GT(stats.probesFailed, 0);
+  ASSERT_GE(stats.probesSent, stats.probesFailed);
+  ASSERT_EQ(stats.stateChanges, 1);
+  // listener is back. real must become healthy again
+  listener = createListener(port);
+  ASSERT_TRUE(waitForState(true));
+  ::close(listener);
+  stats = checker.getStats();
+  ASSERT_EQ(stats.stateChanges, 2);
+}
+
+TEST_F(HealthCheckerTest, testApplyStateChanges) {
+  KatranConfig config;
+  config.testing = true;
+  config.enableHc = false;
+  config.memlockUnlimited = false;
+  KatranLb lb(config);
+  ASSERT_TRUE(lb.addVip(vip));
+  ASSERT_TRUE(lb.addRealForVip(real, vip));
+  // port where nothing is listening
+  uint16_t port = 0;
+  int listener = createListener(port);
+  ::close(listener);
+  hc.port = port;
+  ASSERT_TRUE(checker.addHealthCheck(vip, real, hc));
+  ASSERT_TRUE(waitForState(false));
+  ASSERT_EQ(checker.applyStateChanges(lb), 1);
+  auto reals = lb.getRealsForVip(vip);
+  ASSERT_EQ(reals.size(), 1);
+  ASSERT_EQ(reals[0].weight, 0);
+  // all changes have been already applied
+  ASSERT_EQ(checker.applyStateChanges(lb), 0);
+}
+
+} // namespace katran
@@ -0,0 +1,120 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/IrqHelpers.h"
+
+extern "C" {
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace katran {
+
+namespace {
+void mkdirs(const std::string& path) {
+  for (size_t pos = 1; pos != std::string::npos;) {
+    pos = path.find('/', pos + 1);
+    ::mkdir(path.substr(0, pos).c_str(), 0755);
+  }
+}
+
+void writeFile(const std::string& path, const std::string& content) {
+  mkdirs(path.substr(0, path.rfind('/')));
+  std::ofstream file(path);
+  file << content;
+}
+} // namespace
+
+class IrqHelpersTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/irqhelpers.XXXXXX";
+    ASSERT_NE(::mkdtemp(tmpl), nullptr);
+    root = tmpl;
+  }
+
+  void TearDown() override {
+    std::string cmd = "rm -rf " + root;
+    ::system(cmd.c_str());
+  }
+
+  std::string root;
+};
+
+TEST_F(IrqHelpersTest, testParseCpuList) {
+  ASSERT_EQ(IrqHelpers::parseCpuList("0"), std::vector<int32_t>({0}));
+  ASSERT_EQ(
+      IrqHelpers::parseCpuList("0-2,8,10-11\n"),
+      std::vector<int32_t>({0, 1, 2, 8, 10, 11}));
+  // overlapping ranges
+  ASSERT_EQ(
+      IrqHelpers::parseCpuList("2-3,1-2"), std::vector<int32_t>({1, 2, 3}));
+  ASSERT_TRUE(IrqHelpers::parseCpuList("").empty());
+  ASSERT_TRUE(IrqHelpers::parseCpuList("3-1").empty());
+  ASSERT_TRUE(IrqHelpers::parseCpuList("a,1").empty());
+}
+
+TEST_F(IrqHelpersTest, testMsiIrqs) {
+  mkdirs(root + "/sys/class/net/eth0/device/msi_irqs/40");
+  mkdirs(root + "/sys/class/net/eth0/device/msi_irqs/41");
+  writeFile(root + "/proc/irq/40/effective_affinity_list", "2\n");
+  // no effective affinity; configured one must be used
+  writeFile(root + "/proc/irq/41/smp_affinity_list", "4-5\n");
+  ASSERT_EQ(
+      IrqHelpers::getInterfaceIrqs("eth0", root),
+      std::vector<int32_t>({40, 41}));
+  ASSERT_EQ(
+      IrqHelpers::getInterfaceCpus("eth0", root),
+      std::vector<int32_t>({2, 4, 5}));
+  ASSERT_TRUE(IrqHelpers::getInterfaceCpus("eth1", root).empty());
+}
+
+TEST_F(IrqHelpersTest, testProcInterrupts) {
+  writeFile(
+      root + "/proc/interrupts",
+      "           CPU0       CPU1\n"
+      "  0:         10          0   IO-APIC   2-edge      timer\n"
+      " 42:        100        200   PCI-MSI 524288-edge      eth0-TxRx-0\n"
+      " 43:        100        200   PCI-MSI 524289-edge      eth0-TxRx-1\n"
+      " 44:        100        200   PCI-MSI 524290-edge      eth1-TxRx-0\n"
+      " 45:        100        200   PCI-MSI 524291-edge      eth00-TxRx-0\n"
+      " 46:        100        200   PCI-MSI 524292-edge      veth0\n"
+      " 47:        100        200   PCI-MSI 524293-edge      eth0\n"
+      "NMI:          0          0   Non-maskable interrupts\n");
+  writeFile(root + "/proc/irq/42/effective_affinity_list", "0\n");
+  writeFile(root + "/proc/irq/43/effective_affinity_list", "1\n");
+  ASSERT_EQ(
+      IrqHelpers::getInterfaceIrqs("eth0", root),
+      std::vector<int32_t>({42, 43, 47}));
+  ASSERT_EQ(
+      IrqHelpers::getInterfaceCpus("eth0", root),
+      std::vector<int32_t>({0, 1}));
+}
+
+TEST_F(IrqHelpersTest, testCpuNumaNode) {
+  mkdirs(root + "/sys/devices/system/cpu/cpu3/node1");
+  mkdirs(root + "/sys/devices/system/cpu/cpu3/topology");
+  ASSERT_EQ(IrqHelpers::getCpuNumaNode(3, root), 1);
+  ASSERT_EQ(IrqHelpers::getCpuNumaNode(4, root), -1);
+}
+
+} // namespace katran
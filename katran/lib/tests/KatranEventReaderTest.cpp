@@ -0,0 +1,76 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/BalancerStructs.h"
+#include "katran/lib/KatranEventReader.h"
+
+namespace katran {
+
+namespace {
+// values from linux/bpf.h and introspection.h
+constexpr uint32_t kXdpDrop = 1;
+constexpr uint32_t kXdpPass = 2;
+constexpr uint32_t kXdpTx = 3;
+constexpr uint32_t kReasonNotVip = 2;
+constexpr uint32_t kReasonNoReal = 5;
+constexpr uint32_t kReasonForwarded = 7;
+} // namespace
+
+TEST(KatranEventReaderTest, testDescribeForwardedVerdict) {
+  struct verdict_info info = {};
+  info.action = kXdpTx;
+  info.reason = kReasonForwarded;
+  info.vip_num = 3;
+  info.real_index = 42;
+  info.lru_hit = 1;
+  ASSERT_EQ(
+      KatranEventReader::describeVerdict(info),
+      "action: XDP_TX reason: forwarded vip: 3 real: 42 lru: hit");
+}
+
+TEST(KatranEventReaderTest, testDescribeDroppedVerdict) {
+  struct verdict_info info = {};
+  info.action = kXdpDrop;
+  info.reason = kReasonNoReal;
+  info.vip_num = 1;
+  ASSERT_EQ(
+      KatranEventReader::describeVerdict(info),
+      "action: XDP_DROP reason: no_real vip: 1 real: 0 lru: miss");
+}
+
+TEST(KatranEventReaderTest, testDescribeNotVipVerdict) {
+  struct verdict_info info = {};
+  info.action = kXdpPass;
+  info.reason = kReasonNotVip;
+  ASSERT_EQ(
+      KatranEventReader::describeVerdict(info),
+      "action: XDP_PASS reason: not_vip vip: 0 real: 0 lru: miss");
+}
+
+TEST(KatranEventReaderTest, testDescribeUnknownVerdict) {
+  struct verdict_info info = {};
+  info.action = 100;
+  info.reason = 100;
+  ASSERT_EQ(
+      KatranEventReader::describeVerdict(info),
+      "action: unknown reason: unknown vip: 0 real: 0 lru: miss");
+}
+
+} // namespace katran
@@ -145,6 +145,79 @@ TEST_F(KatranLbTest, testRealHelpers) {
   ASSERT_TRUE(lb.addRealForVip(r1, v1));
 };
 
+TEST_F(KatranLbTest, testRealDownHelper) {
+  lb.addVip(v1);
+  // marking non-existing real
+  ASSERT_FALSE(lb.setRealDown(r1.address, true));
+  ASSERT_FALSE(lb.setRealDown("invalid", true));
+  ASSERT_TRUE(lb.addRealForVip(r1, v1));
+  ASSERT_TRUE(lb.setRealDown(r1.address, true));
+  ASSERT_TRUE(lb.setRealDown(r1.address, false));
+};
+
+TEST_F(KatranLbTest, testPortRangeVipHelpers) {
+  VipKey range;
+  range.address = "fc01::1";
+  range.port = 1000;
+  range.lastPort = 2000;
+  range.proto = 6;
+  // exact port vip w/ the same address does not conflict w/ the range
+  ASSERT_TRUE(lb.addVip(v1));
+  ASSERT_TRUE(lb.addVip(range));
+  ASSERT_EQ(lb.getAllVips().size(), 2);
+  VipKey overlap = range;
+  overlap.port = 2000;
+  overlap.lastPort = 3000;
+  ASSERT_FALSE(lb.addVip(overlap));
+  overlap.proto = 17;
+  ASSERT_TRUE(lb.addVip(overlap));
+  VipKey invalid = range;
+  invalid.port = 3000;
+  ASSERT_FALSE(lb.addVip(invalid));
+  invalid.port = 0;
+  ASSERT_FALSE(lb.addVip(invalid));
+  ASSERT_TRUE(lb.delVip(range));
+  overlap.proto = 6;
+  ASSERT_TRUE(lb.addVip(overlap));
+};
+
+TEST_F(KatranLbTest, testPortRangePrefixes) {
+  auto prefixes = KatranLb::getPortRangePrefixes(1024, 2047);
+  ASSERT_EQ(prefixes.size(), 1);
+  ASSERT_EQ(prefixes[0].first, 1024);
+  ASSERT_EQ(prefixes[0].second, 6);
+  prefixes = KatranLb::getPortRangePrefixes(1000, 1031);
+  std::vector<std::pair<uint16_t, uint8_t>> expected = {
+      {1000, 13}, {1008, 12}, {1024, 13}};
+  ASSERT_EQ(prefixes, expected);
+  prefixes = KatranLb::getPortRangePrefixes(1, 65535);
+  ASSERT_EQ(prefixes.size(), 16);
+  ASSERT_EQ(prefixes.back().first, 32768);
+  ASSERT_EQ(prefixes.back().second, 1);
+  // worst case
+  prefixes = KatranLb::getPortRangePrefixes(1, 65534);
+  ASSERT_EQ(prefixes.size(), 30);
+};
+
+TEST_F(KatranLbTest, testVipAddrsRefCount) {
+  VipKey v = v1;
+  v.port = 80;
+  folly::IPAddress addr(v1.address);
+  ASSERT_TRUE(lb.addVip(v1));
+  ASSERT_TRUE(lb.addVip(v));
+  ASSERT_EQ(lb.getVipAddrs().at(addr), 2);
+  // failed add does not change refcount
+  ASSERT_FALSE(lb.addVip(v));
+  ASSERT_EQ(lb.getVipAddrs().at(addr), 2);
+  // address is still in use by the other vip
+  ASSERT_TRUE(lb.delVip(v1));
+  ASSERT_EQ(lb.getVipAddrs().at(addr), 1);
+  ASSERT_FALSE(lb.delVip(v1));
+  ASSERT_EQ(lb.getVipAddrs().at(addr), 1);
+  ASSERT_TRUE(lb.delVip(v));
+  ASSERT_EQ(lb.getVipAddrs().count(addr), 0);
+};
+
 TEST_F(KatranLbTest, testVipStatsHelper) {
   lb.addVip(v1);
   auto stats = lb.getStatsForVip(v1);
@@ -275,6 +348,59 @@ TEST_F(KatranLbTest, getHealthcheckersDst) {
   ASSERT_EQ(hcs.size(), 2);
 };
 
+TEST_F(KatranLbTest, getHealthcheckStatsPerReal) {
+  lb.addHealthcheckerDst(1, "192.168.1.1");
+  lb.addHealthcheckerDst(2, "192.168.1.2");
+  auto stats = lb.getHealthcheckStatsPerReal();
+  ASSERT_EQ(stats.size(), 2);
+  ASSERT_EQ(stats[1].packetsEncaped, 0);
+  ASSERT_EQ(stats[2].bytesDropped, 0);
+  lb.delHealthcheckerDst(1);
+  ASSERT_EQ(lb.getHealthcheckStatsPerReal().size(), 1);
+  // reused somark starts w/ zeroed counters
+  lb.addHealthcheckerDst(1, "192.168.1.3");
+  stats = lb.getHealthcheckStatsPerReal();
+  ASSERT_EQ(stats.size(), 2);
+  ASSERT_EQ(stats[1].packetsEncaped, 0);
+  ASSERT_EQ(stats[1].bytesEncaped, 0);
+};
+
+TEST_F(KatranLbTest, aggregateHcRealStats) {
+  constexpr int kCpus = 2;
+  // key 0 is an unused entry of the array
+  std::unordered_map<uint32_t, uint32_t> somarks = {{1, 1000}, {2, 1001}};
+  std::vector<uint32_t> keys = {0, 1, 2};
+  std::vector<HealthCheckRealStats> values = {
+      {100, 100, 100, 100},
+      {100, 100, 100, 100},
+      {1, 100, 0, 0},
+      {2, 200, 0, 0},
+      {0, 0, 3, 30},
+      {5, 500, 4, 40},
+  };
+  std::unordered_map<uint32_t, HealthCheckRealStats> result;
+  KatranLb::aggregateHcRealStats(somarks, keys, values, kCpus, result);
+  ASSERT_EQ(result.size(), 2);
+  ASSERT_EQ(result[1000].packetsEncaped, 3);
+  ASSERT_EQ(result[1000].bytesEncaped, 300);
+  ASSERT_EQ(result[1000].packetsDropped, 0);
+  ASSERT_EQ(result[1001].packetsEncaped, 5);
+  ASSERT_EQ(result[1001].bytesEncaped, 500);
+  ASSERT_EQ(result[1001].packetsDropped, 7);
+  ASSERT_EQ(result[1001].bytesDropped, 70);
+  // counters from the next read (e.g. per key fallback) are added
+  KatranLb::aggregateHcRealStats(
+      somarks,
+      {1},
+      {{1, 10, 1, 10}, {0, 0, 0, 0}},
+      kCpus,
+      result);
+  ASSERT_EQ(result[1000].packetsEncaped, 4);
+  ASSERT_EQ(result[1000].bytesEncaped, 310);
+  ASSERT_EQ(result[1000].packetsDropped, 1);
+  ASSERT_EQ(result[1000].bytesDropped, 10);
+};
+
 TEST_F(KatranLbTest, invalidAddressHandling) {
   VipKey v;
   v.address = "aaa";
@@ -0,0 +1,87 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <numeric>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/LruSizing.h"
+
+namespace katran {
+
+namespace {
+constexpr uint64_t kBudget = 4000;
+constexpr uint64_t kMinSize = 100;
+constexpr double kThreshold = 0.25;
+
+uint64_t sum(const std::vector<uint64_t>& sizes) {
+  return std::accumulate(sizes.begin(), sizes.end(), 0ULL);
+}
+} // namespace
+
+TEST(LruSizingTest, testEvenLoad) {
+  std::vector<LruCoreLoad> load(4, {1000, 500});
+  auto sizes =
+      LruSizing::computeLruSizes(load, kBudget, kMinSize, kThreshold);
+  ASSERT_EQ(sizes, std::vector<uint64_t>(4, 1000));
+}
+
+TEST(LruSizingTest, testNoTraffic) {
+  std::vector<LruCoreLoad> load(4, {1000, 0});
+  auto sizes =
+      LruSizing::computeLruSizes(load, kBudget, kMinSize, kThreshold);
+  ASSERT_EQ(sizes, std::vector<uint64_t>(4, 1000));
+}
+
+TEST(LruSizingTest, testSkewedLoad) {
+  std::vector<LruCoreLoad> load = {
+      {1000, 7000}, {1000, 1000}, {1000, 1000}, {1000, 1000}};
+  auto sizes =
+      LruSizing::computeLruSizes(load, kBudget, kMinSize, kThreshold);
+  ASSERT_GT(sizes[0], 2500);
+  for (size_t i = 1; i < sizes.size(); i++) {
+    ASSERT_GE(sizes[i], kMinSize);
+    ASSERT_LT(sizes[i], 1000);
+  }
+  ASSERT_LE(sum(sizes), kBudget);
+}
+
+TEST(LruSizingTest, testThreshold) {
+  // ideal sizes are 1100 and 900; change is below the threshold
+  std::vector<LruCoreLoad> load = {{1000, 1100}, {1000, 900}};
+  auto sizes = LruSizing::computeLruSizes(load, 2000, kMinSize, kThreshold);
+  ASSERT_EQ(sizes, std::vector<uint64_t>(2, 1000));
+  // only 1st and 3rd cores are far enough from ideal; 2nd keeps it's size
+  // and the rest of the budget is split between others
+  load = {{1000, 10}, {1000, 1000}, {1000, 1990}};
+  sizes = LruSizing::computeLruSizes(load, 3000, kMinSize, kThreshold);
+  ASSERT_EQ(sizes[1], 1000);
+  ASSERT_LT(sizes[0], 200);
+  ASSERT_GT(sizes[2], 1800);
+  ASSERT_LE(sum(sizes), 3000);
+}
+
+TEST(LruSizingTest, testMinSize) {
+  std::vector<LruCoreLoad> load = {{1000, 1000000}, {1000, 0}};
+  auto sizes = LruSizing::computeLruSizes(load, 2000, kMinSize, kThreshold);
+  ASSERT_EQ(sizes[1], kMinSize);
+  ASSERT_EQ(sizes[0], 2000 - kMinSize);
+  // budget is too small to fit min sizes
+  sizes = LruSizing::computeLruSizes(load, 150, kMinSize, kThreshold);
+  ASSERT_EQ(sizes, std::vector<uint64_t>(2, 1000));
+}
+
+} // namespace katran
@@ -0,0 +1,110 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/MetricsExporter.h"
+#include "katran/lib/StatsCounters.h"
+
+extern "C" {
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+namespace katran {
+
+namespace {
+// sends http request to local endpoint and returns the whole response
+std::string scrape(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr))) {
+    ::close(fd);
+    return "";
+  }
+  std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+  ::send(fd, request.data(), request.size(), 0);
+  std::string response;
+  char buf[1024];
+  ssize_t len;
+  while ((len = ::recv(fd, buf, sizeof(buf), 0)) > 0) {
+    response.append(buf, len);
+  }
+  ::close(fd);
+  return response;
+}
+} // namespace
+
+TEST(MetricsExporterTest, testBuilderFormat) {
+  MetricsBuilder builder;
+  builder.add("test_packets", 1, {{"vip", "10.0.0.1"}}, MetricType::COUNTER,
+              "packets");
+  builder.add("test_entries", 5, {}, MetricType::GAUGE);
+  builder.add("test_packets", 2, {{"vip", "fc00::1"}});
+  std::string expected =
+      "# TYPE test_entries gauge\n"
+      "test_entries 5\n"
+      "# HELP test_packets packets\n"
+      "# TYPE test_packets counter\n"
+      "test_packets{vip=\"10.0.0.1\"} 1\n"
+      "test_packets{vip=\"fc00::1\"} 2\n";
+  ASSERT_EQ(builder.build(), expected);
+}
+
+TEST(MetricsExporterTest, testSanitizeName) {
+  ASSERT_EQ(MetricsBuilder::sanitizeName("katran.bpf-failed"),
+            "katran_bpf_failed");
+  ASSERT_EQ(MetricsBuilder::sanitizeName("1abc"), "_abc");
+}
+
+TEST(MetricsExporterTest, testScrape) {
+  StatsCounter counter("metrics_test.counter");
+  counter += 7;
+  MetricsExporterConfig config;
+  config.port = 0;
+  // so background collection would not run during the test; collections
+  // are triggered explicitly
+  config.cacheTtlMs = 3600 * 1000;
+  MetricsExporter exporter(config);
+  exporter.addCollector([](MetricsBuilder& builder) {
+    builder.add("katran_test_collector", 42);
+  });
+  ASSERT_TRUE(exporter.start());
+  auto response = scrape(exporter.getPort());
+  ASSERT_NE(response.find("HTTP/1.0 200 OK"), std::string::npos);
+  ASSERT_NE(response.find("katran_test_collector 42\n"), std::string::npos);
+  ASSERT_NE(
+      response.find("katran_metrics_test_counter 7\n"), std::string::npos);
+  // scrapes are served from cache until next collection
+  counter += 1;
+  ASSERT_EQ(
+      exporter.getMetrics().find("katran_metrics_test_counter 8\n"),
+      std::string::npos);
+  exporter.collect();
+  ASSERT_NE(
+      exporter.getMetrics().find("katran_metrics_test_counter 8\n"),
+      std::string::npos);
+  exporter.stop();
+}
+
+} // namespace katran
@@ -0,0 +1,166 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/MPMCQueue.h>
+#include <folly/Range.h>
+#include <gtest/gtest.h>
+
+#include "katran/lib/ByteRangeWriter.h"
+#include "katran/lib/PcapStructs.h"
+#include "katran/lib/PcapWriter.h"
+
+namespace katran {
+
+namespace {
+constexpr uint32_t kBufferSize = 4096;
+constexpr uint32_t kQueueSize = 16;
+constexpr uint32_t kPcapngShb = 0x0A0D0D0A;
+constexpr uint32_t kPcapngIdb = 0x00000001;
+constexpr uint32_t kPcapngEpb = 0x00000006;
+constexpr uint16_t kOptComment = 1;
+constexpr uint16_t kOptEpbFlags = 2;
+constexpr uint16_t kOptEpbPacketId = 5;
+constexpr uint32_t kInbound = 1;
+constexpr uint32_t kOutbound = 2;
+constexpr uint64_t kPacketId = (1ULL << 48) | 42;
+
+struct Block {
+  uint32_t type;
+  std::string body;
+};
+
+// splits pcapng's output into blocks, checking that trailing length
+// of each block matches the one from the header
+std::vector<Block> parseBlocks(const uint8_t* data, std::size_t len) {
+  std::vector<Block> blocks;
+  std::size_t offset = 0;
+  while (offset + sizeof(pcapng_block_hdr) <= len) {
+    pcapng_block_hdr hdr;
+    std::memcpy(&hdr, data + offset, sizeof(hdr));
+    EXPECT_EQ(hdr.block_total_length % 4, 0);
+    uint32_t trailer;
+    std::memcpy(
+        &trailer,
+        data + offset + hdr.block_total_length - sizeof(trailer),
+        sizeof(trailer));
+    EXPECT_EQ(hdr.block_total_length, trailer);
+    blocks.push_back(
+        {hdr.block_type,
+         std::string(
+             reinterpret_cast<const char*>(data + offset + sizeof(hdr)),
+             hdr.block_total_length - sizeof(hdr) - sizeof(trailer))});
+    offset += hdr.block_total_length;
+  }
+  EXPECT_EQ(offset, len);
+  return blocks;
+}
+
+// returns value of the option w/ specified code, which starts at offset
+std::string
+getOption(const std::string& body, std::size_t offset, uint16_t code) {
+  while (offset + sizeof(pcapng_opt_hdr) <= body.size()) {
+    pcapng_opt_hdr opt;
+    std::memcpy(&opt, body.data() + offset, sizeof(opt));
+    if (opt.code == code) {
+      return body.substr(offset + sizeof(opt), opt.length);
+    }
+    if (!opt.code) {
+      break;
+    }
+    offset += sizeof(opt) + ((opt.length + 3) & ~3);
+  }
+  return "";
+}
+} // namespace
+
+TEST(PcapWriterTest, testPcapng) {
+  std::vector<uint8_t> buffer(kBufferSize);
+  folly::MutableByteRange range(buffer.data(), buffer.size());
+  auto writer = std::make_shared<ByteRangeWriter>(range);
+  PcapWriter pcapWriter(writer, 0, 0);
+  pcapWriter.enablePcapng({"pre-katran", "post-katran"});
+
+  auto queue = std::make_shared<folly::MPMCQueue<PcapMsg>>(kQueueSize);
+  std::string pckt(61, 'a');
+  PcapMsg pre(pckt.data(), pckt.size(), pckt.size());
+  pre.setInterfaceId(0);
+  pre.setPacketId(kPacketId);
+  pre.setFlags(kInbound);
+  PcapMsg post(pckt.data(), pckt.size(), pckt.size());
+  post.setInterfaceId(1);
+  post.setPacketId(kPacketId);
+  post.setFlags(kOutbound);
+  post.setComment("verdict: XDP_TX");
+  queue->blockingWrite(std::move(pre));
+  queue->blockingWrite(std::move(post));
+  queue->blockingWrite(PcapMsg(nullptr, 0, 0));
+  pcapWriter.run(queue);
+  ASSERT_EQ(pcapWriter.packetsCaptured(), 2);
+
+  auto blocks = parseBlocks(buffer.data(), writer->writtenBytes());
+  ASSERT_EQ(blocks.size(), 5);
+  ASSERT_EQ(blocks[0].type, kPcapngShb);
+  ASSERT_EQ(blocks[1].type, kPcapngIdb);
+  ASSERT_EQ(blocks[2].type, kPcapngIdb);
+  ASSERT_EQ(blocks[3].type, kPcapngEpb);
+  ASSERT_EQ(blocks[4].type, kPcapngEpb);
+
+  pcapng_epb epb;
+  std::memcpy(&epb, blocks[4].body.data(), sizeof(epb));
+  ASSERT_EQ(epb.interface_id, 1);
+  ASSERT_EQ(epb.captured_len, pckt.size());
+  ASSERT_EQ(blocks[4].body.substr(sizeof(epb), epb.captured_len), pckt);
+  auto optsOffset = sizeof(epb) + ((epb.captured_len + 3) & ~3);
+  uint32_t flags;
+  auto flagsOpt = getOption(blocks[4].body, optsOffset, kOptEpbFlags);
+  ASSERT_EQ(flagsOpt.size(), sizeof(flags));
+  std::memcpy(&flags, flagsOpt.data(), sizeof(flags));
+  ASSERT_EQ(flags, kOutbound);
+  uint64_t packetId;
+  auto idOpt = getOption(blocks[4].body, optsOffset, kOptEpbPacketId);
+  ASSERT_EQ(idOpt.size(), sizeof(packetId));
+  std::memcpy(&packetId, idOpt.data(), sizeof(packetId));
+  ASSERT_EQ(packetId, kPacketId);
+  ASSERT_EQ(
+      getOption(blocks[4].body, optsOffset, kOptComment), "verdict: XDP_TX");
+  ASSERT_EQ(getOption(blocks[1].body, sizeof(pcapng_idb), 2), "pre-katran");
+}
+
+TEST(PcapWriterTest, testPcapngBufferFull) {
+  // room for headers and single packet only
+  std::vector<uint8_t> buffer(256);
+  folly::MutableByteRange range(buffer.data(), buffer.size());
+  auto writer = std::make_shared<ByteRangeWriter>(range);
+  PcapWriter pcapWriter(writer, 0, 0);
+  pcapWriter.enablePcapng({"pre-katran"});
+
+  auto queue = std::make_shared<folly::MPMCQueue<PcapMsg>>(kQueueSize);
+  std::string pckt(100, 'a');
+  queue->blockingWrite(PcapMsg(pckt.data(), pckt.size(), pckt.size()));
+  queue->blockingWrite(PcapMsg(pckt.data(), pckt.size(), pckt.size()));
+  queue->blockingWrite(PcapMsg(nullptr, 0, 0));
+  pcapWriter.run(queue);
+  ASSERT_EQ(pcapWriter.packetsCaptured(), 1);
+  ASSERT_EQ(pcapWriter.getStats().bufferFull, 1);
+  parseBlocks(buffer.data(), writer->writtenBytes());
+}
+
+} // namespace katran
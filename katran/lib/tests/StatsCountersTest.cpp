@@ -0,0 +1,87 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/StatsCounters.h"
+
+namespace katran {
+
+TEST(StatsCountersTest, testCounterOperations) {
+  StatsCounter counter;
+  counter++;
+  ++counter;
+  counter += 3;
+  ASSERT_EQ(counter.get(), 5);
+  counter.set(1);
+  ASSERT_EQ(counter.get(), 1);
+}
+
+TEST(StatsCountersTest, testCountersDoNotShareCacheLine) {
+  StatsCounter counters[2];
+  auto first = reinterpret_cast<uintptr_t>(&counters[0]);
+  auto second = reinterpret_cast<uintptr_t>(&counters[1]);
+  ASSERT_GE(second - first, kCacheLineSize);
+}
+
+TEST(StatsCountersTest, testConcurrentUpdates) {
+  constexpr int kThreads = 4;
+  constexpr int kIncrements = 100000;
+  StatsCounter counter;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&counter]() {
+      for (int j = 0; j < kIncrements; j++) {
+        counter++;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(counter.get(), kThreads * kIncrements);
+}
+
+TEST(StatsCountersTest, testRegistry) {
+  auto& registry = StatsRegistry::get();
+  StatsCounter unnamed;
+  unnamed++;
+  {
+    StatsCounter first("test.counter");
+    auto second = std::make_unique<StatsCounter>("test.counter");
+    StatsCounter other("test.other");
+    first += 2;
+    *second += 3;
+    auto snapshot = registry.snapshot();
+    // counters w/ the same name are summed up
+    ASSERT_EQ(snapshot["test.counter"], 5);
+    ASSERT_EQ(snapshot["test.other"], 0);
+    second.reset();
+    snapshot = registry.snapshot();
+    ASSERT_EQ(snapshot["test.counter"], 2);
+  }
+  // counters unregister themselves on destruction
+  auto snapshot = registry.snapshot();
+  ASSERT_EQ(snapshot.count("test.counter"), 0);
+  ASSERT_EQ(snapshot.count("test.other"), 0);
+  ASSERT_EQ(snapshot.count(""), 0);
+}
+
+} // namespace katran
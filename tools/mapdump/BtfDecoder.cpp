@@ -0,0 +1,386 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "tools/mapdump/BtfDecoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+#include <glog/logging.h>
+
+extern "C" {
+#include <arpa/inet.h>
+#include <bpf/btf.h>
+#include <bpf/libbpf.h>
+}
+
+namespace mapdump {
+
+namespace {
+constexpr char kMapTypePrefix[] = "____btf_map_";
+constexpr char kKeyMember[] = "key";
+constexpr char kValueMember[] = "value";
+constexpr char kBeAddrTypedef[] = "__be32";
+constexpr char kBeNumberTypedef[] = "__be16";
+constexpr uint32_t kV4AddrSize = 4;
+constexpr uint32_t kV6AddrSize = 16;
+constexpr uint32_t kV6AddrWords = 4;
+constexpr uint32_t kMaxIntSize = 8;
+constexpr uint32_t kBitsInByte = 8;
+
+// members, which are kept in network byte order, even though BTF types of
+// them are plain integers
+const std::unordered_set<std::string> kBeMembers = {
+    "port",
+    "port16",
+    "sport",
+    "dport",
+};
+
+uint64_t readInt(const uint8_t* data, uint32_t size) {
+  uint64_t value = 0;
+  ::memcpy(&value, data, std::min(size, kMaxIntSize));
+  return value;
+}
+} // namespace
+
+BtfDecoder::~BtfDecoder() {
+  if (btf_) {
+    btf__free(btf_);
+  }
+}
+
+bool BtfDecoder::load(const std::string& path) {
+  auto btf = btf__parse_elf(path.c_str(), nullptr);
+  if (!btf || libbpf_get_error(btf)) {
+    LOG(ERROR) << "can't load BTF from " << path;
+    return false;
+  }
+  load(btf);
+  return true;
+}
+
+void BtfDecoder::load(struct btf* btf) {
+  if (btf_) {
+    btf__free(btf_);
+  }
+  btf_ = btf;
+}
+
+bool BtfDecoder::getMapTypes(
+    const std::string& mapName,
+    uint32_t& keyTypeId,
+    uint32_t& valueTypeId) const {
+  if (!btf_) {
+    return false;
+  }
+  auto name = kMapTypePrefix + mapName;
+  auto id = btf__find_by_name_kind(btf_, name.c_str(), BTF_KIND_STRUCT);
+  if (id < 0) {
+    VLOG(2) << "no BTF annotation for map " << mapName;
+    return false;
+  }
+  auto type = btf__type_by_id(btf_, id);
+  auto member = btf_members(type);
+  bool keyFound = false, valueFound = false;
+  for (int i = 0; i < btf_vlen(type); i++, member++) {
+    std::string memberName = btf__name_by_offset(btf_, member->name_off);
+    if (memberName == kKeyMember) {
+      keyTypeId = member->type;
+      keyFound = true;
+    } else if (memberName == kValueMember) {
+      valueTypeId = member->type;
+      valueFound = true;
+    }
+  }
+  return keyFound && valueFound;
+}
+
+Value BtfDecoder::decode(uint32_t typeId, const uint8_t* data, uint32_t size)
+    const {
+  if (!btf_ || btf__resolve_size(btf_, typeId) != size) {
+    return decodeRaw(data, size);
+  }
+  return decodeType(typeId, data, size, IntHint::NONE);
+}
+
+Value BtfDecoder::decodeRaw(const uint8_t* data, uint32_t size) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  std::string hex = "0x";
+  for (uint32_t i = 0; i < size; i++) {
+    hex.push_back(kHexDigits[data[i] >> 4]);
+    hex.push_back(kHexDigits[data[i] & 0xf]);
+  }
+  return Value::makeString(hex);
+}
+
+uint32_t BtfDecoder::skipModifiers(uint32_t typeId, IntHint& hint) const {
+  auto type = btf__type_by_id(btf_, typeId);
+  while (type && (btf_is_typedef(type) || btf_is_mod(type))) {
+    if (btf_is_typedef(type)) {
+      std::string name = btf__name_by_offset(btf_, type->name_off);
+      if (name == kBeAddrTypedef) {
+        hint = IntHint::BE_ADDR;
+      } else if (name == kBeNumberTypedef) {
+        hint = IntHint::BE_NUMBER;
+      }
+    }
+    typeId = type->type;
+    type = btf__type_by_id(btf_, typeId);
+  }
+  return typeId;
+}
+
+bool BtfDecoder::isAddress(uint32_t typeId) const {
+  auto hint = IntHint::NONE;
+  auto type = btf__type_by_id(btf_, skipModifiers(typeId, hint));
+  if (!type) {
+    return false;
+  }
+  if (btf_is_int(type)) {
+    return hint == IntHint::BE_ADDR && type->size == kV4AddrSize;
+  }
+  if (btf_is_array(type) && btf_array(type)->nelems == kV6AddrWords) {
+    auto elemHint = IntHint::NONE;
+    auto elem = btf__type_by_id(
+        btf_, skipModifiers(btf_array(type)->type, elemHint));
+    return elem && btf_is_int(elem) && elemHint == IntHint::BE_ADDR;
+  }
+  return false;
+}
+
+Value BtfDecoder::decodeType(
+    uint32_t typeId,
+    const uint8_t* data,
+    uint32_t size,
+    IntHint hint) const {
+  auto typedefHint = IntHint::NONE;
+  auto type = btf__type_by_id(btf_, skipModifiers(typeId, typedefHint));
+  if (typedefHint != IntHint::NONE) {
+    hint = typedefHint;
+  }
+  if (!type) {
+    return decodeRaw(data, size);
+  }
+  if (btf_is_int(type)) {
+    return decodeInt(type, data, size, hint);
+  }
+  if (btf_is_enum(type)) {
+    auto value = readInt(data, std::min(size, type->size));
+    auto member = btf_enum(type);
+    for (int i = 0; i < btf_vlen(type); i++, member++) {
+      if (static_cast<uint32_t>(member->val) == value) {
+        return Value::makeString(btf__name_by_offset(btf_, member->name_off));
+      }
+    }
+    return Value::makeNumber(value);
+  }
+  if (btf_is_array(type)) {
+    return decodeArray(type, data, size, hint);
+  }
+  if (btf_is_struct(type)) {
+    return decodeStruct(type, data, size);
+  }
+  if (btf_is_union(type)) {
+    return decodeUnion(type, data, size).second;
+  }
+  return decodeRaw(data, size);
+}
+
+Value BtfDecoder::decodeInt(
+    const struct btf_type* type,
+    const uint8_t* data,
+    uint32_t size,
+    IntHint hint) const {
+  if (type->size > size || type->size > kMaxIntSize) {
+    return decodeRaw(data, size);
+  }
+  if (hint == IntHint::BE_ADDR && type->size == kV4AddrSize) {
+    char addr[INET_ADDRSTRLEN];
+    ::inet_ntop(AF_INET, data, addr, sizeof(addr));
+    return Value::makeString(addr);
+  }
+  auto value = readInt(data, type->size);
+  if (hint != IntHint::NONE) {
+    if (type->size == sizeof(uint16_t)) {
+      value = ntohs(static_cast<uint16_t>(value));
+    } else if (type->size == sizeof(uint32_t)) {
+      value = ntohl(static_cast<uint32_t>(value));
+    }
+  }
+  bool isSigned = btf_int_encoding(type) & BTF_INT_SIGNED;
+  if (isSigned && type->size < kMaxIntSize) {
+    auto shift = (kMaxIntSize - type->size) * kBitsInByte;
+    value =
+        static_cast<uint64_t>(static_cast<int64_t>(value << shift) >> shift);
+  }
+  return Value::makeNumber(value, isSigned);
+}
+
+Value BtfDecoder::decodeArray(
+    const struct btf_type* type,
+    const uint8_t* data,
+    uint32_t size,
+    IntHint hint) const {
+  auto array = btf_array(type);
+  auto elemSize = btf__resolve_size(btf_, array->type);
+  if (elemSize <= 0) {
+    return decodeRaw(data, size);
+  }
+  auto elemHint = IntHint::NONE;
+  auto elem = btf__type_by_id(btf_, skipModifiers(array->type, elemHint));
+  if (elemHint == IntHint::BE_ADDR && array->nelems == kV6AddrWords &&
+      size >= kV6AddrSize) {
+    char addr[INET6_ADDRSTRLEN];
+    ::inet_ntop(AF_INET6, data, addr, sizeof(addr));
+    return Value::makeString(addr);
+  }
+  if (elem && btf_is_int(elem) && elem->size == 1 &&
+      (btf_int_encoding(elem) & BTF_INT_CHAR)) {
+    auto len = ::strnlen(
+        reinterpret_cast<const char*>(data),
+        std::min<uint32_t>(size, array->nelems));
+    return Value::makeString(
+        std::string(reinterpret_cast<const char*>(data), len));
+  }
+  auto result = Value::makeArray();
+  for (uint32_t i = 0; i < array->nelems; i++) {
+    auto offset = i * elemSize;
+    if (offset + elemSize > size) {
+      break;
+    }
+    result.add("", decodeType(array->type, data + offset, elemSize, hint));
+  }
+  return result;
+}
+
+Value BtfDecoder::decodeStruct(
+    const struct btf_type* type,
+    const uint8_t* data,
+    uint32_t size) const {
+  auto result = Value::makeObject();
+  auto member = btf_members(type);
+  for (int i = 0; i < btf_vlen(type); i++, member++) {
+    std::string name = btf__name_by_offset(btf_, member->name_off);
+    auto bitOffset = btf_member_bit_offset(type, i);
+    auto bitSize = btf_member_bitfield_size(type, i);
+    auto offset = bitOffset / kBitsInByte;
+    if (offset >= size) {
+      break;
+    }
+    if (bitSize) {
+      auto value = readInt(data + offset, size - offset);
+      value >>= bitOffset % kBitsInByte;
+      if (bitSize < kMaxIntSize * kBitsInByte) {
+        value &= (1ULL << bitSize) - 1;
+      }
+      result.add(name, Value::makeNumber(value));
+      continue;
+    }
+    auto memberSize = btf__resolve_size(btf_, member->type);
+    if (memberSize <= 0 || offset + memberSize > size) {
+      result.add(name, decodeRaw(data + offset, size - offset));
+      continue;
+    }
+    auto hint = kBeMembers.count(name) ? IntHint::BE_NUMBER : IntHint::NONE;
+    auto memberHint = IntHint::NONE;
+    auto memberType =
+        btf__type_by_id(btf_, skipModifiers(member->type, memberHint));
+    if (name.empty() && memberType && btf_is_union(memberType)) {
+      // anonymous union: chosen member is printed as member of the struct
+      auto chosen = decodeUnion(memberType, data + offset, memberSize);
+      result.add(chosen.first, std::move(chosen.second));
+      continue;
+    }
+    auto value = decodeType(member->type, data + offset, memberSize, hint);
+    if (name.empty() && value.kind == Value::Kind::OBJECT) {
+      // anonymous struct: its members are merged into parent
+      for (auto& nested : value.members) {
+        result.add(nested.first, std::move(nested.second));
+      }
+      continue;
+    }
+    result.add(name, std::move(value));
+  }
+  return result;
+}
+
+std::pair<std::string, Value> BtfDecoder::decodeUnion(
+    const struct btf_type* type,
+    const uint8_t* data,
+    uint32_t size) const {
+  auto member = btf_members(type);
+  auto vlen = btf_vlen(type);
+  bool allAddresses = vlen > 0;
+  for (int i = 0; i < vlen; i++) {
+    allAddresses = allAddresses && isAddress(member[i].type);
+  }
+  if (allAddresses) {
+    // e.g. vip/vipv6 in vip_definition. v4 addresses are stored in first
+    // 4 bytes and the rest of the union is zeroed
+    bool isV4 = size < kV6AddrSize;
+    if (!isV4) {
+      isV4 = true;
+      for (uint32_t i = kV4AddrSize; i < kV6AddrSize; i++) {
+        isV4 = isV4 && data[i] == 0;
+      }
+    }
+    for (int i = 0; i < vlen; i++) {
+      bool memberIsV4 =
+          btf__resolve_size(btf_, member[i].type) == kV4AddrSize;
+      if (memberIsV4 == isV4) {
+        return std::make_pair(
+            std::string(btf__name_by_offset(btf_, member[i].name_off)),
+            decodeType(
+                member[i].type,
+                data,
+                isV4 ? kV4AddrSize : kV6AddrSize,
+                IntHint::BE_ADDR));
+      }
+    }
+  }
+  // otherwise printing the biggest member (arrays are preferred, as they are
+  // more specific, e.g. port16[2] vs ports)
+  int chosen = -1;
+  int64_t chosenSize = 0;
+  bool chosenIsArray = false;
+  for (int i = 0; i < vlen; i++) {
+    auto memberSize = btf__resolve_size(btf_, member[i].type);
+    if (memberSize <= 0 || memberSize > size) {
+      continue;
+    }
+    auto hint = IntHint::NONE;
+    auto memberType =
+        btf__type_by_id(btf_, skipModifiers(member[i].type, hint));
+    bool isArray = memberType && btf_is_array(memberType);
+    if (memberSize > chosenSize ||
+        (memberSize == chosenSize && isArray && !chosenIsArray)) {
+      chosen = i;
+      chosenSize = memberSize;
+      chosenIsArray = isArray;
+    }
+  }
+  if (chosen < 0) {
+    return std::make_pair(std::string(), decodeRaw(data, size));
+  }
+  std::string name = btf__name_by_offset(btf_, member[chosen].name_off);
+  auto hint = kBeMembers.count(name) ? IntHint::BE_NUMBER : IntHint::NONE;
+  return std::make_pair(
+      name, decodeType(member[chosen].type, data, chosenSize, hint));
+}
+
+} // namespace mapdump
@@ -0,0 +1,147 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "tools/mapdump/MapDumpValue.h"
+
+extern "C" {
+struct btf;
+struct btf_type;
+}
+
+namespace mapdump {
+
+/**
+ * decodes raw bytes of katran's maps into Values w/ the help of BTF from
+ * balancer's object file. maps are declared w/ BPF_ANNOTATE_KV_PAIR, so for
+ * each map there is a ____btf_map_<name> struct w/ key and value members.
+ *
+ * on top of plain BTF types decoder knows katran's conventions: __be32
+ * (and __be32[4]) are printed as ip addresses, ports are in network order
+ * and for unions only one (the most specific) member is printed.
+ */
+class BtfDecoder {
+ public:
+  BtfDecoder() = default;
+
+  ~BtfDecoder();
+
+  BtfDecoder(const BtfDecoder&) = delete;
+  BtfDecoder& operator=(const BtfDecoder&) = delete;
+
+  /**
+   * @param string path to balancer's bpf object file
+   * @return true on success
+   */
+  bool load(const std::string& path);
+
+  /**
+   * @param btf* btf already parsed (or constructed) BTF. decoder takes the
+   * ownership of it
+   */
+  void load(struct btf* btf);
+
+  /**
+   * @param string mapName name of the map as declared in bpf program
+   * @param uint32_t keyTypeId where key's type id would be written
+   * @param uint32_t valueTypeId where value's type id would be written
+   * @return true if types of the map have been found
+   */
+  bool getMapTypes(
+      const std::string& mapName,
+      uint32_t& keyTypeId,
+      uint32_t& valueTypeId) const;
+
+  /**
+   * @param uint32_t typeId BTF type of the data
+   * @param const uint8_t* data raw bytes of the key or value
+   * @param uint32_t size of the data
+   * @return Value decoded data. if type is unknown (or its size does not
+   * match) data is returned as hex string
+   */
+  Value decode(uint32_t typeId, const uint8_t* data, uint32_t size) const;
+
+  /**
+   * @param const uint8_t* data raw bytes
+   * @param uint32_t size of the data
+   * @return Value hex representation of the data
+   */
+  static Value decodeRaw(const uint8_t* data, uint32_t size);
+
+ private:
+  /**
+   * possible representations of the integer, based on typedefs and names
+   * of the members
+   */
+  enum class IntHint {
+    NONE,
+    BE_ADDR,
+    BE_NUMBER,
+  };
+
+  Value decodeType(
+      uint32_t typeId,
+      const uint8_t* data,
+      uint32_t size,
+      IntHint hint) const;
+
+  Value decodeInt(
+      const struct btf_type* type,
+      const uint8_t* data,
+      uint32_t size,
+      IntHint hint) const;
+
+  Value decodeArray(
+      const struct btf_type* type,
+      const uint8_t* data,
+      uint32_t size,
+      IntHint hint) const;
+
+  Value decodeStruct(
+      const struct btf_type* type,
+      const uint8_t* data,
+      uint32_t size) const;
+
+  /**
+   * @return pair of name and decoded value of union's member which is
+   * going to be printed
+   */
+  std::pair<std::string, Value> decodeUnion(
+      const struct btf_type* type,
+      const uint8_t* data,
+      uint32_t size) const;
+
+  /**
+   * @param uint32_t typeId type to resolve
+   * @param IntHint hint where hint from typedefs would be written
+   * @return uint32_t id of the type w/o typedefs and modifiers
+   */
+  uint32_t skipModifiers(uint32_t typeId, IntHint& hint) const;
+
+  /**
+   * @return true if member is __be32 or __be32[4]
+   */
+  bool isAddress(uint32_t typeId) const;
+
+  struct btf* btf_{nullptr};
+};
+
+} // namespace mapdump
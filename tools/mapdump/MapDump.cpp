@@ -0,0 +1,505 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "tools/mapdump/MapDump.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <folly/String.h>
+#include <glog/logging.h>
+
+#include "katran/lib/BalancerStructs.h"
+#include "katran/lib/BpfAdapter.h"
+#include "katran/lib/CHHelpers.h"
+#include "katran/lib/IpHelpers.h"
+
+extern "C" {
+#include <arpa/inet.h>
+#include <unistd.h>
+}
+
+namespace mapdump {
+
+namespace {
+constexpr char kLruMapsMapping[] = "lru_maps_mapping";
+constexpr char kLruMapName[] = "fallback_lru_cache";
+constexpr char kChRingsMapName[] = "ch_rings";
+constexpr char kVipMapName[] = "vip_map";
+constexpr char kRealsMapName[] = "reals";
+constexpr char kLimitsMapName[] = "lb_limits_map";
+constexpr uint32_t kPerCpuValueAlign = 8;
+// numa replicas are named "<map>_n<node>" or "<map>_nany"
+constexpr char kReplicaNameSuffix[] = "_n";
+constexpr char kAnyNodeName[] = "any";
+
+bool isPerCpuMap(uint32_t type) {
+  return type == BPF_MAP_TYPE_PERCPU_HASH ||
+      type == BPF_MAP_TYPE_PERCPU_ARRAY || type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+// name of the map in bpf program for numa replica's kernel name
+std::string stripReplicaSuffix(const std::string& name) {
+  auto pos = name.rfind(kReplicaNameSuffix);
+  if (pos == std::string::npos) {
+    return name;
+  }
+  auto node = name.substr(pos + sizeof(kReplicaNameSuffix) - 1);
+  if (node != kAnyNodeName &&
+      (node.empty() ||
+       !std::all_of(node.begin(), node.end(), [](char c) {
+         return c >= '0' && c <= '9';
+       }))) {
+    return name;
+  }
+  auto base = name.substr(0, pos);
+  if (base != kVipMapName && base != kChRingsMapName && base != kRealsMapName) {
+    return name;
+  }
+  return base;
+}
+
+bool isBatchNotSupported(int error) {
+  return error == EINVAL || error == ENOTSUPP || error == EOPNOTSUPP;
+}
+} // namespace
+
+MapDump::MapDump(const MapDumpConfig& config) : config_(config) {}
+
+MapDump::~MapDump() {
+  if (mapFd_ >= 0) {
+    ::close(mapFd_);
+  }
+}
+
+int MapDump::getMapFdByName(const std::string& name) {
+  // kernel keeps only first BPF_OBJ_NAME_LEN - 1 chars of the map's name
+  auto kernelName = name.substr(0, BPF_OBJ_NAME_LEN - 1);
+  int mapFd = -1;
+  uint32_t id = 0;
+  while (!katran::BpfAdapter::bpfMapGetNextId(id, &id)) {
+    int fd = katran::BpfAdapter::bpfMapGetFdById(id);
+    if (fd < 0) {
+      // map could be removed since we got its id
+      continue;
+    }
+    struct bpf_map_info info = {};
+    if (katran::BpfAdapter::getBpfMapInfo(fd, &info) ||
+        kernelName != info.name) {
+      ::close(fd);
+      continue;
+    }
+    if (mapFd >= 0) {
+      // e.g. maps of several loaded balancers
+      LOG(ERROR) << "more than one map w/ name " << name
+                 << " is loaded, use map id or pinned path to choose one";
+      ::close(fd);
+      ::close(mapFd);
+      return -1;
+    }
+    mapFd = fd;
+  }
+  return mapFd;
+}
+
+bool MapDump::init() {
+  try {
+    filters_ = parseFilters(config_.filter);
+  } catch (const std::invalid_argument& e) {
+    LOG(ERROR) << e.what();
+    return false;
+  }
+  if (!config_.balancerProg.empty() && !btf_.load(config_.balancerProg)) {
+    LOG(WARNING) << "entries are going to be printed w/o decoding";
+  }
+  auto btfName = config_.mapName;
+  if (config_.lruCpu >= 0) {
+    btfName = kLruMapName;
+    int outerFd = getMapFdByName(kLruMapsMapping);
+    if (outerFd < 0) {
+      LOG(ERROR) << "can't find " << kLruMapsMapping << " map";
+      return false;
+    }
+    uint32_t cpu = config_.lruCpu;
+    mapFd_ = katran::BpfAdapter::bpfMapGetFdOfInnerMap(outerFd, &cpu);
+    ::close(outerFd);
+  } else if (!config_.vip.empty()) {
+    btfName = kChRingsMapName;
+    mapFd_ = getMapFdByName(kChRingsMapName);
+  } else if (!config_.pinnedPath.empty()) {
+    mapFd_ = katran::BpfAdapter::getPinnedBpfObject(config_.pinnedPath);
+  } else if (config_.mapId) {
+    mapFd_ = katran::BpfAdapter::bpfMapGetFdById(config_.mapId);
+  } else {
+    mapFd_ = getMapFdByName(config_.mapName);
+  }
+  if (mapFd_ < 0) {
+    LOG(ERROR) << "can't open map " << btfName;
+    return false;
+  }
+  struct bpf_map_info info = {};
+  if (katran::BpfAdapter::getBpfMapInfo(mapFd_, &info)) {
+    LOG(ERROR) << "can't get info of map " << btfName << ": "
+               << folly::errnoStr(errno);
+    return false;
+  }
+  if (btfName.empty()) {
+    // map was opened by id or path. trying to decode it by its kernel name
+    btfName = stripReplicaSuffix(info.name);
+  }
+  mapType_ = info.type;
+  keySize_ = info.key_size;
+  valueSize_ = info.value_size;
+  maxEntries_ = info.max_entries;
+  valueStride_ = valueSize_;
+  if (isPerCpuMap(mapType_)) {
+    nrCpus_ = katran::BpfAdapter::getPossibleCpus();
+    valueStride_ =
+        (valueSize_ + kPerCpuValueAlign - 1) & ~(kPerCpuValueAlign - 1);
+  }
+  typesKnown_ = btf_.getMapTypes(btfName, keyTypeId_, valueTypeId_);
+  auto batchSize =
+      std::max<uint32_t>(1, std::min(config_.batchSize, maxEntries_));
+  keys_.resize(batchSize * keySize_);
+  values_.resize(batchSize * valueStride_ * nrCpus_);
+  return true;
+}
+
+Value MapDump::decodeEntry(const uint8_t* key, const uint8_t* value) {
+  auto entry = Value::makeObject();
+  if (typesKnown_) {
+    entry.add("key", btf_.decode(keyTypeId_, key, keySize_));
+  } else if (keySize_ == sizeof(uint32_t)) {
+    // index of array or id. most of katran's maps are keyed this way
+    uint32_t idx;
+    ::memcpy(&idx, key, sizeof(idx));
+    entry.add("key", Value::makeNumber(idx));
+  } else {
+    entry.add("key", BtfDecoder::decodeRaw(key, keySize_));
+  }
+  auto decodeValue = [this](const uint8_t* data) {
+    return typesKnown_ ? btf_.decode(valueTypeId_, data, valueSize_)
+                       : BtfDecoder::decodeRaw(data, valueSize_);
+  };
+  if (nrCpus_ == 1) {
+    entry.add("value", decodeValue(value));
+    return entry;
+  }
+  auto total = decodeValue(value);
+  auto perCpu = Value::makeArray();
+  if (config_.perCpu) {
+    perCpu.add("", total);
+  }
+  for (uint32_t cpu = 1; cpu < nrCpus_; cpu++) {
+    auto cpuValue = decodeValue(value + cpu * valueStride_);
+    sumValues(total, cpuValue);
+    if (config_.perCpu) {
+      perCpu.add("", std::move(cpuValue));
+    }
+  }
+  entry.add("value", std::move(total));
+  if (config_.perCpu) {
+    entry.add("per_cpu", std::move(perCpu));
+  }
+  return entry;
+}
+
+bool MapDump::processEntry(
+    const uint8_t* key,
+    const uint8_t* value,
+    const EntryCallback& cb) {
+  auto entry = decodeEntry(key, value);
+  if (!matchesFilters(entry, filters_)) {
+    return true;
+  }
+  return cb(entry);
+}
+
+int MapDump::readBatches(
+    int fd,
+    const std::function<bool(uint32_t)>& onBatch) {
+  uint32_t batchSize = keys_.size() / keySize_;
+  // opaque position in the map. hash and array maps are using u32 for it
+  uint64_t in_batch = 0, out_batch = 0;
+  bool first_batch = true;
+  while (true) {
+    uint32_t count = batchSize;
+    auto err = katran::BpfAdapter::bpfMapLookupBatch(
+        fd,
+        first_batch ? nullptr : &in_batch,
+        &out_batch,
+        keys_.data(),
+        values_.data(),
+        &count);
+    if (err && errno != ENOENT) {
+      if (first_batch && (isBatchNotSupported(errno) || errno == ENOSPC)) {
+        // batch operations are not supported for this map (or bucket is
+        // bigger than the batch)
+        return 1;
+      }
+      LOG(ERROR) << "error while reading the map: " << folly::errnoStr(errno);
+      return -1;
+    }
+    if (!onBatch(count) || err) {
+      // callback asked to stop or ENOENT: we reached the end of the map
+      return 0;
+    }
+    in_batch = out_batch;
+    first_batch = false;
+  }
+}
+
+int MapDump::forEachEntry(int fd, const EntryCallback& cb) {
+  auto valueSize = valueStride_ * nrCpus_;
+  auto res = readBatches(fd, [&](uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+      auto key = keys_.data() + i * keySize_;
+      if (!processEntry(key, values_.data() + i * valueSize, cb)) {
+        return false;
+      }
+    }
+    return true;
+  });
+  if (res <= 0) {
+    return res;
+  }
+  // batch operations are not supported (e.g. lpm trie or old kernel).
+  // walking every key instead
+  VLOG(2) << "batch lookup is not supported, walking every key";
+  std::vector<uint8_t> key(keySize_), nextKey(keySize_);
+  bool first = true;
+  while (!katran::BpfAdapter::bpfMapGetNextKey(
+      fd, first ? nullptr : key.data(), nextKey.data())) {
+    first = false;
+    key.swap(nextKey);
+    if (katran::BpfAdapter::bpfMapLookupElement(
+            fd, key.data(), values_.data())) {
+      // entry has been removed since we got the key
+      continue;
+    }
+    if (!processEntry(key.data(), values_.data(), cb)) {
+      break;
+    }
+  }
+  return 0;
+}
+
+uint32_t MapDump::getRingSize() {
+  if (config_.ringSize) {
+    return config_.ringSize;
+  }
+  uint32_t ringSize = katran::kDefaultChRingSize;
+  int fd = getMapFdByName(kLimitsMapName);
+  if (fd >= 0) {
+    uint32_t key = 0;
+    struct katran::lb_limits limits = {};
+    if (!katran::BpfAdapter::bpfMapLookupElement(fd, &key, &limits) &&
+        limits.ring_size) {
+      ringSize = limits.ring_size;
+    }
+    ::close(fd);
+  }
+  return ringSize;
+}
+
+int MapDump::forEachRingReal(const EntryCallback& cb) {
+  struct katran::vip_definition vip = {};
+  try {
+    auto addr = katran::IpHelpers::parseAddrToBe(config_.vip);
+    if (addr.flags > 0) {
+      ::memcpy(vip.vipv6, addr.v6daddr, sizeof(vip.vipv6));
+    } else {
+      vip.vip = addr.daddr;
+    }
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "invalid vip address " << config_.vip << ": " << e.what();
+    return -1;
+  }
+  vip.port = htons(config_.vipPort);
+  vip.proto = config_.vipProto;
+  struct katran::vip_meta meta = {};
+  int vipMapFd = getMapFdByName(kVipMapName);
+  if (vipMapFd < 0) {
+    LOG(ERROR) << "can't find " << kVipMapName << " map";
+    return -1;
+  }
+  auto err = katran::BpfAdapter::bpfMapLookupElement(vipMapFd, &vip, &meta);
+  ::close(vipMapFd);
+  if (err) {
+    LOG(ERROR) << "vip " << config_.vip << ":" << config_.vipPort << ":"
+               << static_cast<int>(config_.vipProto) << " is not found";
+    return -1;
+  }
+  auto ringSize = getRingSize();
+  uint32_t start = meta.vip_num * ringSize;
+  uint32_t end = start + ringSize;
+  if (end > maxEntries_) {
+    LOG(ERROR) << "ring of vip #" << meta.vip_num << " is out of "
+               << kChRingsMapName << " bounds; wrong ring size?";
+    return -1;
+  }
+  // ring's size is bounded, so only per real counters are kept
+  std::map<uint32_t, uint32_t> positions;
+  uint32_t batchSize = keys_.size() / keySize_;
+  uint32_t pos = start;
+  bool batchSupported = true;
+  while (pos < end) {
+    uint32_t count = std::min(batchSize, end - pos);
+    if (batchSupported) {
+      // for arrays batch's position is the last key of previous batch
+      uint64_t in_batch = pos - 1, out_batch = 0;
+      auto res = katran::BpfAdapter::bpfMapLookupBatch(
+          mapFd_,
+          pos ? &in_batch : nullptr,
+          &out_batch,
+          keys_.data(),
+          values_.data(),
+          &count);
+      if (res && errno != ENOENT) {
+        if (pos == start && isBatchNotSupported(errno)) {
+          batchSupported = false;
+          continue;
+        }
+        LOG(ERROR) << "error while reading " << kChRingsMapName << ": "
+                   << folly::errnoStr(errno);
+        return -1;
+      }
+    } else {
+      count = 1;
+      if (katran::BpfAdapter::bpfMapLookupElement(
+              mapFd_, &pos, values_.data())) {
+        LOG(ERROR) << "error while reading " << kChRingsMapName << ": "
+                   << folly::errnoStr(errno);
+        return -1;
+      }
+    }
+    if (!count) {
+      break;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t realNum;
+      ::memcpy(&realNum, values_.data() + i * valueStride_, sizeof(realNum));
+      positions[realNum]++;
+    }
+    pos += count;
+  }
+
+  int realsFd = getMapFdByName(kRealsMapName);
+  struct bpf_map_info realsInfo = {};
+  if (realsFd >= 0 && katran::BpfAdapter::getBpfMapInfo(realsFd, &realsInfo)) {
+    ::close(realsFd);
+    realsFd = -1;
+  }
+  uint32_t realsKeyTypeId = 0, realsValueTypeId = 0;
+  bool realsTypesKnown =
+      btf_.getMapTypes(kRealsMapName, realsKeyTypeId, realsValueTypeId);
+  std::vector<uint8_t> real(realsInfo.value_size);
+  for (const auto& realPositions : positions) {
+    auto entry = Value::makeObject();
+    entry.add("real_index", Value::makeNumber(realPositions.first));
+    uint32_t realNum = realPositions.first;
+    if (realsFd >= 0 &&
+        !katran::BpfAdapter::bpfMapLookupElement(
+            realsFd, &realNum, real.data())) {
+      entry.add(
+          "real",
+          realsTypesKnown
+              ? btf_.decode(realsValueTypeId, real.data(), real.size())
+              : BtfDecoder::decodeRaw(real.data(), real.size()));
+    }
+    entry.add("positions", Value::makeNumber(realPositions.second));
+    if (!matchesFilters(entry, filters_)) {
+      continue;
+    }
+    if (!cb(entry)) {
+      break;
+    }
+  }
+  if (realsFd >= 0) {
+    ::close(realsFd);
+  }
+  return 0;
+}
+
+int64_t MapDump::dump(std::ostream& out) {
+  EntryWriter writer(out, config_.json);
+  auto cb = [&](const Value& entry) {
+    writer.write(entry);
+    return !config_.limit || writer.getWritten() < config_.limit;
+  };
+  auto res = config_.vip.empty() ? forEachEntry(mapFd_, cb)
+                                 : forEachRingReal(cb);
+  writer.finish();
+  if (res) {
+    return res;
+  }
+  return writer.getWritten();
+}
+
+int MapDump::watch(
+    std::ostream& out,
+    uint32_t intervalMs,
+    uint32_t iterations) {
+  // previous values of entries, keyed by text representation of the key
+  std::unordered_map<std::string, Value> prev;
+  auto prevTime = std::chrono::steady_clock::now();
+  for (uint32_t iteration = 0;; iteration++) {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - prevTime).count();
+    prevTime = now;
+    std::unordered_map<std::string, Value> cur;
+    // first reading is only used as a base for the rates
+    std::unique_ptr<EntryWriter> writer;
+    if (iteration) {
+      writer = std::make_unique<EntryWriter>(out, config_.json);
+    }
+    auto res = forEachEntry(mapFd_, [&](const Value& entry) {
+      auto key = findPath(entry, "key");
+      auto value = findPath(entry, "value");
+      if (!key || !value) {
+        return true;
+      }
+      auto keyStr = toText(*key);
+      auto it = prev.find(keyStr);
+      if (writer && it != prev.end() &&
+          (!config_.limit || writer->getWritten() < config_.limit)) {
+        auto rate = Value::makeObject();
+        rate.add("key", *key);
+        rate.add("rate", rateOf(it->second, *value, seconds));
+        writer->write(rate);
+      }
+      cur.emplace(std::move(keyStr), *value);
+      return true;
+    });
+    if (res) {
+      return res;
+    }
+    writer.reset();
+    prev.swap(cur);
+    if (iterations && iteration == iterations) {
+      return 0;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+  }
+}
+
+} // namespace mapdump
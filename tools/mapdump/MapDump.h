@@ -0,0 +1,204 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "tools/mapdump/BtfDecoder.h"
+#include "tools/mapdump/MapDumpValue.h"
+
+namespace mapdump {
+
+namespace {
+constexpr uint32_t kDefaultBatchSize = 1024;
+} // namespace
+
+/**
+ * @param string balancerProg path to balancer's bpf object (source of BTF)
+ * @param string mapName name of the map as declared in bpf program
+ * @param string pinnedPath if not empty - map is taken from this location,
+ * instead of searching thru all loaded maps by name
+ * @param uint32_t mapId if not 0 - id of the map to dump
+ * @param int lruCpu if >= 0: per cpu lru of this cpu is dumped (mapName
+ * is ignored)
+ * @param string vip if not empty: ch ring of this vip is dumped (as number
+ * of ring's positions per real); vipPort and vipProto must be set as well
+ * @param string filter comma separated list of path=value conditions
+ * @param bool json true if output should be in json format
+ * @param bool perCpu true if values of per cpu maps should be printed for
+ * each cpu (by default only totals are printed)
+ * @param uint32_t limit max number of entries to print (0 - no limit)
+ * @param uint32_t batchSize number of entries read from the map per syscall
+ * @param uint32_t ringSize size of ch ring, if it can't be read from
+ * lb_limits_map
+ *
+ * config of the map dumper
+ */
+struct MapDumpConfig {
+  std::string balancerProg;
+  std::string mapName;
+  std::string pinnedPath;
+  uint32_t mapId{0};
+  int lruCpu{-1};
+  std::string vip;
+  uint16_t vipPort{0};
+  uint8_t vipProto{0};
+  std::string filter;
+  bool json{false};
+  bool perCpu{false};
+  uint32_t limit{0};
+  uint32_t batchSize{kDefaultBatchSize};
+  uint32_t ringSize{0};
+};
+
+/**
+ * reads katran's maps from the kernel and prints them in human readable
+ * form. entries are read in batches and printed as soon as they are
+ * decoded, so memory usage does not depend on the size of the map.
+ */
+class MapDump {
+ public:
+  explicit MapDump(const MapDumpConfig& config);
+
+  ~MapDump();
+
+  MapDump(const MapDump&) = delete;
+  MapDump& operator=(const MapDump&) = delete;
+
+  /**
+   * @return true on success
+   *
+   * opens the map and loads BTF. if BTF is not available entries are
+   * printed as hex strings
+   */
+  bool init();
+
+  /**
+   * @param ostream out where entries would be written
+   * @return int64_t number of printed entries, negative on failure
+   */
+  int64_t dump(std::ostream& out);
+
+  /**
+   * @param ostream out where rates would be written
+   * @param uint32_t intervalMs interval between readings
+   * @param uint32_t iterations number of printed readings (0 - forever)
+   * @return int 0 on success
+   *
+   * periodically reads the map and prints per second rates of all numeric
+   * members (e.g. packets and bytes in stats maps). state kept between
+   * readings is proportional to the number of (filtered) entries, so this
+   * is meant for counters' maps
+   */
+  int watch(std::ostream& out, uint32_t intervalMs, uint32_t iterations);
+
+  /**
+   * @param string name of the map as declared in bpf program
+   * @return int fd of the loaded map w/ this name, negative if there is no
+   * such map or if there are more than one of them (e.g. several balancers)
+   */
+  static int getMapFdByName(const std::string& name);
+
+ private:
+  using EntryCallback = std::function<bool(const Value& entry)>;
+
+  /**
+   * @param int fd of the map
+   * @param EntryCallback cb called for each decoded entry which passes
+   * filters. iteration is stopped if callback returns false
+   * @return int 0 on success
+   */
+  int forEachEntry(int fd, const EntryCallback& cb);
+
+  /**
+   * @return int 0 on success
+   *
+   * reads ch ring of configured vip and calls cb w/ number of ring's
+   * positions per real
+   */
+  int forEachRingReal(const EntryCallback& cb);
+
+  /**
+   * @return Value decoded entry: {key, value[, per_cpu]}
+   */
+  Value decodeEntry(const uint8_t* key, const uint8_t* value);
+
+  /**
+   * @param int fd of the map
+   * @param function onBatch called w/ number of entries read into keys_ and
+   * values_. reading is stopped if it returns false
+   * @return int 0 if map has been read till the end (or onBatch asked to
+   * stop); 1 if batch operations are not supported for this map; negative
+   * on failure
+   */
+  int readBatches(int fd, const std::function<bool(uint32_t)>& onBatch);
+
+  /**
+   * helper to decode and filter single raw entry
+   */
+  bool processEntry(
+      const uint8_t* key,
+      const uint8_t* value,
+      const EntryCallback& cb);
+
+  /**
+   * @return uint32_t ring size from lb_limits_map or from the config
+   */
+  uint32_t getRingSize();
+
+  MapDumpConfig config_;
+
+  BtfDecoder btf_;
+
+  std::vector<Filter> filters_;
+
+  int mapFd_{-1};
+
+  uint32_t mapType_{0};
+
+  uint32_t keySize_{0};
+
+  uint32_t valueSize_{0};
+
+  uint32_t maxEntries_{0};
+
+  /**
+   * number of cpus for per cpu maps (1 otherwise)
+   */
+  uint32_t nrCpus_{1};
+
+  /**
+   * size of single cpu's slot in the value of per cpu maps
+   */
+  uint32_t valueStride_{0};
+
+  uint32_t keyTypeId_{0};
+
+  uint32_t valueTypeId_{0};
+
+  bool typesKnown_{false};
+
+  std::vector<uint8_t> keys_;
+
+  std::vector<uint8_t> values_;
+};
+
+} // namespace mapdump
@@ -0,0 +1,326 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "tools/mapdump/MapDumpValue.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+namespace mapdump {
+
+namespace {
+constexpr char kPathDelimiter = '.';
+constexpr char kFiltersDelimiter = ',';
+constexpr char kFilterAssign = '=';
+
+std::string numberToString(const Value& value) {
+  if (value.isSigned) {
+    return std::to_string(static_cast<int64_t>(value.number));
+  }
+  return std::to_string(value.number);
+}
+
+std::string escapeJson(const std::string& str) {
+  std::string escaped;
+  for (auto c : str) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      ::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      escaped.append(buf);
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+void appendJson(const Value& value, std::string& out) {
+  switch (value.kind) {
+    case Value::Kind::NUMBER:
+      out.append(numberToString(value));
+      break;
+    case Value::Kind::STRING:
+      out.append("\"").append(escapeJson(value.str)).append("\"");
+      break;
+    case Value::Kind::OBJECT:
+    case Value::Kind::ARRAY: {
+      bool isObject = value.kind == Value::Kind::OBJECT;
+      out.push_back(isObject ? '{' : '[');
+      bool first = true;
+      for (const auto& member : value.members) {
+        if (!first) {
+          out.push_back(',');
+        }
+        first = false;
+        if (isObject) {
+          out.append("\"").append(escapeJson(member.first)).append("\":");
+        }
+        appendJson(member.second, out);
+      }
+      out.push_back(isObject ? '}' : ']');
+      break;
+    }
+  }
+}
+
+void appendText(const Value& value, std::string& out) {
+  switch (value.kind) {
+    case Value::Kind::NUMBER:
+      out.append(numberToString(value));
+      break;
+    case Value::Kind::STRING:
+      out.append(value.str);
+      break;
+    case Value::Kind::OBJECT:
+    case Value::Kind::ARRAY: {
+      bool isObject = value.kind == Value::Kind::OBJECT;
+      out.push_back(isObject ? '{' : '[');
+      bool first = true;
+      for (const auto& member : value.members) {
+        if (!first) {
+          out.append(", ");
+        }
+        first = false;
+        if (isObject) {
+          out.append(member.first).append(": ");
+        }
+        appendText(member.second, out);
+      }
+      out.push_back(isObject ? '}' : ']');
+      break;
+    }
+  }
+}
+} // namespace
+
+Value Value::makeNumber(uint64_t number, bool isSigned) {
+  Value value;
+  value.kind = Kind::NUMBER;
+  value.number = number;
+  value.isSigned = isSigned;
+  return value;
+}
+
+Value Value::makeString(const std::string& str) {
+  Value value;
+  value.kind = Kind::STRING;
+  value.str = str;
+  return value;
+}
+
+Value Value::makeObject() {
+  Value value;
+  value.kind = Kind::OBJECT;
+  return value;
+}
+
+Value Value::makeArray() {
+  Value value;
+  value.kind = Kind::ARRAY;
+  return value;
+}
+
+void Value::add(const std::string& name, Value value) {
+  members.emplace_back(
+      kind == Kind::ARRAY ? std::string() : name, std::move(value));
+}
+
+std::string toJson(const Value& value) {
+  std::string out;
+  appendJson(value, out);
+  return out;
+}
+
+std::string toText(const Value& value) {
+  std::string out;
+  appendText(value, out);
+  return out;
+}
+
+const Value* findPath(const Value& value, const std::string& path) {
+  const Value* current = &value;
+  size_t start = 0;
+  while (start <= path.size()) {
+    auto end = path.find(kPathDelimiter, start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    auto name = path.substr(start, end - start);
+    start = end + 1;
+    if (name.empty()) {
+      return nullptr;
+    }
+    const Value* next = nullptr;
+    if (current->kind == Value::Kind::OBJECT) {
+      for (const auto& member : current->members) {
+        if (member.first == name) {
+          next = &member.second;
+          break;
+        }
+      }
+    } else if (current->kind == Value::Kind::ARRAY) {
+      size_t idx;
+      try {
+        idx = std::stoul(name);
+      } catch (const std::exception&) {
+        return nullptr;
+      }
+      if (idx < current->members.size()) {
+        next = &current->members[idx].second;
+      }
+    }
+    if (!next) {
+      return nullptr;
+    }
+    current = next;
+  }
+  return current;
+}
+
+std::vector<Filter> parseFilters(const std::string& filters) {
+  std::vector<Filter> result;
+  size_t start = 0;
+  while (start < filters.size()) {
+    auto end = filters.find(kFiltersDelimiter, start);
+    if (end == std::string::npos) {
+      end = filters.size();
+    }
+    auto condition = filters.substr(start, end - start);
+    start = end + 1;
+    if (condition.empty()) {
+      continue;
+    }
+    auto pos = condition.find(kFilterAssign);
+    if (pos == std::string::npos || pos == 0) {
+      throw std::invalid_argument("malformed filter: " + condition);
+    }
+    result.push_back(
+        Filter{condition.substr(0, pos), condition.substr(pos + 1)});
+  }
+  return result;
+}
+
+bool matchesFilters(const Value& entry, const std::vector<Filter>& filters) {
+  for (const auto& filter : filters) {
+    auto value = findPath(entry, filter.path);
+    if (!value) {
+      return false;
+    }
+    if (value->kind == Value::Kind::NUMBER) {
+      if (numberToString(*value) != filter.value) {
+        return false;
+      }
+    } else if (value->kind == Value::Kind::STRING) {
+      if (value->str != filter.value) {
+        return false;
+      }
+    } else {
+      // only scalars could be matched
+      return false;
+    }
+  }
+  return true;
+}
+
+void sumValues(Value& acc, const Value& value) {
+  if (acc.kind != value.kind) {
+    return;
+  }
+  if (acc.kind == Value::Kind::NUMBER) {
+    acc.number += value.number;
+    return;
+  }
+  if (acc.members.size() != value.members.size()) {
+    return;
+  }
+  for (size_t i = 0; i < acc.members.size(); i++) {
+    sumValues(acc.members[i].second, value.members[i].second);
+  }
+}
+
+Value rateOf(const Value& prev, const Value& cur, double seconds) {
+  if (cur.kind == Value::Kind::NUMBER) {
+    uint64_t rate = 0;
+    if (prev.kind == Value::Kind::NUMBER && cur.number >= prev.number &&
+        seconds > 0) {
+      rate = static_cast<uint64_t>((cur.number - prev.number) / seconds);
+    }
+    return Value::makeNumber(rate);
+  }
+  if (cur.kind == Value::Kind::STRING) {
+    return cur;
+  }
+  Value result;
+  result.kind = cur.kind;
+  bool sameShape =
+      prev.kind == cur.kind && prev.members.size() == cur.members.size();
+  // w/o previous reading of the member its rate is reported as 0
+  const Value unknown = Value::makeString("");
+  for (size_t i = 0; i < cur.members.size(); i++) {
+    const auto& member = cur.members[i];
+    result.members.emplace_back(
+        member.first,
+        rateOf(
+            sameShape ? prev.members[i].second : unknown,
+            member.second,
+            seconds));
+  }
+  return result;
+}
+
+EntryWriter::EntryWriter(std::ostream& out, bool json)
+    : out_(out), json_(json) {
+  if (json_) {
+    out_ << "[";
+  }
+}
+
+EntryWriter::~EntryWriter() {
+  finish();
+}
+
+void EntryWriter::write(const Value& entry) {
+  if (json_) {
+    out_ << (written_ ? ",\n" : "\n") << toJson(entry);
+  } else if (entry.kind == Value::Kind::OBJECT) {
+    bool first = true;
+    for (const auto& member : entry.members) {
+      out_ << (first ? "" : " ") << member.first << ": "
+           << toText(member.second);
+      first = false;
+    }
+    out_ << "\n";
+  } else {
+    out_ << toText(entry) << "\n";
+  }
+  written_++;
+}
+
+void EntryWriter::finish() {
+  if (finished_) {
+    return;
+  }
+  finished_ = true;
+  if (json_) {
+    out_ << (written_ ? "\n]\n" : "]\n");
+  }
+  out_.flush();
+}
+
+} // namespace mapdump
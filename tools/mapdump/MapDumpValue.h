@@ -0,0 +1,164 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mapdump {
+
+/**
+ * decoded representation of map's key or value. numbers are kept as raw
+ * unsigned values (w/ signedness), so values from different cpus could be
+ * summed up and rates could be calculated w/o reparsing the output.
+ */
+struct Value {
+  enum class Kind {
+    NUMBER,
+    STRING,
+    OBJECT,
+    ARRAY,
+  };
+
+  Kind kind{Kind::NUMBER};
+  uint64_t number{0};
+  bool isSigned{false};
+  std::string str;
+  // members of OBJECT (names of ARRAY's elements are empty)
+  std::vector<std::pair<std::string, Value>> members;
+
+  static Value makeNumber(uint64_t number, bool isSigned = false);
+
+  static Value makeString(const std::string& str);
+
+  static Value makeObject();
+
+  static Value makeArray();
+
+  /**
+   * @param string name of the member (ignored for arrays)
+   * @param Value value of the member
+   */
+  void add(const std::string& name, Value value);
+};
+
+/**
+ * single filter's condition: decoded entry must have a scalar at the path
+ * (e.g. "key.vip" or "value.0") w/ specified string representation
+ */
+struct Filter {
+  std::string path;
+  std::string value;
+};
+
+/**
+ * @param Value value to print
+ * @return string value in compact json format
+ */
+std::string toJson(const Value& value);
+
+/**
+ * @param Value value to print
+ * @return string value in human readable, single line format
+ */
+std::string toText(const Value& value);
+
+/**
+ * @param Value value where to look
+ * @param string path dot separated list of members' names or arrays' indexes
+ * @return const Value* pointer to the value at the path, nullptr if there is
+ * no such path
+ */
+const Value* findPath(const Value& value, const std::string& path);
+
+/**
+ * @param string filters comma separated list of path=value conditions
+ * @return vector<Filter> parsed conditions
+ *
+ * throws std::invalid_argument if condition is malformed
+ */
+std::vector<Filter> parseFilters(const std::string& filters);
+
+/**
+ * @param Value entry decoded entry
+ * @param vector<Filter> filters
+ * @return true if entry matches all the conditions
+ */
+bool matchesFilters(const Value& entry, const std::vector<Filter>& filters);
+
+/**
+ * @param Value acc where sum is accumulated
+ * @param Value value to add
+ *
+ * adds all numbers from value to the numbers at the same positions in acc.
+ * used to get total of per cpu values. non numeric members are left as is
+ */
+void sumValues(Value& acc, const Value& value);
+
+/**
+ * @param Value prev previous value of counters
+ * @param Value cur current value of counters
+ * @param double seconds time between two readings
+ * @return Value w/ the same shape as cur, where every number is replaced by
+ * per second rate of its change (counter's resets are reported as 0)
+ */
+Value rateOf(const Value& prev, const Value& cur, double seconds);
+
+/**
+ * writes decoded entries to the stream one by one, as they are read from
+ * the map, so big maps (e.g. lru) are never kept in memory as a whole.
+ * in json mode entries are written as a json array (one element per line).
+ */
+class EntryWriter {
+ public:
+  /**
+   * @param ostream out where entries would be written
+   * @param bool json true if output should be in json format
+   */
+  EntryWriter(std::ostream& out, bool json);
+
+  ~EntryWriter();
+
+  EntryWriter(const EntryWriter&) = delete;
+  EntryWriter& operator=(const EntryWriter&) = delete;
+
+  /**
+   * @param Value entry to write
+   */
+  void write(const Value& entry);
+
+  /**
+   * finishes the output (e.g. closes json array). called by destructor
+   * if it was not called explicitly
+   */
+  void finish();
+
+  uint64_t getWritten() const {
+    return written_;
+  }
+
+ private:
+  std::ostream& out_;
+  bool json_;
+  bool finished_{false};
+  uint64_t written_{0};
+};
+
+} // namespace mapdump
@@ -0,0 +1,84 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <iostream>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "tools/mapdump/MapDump.h"
+
+DEFINE_string(
+    balancer_prog,
+    "./balancer_kern.o",
+    "path to balancer's bpf object (source of BTF for decoding)");
+DEFINE_string(map, "", "name of the map to dump (e.g. vip_map or stats)");
+DEFINE_string(pinned_path, "", "path where the map is pinned");
+DEFINE_int32(map_id, 0, "id of the map to dump");
+DEFINE_int32(lru_cpu, -1, "dump per cpu lru of this cpu");
+DEFINE_string(vip, "", "dump ch ring of this vip (w/ --vip_port/--vip_proto)");
+DEFINE_int32(vip_port, 0, "port of the vip");
+DEFINE_int32(vip_proto, 6, "protocol of the vip");
+DEFINE_int32(ring_size, 0, "ch ring size (0 - read from lb_limits_map)");
+DEFINE_string(
+    filter,
+    "",
+    "comma separated list of path=value conditions, "
+    "e.g. key.vip=10.0.0.1,key.port=80");
+DEFINE_bool(json, false, "print entries in json format");
+DEFINE_bool(per_cpu, false, "print values of per cpu maps for each cpu");
+DEFINE_int32(limit, 0, "max number of entries to print (0 - no limit)");
+DEFINE_int32(batch_size, 1024, "number of entries read per syscall");
+DEFINE_int32(
+    watch_ms,
+    0,
+    "if set: prints per second rates of counters every watch_ms");
+DEFINE_int32(watch_count, 0, "number of rate's readings (0 - forever)");
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  if (FLAGS_map.empty() && FLAGS_pinned_path.empty() && !FLAGS_map_id &&
+      FLAGS_lru_cpu < 0 && FLAGS_vip.empty()) {
+    std::cout << "one of --map, --pinned_path, --map_id, --lru_cpu or --vip "
+              << "must be specified\n";
+    return 1;
+  }
+  mapdump::MapDumpConfig config;
+  config.balancerProg = FLAGS_balancer_prog;
+  config.mapName = FLAGS_map;
+  config.pinnedPath = FLAGS_pinned_path;
+  config.mapId = FLAGS_map_id;
+  config.lruCpu = FLAGS_lru_cpu;
+  config.vip = FLAGS_vip;
+  config.vipPort = FLAGS_vip_port;
+  config.vipProto = FLAGS_vip_proto;
+  config.ringSize = FLAGS_ring_size;
+  config.filter = FLAGS_filter;
+  config.json = FLAGS_json;
+  config.perCpu = FLAGS_per_cpu;
+  config.limit = FLAGS_limit;
+  config.batchSize = FLAGS_batch_size;
+  mapdump::MapDump mapDump(config);
+  if (!mapDump.init()) {
+    return 1;
+  }
+  if (FLAGS_watch_ms > 0) {
+    return mapDump.watch(std::cout, FLAGS_watch_ms, FLAGS_watch_count) ? 1
+                                                                       : 0;
+  }
+  return mapDump.dump(std::cout) < 0 ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tools/mapdump/BtfDecoder.h"
+
+extern "C" {
+#include <arpa/inet.h>
+#include <bpf/btf.h>
+#include <bpf/libbpf.h>
+}
+
+namespace mapdump {
+
+namespace {
+constexpr uint32_t kVipDefinitionSize = 20;
+constexpr uint32_t kVipMetaSize = 8;
+
+/**
+ * BTF of vip_map, as it is generated from balancer's bpf program:
+ * struct vip_definition {
+ *   union { __be32 vip; __be32 vipv6[4]; };
+ *   __u16 port;
+ *   __u8 proto;
+ * };
+ * struct vip_meta { __u32 flags; __u32 vip_num; };
+ * struct ____btf_map_vip_map { struct vip_definition key; ... value; };
+ * plus signed int and enum for other members
+ */
+class BtfDecoderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto btf = btf__new_empty();
+    ASSERT_FALSE(libbpf_get_error(btf));
+    auto u8 = btf__add_int(btf, "unsigned char", 1, 0);
+    auto u16 = btf__add_int(btf, "unsigned short", 2, 0);
+    auto u32 = btf__add_int(btf, "unsigned int", 4, 0);
+    signedType = btf__add_int(btf, "int", 4, BTF_INT_SIGNED);
+    auto u8_typedef = btf__add_typedef(btf, "__u8", u8);
+    auto u16_typedef = btf__add_typedef(btf, "__u16", u16);
+    auto u32_typedef = btf__add_typedef(btf, "__u32", u32);
+    auto be32 = btf__add_typedef(btf, "__be32", u32_typedef);
+    auto be32_array = btf__add_array(btf, u32, be32, 4);
+
+    auto addr = btf__add_union(btf, nullptr, 16);
+    btf__add_field(btf, "vip", be32, 0, 0);
+    btf__add_field(btf, "vipv6", be32_array, 0, 0);
+    vipDefinition = btf__add_struct(btf, "vip_definition", kVipDefinitionSize);
+    btf__add_field(btf, nullptr, addr, 0, 0);
+    btf__add_field(btf, "port", u16_typedef, 128, 0);
+    btf__add_field(btf, "proto", u8_typedef, 144, 0);
+
+    vipMeta = btf__add_struct(btf, "vip_meta", kVipMetaSize);
+    btf__add_field(btf, "flags", u32_typedef, 0, 0);
+    btf__add_field(btf, "vip_num", u32_typedef, 32, 0);
+
+    btf__add_struct(
+        btf, "____btf_map_vip_map", kVipDefinitionSize + kVipMetaSize);
+    btf__add_field(btf, "key", vipDefinition, 0, 0);
+    btf__add_field(btf, "value", vipMeta, kVipDefinitionSize * 8, 0);
+
+    enumType = btf__add_enum(btf, "verdict", 4);
+    btf__add_enum_value(btf, "PASS", 2);
+    btf__add_enum_value(btf, "TX", 3);
+    ASSERT_GT(enumType, 0);
+    decoder.load(btf);
+  }
+
+  BtfDecoder decoder;
+  int vipDefinition;
+  int vipMeta;
+  int signedType;
+  int enumType;
+};
+
+std::vector<uint8_t> makeVip(const char* addr, bool v6, uint16_t port) {
+  std::vector<uint8_t> vip(kVipDefinitionSize);
+  ::inet_pton(v6 ? AF_INET6 : AF_INET, addr, vip.data());
+  uint16_t be_port = htons(port);
+  ::memcpy(vip.data() + 16, &be_port, sizeof(be_port));
+  vip[18] = IPPROTO_TCP;
+  return vip;
+}
+} // namespace
+
+TEST(BtfDecoderRawTest, testDecodeRaw) {
+  uint8_t data[] = {0x0a, 0xff, 0x00};
+  ASSERT_EQ(toText(BtfDecoder::decodeRaw(data, sizeof(data))), "0x0aff00");
+  ASSERT_EQ(toText(BtfDecoder::decodeRaw(data, 0)), "0x");
+}
+
+TEST(BtfDecoderRawTest, testWithoutBtf) {
+  BtfDecoder decoder;
+  ASSERT_FALSE(decoder.load("/nonexistent/balancer_kern.o"));
+  uint32_t keyTypeId = 0, valueTypeId = 0;
+  ASSERT_FALSE(decoder.getMapTypes("vip_map", keyTypeId, valueTypeId));
+  uint8_t data[] = {1, 2};
+  ASSERT_EQ(toText(decoder.decode(1, data, sizeof(data))), "0x0102");
+}
+
+TEST_F(BtfDecoderTest, testMapTypes) {
+  uint32_t keyTypeId = 0, valueTypeId = 0;
+  ASSERT_TRUE(decoder.getMapTypes("vip_map", keyTypeId, valueTypeId));
+  ASSERT_EQ(keyTypeId, static_cast<uint32_t>(vipDefinition));
+  ASSERT_EQ(valueTypeId, static_cast<uint32_t>(vipMeta));
+  ASSERT_FALSE(decoder.getMapTypes("reals", keyTypeId, valueTypeId));
+}
+
+TEST_F(BtfDecoderTest, testDecodeV4Vip) {
+  auto vip = makeVip("10.0.0.1", false, 80);
+  auto value = decoder.decode(vipDefinition, vip.data(), vip.size());
+  // only v4 member of the union is printed; port is in host order
+  ASSERT_EQ(toText(value), "{vip: 10.0.0.1, port: 80, proto: 6}");
+}
+
+TEST_F(BtfDecoderTest, testDecodeV6Vip) {
+  auto vip = makeVip("fc00::1", true, 443);
+  auto value = decoder.decode(vipDefinition, vip.data(), vip.size());
+  ASSERT_EQ(toText(value), "{vipv6: fc00::1, port: 443, proto: 6}");
+}
+
+TEST_F(BtfDecoderTest, testDecodeNumbers) {
+  uint32_t meta[] = {1, 42};
+  auto value = decoder.decode(
+      vipMeta, reinterpret_cast<uint8_t*>(meta), sizeof(meta));
+  ASSERT_EQ(toText(value), "{flags: 1, vip_num: 42}");
+
+  int32_t negative = -7;
+  value = decoder.decode(
+      signedType, reinterpret_cast<uint8_t*>(&negative), sizeof(negative));
+  ASSERT_EQ(toText(value), "-7");
+
+  uint32_t verdict = 3;
+  value = decoder.decode(
+      enumType, reinterpret_cast<uint8_t*>(&verdict), sizeof(verdict));
+  ASSERT_EQ(toText(value), "TX");
+  verdict = 5;
+  value = decoder.decode(
+      enumType, reinterpret_cast<uint8_t*>(&verdict), sizeof(verdict));
+  ASSERT_EQ(toText(value), "5");
+}
+
+TEST_F(BtfDecoderTest, testSizeMismatch) {
+  auto vip = makeVip("10.0.0.1", false, 80);
+  // data w/ size which differs from the type's one is printed as is
+  auto value = decoder.decode(vipDefinition, vip.data(), vip.size() - 1);
+  ASSERT_EQ(value.kind, Value::Kind::STRING);
+  ASSERT_EQ(value.str.substr(0, 10), "0x0a000001");
+}
+
+} // namespace mapdump
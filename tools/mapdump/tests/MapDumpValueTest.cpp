@@ -0,0 +1,169 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <sstream>
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "tools/mapdump/MapDumpValue.h"
+
+namespace mapdump {
+
+namespace {
+// {key: {vip: 10.0.0.1, port: 80}, value: [1, 2]}
+Value makeEntry() {
+  auto key = Value::makeObject();
+  key.add("vip", Value::makeString("10.0.0.1"));
+  key.add("port", Value::makeNumber(80));
+  auto value = Value::makeArray();
+  value.add("ignored", Value::makeNumber(1));
+  value.add("", Value::makeNumber(2));
+  auto entry = Value::makeObject();
+  entry.add("key", std::move(key));
+  entry.add("value", std::move(value));
+  return entry;
+}
+} // namespace
+
+TEST(MapDumpValueTest, testToJson) {
+  auto entry = makeEntry();
+  ASSERT_EQ(
+      toJson(entry),
+      "{\"key\":{\"vip\":\"10.0.0.1\",\"port\":80},"
+      "\"value\":[1,2]}");
+  ASSERT_EQ(toJson(Value::makeString("a\"b\\c\n")), "\"a\\\"b\\\\c\\u000a\"");
+  ASSERT_EQ(toJson(Value::makeNumber(static_cast<uint64_t>(-5), true)), "-5");
+  ASSERT_EQ(toJson(Value::makeObject()), "{}");
+  ASSERT_EQ(toJson(Value::makeArray()), "[]");
+}
+
+TEST(MapDumpValueTest, testToText) {
+  auto entry = makeEntry();
+  ASSERT_EQ(toText(entry), "{key: {vip: 10.0.0.1, port: 80}, value: [1, 2]}");
+  ASSERT_EQ(
+      toText(Value::makeNumber(static_cast<uint64_t>(-1))),
+      "18446744073709551615");
+}
+
+TEST(MapDumpValueTest, testFindPath) {
+  auto entry = makeEntry();
+  auto vip = findPath(entry, "key.vip");
+  ASSERT_NE(vip, nullptr);
+  ASSERT_EQ(vip->str, "10.0.0.1");
+  auto second = findPath(entry, "value.1");
+  ASSERT_NE(second, nullptr);
+  ASSERT_EQ(second->number, 2);
+  ASSERT_EQ(findPath(entry, "key"), &entry.members[0].second);
+  ASSERT_EQ(findPath(entry, "value.2"), nullptr);
+  ASSERT_EQ(findPath(entry, "value.x"), nullptr);
+  ASSERT_EQ(findPath(entry, "key.missing"), nullptr);
+  ASSERT_EQ(findPath(entry, "key.vip.more"), nullptr);
+  ASSERT_EQ(findPath(entry, "key..vip"), nullptr);
+  ASSERT_EQ(findPath(entry, ""), nullptr);
+}
+
+TEST(MapDumpValueTest, testParseFilters) {
+  auto filters = parseFilters("key.vip=10.0.0.1,,value.0=1,key.port=");
+  ASSERT_EQ(filters.size(), 3);
+  ASSERT_EQ(filters[0].path, "key.vip");
+  ASSERT_EQ(filters[0].value, "10.0.0.1");
+  ASSERT_EQ(filters[1].path, "value.0");
+  ASSERT_EQ(filters[1].value, "1");
+  ASSERT_EQ(filters[2].path, "key.port");
+  ASSERT_EQ(filters[2].value, "");
+  ASSERT_TRUE(parseFilters("").empty());
+  ASSERT_THROW(parseFilters("key.vip"), std::invalid_argument);
+  ASSERT_THROW(parseFilters("key.vip=1,=2"), std::invalid_argument);
+}
+
+TEST(MapDumpValueTest, testMatchesFilters) {
+  auto entry = makeEntry();
+  ASSERT_TRUE(matchesFilters(entry, {}));
+  ASSERT_TRUE(matchesFilters(entry, parseFilters("key.vip=10.0.0.1")));
+  ASSERT_TRUE(
+      matchesFilters(entry, parseFilters("key.vip=10.0.0.1,key.port=80")));
+  ASSERT_FALSE(
+      matchesFilters(entry, parseFilters("key.vip=10.0.0.1,key.port=81")));
+  ASSERT_FALSE(matchesFilters(entry, parseFilters("key.vip=10.0.0.2")));
+  // missing members and non scalars never match
+  ASSERT_FALSE(matchesFilters(entry, parseFilters("key.proto=6")));
+  ASSERT_FALSE(matchesFilters(entry, parseFilters("key=10.0.0.1")));
+  auto negative = Value::makeObject();
+  negative.add("v", Value::makeNumber(static_cast<uint64_t>(-3), true));
+  ASSERT_TRUE(matchesFilters(negative, parseFilters("v=-3")));
+}
+
+TEST(MapDumpValueTest, testSumValues) {
+  auto acc = makeEntry();
+  auto other = makeEntry();
+  other.members[1].second.members[0].second.number = 10;
+  sumValues(acc, other);
+  ASSERT_EQ(toText(acc), "{key: {vip: 10.0.0.1, port: 160}, value: [11, 4]}");
+  // values of different shape are ignored
+  sumValues(acc, Value::makeNumber(1));
+  auto shorter = makeEntry();
+  shorter.members[1].second.members.pop_back();
+  sumValues(acc, shorter);
+  ASSERT_EQ(
+      toText(acc), "{key: {vip: 10.0.0.1, port: 240}, value: [11, 4]}");
+}
+
+TEST(MapDumpValueTest, testRateOf) {
+  auto prev = makeEntry();
+  auto cur = makeEntry();
+  cur.members[1].second.members[0].second.number = 21;
+  // counter has been reset
+  cur.members[1].second.members[1].second.number = 1;
+  auto rate = rateOf(prev, cur, 2.0);
+  ASSERT_EQ(toText(rate), "{key: {vip: 10.0.0.1, port: 0}, value: [10, 0]}");
+  // w/o previous reading rates are 0
+  rate = rateOf(Value::makeObject(), cur, 2.0);
+  ASSERT_EQ(toText(rate), "{key: {vip: 10.0.0.1, port: 0}, value: [0, 0]}");
+  rate = rateOf(prev, cur, 0);
+  ASSERT_EQ(toText(rate), "{key: {vip: 10.0.0.1, port: 0}, value: [0, 0]}");
+}
+
+TEST(MapDumpValueTest, testEntryWriterJson) {
+  std::ostringstream out;
+  {
+    EntryWriter writer(out, true);
+    writer.write(Value::makeNumber(1));
+    writer.write(Value::makeString("a"));
+    ASSERT_EQ(writer.getWritten(), 2);
+  }
+  ASSERT_EQ(out.str(), "[\n1,\n\"a\"\n]\n");
+
+  std::ostringstream empty;
+  EntryWriter writer(empty, true);
+  writer.finish();
+  writer.finish();
+  ASSERT_EQ(empty.str(), "[]\n");
+}
+
+TEST(MapDumpValueTest, testEntryWriterText) {
+  std::ostringstream out;
+  EntryWriter writer(out, false);
+  writer.write(makeEntry());
+  writer.write(Value::makeNumber(7));
+  writer.finish();
+  ASSERT_EQ(
+      out.str(),
+      "key: {vip: 10.0.0.1, port: 80} value: [1, 2]\n"
+      "7\n");
+}
+
+} // namespace mapdump
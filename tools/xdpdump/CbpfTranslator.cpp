@@ -0,0 +1,415 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "tools/xdpdump/CbpfTranslator.h"
+
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+extern "C" {
+#include <linux/filter.h>
+}
+
+namespace xdpdump {
+
+namespace {
+
+// register's allocation. R1 - R5 are not clobbered as there are no helper
+// calls till the end of the filter
+constexpr uint8_t kRegCtx = BPF_REG_6;
+constexpr uint8_t kRegA = BPF_REG_7;
+constexpr uint8_t kRegX = BPF_REG_8;
+constexpr uint8_t kRegData = BPF_REG_9;
+constexpr uint8_t kRegDataEnd = BPF_REG_2;
+constexpr uint8_t kRegTmp = BPF_REG_3;
+constexpr uint8_t kRegTmp2 = BPF_REG_4;
+constexpr uint8_t kRegFp = BPF_REG_10;
+constexpr uint8_t kNoReg = 0;
+
+// max offset of direct packet access which verifier allows. it applies to
+// the end of the load (offset + size), which is checked against data_end
+constexpr uint32_t kMaxPacketOff = 0xffff;
+constexpr uint32_t kMaxShift = 32;
+constexpr int32_t kMemSlotSize = sizeof(uint32_t);
+constexpr int32_t kScratchMemSize = BPF_MEMWORDS * kMemSlotSize;
+constexpr int32_t kCapturePos = 0;
+constexpr int32_t kMissPos = 1;
+constexpr uint8_t kMshMask = 0xf;
+constexpr int32_t kMshShift = 2;
+
+/**
+ * where the jump should land: on the first instruction of translated cbpf
+ * insn w/ index "target", or on one of the program's exits
+ */
+enum class JumpTarget {
+  INSN,
+  ACCEPT,
+  REJECT,
+};
+
+struct Fixup {
+  size_t pos;
+  JumpTarget kind;
+  size_t target;
+};
+
+class Translator {
+ public:
+  Translator(const std::vector<CbpfInsn> &filter, int captureProgsFd,
+             int jmpFd, uint32_t jmpArraySize)
+      : filter_(filter), captureProgsFd_(captureProgsFd), jmpFd_(jmpFd),
+        jmpArraySize_(jmpArraySize) {}
+
+  std::vector<struct bpf_insn> translate() {
+    if (filter_.empty() || filter_.size() > BPF_MAXINSNS) {
+      throw std::runtime_error("invalid size of cbpf program");
+    }
+    emitPrologue();
+    starts_.resize(filter_.size());
+    for (size_t i = 0; i < filter_.size(); i++) {
+      starts_[i] = prog_.size();
+      translateInsn(i);
+    }
+    auto accept = prog_.size();
+    emitTailCall(captureProgsFd_, kCapturePos);
+    auto reject = prog_.size();
+    // miss prog resets xdpdump's state and continues w/ rootlet's chain.
+    // if it is not set - we continue w/ the chain ourselves
+    emitTailCall(captureProgsFd_, kMissPos);
+    for (uint32_t i = 1; i < jmpArraySize_; i++) {
+      emitTailCall(jmpFd_, i);
+    }
+    emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, kNoReg, 0, XDP_PASS);
+    emit(BPF_JMP | BPF_EXIT, kNoReg, kNoReg, 0, 0);
+
+    for (const auto &fixup : fixups_) {
+      size_t target;
+      switch (fixup.kind) {
+      case JumpTarget::INSN:
+        target = starts_[fixup.target];
+        break;
+      case JumpTarget::ACCEPT:
+        target = accept;
+        break;
+      default:
+        target = reject;
+      }
+      auto off = static_cast<int64_t>(target) - fixup.pos - 1;
+      if (off > std::numeric_limits<int16_t>::max()) {
+        throw std::runtime_error("jump is too long");
+      }
+      prog_[fixup.pos].off = static_cast<int16_t>(off);
+    }
+    return prog_;
+  }
+
+ private:
+  void emit(uint8_t code, uint8_t dst, uint8_t src, int16_t off,
+            int32_t imm) {
+    struct bpf_insn insn = {};
+    insn.code = code;
+    insn.dst_reg = dst;
+    insn.src_reg = src;
+    insn.off = off;
+    insn.imm = imm;
+    prog_.push_back(insn);
+  }
+
+  void emitJump(uint8_t code, uint8_t dst, uint8_t src, int32_t imm,
+                JumpTarget kind, size_t target = 0) {
+    fixups_.push_back({prog_.size(), kind, target});
+    emit(code, dst, src, 0, imm);
+  }
+
+  void emitTailCall(int mapFd, int32_t pos) {
+    emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, kRegCtx, 0, 0);
+    emit(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_2, BPF_PSEUDO_MAP_FD, 0, mapFd);
+    emit(0, 0, 0, 0, 0);
+    emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, kNoReg, 0, pos);
+    emit(BPF_JMP | BPF_CALL, kNoReg, kNoReg, 0, BPF_FUNC_tail_call);
+  }
+
+  void emitPrologue() {
+    emit(BPF_ALU64 | BPF_MOV | BPF_X, kRegCtx, BPF_REG_1, 0, 0);
+    emit(BPF_LDX | BPF_MEM | BPF_W, kRegData, BPF_REG_1,
+         offsetof(struct xdp_md, data), 0);
+    emit(BPF_LDX | BPF_MEM | BPF_W, kRegDataEnd, BPF_REG_1,
+         offsetof(struct xdp_md, data_end), 0);
+    emit(BPF_ALU | BPF_MOV | BPF_K, kRegA, kNoReg, 0, 0);
+    emit(BPF_ALU | BPF_MOV | BPF_K, kRegX, kNoReg, 0, 0);
+    // verifier does not allow reads of uninitialized stack
+    for (int32_t off = kMemSlotSize; off <= kScratchMemSize;
+         off += kMemSlotSize) {
+      emit(BPF_ST | BPF_MEM | BPF_W, kRegFp, kNoReg, -off, 0);
+    }
+  }
+
+  int16_t memOffset(uint32_t k) {
+    if (k >= BPF_MEMWORDS) {
+      throw std::runtime_error("invalid scratch memory index");
+    }
+    return -kScratchMemSize + k * kMemSlotSize;
+  }
+
+  /**
+   * loads size bytes from the packet into dst. offset is either k (for
+   * BPF_ABS) or X + k (for BPF_IND). packet is rejected if offset is out
+   * of bounds
+   */
+  void emitPacketLoad(uint8_t size, uint8_t mode, uint32_t k, uint8_t dst) {
+    uint32_t bytes = size == BPF_W ? 4 : (size == BPF_H ? 2 : 1);
+    if (mode == BPF_ABS) {
+      if (k > kMaxPacketOff - bytes) {
+        emitJump(BPF_JMP | BPF_JA, kNoReg, kNoReg, 0, JumpTarget::REJECT);
+        return;
+      }
+      emit(BPF_ALU64 | BPF_MOV | BPF_X, kRegTmp, kRegData, 0, 0);
+      emit(BPF_ALU64 | BPF_ADD | BPF_K, kRegTmp, kNoReg, 0, k);
+    } else {
+      // 32 bit ops, as X + k could overflow in cbpf
+      emit(BPF_ALU | BPF_MOV | BPF_X, kRegTmp, kRegX, 0, 0);
+      emit(BPF_ALU | BPF_ADD | BPF_K, kRegTmp, kNoReg, 0, k);
+      emitJump(BPF_JMP | BPF_JGT | BPF_K, kRegTmp, kNoReg,
+               kMaxPacketOff - bytes, JumpTarget::REJECT);
+      emit(BPF_ALU64 | BPF_MOV | BPF_X, kRegTmp2, kRegData, 0, 0);
+      emit(BPF_ALU64 | BPF_ADD | BPF_X, kRegTmp2, kRegTmp, 0, 0);
+      emit(BPF_ALU64 | BPF_MOV | BPF_X, kRegTmp, kRegTmp2, 0, 0);
+    }
+    emit(BPF_ALU64 | BPF_MOV | BPF_X, kRegTmp2, kRegTmp, 0, 0);
+    emit(BPF_ALU64 | BPF_ADD | BPF_K, kRegTmp2, kNoReg, 0, bytes);
+    emitJump(BPF_JMP | BPF_JGT | BPF_X, kRegTmp2, kRegDataEnd, 0,
+             JumpTarget::REJECT);
+    emit(BPF_LDX | BPF_MEM | size, dst, kRegTmp, 0, 0);
+    if (bytes > 1) {
+      // packet's data is in network byte order
+      emit(BPF_ALU | BPF_END | BPF_TO_BE, dst, kNoReg, 0, bytes * 8);
+    }
+  }
+
+  void emitPacketLen(uint8_t dst) {
+    emit(BPF_ALU64 | BPF_MOV | BPF_X, kRegTmp, kRegDataEnd, 0, 0);
+    emit(BPF_ALU64 | BPF_SUB | BPF_X, kRegTmp, kRegData, 0, 0);
+    emit(BPF_ALU | BPF_MOV | BPF_X, dst, kRegTmp, 0, 0);
+  }
+
+  void translateLoad(const CbpfInsn &insn, uint8_t dst) {
+    auto mode = BPF_MODE(insn.code);
+    auto size = BPF_SIZE(insn.code);
+    // only packet loads could be of other than word size (and there is no
+    // double word loads in cbpf)
+    bool validSize = mode == BPF_ABS || mode == BPF_IND
+                         ? size == BPF_W || size == BPF_H || size == BPF_B
+                         : size == (mode == BPF_MSH ? BPF_B : BPF_W);
+    if (!validSize) {
+      throw std::runtime_error("invalid size of load");
+    }
+    switch (mode) {
+    case BPF_IMM:
+      emit(BPF_ALU | BPF_MOV | BPF_K, dst, kNoReg, 0, insn.k);
+      break;
+    case BPF_MEM:
+      emit(BPF_LDX | BPF_MEM | BPF_W, dst, kRegFp, memOffset(insn.k), 0);
+      break;
+    case BPF_LEN:
+      emitPacketLen(dst);
+      break;
+    case BPF_ABS:
+    case BPF_IND:
+      if (dst != kRegA) {
+        throw std::runtime_error("invalid ldx instruction");
+      }
+      emitPacketLoad(size, mode, insn.k, dst);
+      break;
+    case BPF_MSH:
+      if (dst != kRegX) {
+        throw std::runtime_error("invalid ld instruction");
+      }
+      // X = 4 * (P[k] & 0xf)
+      emitPacketLoad(BPF_B, BPF_ABS, insn.k, dst);
+      emit(BPF_ALU | BPF_AND | BPF_K, dst, kNoReg, 0, kMshMask);
+      emit(BPF_ALU | BPF_LSH | BPF_K, dst, kNoReg, 0, kMshShift);
+      break;
+    default:
+      throw std::runtime_error("unsupported load mode");
+    }
+  }
+
+  void translateAlu(const CbpfInsn &insn) {
+    auto op = BPF_OP(insn.code);
+    auto src = BPF_SRC(insn.code);
+    if (op == BPF_NEG) {
+      emit(BPF_ALU | BPF_NEG, kRegA, kNoReg, 0, 0);
+      return;
+    }
+    if ((op == BPF_DIV || op == BPF_MOD) && src == BPF_X) {
+      // division by zero terminates cbpf program w/ 0
+      emitJump(BPF_JMP | BPF_JEQ | BPF_K, kRegX, kNoReg, 0,
+               JumpTarget::REJECT);
+    }
+    if (src == BPF_K) {
+      if ((op == BPF_DIV || op == BPF_MOD) && insn.k == 0) {
+        throw std::runtime_error("division by zero");
+      }
+      if ((op == BPF_LSH || op == BPF_RSH) && insn.k >= kMaxShift) {
+        throw std::runtime_error("invalid shift");
+      }
+    }
+    switch (op) {
+    case BPF_ADD:
+    case BPF_SUB:
+    case BPF_MUL:
+    case BPF_DIV:
+    case BPF_MOD:
+    case BPF_OR:
+    case BPF_AND:
+    case BPF_XOR:
+    case BPF_LSH:
+    case BPF_RSH:
+      emit(BPF_ALU | op | src, kRegA, src == BPF_X ? kRegX : kNoReg, 0,
+           src == BPF_K ? insn.k : 0);
+      break;
+    default:
+      throw std::runtime_error("unsupported alu operation");
+    }
+  }
+
+  void translateJmp(size_t pos, const CbpfInsn &insn) {
+    auto op = BPF_OP(insn.code);
+    if (op == BPF_JA) {
+      checkTarget(pos + 1 + insn.k);
+      emitJump(BPF_JMP | BPF_JA, kNoReg, kNoReg, 0, JumpTarget::INSN,
+               pos + 1 + insn.k);
+      return;
+    }
+    if (op != BPF_JEQ && op != BPF_JGT && op != BPF_JGE && op != BPF_JSET) {
+      throw std::runtime_error("unsupported jump operation");
+    }
+    size_t onTrue = pos + 1 + insn.jt;
+    size_t onFalse = pos + 1 + insn.jf;
+    checkTarget(onTrue);
+    checkTarget(onFalse);
+    if (BPF_SRC(insn.code) == BPF_X) {
+      emitJump(BPF_JMP | op | BPF_X, kRegA, kRegX, 0, JumpTarget::INSN,
+               onTrue);
+    } else if (insn.k > std::numeric_limits<int32_t>::max() &&
+               op != BPF_JSET) {
+      // imm is sign extended to 64 bits, while A is zero extended
+      emit(BPF_ALU | BPF_MOV | BPF_K, kRegTmp, kNoReg, 0, insn.k);
+      emitJump(BPF_JMP | op | BPF_X, kRegA, kRegTmp, 0, JumpTarget::INSN,
+               onTrue);
+    } else {
+      emitJump(BPF_JMP | op | BPF_K, kRegA, kNoReg, insn.k, JumpTarget::INSN,
+               onTrue);
+    }
+    // if onTrue is the next insn the jump above lands right after this one
+    if (insn.jf != 0) {
+      emitJump(BPF_JMP | BPF_JA, kNoReg, kNoReg, 0, JumpTarget::INSN,
+               onFalse);
+    }
+  }
+
+  void translateRet(const CbpfInsn &insn) {
+    if (BPF_RVAL(insn.code) == BPF_K) {
+      emitJump(BPF_JMP | BPF_JA, kNoReg, kNoReg, 0,
+               insn.k ? JumpTarget::ACCEPT : JumpTarget::REJECT);
+    } else if (BPF_RVAL(insn.code) == BPF_A) {
+      emitJump(BPF_JMP | BPF_JNE | BPF_K, kRegA, kNoReg, 0,
+               JumpTarget::ACCEPT);
+      emitJump(BPF_JMP | BPF_JA, kNoReg, kNoReg, 0, JumpTarget::REJECT);
+    } else {
+      throw std::runtime_error("unsupported return value");
+    }
+  }
+
+  void translateMisc(const CbpfInsn &insn) {
+    switch (BPF_MISCOP(insn.code)) {
+    case BPF_TAX:
+      emit(BPF_ALU | BPF_MOV | BPF_X, kRegX, kRegA, 0, 0);
+      break;
+    case BPF_TXA:
+      emit(BPF_ALU | BPF_MOV | BPF_X, kRegA, kRegX, 0, 0);
+      break;
+    default:
+      throw std::runtime_error("unsupported misc operation");
+    }
+  }
+
+  void translateInsn(size_t pos) {
+    const auto &insn = filter_[pos];
+    switch (BPF_CLASS(insn.code)) {
+    case BPF_LD:
+      translateLoad(insn, kRegA);
+      break;
+    case BPF_LDX:
+      translateLoad(insn, kRegX);
+      break;
+    case BPF_ST:
+    case BPF_STX:
+      if (insn.code != BPF_ST && insn.code != BPF_STX) {
+        throw std::runtime_error("invalid store instruction");
+      }
+      emit(BPF_STX | BPF_MEM | BPF_W, kRegFp,
+           BPF_CLASS(insn.code) == BPF_ST ? kRegA : kRegX, memOffset(insn.k),
+           0);
+      break;
+    case BPF_ALU:
+      translateAlu(insn);
+      break;
+    case BPF_JMP:
+      translateJmp(pos, insn);
+      break;
+    case BPF_RET:
+      translateRet(insn);
+      return;
+    case BPF_MISC:
+      translateMisc(insn);
+      break;
+    default:
+      throw std::runtime_error("unsupported instruction class");
+    }
+    if (pos + 1 == filter_.size() && BPF_CLASS(insn.code) != BPF_JMP) {
+      throw std::runtime_error("cbpf program does not end w/ return");
+    }
+  }
+
+  void checkTarget(size_t target) {
+    if (target >= filter_.size()) {
+      throw std::runtime_error("jump out of cbpf program");
+    }
+  }
+
+  const std::vector<CbpfInsn> &filter_;
+  int captureProgsFd_;
+  int jmpFd_;
+  uint32_t jmpArraySize_;
+  std::vector<struct bpf_insn> prog_;
+  // index of the first translated instruction for each cbpf instruction
+  std::vector<size_t> starts_;
+  std::vector<Fixup> fixups_;
+};
+
+} // namespace
+
+std::vector<struct bpf_insn> translateCbpf(
+    const std::vector<CbpfInsn> &filter, int captureProgsFd, int jmpFd,
+    uint32_t jmpArraySize) {
+  Translator translator(filter, captureProgsFd, jmpFd, jmpArraySize);
+  return translator.translate();
+}
+
+} // namespace xdpdump
@@ -0,0 +1,51 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <linux/bpf.h>
+}
+
+#include "tools/xdpdump/PcapFilterCompiler.h"
+
+namespace xdpdump {
+
+/**
+ * @param vector<CbpfInsn> filter classic bpf program (e.g. from libpcap)
+ * @param int captureProgsFd fd of prog array w/ xdpdump's program on
+ * position 0 and (optionally) xdpdump's miss program on position 1. they
+ * are tail called for packets which match and do not match the filter
+ * @param int jmpFd fd of rootlet's prog array
+ * @param uint32_t jmpArraySize size of rootlet's prog array
+ * @return vector<bpf_insn> xdp program
+ *
+ * translates classic bpf filter into xdp program. packet's loads are done
+ * w/ direct packet access; out of bounds load means that packet does not
+ * match (as in classic bpf). program tail calls into xdpdump's program if
+ * packet matches, otherwise into the miss program, or, if it is not set,
+ * continues w/ the rest of rootlet's programs (positions 1 and above).
+ * throws std::runtime_error if filter contains unsupported or invalid
+ * instructions
+ */
+std::vector<struct bpf_insn> translateCbpf(
+    const std::vector<CbpfInsn> &filter, int captureProgsFd, int jmpFd,
+    uint32_t jmpArraySize);
+
+} // namespace xdpdump
@@ -0,0 +1,172 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "tools/xdpdump/FlowAggregator.h"
+
+#include <arpa/inet.h>
+#include <algorithm>
+
+#include <folly/Format.h>
+#include <folly/IPAddress.h>
+#include <folly/String.h>
+#include <folly/dynamic.h>
+#include <folly/json.h>
+#include <glog/logging.h>
+
+#include "katran/lib/BpfAdapter.h"
+
+namespace xdpdump {
+
+namespace {
+constexpr uint8_t kIPv6AddrSize = 16;
+// clears terminal and moves cursor to the top left corner
+constexpr char kClearScreen[] = "\033[2J\033[H";
+constexpr char kCsvHeader[] = "src,sport,dst,dport,proto,packets,bytes";
+constexpr double kMsecPerSec = 1000.0;
+
+std::string addrToString(const uint32_t *addr, bool ipv6) {
+  if (ipv6) {
+    folly::ByteRange bytes(reinterpret_cast<const uint8_t *>(addr),
+                           kIPv6AddrSize);
+    return folly::IPAddressV6::fromBinary(bytes).str();
+  }
+  return folly::IPAddressV4::fromLong(*addr).str();
+}
+
+std::string srcToString(const XdpDumpFlowKey &key) {
+  return addrToString(key.srcv6, key.ipv6);
+}
+
+std::string dstToString(const XdpDumpFlowKey &key) {
+  return addrToString(key.dstv6, key.ipv6);
+}
+} // namespace
+
+FlowAggregator::FlowAggregator(int flowsMapFd, int nrCpus)
+    : flowsMapFd_(flowsMapFd), nrCpus_(nrCpus),
+      lastUpdate_(std::chrono::steady_clock::now()) {}
+
+bool FlowAggregator::update() {
+  auto now = std::chrono::steady_clock::now();
+  double elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         now - lastUpdate_)
+                         .count();
+  lastUpdate_ = now;
+  std::unordered_map<std::string, Flow> flows;
+  std::vector<XdpDumpFlowCounters> values(nrCpus_);
+  XdpDumpFlowKey key = {};
+  XdpDumpFlowKey nextKey = {};
+  void *prevKey = nullptr;
+  while (!katran::BpfAdapter::bpfMapGetNextKey(flowsMapFd_, prevKey,
+                                               &nextKey)) {
+    key = nextKey;
+    prevKey = &key;
+    if (katran::BpfAdapter::bpfMapLookupElement(flowsMapFd_, &key,
+                                                values.data())) {
+      // flow could be evicted since we got its key
+      continue;
+    }
+    Flow flow = {};
+    flow.key = key;
+    for (const auto &value : values) {
+      flow.total.packets += value.packets;
+      flow.total.bytes += value.bytes;
+    }
+    std::string rawKey(reinterpret_cast<const char *>(&key), sizeof(key));
+    auto prev = flows_.find(rawKey);
+    XdpDumpFlowCounters prevTotal = {};
+    if (prev != flows_.end()) {
+      prevTotal = prev->second.total;
+    }
+    if (elapsedMs > 0 && flow.total.packets >= prevTotal.packets) {
+      flow.rate.packets =
+          (flow.total.packets - prevTotal.packets) * kMsecPerSec / elapsedMs;
+      flow.rate.bytes =
+          (flow.total.bytes - prevTotal.bytes) * kMsecPerSec / elapsedMs;
+    }
+    flows[rawKey] = flow;
+  }
+  if (errno != ENOENT) {
+    LOG(ERROR) << "error while reading xdpdump_flows map: "
+               << folly::errnoStr(errno);
+    return false;
+  }
+  flows_ = std::move(flows);
+  return true;
+}
+
+std::vector<const Flow *>
+FlowAggregator::sortedFlows(XdpDumpFlowCounters Flow::*counters) {
+  std::vector<const Flow *> sorted;
+  sorted.reserve(flows_.size());
+  for (const auto &flow : flows_) {
+    sorted.push_back(&flow.second);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [counters](const Flow *lhs, const Flow *rhs) {
+              return (lhs->*counters).packets > (rhs->*counters).packets;
+            });
+  return sorted;
+}
+
+void FlowAggregator::printTop(std::ostream &out, uint32_t topN) {
+  auto sorted = sortedFlows(&Flow::rate);
+  out << kClearScreen;
+  out << folly::sformat("{:>40} {:>40} {:>5} {:>10} {:>12} {:>12}\n",
+                        "src:sport", "dst:dport", "proto", "pps", "Bps",
+                        "packets");
+  for (size_t i = 0; i < sorted.size() && i < topN; i++) {
+    const auto &flow = *sorted[i];
+    auto src =
+        folly::sformat("{}:{}", srcToString(flow.key), ntohs(flow.key.sport));
+    auto dst =
+        folly::sformat("{}:{}", dstToString(flow.key), ntohs(flow.key.dport));
+    out << folly::sformat("{:>40} {:>40} {:>5} {:>10} {:>12} {:>12}\n", src,
+                          dst, static_cast<uint32_t>(flow.key.proto),
+                          flow.rate.packets, flow.rate.bytes,
+                          flow.total.packets);
+  }
+  out << "flows: " << flows_.size() << std::endl;
+}
+
+void FlowAggregator::writeCsv(std::ostream &out) {
+  out << kCsvHeader << "\n";
+  for (const auto *flow : sortedFlows(&Flow::total)) {
+    out << folly::sformat("{},{},{},{},{},{},{}\n", srcToString(flow->key),
+                          ntohs(flow->key.sport), dstToString(flow->key),
+                          ntohs(flow->key.dport),
+                          static_cast<uint32_t>(flow->key.proto),
+                          flow->total.packets, flow->total.bytes);
+  }
+}
+
+void FlowAggregator::writeJson(std::ostream &out) {
+  auto flows = folly::dynamic::array();
+  for (const auto *flow : sortedFlows(&Flow::total)) {
+    folly::dynamic entry = folly::dynamic::object;
+    entry["src"] = srcToString(flow->key);
+    entry["sport"] = ntohs(flow->key.sport);
+    entry["dst"] = dstToString(flow->key);
+    entry["dport"] = ntohs(flow->key.dport);
+    entry["proto"] = static_cast<int>(flow->key.proto);
+    entry["packets"] = flow->total.packets;
+    entry["bytes"] = flow->total.bytes;
+    flows.push_back(std::move(entry));
+  }
+  out << folly::toPrettyJson(flows) << "\n";
+}
+
+} // namespace xdpdump
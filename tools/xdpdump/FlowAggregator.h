@@ -0,0 +1,104 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tools/xdpdump/XdpDumpStructs.h"
+
+namespace xdpdump {
+
+/**
+ * aggregated flow: total counters since the start of the capture and
+ * per second rates since previous reading of the map
+ */
+struct Flow {
+  XdpDumpFlowKey key;
+  XdpDumpFlowCounters total;
+  XdpDumpFlowCounters rate;
+};
+
+/**
+ * reads per cpu flow counters, which are collected by xdpdump's bpf program
+ * in aggregating mode, and prints them as top-N table or as a summary
+ */
+class FlowAggregator {
+public:
+  /**
+   * @param int flowsMapFd fd of xdpdump_flows map
+   * @param int nrCpus number of possible cpus
+   */
+  FlowAggregator(int flowsMapFd, int nrCpus);
+
+  /**
+   * @return bool true on success
+   *
+   * reads all flows from the map, sums per cpu counters and recalculates
+   * rates
+   */
+  bool update();
+
+  /**
+   * @param ostream out where table would be written
+   * @param uint32_t topN number of printed flows (sorted by packets rate)
+   *
+   * prints table of the busiest flows since last update
+   */
+  void printTop(std::ostream &out, uint32_t topN);
+
+  /**
+   * @param ostream out where summary would be written
+   *
+   * writes totals of all flows (sorted by packets) in csv format
+   */
+  void writeCsv(std::ostream &out);
+
+  /**
+   * @param ostream out where summary would be written
+   *
+   * writes totals of all flows (sorted by packets) in json format
+   */
+  void writeJson(std::ostream &out);
+
+private:
+  /**
+   * @return vector<const Flow*> flows sorted by member of Flow (in
+   * descending order of packets)
+   */
+  std::vector<const Flow *> sortedFlows(XdpDumpFlowCounters Flow::*counters);
+
+  int flowsMapFd_;
+
+  int nrCpus_;
+
+  /**
+   * flows from the last reading. key is raw XdpDumpFlowKey
+   */
+  std::unordered_map<std::string, Flow> flows_;
+
+  /**
+   * time of the last reading
+   */
+  std::chrono::steady_clock::time_point lastUpdate_;
+};
+
+} // namespace xdpdump
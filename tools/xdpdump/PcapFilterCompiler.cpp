@@ -0,0 +1,54 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "tools/xdpdump/PcapFilterCompiler.h"
+
+#include <stdexcept>
+
+#include <pcap/pcap.h>
+
+namespace xdpdump {
+
+namespace {
+constexpr int kOptimize = 1;
+} // namespace
+
+std::vector<CbpfInsn> compilePcapFilter(
+    const std::string &expression, int snaplen) {
+  auto pcap = pcap_open_dead(DLT_EN10MB, snaplen);
+  if (!pcap) {
+    throw std::runtime_error("cant allocate pcap handle");
+  }
+  struct bpf_program prog = {};
+  if (pcap_compile(pcap, &prog, expression.c_str(), kOptimize,
+                   PCAP_NETMASK_UNKNOWN)) {
+    std::string err = pcap_geterr(pcap);
+    pcap_close(pcap);
+    throw std::runtime_error("cant compile filter '" + expression +
+                             "': " + err);
+  }
+  std::vector<CbpfInsn> result;
+  result.reserve(prog.bf_len);
+  for (uint32_t i = 0; i < prog.bf_len; i++) {
+    const auto &insn = prog.bf_insns[i];
+    result.push_back({insn.code, insn.jt, insn.jf, insn.k});
+  }
+  pcap_freecode(&prog);
+  pcap_close(pcap);
+  return result;
+}
+
+} // namespace xdpdump
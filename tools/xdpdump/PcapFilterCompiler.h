@@ -0,0 +1,48 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xdpdump {
+
+/**
+ * classic bpf instruction (same layout as struct sock_filter and pcap's
+ * struct bpf_insn). defined separately, as pcap's definition collides w/
+ * the one from linux/bpf.h
+ */
+struct CbpfInsn {
+  uint16_t code;
+  uint8_t jt;
+  uint8_t jf;
+  uint32_t k;
+};
+
+/**
+ * @param string expression pcap-filter (tcpdump like) expression
+ * @param int snaplen max length of captured packet
+ * @return vector<CbpfInsn> classic bpf program for ethernet frames
+ *
+ * compiles filter expression w/ libpcap. throws std::runtime_error if
+ * expression is invalid
+ */
+std::vector<CbpfInsn> compilePcapFilter(
+    const std::string &expression, int snaplen);
+
+} // namespace xdpdump
@@ -16,63 +16,65 @@
 
 #include "XdpDump.h"
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <chrono>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <signal.h>
 
-#include <bcc/libbpf.h>
-#include <bcc/table_storage.h>
 #include <folly/Format.h>
+#include <folly/String.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <glog/logging.h>
 
 #include "katran/lib/PcapWriter.h"
-#include "tools/xdpdump/XdpDumpKern.h"
+#include "tools/xdpdump/CbpfTranslator.h"
+#include "tools/xdpdump/PcapFilterCompiler.h"
 
 namespace xdpdump {
 
 namespace {
 
-const std::string kBpfFunc = "xdpdump";
-const std::string kPcapFunc = "process";
+const std::string kXdpDumpProgName = "xdp-dump";
+const std::string kXdpDumpMissProgName = "xdp-dump-miss";
+// balancer's prog array, which is tail called w/ verdict as an index
+const std::string kExitHookMap = "exit_hook";
+// exit hook progs, indexed by xdp verdict
+const std::vector<std::string> kExitHookProgNames = {
+    "xdp-dump-exit-aborted",
+    "xdp-dump-exit-drop",
+    "xdp-dump-exit-pass",
+    "xdp-dump-exit-tx",
+};
+// names of pcapng's interfaces, indexed by capture point
+const std::vector<std::string> kCapturePointNames = {
+    "pre-katran",
+    "post-katran",
+};
 const std::string kRootJmpArray = "jmp";
 const std::string kPerfEventMap = "perf_event_map";
-const std::string kXdpMode = "xdp";
-constexpr int kBpfLogBufSize = 1024 * 1024 * 1;
-constexpr int kIoPoolSize = 1;
+const std::string kFilterMap = "xdpdump_filter";
+const std::string kStatsMap = "xdpdump_stats";
+const std::string kFlowsMap = "xdpdump_flows";
+const std::string kJsonFormat = "json";
 int kMapPos = 0;
-constexpr unsigned kNoFlags = 0;
+uint32_t kFilterPos = 0;
 constexpr uint32_t kNoSample = 1;
+// random u32 is compared against kSampleRange / sample_rate
+constexpr uint64_t kSampleRange = 1ULL << 32;
 constexpr uint32_t kQueueCapacity = 2048;
-
-uint64_t getPossibleCpus() {
-  static const char *fcpu = "/sys/devices/system/cpu/possible";
-  unsigned int start, end, possible_cpus = 0;
-  char buff[128];
-  FILE *fp;
-
-  fp = fopen(fcpu, "r");
-  if (!fp) {
-    printf("Failed to open %s: '%s'!\n", fcpu, strerror(errno));
-    exit(1);
-  }
-
-  while (fgets(buff, sizeof(buff), fp)) {
-    if (sscanf(buff, "%u-%u", &start, &end) == 2) {
-      possible_cpus = start == 0 ? end + 1 : 0;
-      break;
-    }
-  }
-
-  fclose(fp);
-  if (!possible_cpus) {
-    printf("Failed to retrieve # possible CPUs!\n");
-    exit(1);
-  }
-
-  return possible_cpus;
-}
+// must be in sync w/ JMP_ARRAY_SIZE in bpf/xdpdump_maps.h
+constexpr uint32_t kJmpArraySize = 16;
+constexpr int kPcapSnaplen = 0xFFFF;
+uint32_t kCapturePos = 0;
+uint32_t kMissPos = 1;
+constexpr uint32_t kCaptureProgsSize = 2;
+uint32_t kStatsPos = 0;
+constexpr uint64_t kNsecPerSec = 1000000000;
+constexpr uint32_t kTopRefreshMs = 1000;
 
 } // namespace
 
@@ -86,110 +88,146 @@ XdpDump::~XdpDump() {}
 void XdpDump::prepareSharedMap() {
   VLOG(2) << "preparing shared env: map path " << filter_.map_path
           << " map pos: " << kMapPos;
-
-  auto ts = ebpf::createSharedTableStorage();
-  ts->Delete({kRootJmpArray});
-
-  ebpf::TableDesc desc;
-  desc.type = BPF_MAP_TYPE_PROG_ARRAY;
-  desc.name = kRootJmpArray;
-  desc.fd = ebpf::FileDesc(::dup(jmpFd_));
-  ts->Insert({kRootJmpArray}, std::move(desc));
-}
-
-void XdpDump::compile() {
-  VLOG(2) << "compiling bpf prog";
-  std::vector<const char *> cflags;
-  for (const auto &flag : cflags_) {
-    LOG(INFO) << "adding compile flag: " << flag;
-    cflags.push_back(flag.c_str());
-  }
-  try {
-    funcName_ = kBpfFunc;
-    VLOG(2) << "compiling xdpdump from string";
-    bpf_ = std::make_unique<ebpf::BPFModule>(kNoFlags);
-    bpf_->load_string(kXdpDumpProg, cflags.data(), cflags.size());
-  } catch (const std::runtime_error &e) {
-    LOG(ERROR) << "Error while load xdpdump prog";
-    throw e;
+  if (bpfAdapter_.updateSharedMap(kRootJmpArray, jmpFd_)) {
+    throw std::runtime_error("cant set rootlet's prog array as shared map");
   }
 }
 
-void XdpDump::prepareCflags() {
-  if (filter_.ipv6) {
-    if ((filter_.flags & kSrcSet) > 0) {
-      cflags_.push_back(folly::sformat("-DSRCV6_0={}", filter_.srcv6[0]));
-      cflags_.push_back(folly::sformat("-DSRCV6_1={}", filter_.srcv6[1]));
-      cflags_.push_back(folly::sformat("-DSRCV6_2={}", filter_.srcv6[2]));
-      cflags_.push_back(folly::sformat("-DSRCV6_3={}", filter_.srcv6[3]));
-    }
-    if ((filter_.flags & kDstSet) > 0) {
-      cflags_.push_back(folly::sformat("-DDSTV6_0={}", filter_.dstv6[0]));
-      cflags_.push_back(folly::sformat("-DDSTV6_1={}", filter_.dstv6[1]));
-      cflags_.push_back(folly::sformat("-DDSTV6_2={}", filter_.dstv6[2]));
-      cflags_.push_back(folly::sformat("-DDSTV6_3={}", filter_.dstv6[3]));
-    }
-  } else {
-    if ((filter_.flags & kSrcSet) > 0) {
-      cflags_.push_back(folly::sformat("-DSRCV4={}", filter_.src));
-    }
-    if ((filter_.flags & kDstSet) > 0) {
-      cflags_.push_back(folly::sformat("-DDSTV4={}", filter_.dst));
-    }
+void XdpDump::load() {
+  VLOG(2) << "loading xdpdump prog from " << filter_.prog_path;
+  auto cpus = katran::BpfAdapter::getPossibleCpus();
+  if (cpus <= 0 || bpfAdapter_.setMapMaxEntries(kPerfEventMap, cpus)) {
+    throw std::runtime_error("cant set size of perf event map");
+  }
+  if (filter_.aggregate && filter_.max_flows > 0 &&
+      bpfAdapter_.setMapMaxEntries(kFlowsMap, filter_.max_flows)) {
+    throw std::runtime_error("cant set size of flows map");
   }
-  if ((filter_.flags & kSportSet) > 0) {
-    cflags_.push_back(folly::sformat("-DSPORT={}", htons(filter_.sport)));
+  if (bpfAdapter_.loadBpfProg(filter_.prog_path)) {
+    throw std::runtime_error("cant load xdpdump prog from " +
+                             filter_.prog_path);
   }
-  if ((filter_.flags & kDportSet) > 0) {
-    cflags_.push_back(folly::sformat("-DDPORT={}", htons(filter_.dport)));
+  progFd_ = bpfAdapter_.getProgFdByName(kXdpDumpProgName);
+  if (progFd_ < 0) {
+    throw std::runtime_error("cant find prog w/ name " + kXdpDumpProgName);
+  }
+  perfEventMapFd_ = bpfAdapter_.getMapFdByName(kPerfEventMap);
+  if (perfEventMapFd_ < 0) {
+    throw std::runtime_error("cant get fd for perf map");
+  }
+  VLOG(2) << "progs fd is: " << progFd_;
+}
+
+void XdpDump::prepareFilter() {
+  XdpDumpFilterConfig config = {};
+  if ((filter_.flags & kSrcSet) > 0) {
+    std::memcpy(&config.srcv6, &filter_.srcv6, sizeof(config.srcv6));
   }
-  if ((filter_.flags & kProtoSet) > 0) {
-    cflags_.push_back(folly::sformat("-DPROTO={}", filter_.proto));
+  if ((filter_.flags & kDstSet) > 0) {
+    std::memcpy(&config.dstv6, &filter_.dstv6, sizeof(config.dstv6));
   }
+  config.sport = htons(filter_.sport);
+  config.dport = htons(filter_.dport);
+  config.proto = filter_.proto;
+  config.ipv6 = filter_.ipv6;
+  config.flags = filter_.flags;
   if (filter_.offset_len > 0) {
-    cflags_.push_back(folly::sformat("-DOFFSET={}", filter_.offset));
-    cflags_.push_back(folly::sformat("-DO_LEN={}", filter_.offset_len));
-    cflags_.push_back(folly::sformat("-DO_PATTERN={}", filter_.pattern));
+    config.offset = filter_.offset;
+    config.offset_len = filter_.offset_len;
+    config.pattern = filter_.pattern;
   }
-  if (filter_.count > 0) {
-    // not yet used
-    cflags_.push_back(folly::sformat("-DCOUNT={}", filter_.count));
+  config.cpu = filter_.cpu;
+  config.points = filter_.points;
+  config.aggregate = filter_.aggregate;
+  if (filter_.sample_rate > kNoSample) {
+    config.sample_threshold = kSampleRange / filter_.sample_rate;
   }
-  if (filter_.cpu >= 0) {
-    cflags_.push_back(folly::sformat("-DCPU_NUMBER={}", filter_.cpu));
+  if (filter_.pps_limit > 0) {
+    config.rate_cost_ns =
+        std::max<uint64_t>(kNsecPerSec / filter_.pps_limit, 1);
+  }
+  config.limit = std::min<uint64_t>(filter_.count,
+                                    std::numeric_limits<uint32_t>::max());
+  auto filterFd = bpfAdapter_.getMapFdByName(kFilterMap);
+  if (filterFd < 0 ||
+      katran::BpfAdapter::bpfUpdateMap(filterFd, &kFilterPos, &config)) {
+    throw std::runtime_error("cant update filter's map: " +
+                             folly::errnoStr(errno));
   }
 }
 
-void XdpDump::load() {
-  perfEventMapFd_ = bpf_->table_fd(kPerfEventMap);
-  if (perfEventMapFd_ < 0) {
-    throw std::runtime_error("cant get fd for perf map");
+void XdpDump::loadPcapFilter() {
+  VLOG(2) << "compiling pcap filter: " << filter_.pcap_filter;
+  auto cbpf = compilePcapFilter(filter_.pcap_filter, kPcapSnaplen);
+  captureProgsFd_ = katran::BpfAdapter::createBpfMap(
+      katran::kBpfMapTypeProgArray, sizeof(uint32_t), sizeof(uint32_t),
+      kCaptureProgsSize, 0 /* map_flags */);
+  auto missProgFd = bpfAdapter_.getProgFdByName(kXdpDumpMissProgName);
+  if (captureProgsFd_ < 0 || missProgFd < 0 ||
+      katran::BpfAdapter::bpfUpdateMap(captureProgsFd_, &kCapturePos,
+                                       &progFd_) ||
+      katran::BpfAdapter::bpfUpdateMap(captureProgsFd_, &kMissPos,
+                                       &missProgFd)) {
+    throw std::runtime_error("cant create prog array for pcap filter: " +
+                             folly::errnoStr(errno));
   }
-  auto fnStart = bpf_->function_start(funcName_);
-  if (!fnStart) {
-    throw std::runtime_error("cant find function w/ name " +
-                             folly::to<std::string>(funcName_));
+  auto insns = translateCbpf(cbpf, captureProgsFd_, jmpFd_, kJmpArraySize);
+  std::string log;
+  pcapFilterProgFd_ =
+      katran::BpfAdapter::loadRawBpfProg(insns, BPF_PROG_TYPE_XDP, log);
+  if (pcapFilterProgFd_ < 0) {
+    throw std::runtime_error("cant load pcap filter prog: " + log);
   }
+  VLOG(2) << "pcap filter translated into " << insns.size() << " insns";
+}
 
-  auto fnSize = bpf_->function_size(funcName_);
-  auto bpfLogBuf = std::make_unique<char[]>(kBpfLogBufSize);
-  progFd_ = bpf_prog_load(BPF_PROG_TYPE_XDP, funcName_.c_str(),
-                          reinterpret_cast<struct bpf_insn *>(fnStart), fnSize,
-                          bpf_->license(), bpf_->kern_version(),
-                          0 /* log_level */, bpfLogBuf.get(), kBpfLogBufSize);
-  if (progFd_ < 0) {
-    VLOG(2) << "fd is negative: " << progFd_ << " errno: " << errno
-            << " errno str: " << folly::to<std::string>(std::strerror(errno))
-            << " fn size: " << fnSize;
-    throw std::runtime_error("cant load bpfprog. error:" +
-                             folly::to<std::string>(bpfLogBuf.get()));
+void XdpDump::getExitHookFd() {
+  if (!filter_.exit_hook_path.empty()) {
+    exitHookFd_ =
+        katran::BpfAdapter::getPinnedBpfObject(filter_.exit_hook_path);
   } else {
-    VLOG(2) << "progs fd is: " << progFd_;
+    exitHookFd_ = katran::BpfAdapter::bpfMapGetFdByName(kExitHookMap);
+  }
+  if (exitHookFd_ < 0) {
+    throw std::runtime_error(
+        "cant find balancer's exit hook, probably it was built w/o "
+        "KATRAN_EXIT_HOOK");
+  }
+}
+
+void XdpDump::attachExitHook() {
+  for (uint32_t verdict = 0; verdict < kExitHookProgNames.size();
+       verdict++) {
+    auto fd = bpfAdapter_.getProgFdByName(kExitHookProgNames[verdict]);
+    if (fd < 0 ||
+        katran::BpfAdapter::bpfUpdateMap(exitHookFd_, &verdict, &fd)) {
+      throw std::runtime_error("cant attach " + kExitHookProgNames[verdict] +
+                               " to balancer's exit hook: " +
+                               folly::errnoStr(errno));
+    }
+  }
+}
+
+void XdpDump::detachExitHook() {
+  VLOG(2) << "detaching xdpdump from balancer's exit hook";
+  for (uint32_t verdict = 0; verdict < kExitHookProgNames.size();
+       verdict++) {
+    if (katran::BpfAdapter::bpfMapDeleteElement(exitHookFd_, &verdict)) {
+      LOG(ERROR) << "cant detach " << kExitHookProgNames[verdict]
+                 << " from balancer's exit hook: " << folly::errnoStr(errno);
+    }
   }
 }
 
 void XdpDump::attach() {
-  auto bpfError = bpf_update_elem(jmpFd_, &kMapPos, &progFd_, 0);
+  if (filter_.points & kCapturePost) {
+    // exit hook must be in place before the packets are marked as matched
+    attachExitHook();
+  }
+  // w/ pcap filter, its prog is the entry point and xdpdump's prog is
+  // called only for matched packets
+  int fd = pcapFilterProgFd_ >= 0 ? pcapFilterProgFd_ : progFd_;
+  auto bpfError = katran::BpfAdapter::bpfUpdateMap(jmpFd_, &kMapPos, &fd);
   if (bpfError) {
     throw std::runtime_error("Error while updating value in map: " +
                              folly::to<std::string>(std::strerror(errno)));
@@ -198,35 +236,129 @@ void XdpDump::attach() {
 
 void XdpDump::detach() {
   VLOG(2) << "detaching xdpdump from rootlet";
-  auto bpfError = bpf_delete_elem(jmpFd_, &kMapPos);
+  auto bpfError = katran::BpfAdapter::bpfMapDeleteElement(jmpFd_, &kMapPos);
   if (bpfError) {
     throw std::runtime_error("Error while deleting key from map: " +
                              folly::errnoStr(errno));
   }
+  if (exitHookFd_ >= 0) {
+    detachExitHook();
+  }
+}
+
+XdpDumpStats XdpDump::getStats() {
+  XdpDumpStats total = {};
+  auto cpus = katran::BpfAdapter::getPossibleCpus();
+  auto statsFd = bpfAdapter_.getMapFdByName(kStatsMap);
+  if (cpus <= 0 || statsFd < 0) {
+    LOG(ERROR) << "cant read xdpdump's stats";
+    return total;
+  }
+  std::vector<XdpDumpStats> stats(cpus);
+  if (katran::BpfAdapter::bpfMapLookupElement(statsFd, &kStatsPos,
+                                              stats.data())) {
+    LOG(ERROR) << "cant read xdpdump's stats: " << folly::errnoStr(errno);
+    return total;
+  }
+  for (const auto &cpuStats : stats) {
+    total.matched += cpuStats.matched;
+    total.emitted += cpuStats.emitted;
+    total.sampled_out += cpuStats.sampled_out;
+    total.rate_limited += cpuStats.rate_limited;
+    total.limit_reached += cpuStats.limit_reached;
+    total.output_errors += cpuStats.output_errors;
+  }
+  return total;
+}
+
+void XdpDump::reportStats() {
+  auto stats = getStats();
+  auto suppressed =
+      stats.sampled_out + stats.rate_limited + stats.limit_reached;
+  LOG(INFO) << "packets matched: " << stats.matched
+            << " emitted: " << stats.emitted << " suppressed: " << suppressed
+            << " (sampling: " << stats.sampled_out
+            << " rate limit: " << stats.rate_limited
+            << " packet limit: " << stats.limit_reached
+            << ") perf output errors: " << stats.output_errors;
+}
+
+void XdpDump::startAggregator() {
+  auto flowsFd = bpfAdapter_.getMapFdByName(kFlowsMap);
+  if (flowsFd < 0) {
+    throw std::runtime_error("cant get fd for flows map");
+  }
+  aggregator_ = std::make_unique<FlowAggregator>(
+      flowsFd, katran::BpfAdapter::getPossibleCpus());
+  topTimer_ = folly::AsyncTimeout::make(*eventBase_, [this]() noexcept {
+    if (aggregator_->update()) {
+      aggregator_->printTop(std::cout, filter_.top_n);
+    }
+    topTimer_->scheduleTimeout(kTopRefreshMs);
+  });
+  eventBase_->runInEventBaseThread(
+      [this]() { topTimer_->scheduleTimeout(kTopRefreshMs); });
+}
+
+void XdpDump::writeAggregatorSummary() {
+  // evb thread has already been stopped, so aggregator is not used there
+  if (!aggregator_->update()) {
+    LOG(ERROR) << "cant read flows for the summary";
+    return;
+  }
+  if (filter_.aggregate_output.empty()) {
+    aggregator_->printTop(std::cout, filter_.top_n);
+    return;
+  }
+  std::ofstream out(filter_.aggregate_output);
+  if (!out) {
+    LOG(ERROR) << "cant open " << filter_.aggregate_output;
+    return;
+  }
+  if (filter_.aggregate_format == kJsonFormat) {
+    aggregator_->writeJson(out);
+  } else {
+    aggregator_->writeCsv(out);
+  }
+  LOG(INFO) << "flows summary is written to " << filter_.aggregate_output;
 }
 
 void XdpDump::run() {
   getJmpFd();
   prepareSharedMap();
-  prepareCflags();
-  compile();
   load();
+  prepareFilter();
+  if (filter_.points & kCapturePost) {
+    getExitHookFd();
+  }
+  if (!filter_.pcap_filter.empty()) {
+    loadPcapFilter();
+  }
   pumpEventBase();      // run evbThread_ here
   tryStartPcapWriter(); // create: queue_ -> writerThread_ if pcap
-  startEventReaders();
+  if (filter_.aggregate) {
+    // packets are only counted in bpf program, nothing is sent to perf ring
+    startAggregator();
+  } else {
+    startEventReaders();
+  }
   startSigHandler();
   attach();
   LOG(INFO) << "Starting xdpdump";
   sleepForever();
   LOG(INFO) << "Detaching bpf";
   detach();
+  reportStats();
+  if (filter_.aggregate) {
+    writeAggregatorSummary();
+  }
   LOG(INFO) << "Finalized xdpdump";
 }
 
 void XdpDump::timeoutExpired() noexcept { stop(); }
 
 void XdpDump::getJmpFd() {
-  jmpFd_ = bpf_obj_get(filter_.map_path.c_str());
+  jmpFd_ = katran::BpfAdapter::getPinnedBpfObject(filter_.map_path);
   if (jmpFd_ < 0) {
     throw std::runtime_error(
         "cant get fd of shared map, probably xdp is not supported");
@@ -249,6 +381,11 @@ void XdpDump::pumpEventBase() {
 
 void XdpDump::tryStartPcapWriter() {
   if (pcapWriter_) {
+    if (filter_.points & kCapturePost) {
+      // records from different capture points are written as packets on
+      // different interfaces, so they could be told apart
+      pcapWriter_->enablePcapng(kCapturePointNames);
+    }
     queue_ =
         std::make_shared<folly::MPMCQueue<katran::PcapMsg>>(kQueueCapacity);
     writerThread_ = std::thread([this]() {
@@ -267,9 +404,10 @@ void XdpDump::tryStartPcapWriter() {
 }
 
 void XdpDump::startEventReaders() {
-  uint64_t numCpu = getPossibleCpus();
+  int numCpu = katran::BpfAdapter::getPossibleCpus();
   std::shared_ptr<XdpEventLogger> eventLogger_;
-  eventLogger_ = std::make_shared<ProgLogger>(filter_.mute, std::cerr);
+  eventLogger_ = std::make_shared<ProgLogger>(
+      filter_.mute, std::cerr, filter_.points & kCapturePost);
   for (int cpu = 0; cpu < numCpu; ++cpu) {
     auto reader = std::make_unique<XdpEventReader>(queue_, eventLogger_,
                                                    filter_.pages, cpu);
@@ -293,6 +431,9 @@ void XdpDump::startSigHandler() {
 void XdpDump::clear() {
   VLOG(2) << "removing xdpdump from shared array";
   getJmpFd();
+  if (filter_.points & kCapturePost) {
+    getExitHookFd();
+  }
   detach();
 }
 
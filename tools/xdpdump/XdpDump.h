@@ -21,13 +21,14 @@
 #include <thread>
 #include <vector>
 
-#include <bcc/bpf_module.h>
 #include <folly/MPMCQueue.h>
 #include <folly/io/async/AsyncSignalHandler.h>
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/EventBase.h>
 
+#include "katran/lib/BpfAdapter.h"
 #include "katran/lib/PcapMsg.h"
+#include "tools/xdpdump/FlowAggregator.h"
 #include "tools/xdpdump/XdpDumpStructs.h"
 #include "tools/xdpdump/XdpEventReader.h"
 
@@ -81,6 +82,11 @@ public:
    */
   void run();
 
+  /**
+   * @return XdpDumpStats counters of the capture, summed over all cpus
+   */
+  XdpDumpStats getStats();
+
   /**
    * timeout function
    */
@@ -102,25 +108,52 @@ private:
     XdpDump *parent_;
   };
   /**
-   * helper function which compiles bpf program.
+   * helper function which loads precompiled bpf program in kernel
    */
-  void compile();
+  void load();
 
   /**
-   * helper function which loads bpf program in kernel
+   * helper function which passes rootlet's prog array to bpf loader, so it
+   * would be reused by xdpdump's program
    */
-  void load();
+  void prepareSharedMap();
 
   /**
-   * helper function which prepares and passing rootlet's prog fd to bpf prog
+   * helper function which writes filter's configuration into xdpdump_filter
+   * map of loaded program
    */
-  void prepareSharedMap();
+  void prepareFilter();
+
+  /**
+   * helper function which compiles pcap-filter expression into classic bpf,
+   * translates it into xdp program and loads it. this program runs before
+   * xdpdump's one and tail calls into it only for matched packets
+   */
+  void loadPcapFilter();
 
   /**
    * helper function which retrievs rootlet's jump table fd from pinned map
    */
   void getJmpFd();
 
+  /**
+   * helper function which retrieves fd of balancer's exit hook (prog array
+   * which is tail called w/ packet's verdict) either from pinned path or
+   * by the name of the map
+   */
+  void getExitHookFd();
+
+  /**
+   * helper function which puts xdpdump's exit progs into balancer's exit
+   * hook, so packets could be captured after the balancer
+   */
+  void attachExitHook();
+
+  /**
+   * helper function which removes xdpdump's progs from balancer's exit hook
+   */
+  void detachExitHook();
+
   /**
    * helper function to pump eventBase_
    */
@@ -136,6 +169,18 @@ private:
    */
   void startEventReaders();
 
+  /**
+   * helper function which starts periodic printing of the busiest flows
+   * (for aggregating mode)
+   */
+  void startAggregator();
+
+  /**
+   * helper function which writes totals of all aggregated flows into
+   * configured file (or prints them if file is not set)
+   */
+  void writeAggregatorSummary();
+
   /**
    * helper function which starts signal handler
    */
@@ -159,11 +204,10 @@ private:
   void sleepForever();
 
   /**
-   * helper function which prepares cflags for bpf prog compilation.
-   * cflags are based on info which has been provided inside XdpDumpFilter
-   * struct
+   * helper function which logs counters of matched, emitted and suppressed
+   * packets
    */
-  void prepareCflags();
+  void reportStats();
 
   /**
    * helper function which stop both pcapWriter (if running)
@@ -184,10 +228,9 @@ private:
   std::shared_ptr<katran::PcapWriter> pcapWriter_{nullptr};
 
   /**
-   * bpf provider which is used to created bpf prog. depends on configuration
-   * could be either Bcc or Pcap compiler
+   * adapter which is used to load precompiled xdpdump's bpf program
    */
-  std::unique_ptr<ebpf::BPFModule> bpf_;
+  katran::BpfAdapter bpfAdapter_;
 
   /**
    * evbThread, which run all event readers and sighandler.
@@ -205,16 +248,34 @@ private:
    */
   int jmpFd_;
 
+  /**
+   * fd of balancer's exit hook (-1 if post capture is not used)
+   */
+  int exitHookFd_{-1};
+
+  /**
+   * fd of prog array w/ xdpdump's progs, which are called from pcap filter
+   */
+  int captureProgsFd_{-1};
+
+  /**
+   * fd of the prog generated from pcap filter (-1 if filter is not used)
+   */
+  int pcapFilterProgFd_{-1};
+
   /**
    * vector of eventReaders (there is one event reader per cpu core)
    */
   std::vector<std::unique_ptr<XdpEventReader>> eventReaders_;
 
+  std::unique_ptr<XdpDumpSignalHandler> sigHandler_;
+
   /**
-   * vector of cflags, which are passed to bpf backedn during compilation phase
+   * reader of aggregated flows and timer which refreshes top-N table
    */
-  std::vector<std::string> cflags_;
-  std::unique_ptr<XdpDumpSignalHandler> sigHandler_;
+  std::unique_ptr<FlowAggregator> aggregator_;
+  std::unique_ptr<folly::AsyncTimeout> topTimer_;
+
   std::thread writerThread_;
 
   /**
@@ -222,11 +283,6 @@ private:
    */
   std::shared_ptr<folly::MPMCQueue<katran::PcapMsg>> queue_;
 
-  /**
-   * name of main bpf function
-   */
-  std::string funcName_;
-
   /**
    * name of main bpf function
    */
@@ -19,6 +19,21 @@
 
 namespace xdpdump {
 
+/**
+ * points where packets could be captured. must be in sync w/ POINT_* in
+ * bpf/xdpdump_maps.h
+ */
+constexpr uint8_t kPointPre = 0;
+constexpr uint8_t kPointPost = 1;
+constexpr uint8_t kCapturePre = (1 << kPointPre);
+constexpr uint8_t kCapturePost = (1 << kPointPost);
+
+/**
+ * max offset of byte matching. must be in sync w/ MAX_PATTERN_OFFSET in
+ * bpf/xdpdump_maps.h
+ */
+constexpr uint16_t kMaxPatternOffset = 4096;
+
 struct XdpDumpFilter {
   union {
     uint32_t src;
@@ -36,14 +51,96 @@ struct XdpDumpFilter {
   uint16_t offset_len;
   uint32_t pattern;
   std::string map_path;
+  std::string prog_path;
+  std::string pcap_filter;
+  std::string exit_hook_path;
   uint8_t flags;
+  uint8_t points;
   uint64_t count;
+  uint32_t sample_rate;
+  uint32_t pps_limit;
+  bool aggregate;
+  uint32_t max_flows;
+  uint32_t top_n;
+  std::string aggregate_output;
+  std::string aggregate_format;
   bool mute;
   int32_t cpu;
   int32_t pages;
 };
 
 extern "C" {
+/**
+ * filter's configuration which is passed to bpf program thru xdpdump_filter
+ * map. must be in sync w/ struct xdpdump_filter in bpf/xdpdump_maps.h
+ */
+struct XdpDumpFilterConfig {
+  union {
+    uint32_t src;
+    uint32_t srcv6[4];
+  };
+  union {
+    uint32_t dst;
+    uint32_t dstv6[4];
+  };
+  uint16_t sport;
+  uint16_t dport;
+  uint16_t offset;
+  uint16_t offset_len;
+  uint32_t pattern;
+  int32_t cpu;
+  uint8_t proto;
+  uint8_t flags;
+  uint8_t ipv6;
+  uint8_t points;
+  uint32_t sample_threshold;
+  uint32_t rate_cost_ns;
+  uint32_t limit;
+  uint32_t aggregate;
+};
+
+/**
+ * key of aggregated flow. must be in sync w/ struct flow_key in
+ * bpf/xdpdump_maps.h
+ */
+struct XdpDumpFlowKey {
+  union {
+    uint32_t src;
+    uint32_t srcv6[4];
+  };
+  union {
+    uint32_t dst;
+    uint32_t dstv6[4];
+  };
+  uint16_t sport;
+  uint16_t dport;
+  uint8_t proto;
+  uint8_t ipv6;
+  uint16_t pad;
+};
+
+/**
+ * counters of aggregated flow. must be in sync w/ struct flow_counters in
+ * bpf/xdpdump_maps.h
+ */
+struct XdpDumpFlowCounters {
+  uint64_t packets;
+  uint64_t bytes;
+};
+
+/**
+ * per cpu counters of the capture. must be in sync w/ struct xdpdump_stats
+ * in bpf/xdpdump_maps.h
+ */
+struct XdpDumpStats {
+  uint64_t matched;
+  uint64_t emitted;
+  uint64_t sampled_out;
+  uint64_t rate_limited;
+  uint64_t limit_reached;
+  uint64_t output_errors;
+};
+
 struct XdpDumpOutput {
   union {
     uint32_t src;
@@ -59,6 +156,9 @@ struct XdpDumpOutput {
   uint8_t proto;
   uint16_t pkt_size;
   uint16_t data_len;
+  uint64_t pkt_id;
+  uint8_t point;
+  uint8_t verdict;
 };
 }
 } // namespace xdpdump
@@ -16,6 +16,8 @@
 
 #include "tools/xdpdump/XdpEventLogger.h"
 
+#include <linux/bpf.h>
+
 #include <folly/Conv.h>
 #include <folly/IPAddress.h>
 #include <glog/logging.h>
@@ -25,6 +27,27 @@ namespace xdpdump {
 namespace {
 
 constexpr uint8_t kIPv6AddrSize = 16;
+
+std::string pointToString(uint8_t point) {
+  return point == kPointPost ? "post" : "pre";
+}
+} // namespace
+
+std::string verdictToString(uint8_t verdict) {
+  switch (verdict) {
+  case XDP_ABORTED:
+    return "XDP_ABORTED";
+  case XDP_DROP:
+    return "XDP_DROP";
+  case XDP_PASS:
+    return "XDP_PASS";
+  case XDP_TX:
+    return "XDP_TX";
+  case XDP_REDIRECT:
+    return "XDP_REDIRECT";
+  default:
+    return folly::to<std::string>("unknown(", uint32_t(verdict), ")");
+  }
 }
 
 std::string XdpEventLogger::binaryToV6String(uint8_t const *v6) {
@@ -42,6 +65,9 @@ XdpEventInfo ProgLogger::handlePerfEvent(const char *data) {
   info.pkt_size = msg->pkt_size;
   info.data_len = msg->data_len;
   info.hdr_size = sizeof(struct XdpDumpOutput);
+  info.pkt_id = msg->pkt_id;
+  info.point = msg->point;
+  info.verdict = msg->verdict;
   if (!mute_) {
     log(msg);
   }
@@ -49,6 +75,14 @@ XdpEventInfo ProgLogger::handlePerfEvent(const char *data) {
 }
 
 void ProgLogger::log(const XdpDumpOutput *msg) {
+  if (withPoints_) {
+    out_ << "point: " << pointToString(msg->point) << " id: " << std::hex
+         << msg->pkt_id << std::dec;
+    if (msg->point == kPointPost) {
+      out_ << " verdict: " << verdictToString(msg->verdict);
+    }
+    out_ << std::endl;
+  }
   if (msg->ipv6) {
     out_ << "srcv6: " << binaryToV6String((uint8_t *)&msg->srcv6)
          << " dstv6: " << binaryToV6String((uint8_t *)&msg->dstv6) << std::endl;
@@ -18,13 +18,23 @@
 
 #include "tools/xdpdump/XdpDumpStructs.h"
 #include <ostream>
+#include <string>
 
 namespace xdpdump {
 
+/**
+ * @param uint8_t verdict xdp action
+ * @return string name of the action (e.g. XDP_TX)
+ */
+std::string verdictToString(uint8_t verdict);
+
 struct XdpEventInfo {
   uint32_t data_len{0};
   uint32_t hdr_size{0};
   uint32_t pkt_size{0};
+  uint64_t pkt_id{0};
+  uint8_t point{0};
+  uint8_t verdict{0};
 };
 
 class XdpEventLogger {
@@ -82,10 +92,13 @@ public:
   /**
    * @param bool mute set if logger should write any data into out
    * @param std::ostream& out is an ostream where logs are saved
+   * @param bool withPoints set if capture point, packet's id and verdict
+   * should be logged as well (for multi-point capture)
    *
    * Constructor for ProgLogger
    */
-  ProgLogger(bool mute, std::ostream &out) : XdpEventLogger(mute, out) {}
+  ProgLogger(bool mute, std::ostream &out, bool withPoints = false)
+      : XdpEventLogger(mute, out), withPoints_(withPoints) {}
 
   /**
    * @param const char* data received from the XDP prog.
@@ -101,5 +114,10 @@ private:
    * Logs prog data
    */
   void log(const XdpDumpOutput *msg);
+
+  /**
+   * set if capture point, packet's id and verdict are logged
+   */
+  const bool withPoints_{false};
 };
 } // namespace xdpdump
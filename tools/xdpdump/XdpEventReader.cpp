@@ -16,11 +16,12 @@
 
 #include "tools/xdpdump/XdpEventReader.h"
 
-#include <bcc/libbpf.h>
 #include <folly/String.h>
 #include <folly/io/async/EventBase.h>
 #include <unistd.h>
 
+#include "katran/lib/BpfAdapter.h"
+
 extern "C" {
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -32,6 +33,10 @@ namespace xdpdump {
 
 namespace {
 
+// direction bits of pcapng's epb_flags
+constexpr uint32_t kPcapngInbound = 1;
+constexpr uint32_t kPcapngOutbound = 2;
+
 struct perf_event_sample {
   struct perf_event_header header;
   __u32 size;
@@ -115,7 +120,7 @@ bool openPerfEvent(int cpu, int map_fd, int wakeUpNumEvents, int pages,
   if (*header == nullptr) {
     return false;
   }
-  if (bpf_update_elem(map_fd, &cpu, &event_fd, BPF_ANY)) {
+  if (katran::BpfAdapter::bpfUpdateMap(map_fd, &cpu, &event_fd)) {
     LOG(ERROR) << "failed to update perf_event_map " << folly::errnoStr(errno);
     return false;
   }
@@ -223,6 +228,15 @@ void XdpEventReader::handlePerfEvent(const char *data,
   if (queue_ != nullptr) {
     katran::PcapMsg pcap_msg(data + info.hdr_size, info.pkt_size,
                              info.data_len);
+    // annotations are used only if writer's output is in pcapng format
+    pcap_msg.setInterfaceId(info.point);
+    pcap_msg.setPacketId(info.pkt_id);
+    if (info.point == kPointPost) {
+      pcap_msg.setFlags(kPcapngOutbound);
+      pcap_msg.setComment("verdict: " + verdictToString(info.verdict));
+    } else {
+      pcap_msg.setFlags(kPcapngInbound);
+    }
     // best effort non blocking write. if writer thread is full we will lose
     // this packet
     auto res = queue_->write(std::move(pcap_msg));
@@ -0,0 +1,403 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <linux/in.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "bpf.h"
+#include "bpf_helpers.h"
+#include "xdpdump_maps.h"
+
+// we dont want to do htons for each packet, so this is ETH_P_IPV6 and
+// ETH_P_IP in be format
+#define BE_ETH_P_IP 8
+#define BE_ETH_P_IPV6 56710
+#define MAX_LEN 128
+
+#define IPV4_HDR_LEN_NO_OPT 20
+
+__attribute__((__always_inline__))
+static inline bool parse_ports(void *data, __u64 off, void *data_end,
+                               struct packet_description *pckt) {
+  // source and dest ports are at the same offsets in tcp and udp headers
+  struct udphdr *udp = data + off;
+  if ((void *)(udp + 1) > data_end) {
+    return false;
+  }
+  pckt->port16[0] = udp->source;
+  pckt->port16[1] = udp->dest;
+  return true;
+}
+
+__attribute__((__always_inline__))
+static inline bool match_pattern(void *data, void *data_end,
+                                 struct xdpdump_filter *filter) {
+  __u32 len = filter->offset_len;
+  __u64 off = filter->offset;
+  __u32 pkt_chunk;
+  if (len > MAX_PATTERN_LEN) {
+    len = MAX_PATTERN_LEN;
+  }
+  // offset comes from the map; verifier must know it's bounds before it
+  // is added to packet's pointer
+  if (off > MAX_PATTERN_OFFSET) {
+    return false;
+  }
+  off += sizeof(struct ethhdr);
+  if (data + off + sizeof(__u32) > data_end) {
+    return false;
+  }
+  pkt_chunk = *(__u32 *)(data + off);
+  pkt_chunk &= (0xFFFFFFFF >> ((MAX_PATTERN_LEN - len) * 8));
+  return (pkt_chunk & filter->pattern) == filter->pattern;
+}
+
+__attribute__((__always_inline__))
+static inline bool match_filter(struct packet_description *pckt,
+                                struct xdpdump_filter *filter,
+                                bool is_ipv6) {
+  if ((filter->flags & (SRC_SET | DST_SET)) && filter->ipv6 != is_ipv6) {
+    return false;
+  }
+  if (filter->flags & SRC_SET) {
+    if (is_ipv6) {
+      if (pckt->srcv6[0] != filter->srcv6[0] ||
+          pckt->srcv6[1] != filter->srcv6[1] ||
+          pckt->srcv6[2] != filter->srcv6[2] ||
+          pckt->srcv6[3] != filter->srcv6[3]) {
+        return false;
+      }
+    } else if (pckt->src != filter->src) {
+      return false;
+    }
+  }
+  if (filter->flags & DST_SET) {
+    if (is_ipv6) {
+      if (pckt->dstv6[0] != filter->dstv6[0] ||
+          pckt->dstv6[1] != filter->dstv6[1] ||
+          pckt->dstv6[2] != filter->dstv6[2] ||
+          pckt->dstv6[3] != filter->dstv6[3]) {
+        return false;
+      }
+    } else if (pckt->dst != filter->dst) {
+      return false;
+    }
+  }
+  if ((filter->flags & SPORT_SET) && pckt->port16[0] != filter->sport) {
+    return false;
+  }
+  if ((filter->flags & DPORT_SET) && pckt->port16[1] != filter->dport) {
+    return false;
+  }
+  if ((filter->flags & PROTO_SET) && pckt->proto != filter->proto) {
+    return false;
+  }
+  return true;
+}
+
+__attribute__((__always_inline__))
+static inline bool parse_packet(void *data, void *data_end, bool *is_ipv6,
+                                struct packet_description *pckt) {
+  struct ethhdr *eth = data;
+  struct iphdr *iph;
+  struct ipv6hdr *ip6h;
+  __u64 off = sizeof(struct ethhdr);
+
+  if (data + off > data_end) {
+    return false;
+  }
+  if (eth->h_proto == BE_ETH_P_IP) {
+    *is_ipv6 = false;
+    iph = data + off;
+    if ((void *)(iph + 1) > data_end) {
+      return false;
+    }
+    pckt->proto = iph->protocol;
+    off += IPV4_HDR_LEN_NO_OPT;
+    pckt->src = iph->saddr;
+    pckt->dst = iph->daddr;
+  } else if (eth->h_proto == BE_ETH_P_IPV6) {
+    *is_ipv6 = true;
+    ip6h = data + off;
+    if ((void *)(ip6h + 1) > data_end) {
+      return false;
+    }
+    pckt->proto = ip6h->nexthdr;
+    off += sizeof(struct ipv6hdr);
+    memcpy(pckt->srcv6, ip6h->saddr.s6_addr32, 16);
+    memcpy(pckt->dstv6, ip6h->daddr.s6_addr32, 16);
+  } else {
+    return false;
+  }
+  if (pckt->proto == IPPROTO_TCP || pckt->proto == IPPROTO_UDP) {
+    parse_ports(data, off, data_end, pckt);
+  }
+  return true;
+}
+
+__attribute__((__always_inline__))
+static inline void aggregate_packet(struct packet_description *pckt,
+                                    bool is_ipv6, __u64 pkt_size) {
+  struct flow_key key = {};
+  struct flow_counters *counters;
+  struct flow_counters new_counters = {};
+
+  if (is_ipv6) {
+    memcpy(key.srcv6, pckt->srcv6, 16);
+    memcpy(key.dstv6, pckt->dstv6, 16);
+  } else {
+    key.src = pckt->src;
+    key.dst = pckt->dst;
+  }
+  key.ports = pckt->ports;
+  key.proto = pckt->proto;
+  key.ipv6 = is_ipv6;
+  // value of per cpu map is private to this cpu, so no atomics are needed
+  counters = bpf_map_lookup_elem(&xdpdump_flows, &key);
+  if (counters) {
+    counters->packets++;
+    counters->bytes += pkt_size;
+    return;
+  }
+  new_counters.packets = 1;
+  new_counters.bytes = pkt_size;
+  bpf_map_update_elem(&xdpdump_flows, &key, &new_counters, BPF_NOEXIST);
+}
+
+__attribute__((__always_inline__))
+static inline bool rate_limit_passed(struct xdpdump_filter *filter,
+                                     struct xdpdump_state *state) {
+  __u64 now = bpf_ktime_get_ns();
+  __u64 credit = state->credit_ns + (now - state->last_ns);
+
+  state->last_ns = now;
+  if (credit > MAX_RATE_CREDIT_NS) {
+    credit = MAX_RATE_CREDIT_NS;
+  }
+  if (credit < filter->rate_cost_ns) {
+    state->credit_ns = credit;
+    return false;
+  }
+  state->credit_ns = credit - filter->rate_cost_ns;
+  return true;
+}
+
+// decides if matched packet should be captured. checks are ordered from
+// the cheapest one; packet which has been suppressed does not consume
+// rate limiter's credit or global limit
+__attribute__((__always_inline__))
+static inline bool should_capture(struct xdpdump_filter *filter,
+                                  struct xdpdump_state *state,
+                                  struct xdpdump_stats *stats) {
+  __u32 limit_pos = LIMIT_POS;
+  __u64 *captured = NULL;
+
+  stats->matched++;
+  if (filter->sample_threshold &&
+      bpf_get_prandom_u32() >= filter->sample_threshold) {
+    stats->sampled_out++;
+    return false;
+  }
+  if (filter->limit) {
+    captured = bpf_map_lookup_elem(&xdpdump_limit, &limit_pos);
+    // could overshoot by number of cpus which are racing for the last slots
+    if (!captured || *captured >= filter->limit) {
+      stats->limit_reached++;
+      return false;
+    }
+  }
+  if (filter->rate_cost_ns && !rate_limit_passed(filter, state)) {
+    stats->rate_limited++;
+    return false;
+  }
+  if (filter->limit && captured) {
+    __sync_fetch_and_add(captured, 1);
+  }
+  stats->emitted++;
+  return true;
+}
+
+__attribute__((__always_inline__))
+static inline void submit_packet(struct xdp_md *ctx,
+                                 struct packet_description *pckt,
+                                 bool is_ipv6, __u64 pkt_id, __u8 point,
+                                 __u8 verdict,
+                                 struct xdpdump_stats *stats) {
+  void *data = (void *)(long)ctx->data;
+  void *data_end = (void *)(long)ctx->data_end;
+  struct xdpdump_output output = {};
+  __u64 flags = BPF_F_CURRENT_CPU;
+
+  output.ipv6 = is_ipv6;
+  if (is_ipv6) {
+    memcpy(output.srcv6, pckt->srcv6, 16);
+    memcpy(output.dstv6, pckt->dstv6, 16);
+  } else {
+    output.src = pckt->src;
+    output.dst = pckt->dst;
+  }
+  output.sport = pckt->port16[0];
+  output.dport = pckt->port16[1];
+  output.proto = pckt->proto;
+  output.pkt_size = data_end - data;
+  output.data_len = output.pkt_size < MAX_LEN ? output.pkt_size : MAX_LEN;
+  output.pkt_id = pkt_id;
+  output.point = point;
+  output.verdict = verdict;
+  flags |= (__u64)output.data_len << 32;
+  if (bpf_perf_event_output(ctx, &perf_event_map, flags, &output,
+                            sizeof(output))) {
+    stats->output_errors++;
+  }
+}
+
+__attribute__((__always_inline__))
+static inline void process_packet(struct xdp_md *ctx) {
+  void *data = (void *)(long)ctx->data;
+  void *data_end = (void *)(long)ctx->data_end;
+  struct packet_description pckt = {};
+  struct xdpdump_filter *filter;
+  struct xdpdump_state *state;
+  struct xdpdump_stats *stats;
+  __u32 filter_pos = FILTER_POS;
+  __u32 state_pos = STATE_POS;
+  __u32 stats_pos = STATS_POS;
+  __u32 cpu = bpf_get_smp_processor_id();
+  bool is_ipv6 = false;
+
+  filter = bpf_map_lookup_elem(&xdpdump_filter, &filter_pos);
+  state = bpf_map_lookup_elem(&xdpdump_state, &state_pos);
+  stats = bpf_map_lookup_elem(&xdpdump_stats, &stats_pos);
+  if (!filter || !state || !stats) {
+    return;
+  }
+  state->seq++;
+  state->pkt_id = ((__u64)cpu << PKT_ID_CPU_SHIFT) |
+                  (state->seq & ((1ULL << PKT_ID_CPU_SHIFT) - 1));
+  state->matched = 0;
+
+  if (filter->cpu != NO_CPU_FILTER && cpu != filter->cpu) {
+    return;
+  }
+  if (!parse_packet(data, data_end, &is_ipv6, &pckt)) {
+    return;
+  }
+  if (!match_filter(&pckt, filter, is_ipv6)) {
+    return;
+  }
+  if (filter->offset_len > 0 && !match_pattern(data, data_end, filter)) {
+    return;
+  }
+  if (filter->aggregate) {
+    stats->matched++;
+    aggregate_packet(&pckt, is_ipv6, data_end - data);
+    return;
+  }
+  if (!should_capture(filter, state, stats)) {
+    return;
+  }
+  // exit hook would capture this packet after the balancer
+  state->matched = 1;
+  if (filter->points & CAPTURE_PRE) {
+    submit_packet(ctx, &pckt, is_ipv6, state->pkt_id, POINT_PRE, 0, stats);
+  }
+}
+
+__attribute__((__always_inline__))
+static inline int process_exit(struct xdp_md *ctx, int verdict) {
+  void *data = (void *)(long)ctx->data;
+  void *data_end = (void *)(long)ctx->data_end;
+  struct packet_description pckt = {};
+  struct xdpdump_filter *filter;
+  struct xdpdump_state *state;
+  struct xdpdump_stats *stats;
+  __u32 filter_pos = FILTER_POS;
+  __u32 state_pos = STATE_POS;
+  __u32 stats_pos = STATS_POS;
+  bool is_ipv6 = false;
+
+  filter = bpf_map_lookup_elem(&xdpdump_filter, &filter_pos);
+  state = bpf_map_lookup_elem(&xdpdump_state, &state_pos);
+  stats = bpf_map_lookup_elem(&xdpdump_stats, &stats_pos);
+  if (!filter || !state || !stats || !state->matched) {
+    return verdict;
+  }
+  state->matched = 0;
+  if (filter->points & CAPTURE_POST) {
+    // packet could be already encapsulated, so this is the outer header
+    parse_packet(data, data_end, &is_ipv6, &pckt);
+    submit_packet(ctx, &pckt, is_ipv6, state->pkt_id, POINT_POST, verdict,
+                  stats);
+  }
+  return verdict;
+}
+
+__attribute__((__always_inline__))
+static inline void continue_chain(struct xdp_md *ctx) {
+  #pragma clang loop unroll(full)
+  for (__u32 i = 1; i < JMP_ARRAY_SIZE; i++) {
+    bpf_tail_call(ctx, &jmp, i);
+  }
+}
+
+SEC("xdp-dump")
+int xdpdump(struct xdp_md *ctx) {
+  process_packet(ctx);
+  continue_chain(ctx);
+  return XDP_PASS;
+}
+
+// called by pcap filter's program for packets which did not match
+SEC("xdp-dump-miss")
+int xdpdump_miss(struct xdp_md *ctx) {
+  struct xdpdump_state *state;
+  __u32 state_pos = STATE_POS;
+  state = bpf_map_lookup_elem(&xdpdump_state, &state_pos);
+  if (state) {
+    state->matched = 0;
+  }
+  continue_chain(ctx);
+  return XDP_PASS;
+}
+
+// exit hooks of the balancer (one per verdict)
+SEC("xdp-dump-exit-aborted")
+int xdpdump_exit_aborted(struct xdp_md *ctx) {
+  return process_exit(ctx, XDP_ABORTED);
+}
+
+SEC("xdp-dump-exit-drop")
+int xdpdump_exit_drop(struct xdp_md *ctx) {
+  return process_exit(ctx, XDP_DROP);
+}
+
+SEC("xdp-dump-exit-pass")
+int xdpdump_exit_pass(struct xdp_md *ctx) {
+  return process_exit(ctx, XDP_PASS);
+}
+
+SEC("xdp-dump-exit-tx")
+int xdpdump_exit_tx(struct xdp_md *ctx) {
+  return process_exit(ctx, XDP_TX);
+}
+
+char _license[] SEC("license") = "GPL";
@@ -0,0 +1,255 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __XDPDUMP_MAPS_H
+#define __XDPDUMP_MAPS_H
+
+/*
+ * This file contains definition of all maps and structs which are used by
+ * xdpdump
+ */
+
+#include <stdbool.h>
+
+#include "bpf.h"
+#include "bpf_helpers.h"
+
+// size of rootlet's prog array
+#define JMP_ARRAY_SIZE 16
+// could be changed by userspace before load to the number of possible cpus
+#define MAX_SUPPORTED_CPUS 128
+
+// flags which show which field is set in xdpdump_filter. must be in sync
+// with tools/xdpdump/XdpDump.h
+#define SRC_SET (1 << 0)
+#define DST_SET (1 << 1)
+#define SPORT_SET (1 << 2)
+#define DPORT_SET (1 << 3)
+#define PROTO_SET (1 << 4)
+
+// capture points. must be in sync w/ tools/xdpdump/XdpDumpStructs.h
+#define POINT_PRE 0
+#define POINT_POST 1
+#define CAPTURE_PRE (1 << POINT_PRE)
+#define CAPTURE_POST (1 << POINT_POST)
+
+// positions in the prog array which is used by pcap filter's program
+#define CAPTURE_PROG_POS 0
+#define MISS_PROG_POS 1
+
+#define FILTER_POS 0
+#define STATE_POS 0
+#define STATS_POS 0
+#define LIMIT_POS 0
+// could be changed by userspace before load
+#define MAX_FLOWS 65536
+// max credit of rate limiter's token bucket: one second worth of packets
+#define MAX_RATE_CREDIT_NS 1000000000ULL
+// low bits of packet's id are a per cpu sequence number, high - cpu
+#define PKT_ID_CPU_SHIFT 48
+#define NO_CPU_FILTER -1
+#define MAX_PATTERN_LEN 4
+// max offset (from the end of ethernet header) of the matched pattern. xdp
+// frame never spans more than a page. must be in sync w/ kMaxPatternOffset
+#define MAX_PATTERN_OFFSET 4096
+
+// configuration of the capture. written by userspace before xdpdump is
+// attached to the rootlet. must be in sync w/ XdpDumpFilterConfig
+struct xdpdump_filter {
+  union {
+    __be32 src;
+    __be32 srcv6[4];
+  };
+  union {
+    __be32 dst;
+    __be32 dstv6[4];
+  };
+  __be16 sport;
+  __be16 dport;
+  __u16 offset;
+  __u16 offset_len;
+  __u32 pattern;
+  __s32 cpu;
+  __u8 proto;
+  __u8 flags;
+  __u8 ipv6;
+  // bitmask of CAPTURE_PRE and CAPTURE_POST
+  __u8 points;
+  // matched packet is captured if random u32 is below this threshold
+  // (2^32 / sample rate, precomputed in userspace). 0 - all are captured
+  __u32 sample_threshold;
+  // cost of single captured packet in rate limiter's credit
+  // (NSEC_PER_SEC / max pps per cpu). 0 - no rate limit
+  __u32 rate_cost_ns;
+  // max number of captured packets (on all cpus). 0 - no limit
+  __u32 limit;
+  // if set: matched packets are only counted in xdpdump_flows map
+  __u32 aggregate;
+};
+
+// per cpu state, which is used to correlate records of the same packet
+// from different capture points. packet is processed on a single cpu, from
+// the rootlet to balancer's exit hook
+struct xdpdump_state {
+  __u64 seq;
+  __u64 pkt_id;
+  __u32 matched;
+  // state of per cpu rate limiter (token bucket)
+  __u64 credit_ns;
+  __u64 last_ns;
+};
+
+// per cpu counters of the capture. must be in sync w/ XdpDumpStats
+struct xdpdump_stats {
+  // packets which matched the filter
+  __u64 matched;
+  // packets which have been sent to userspace
+  __u64 emitted;
+  // matched packets which were suppressed by sampling
+  __u64 sampled_out;
+  // matched packets which were suppressed by rate limiter
+  __u64 rate_limited;
+  // matched packets which were suppressed after the limit was reached
+  __u64 limit_reached;
+  // records which could not be written into perf ring (e.g. it was full)
+  __u64 output_errors;
+};
+
+// client's packet metadata
+struct packet_description {
+  union {
+    __be32 src;
+    __be32 srcv6[4];
+  };
+  union {
+    __be32 dst;
+    __be32 dstv6[4];
+  };
+  union {
+    __u32 ports;
+    __u16 port16[2];
+  };
+  __u8 proto;
+  __u8 flags;
+};
+
+// key of aggregated flow. must be in sync w/ XdpDumpFlowKey
+struct flow_key {
+  union {
+    __be32 src;
+    __be32 srcv6[4];
+  };
+  union {
+    __be32 dst;
+    __be32 dstv6[4];
+  };
+  union {
+    __u32 ports;
+    __u16 port16[2];
+  };
+  __u8 proto;
+  __u8 ipv6;
+  __u16 pad;
+};
+
+// counters of aggregated flow. must be in sync w/ XdpDumpFlowCounters
+struct flow_counters {
+  __u64 packets;
+  __u64 bytes;
+};
+
+// metadata which is sent to userspace before captured packet. must be
+// in sync w/ XdpDumpOutput
+struct xdpdump_output {
+  union {
+    __u32 src;
+    __u32 srcv6[4];
+  };
+  union {
+    __u32 dst;
+    __u32 dstv6[4];
+  };
+  bool ipv6;
+  __u16 sport;
+  __u16 dport;
+  __u8 proto;
+  __u16 pkt_size;
+  __u16 data_len;
+  __u64 pkt_id;
+  __u8 point;
+  __u8 verdict;
+};
+
+// rootlet's prog array. shared w/ already pinned one before load
+struct bpf_map_def SEC("maps") jmp = {
+  .type = BPF_MAP_TYPE_PROG_ARRAY,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(__u32),
+  .max_entries = JMP_ARRAY_SIZE,
+};
+
+struct bpf_map_def SEC("maps") perf_event_map = {
+  .type = BPF_MAP_TYPE_PERF_EVENT_ARRAY,
+  .key_size = sizeof(int),
+  .value_size = sizeof(__u32),
+  .max_entries = MAX_SUPPORTED_CPUS,
+};
+BPF_ANNOTATE_KV_PAIR(perf_event_map, int, __u32);
+
+struct bpf_map_def SEC("maps") xdpdump_filter = {
+  .type = BPF_MAP_TYPE_ARRAY,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(struct xdpdump_filter),
+  .max_entries = 1,
+};
+BPF_ANNOTATE_KV_PAIR(xdpdump_filter, __u32, struct xdpdump_filter);
+
+struct bpf_map_def SEC("maps") xdpdump_state = {
+  .type = BPF_MAP_TYPE_PERCPU_ARRAY,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(struct xdpdump_state),
+  .max_entries = 1,
+};
+BPF_ANNOTATE_KV_PAIR(xdpdump_state, __u32, struct xdpdump_state);
+
+struct bpf_map_def SEC("maps") xdpdump_stats = {
+  .type = BPF_MAP_TYPE_PERCPU_ARRAY,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(struct xdpdump_stats),
+  .max_entries = 1,
+};
+BPF_ANNOTATE_KV_PAIR(xdpdump_stats, __u32, struct xdpdump_stats);
+
+// number of captured packets on all cpus. used to enforce the limit
+struct bpf_map_def SEC("maps") xdpdump_limit = {
+  .type = BPF_MAP_TYPE_ARRAY,
+  .key_size = sizeof(__u32),
+  .value_size = sizeof(__u64),
+  .max_entries = 1,
+};
+BPF_ANNOTATE_KV_PAIR(xdpdump_limit, __u32, __u64);
+
+// per cpu counters of matched flows (for aggregating mode). lru, so new
+// flows are still counted when the map is full
+struct bpf_map_def SEC("maps") xdpdump_flows = {
+  .type = BPF_MAP_TYPE_LRU_PERCPU_HASH,
+  .key_size = sizeof(struct flow_key),
+  .value_size = sizeof(struct flow_counters),
+  .max_entries = MAX_FLOWS,
+};
+BPF_ANNOTATE_KV_PAIR(xdpdump_flows, struct flow_key, struct flow_counters);
+
+#endif // of __XDPDUMP_MAPS_H
@@ -0,0 +1,453 @@
+/* Copyright (C) 2018-present, Facebook, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "katran/lib/BpfAdapter.h"
+#include "tools/xdpdump/CbpfTranslator.h"
+
+extern "C" {
+#include <linux/filter.h>
+#include <unistd.h>
+}
+
+namespace xdpdump {
+
+namespace {
+
+constexpr int kCaptureProgsFd = 100;
+constexpr int kJmpFd = 200;
+constexpr uint32_t kJmpArraySize = 3;
+constexpr uint32_t kCapturePos = 0;
+constexpr uint32_t kMissPos = 1;
+constexpr uint32_t kAccept = 262144;
+// addresses of ctx, packet and top of the stack as seen by the program
+constexpr uint64_t kCtxAddr = 0x100;
+constexpr uint64_t kPacketAddr = 0x10000;
+constexpr uint64_t kStackAddr = 0x100000;
+constexpr uint64_t kStackSize = 512;
+constexpr size_t kMaxSteps = 100000;
+constexpr uint16_t kEthIpv4 = 0x0800;
+constexpr uint16_t kEthIpv6 = 0x86dd;
+constexpr uint8_t kTcp = 6;
+
+/**
+ * outcome of translated program: first tail call (fd and position in prog
+ * array) or, if program exited, fd is -1 and position is return value
+ */
+struct Outcome {
+  int64_t fd;
+  uint64_t pos;
+};
+
+/**
+ * minimal interpreter of instructions, which could be emitted by the
+ * translator. used to check translated programs w/o loading them into the
+ * kernel
+ */
+class Interpreter {
+public:
+  Interpreter(const std::vector<struct bpf_insn> &prog,
+              const std::vector<uint8_t> &packet)
+      : prog_(prog), packet_(packet), stack_(kStackSize) {
+    ctx_.data = kPacketAddr;
+    ctx_.data_end = kPacketAddr + packet_.size();
+  }
+
+  Outcome run() {
+    uint64_t regs[MAX_BPF_REG] = {};
+    regs[BPF_REG_1] = kCtxAddr;
+    regs[BPF_REG_10] = kStackAddr;
+    size_t pc = 0;
+    for (size_t steps = 0; steps < kMaxSteps; steps++) {
+      if (pc >= prog_.size()) {
+        throw std::runtime_error("pc is out of program");
+      }
+      const auto &insn = prog_[pc++];
+      auto &dst = regs[insn.dst_reg];
+      uint64_t src = BPF_SRC(insn.code) == BPF_X
+                         ? regs[insn.src_reg]
+                         : static_cast<uint64_t>(
+                               static_cast<int64_t>(insn.imm));
+      switch (BPF_CLASS(insn.code)) {
+      case BPF_ALU:
+        if (BPF_OP(insn.code) == BPF_END) {
+          dst = insn.imm == 16 ? __builtin_bswap16(dst)
+                               : __builtin_bswap32(dst);
+        } else {
+          dst = alu<uint32_t>(BPF_OP(insn.code), dst, src);
+        }
+        break;
+      case BPF_ALU64:
+        dst = alu<uint64_t>(BPF_OP(insn.code), dst, src);
+        break;
+      case BPF_LDX:
+        dst = load(regs[insn.src_reg] + insn.off, size(insn.code));
+        break;
+      case BPF_ST:
+        store(dst + insn.off, size(insn.code), insn.imm);
+        break;
+      case BPF_STX:
+        store(dst + insn.off, size(insn.code), regs[insn.src_reg]);
+        break;
+      case BPF_LD:
+        // ld_imm64 w/ map's fd
+        dst = static_cast<uint32_t>(insn.imm) |
+              static_cast<uint64_t>(prog_.at(pc++).imm) << 32;
+        break;
+      case BPF_JMP:
+        switch (BPF_OP(insn.code)) {
+        case BPF_CALL:
+          if (insn.imm != BPF_FUNC_tail_call) {
+            throw std::runtime_error("unexpected helper call");
+          }
+          return {static_cast<int64_t>(regs[BPF_REG_2]), regs[BPF_REG_3]};
+        case BPF_EXIT:
+          return {-1, regs[BPF_REG_0]};
+        default:
+          if (jump(BPF_OP(insn.code), dst, src)) {
+            pc += insn.off;
+          }
+        }
+        break;
+      default:
+        throw std::runtime_error("unexpected instruction class");
+      }
+    }
+    throw std::runtime_error("program does not terminate");
+  }
+
+private:
+  template <typename T> static T alu(uint8_t op, T a, T b) {
+    switch (op) {
+    case BPF_MOV:
+      return b;
+    case BPF_ADD:
+      return a + b;
+    case BPF_SUB:
+      return a - b;
+    case BPF_MUL:
+      return a * b;
+    case BPF_DIV:
+      return b ? a / b : 0;
+    case BPF_MOD:
+      return b ? a % b : a;
+    case BPF_OR:
+      return a | b;
+    case BPF_AND:
+      return a & b;
+    case BPF_XOR:
+      return a ^ b;
+    case BPF_LSH:
+      return a << (b & (sizeof(T) * 8 - 1));
+    case BPF_RSH:
+      return a >> (b & (sizeof(T) * 8 - 1));
+    case BPF_NEG:
+      return -a;
+    default:
+      throw std::runtime_error("unexpected alu operation");
+    }
+  }
+
+  static bool jump(uint8_t op, uint64_t a, uint64_t b) {
+    switch (op) {
+    case BPF_JA:
+      return true;
+    case BPF_JEQ:
+      return a == b;
+    case BPF_JNE:
+      return a != b;
+    case BPF_JGT:
+      return a > b;
+    case BPF_JGE:
+      return a >= b;
+    case BPF_JSET:
+      return a & b;
+    default:
+      throw std::runtime_error("unexpected jump operation");
+    }
+  }
+
+  static uint32_t size(uint8_t code) {
+    switch (BPF_SIZE(code)) {
+    case BPF_W:
+      return 4;
+    case BPF_H:
+      return 2;
+    case BPF_B:
+      return 1;
+    default:
+      return 8;
+    }
+  }
+
+  uint8_t *resolve(uint64_t addr, uint32_t size) {
+    if (addr >= kCtxAddr && addr + size <= kCtxAddr + sizeof(ctx_)) {
+      return reinterpret_cast<uint8_t *>(&ctx_) + (addr - kCtxAddr);
+    }
+    if (addr >= kPacketAddr && addr + size <= kPacketAddr + packet_.size()) {
+      return packet_.data() + (addr - kPacketAddr);
+    }
+    if (addr >= kStackAddr - kStackSize && addr + size <= kStackAddr) {
+      return stack_.data() + (addr - (kStackAddr - kStackSize));
+    }
+    throw std::runtime_error("out of bounds memory access");
+  }
+
+  uint64_t load(uint64_t addr, uint32_t size) {
+    uint64_t value = 0;
+    ::memcpy(&value, resolve(addr, size), size);
+    return value;
+  }
+
+  void store(uint64_t addr, uint32_t size, uint64_t value) {
+    ::memcpy(resolve(addr, size), &value, size);
+  }
+
+  const std::vector<struct bpf_insn> &prog_;
+  std::vector<uint8_t> packet_;
+  std::vector<uint8_t> stack_;
+  struct xdp_md ctx_ = {};
+};
+
+// output of "tcpdump -dd tcp dst port 80"
+const std::vector<CbpfInsn> kTcpDstPort80 = {
+    {0x28, 0, 0, 0x0000000c}, {0x15, 0, 4, 0x000086dd},
+    {0x30, 0, 0, 0x00000014}, {0x15, 0, 11, 0x00000006},
+    {0x28, 0, 0, 0x00000038}, {0x15, 8, 9, 0x00000050},
+    {0x15, 0, 8, 0x00000800}, {0x30, 0, 0, 0x00000017},
+    {0x15, 0, 6, 0x00000006}, {0x28, 0, 0, 0x00000014},
+    {0x45, 4, 0, 0x00001fff}, {0xb1, 0, 0, 0x0000000e},
+    {0x48, 0, 0, 0x00000010}, {0x15, 0, 1, 0x00000050},
+    {0x06, 0, 0, 0x00040000}, {0x06, 0, 0, 0x00000000},
+};
+
+void putBe16(std::vector<uint8_t> &packet, size_t pos, uint16_t value) {
+  packet[pos] = value >> 8;
+  packet[pos + 1] = value & 0xff;
+}
+
+std::vector<uint8_t> makeTcpPacket(bool v6, uint16_t dport,
+                                   uint16_t fragOff = 0) {
+  constexpr size_t kEthLen = 14;
+  constexpr size_t kTcpLen = 20;
+  size_t ipLen = v6 ? 40 : 20;
+  std::vector<uint8_t> packet(kEthLen + ipLen + kTcpLen);
+  putBe16(packet, 12, v6 ? kEthIpv6 : kEthIpv4);
+  if (v6) {
+    packet[kEthLen] = 0x60;
+    packet[kEthLen + 6] = kTcp;
+  } else {
+    packet[kEthLen] = 0x45;
+    putBe16(packet, kEthLen + 6, fragOff);
+    packet[kEthLen + 9] = kTcp;
+  }
+  putBe16(packet, kEthLen + ipLen + 2, dport);
+  return packet;
+}
+
+Outcome runFilter(const std::vector<CbpfInsn> &filter,
+                  const std::vector<uint8_t> &packet) {
+  auto prog = translateCbpf(filter, kCaptureProgsFd, kJmpFd, kJmpArraySize);
+  Interpreter interpreter(prog, packet);
+  return interpreter.run();
+}
+
+bool isCaptured(const Outcome &outcome) {
+  return outcome.fd == kCaptureProgsFd && outcome.pos == kCapturePos;
+}
+
+bool isMissed(const Outcome &outcome) {
+  return outcome.fd == kCaptureProgsFd && outcome.pos == kMissPos;
+}
+
+void expectRejected(const std::vector<CbpfInsn> &filter) {
+  EXPECT_THROW(translateCbpf(filter, kCaptureProgsFd, kJmpFd, kJmpArraySize),
+               std::runtime_error);
+}
+
+} // namespace
+
+TEST(CbpfTranslatorTest, testLibpcapFilter) {
+  EXPECT_TRUE(isCaptured(runFilter(kTcpDstPort80, makeTcpPacket(false, 80))));
+  EXPECT_TRUE(isCaptured(runFilter(kTcpDstPort80, makeTcpPacket(true, 80))));
+  EXPECT_TRUE(isMissed(runFilter(kTcpDstPort80, makeTcpPacket(false, 81))));
+  EXPECT_TRUE(isMissed(runFilter(kTcpDstPort80, makeTcpPacket(true, 443))));
+  // non first fragments do not have tcp header
+  EXPECT_TRUE(
+      isMissed(runFilter(kTcpDstPort80, makeTcpPacket(false, 80, 0x10))));
+  // out of bounds load means that packet does not match
+  auto truncated = makeTcpPacket(false, 80);
+  truncated.resize(truncated.size() - 19);
+  EXPECT_TRUE(isMissed(runFilter(kTcpDstPort80, truncated)));
+}
+
+TEST(CbpfTranslatorTest, testProgramLayout) {
+  auto prog =
+      translateCbpf(kTcpDstPort80, kCaptureProgsFd, kJmpFd, kJmpArraySize);
+  ASSERT_GE(prog.size(), 2);
+  // w/o miss prog: continue w/ rootlet's chain and pass the packet
+  EXPECT_EQ(prog.back().code, BPF_JMP | BPF_EXIT);
+  EXPECT_EQ(prog[prog.size() - 2].imm, XDP_PASS);
+  int tailCalls = 0;
+  for (size_t i = 0; i < prog.size(); i++) {
+    const auto &insn = prog[i];
+    if (insn.code == (BPF_JMP | BPF_CALL)) {
+      tailCalls++;
+      continue;
+    }
+    if (insn.code == (BPF_LD | BPF_DW | BPF_IMM)) {
+      // second half of ld_imm64 is never a target of a jump
+      i++;
+      continue;
+    }
+    if (BPF_CLASS(insn.code) == BPF_JMP && insn.code != (BPF_JMP | BPF_EXIT)) {
+      auto target = static_cast<int64_t>(i) + 1 + insn.off;
+      EXPECT_GT(target, static_cast<int64_t>(i));
+      EXPECT_LT(target, static_cast<int64_t>(prog.size()));
+    }
+  }
+  // capture and miss progs + rootlet's progs after xdpdump's one
+  EXPECT_EQ(tailCalls, 2 + kJmpArraySize - 1);
+}
+
+TEST(CbpfTranslatorTest, testLenAndReturnA) {
+  // len >= 60 ? len : 0
+  std::vector<CbpfInsn> filter = {
+      {BPF_LD | BPF_W | BPF_LEN, 0, 0, 0},
+      {BPF_JMP | BPF_JGE | BPF_K, 1, 0, 60},
+      {BPF_LD | BPF_IMM, 0, 0, 0},
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  EXPECT_TRUE(isCaptured(runFilter(filter, std::vector<uint8_t>(60))));
+  EXPECT_TRUE(isMissed(runFilter(filter, std::vector<uint8_t>(59))));
+}
+
+TEST(CbpfTranslatorTest, testMiscAndScratchMemory) {
+  std::vector<CbpfInsn> filter = {
+      {BPF_LD | BPF_IMM, 0, 0, 5},
+      {BPF_ST, 0, 0, 3},
+      {BPF_LD | BPF_IMM, 0, 0, 0},
+      {BPF_LDX | BPF_MEM, 0, 0, 3},
+      {BPF_MISC | BPF_TXA, 0, 0, 0},
+      {BPF_LDX | BPF_IMM, 0, 0, 0},
+      {BPF_MISC | BPF_TAX, 0, 0, 0},
+      {BPF_ALU | BPF_SUB | BPF_X, 0, 0, 0},
+      // A == 0 if X has been set from A
+      {BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0},
+      {BPF_RET | BPF_K, 0, 0, kAccept},
+      {BPF_RET | BPF_K, 0, 0, 0},
+  };
+  EXPECT_TRUE(isCaptured(runFilter(filter, makeTcpPacket(false, 80))));
+  // txa w/ X == 0
+  filter[3] = {BPF_LDX | BPF_IMM, 0, 0, 0};
+  filter[9] = {BPF_RET | BPF_A, 0, 0, 0};
+  EXPECT_TRUE(isMissed(runFilter(filter, makeTcpPacket(false, 80))));
+}
+
+TEST(CbpfTranslatorTest, testDivisionByZero) {
+  std::vector<CbpfInsn> filter = {
+      {BPF_LD | BPF_IMM, 0, 0, 4},
+      {BPF_LDX | BPF_IMM, 0, 0, 0},
+      {BPF_ALU | BPF_DIV | BPF_X, 0, 0, 0},
+      {BPF_RET | BPF_K, 0, 0, kAccept},
+  };
+  EXPECT_TRUE(isMissed(runFilter(filter, makeTcpPacket(false, 80))));
+  filter[1].k = 2;
+  EXPECT_TRUE(isCaptured(runFilter(filter, makeTcpPacket(false, 80))));
+}
+
+TEST(CbpfTranslatorTest, testInvalidInstructions) {
+  const CbpfInsn ret = {BPF_RET | BPF_K, 0, 0, 0};
+  expectRejected({});
+  expectRejected(std::vector<CbpfInsn>(BPF_MAXINSNS + 1, ret));
+  // unsupported return value, alu and jump operations
+  expectRejected({{BPF_RET | BPF_X, 0, 0, 0}});
+  expectRejected({{BPF_ALU | BPF_END, 0, 0, 0}, ret});
+  expectRejected({{BPF_JMP | BPF_JNE | BPF_K, 0, 0, 0}, ret});
+  // invalid sizes and modes of loads
+  expectRejected({{BPF_LD | BPF_DW | BPF_ABS, 0, 0, 0}, ret});
+  expectRejected({{BPF_LD | BPF_H | BPF_IMM, 0, 0, 0}, ret});
+  expectRejected({{BPF_LDX | BPF_W | BPF_ABS, 0, 0, 0}, ret});
+  expectRejected({{BPF_LD | BPF_B | BPF_MSH, 0, 0, 0}, ret});
+  expectRejected({{BPF_LDX | BPF_W | BPF_MSH, 0, 0, 0}, ret});
+  // unknown misc operation and invalid store
+  expectRejected({{BPF_MISC | 0x40, 0, 0, 0}, ret});
+  expectRejected({{BPF_ST | BPF_IMM | BPF_H, 0, 0, 0}, ret});
+  // invalid constants
+  expectRejected({{BPF_ST, 0, 0, BPF_MEMWORDS}, ret});
+  expectRejected({{BPF_LD | BPF_MEM, 0, 0, BPF_MEMWORDS}, ret});
+  expectRejected({{BPF_ALU | BPF_DIV | BPF_K, 0, 0, 0}, ret});
+  expectRejected({{BPF_ALU | BPF_LSH | BPF_K, 0, 0, 32}, ret});
+  // program must end w/ return
+  expectRejected({{BPF_LD | BPF_IMM, 0, 0, 0}});
+}
+
+TEST(CbpfTranslatorTest, testKernelVerifier) {
+  // ld [x + 0], where x is packet's length. verifier must accept bounds
+  // checks of such load
+  std::vector<CbpfInsn> filter = {
+      {BPF_LD | BPF_W | BPF_LEN, 0, 0, 0},
+      {BPF_MISC | BPF_TAX, 0, 0, 0},
+      {BPF_LD | BPF_W | BPF_IND, 0, 0, 0},
+      {BPF_LD | BPF_H | BPF_ABS, 0, 0, 0xfffd},
+      {BPF_RET | BPF_K, 0, 0, kAccept},
+  };
+  int captureProgsFd = katran::BpfAdapter::createBpfMap(
+      katran::kBpfMapTypeProgArray, sizeof(uint32_t), sizeof(uint32_t),
+      kJmpArraySize, 0 /* map_flags */);
+  int jmpFd = katran::BpfAdapter::createBpfMap(
+      katran::kBpfMapTypeProgArray, sizeof(uint32_t), sizeof(uint32_t),
+      kJmpArraySize, 0 /* map_flags */);
+  if (captureProgsFd < 0 || jmpFd < 0) {
+    for (auto fd : {captureProgsFd, jmpFd}) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+    GTEST_SKIP() << "can't create bpf maps (not enough privileges?)";
+  }
+  auto prog = translateCbpf(filter, captureProgsFd, jmpFd, kJmpArraySize);
+  std::string log;
+  int progFd =
+      katran::BpfAdapter::loadRawBpfProg(prog, BPF_PROG_TYPE_XDP, log);
+  EXPECT_GE(progFd, 0) << log;
+  for (auto fd : {progFd, captureProgsFd, jmpFd}) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+}
+
+TEST(CbpfTranslatorTest, testJumpsPastEnd) {
+  const CbpfInsn ret = {BPF_RET | BPF_K, 0, 0, 0};
+  expectRejected({{BPF_JMP | BPF_JA, 0, 0, 1}, ret});
+  expectRejected({{BPF_JMP | BPF_JEQ | BPF_K, 1, 0, 0}, ret});
+  expectRejected({{BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0}, ret});
+  expectRejected({{BPF_JMP | BPF_JGT | BPF_X, 0, 255, 0}, ret});
+  expectRejected({ret, {BPF_JMP | BPF_JA, 0, 0, 0}});
+  // jumps to the last insn are fine
+  std::vector<CbpfInsn> filter = {{BPF_JMP | BPF_JA, 0, 0, 0}, ret};
+  EXPECT_NO_THROW(
+      translateCbpf(filter, kCaptureProgsFd, kJmpFd, kJmpArraySize));
+}
+
+} // namespace xdpdump
@@ -15,10 +15,13 @@
  */
 
 #include <cstring>
+#include <folly/String.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "katran/lib/IpHelpers.h"
 
@@ -37,9 +40,27 @@ DEFINE_int32(offset_len, 0, "length fot the bytematching; up to 4");
 DEFINE_int32(cpu, -1, "cpu to take dump from");
 DEFINE_int64(pattern, 0, "pattern for bytematching; up to 4bytes");
 DEFINE_string(map_path, "/sys/fs/bpf/jmp_eth0", "path to root jump array");
+DEFINE_string(pcap_filter, "",
+              "pcap-filter (tcpdump like) expression, e.g. "
+              "'tcp[tcpflags] & tcp-syn != 0 and dst net 10.0.0.0/8'");
+DEFINE_string(xdpdump_prog, "./xdpdump_kern.o",
+              "path to precompiled xdpdump bpf prog");
+DEFINE_string(capture_points, "pre",
+              "comma separated list of points where packets are captured: "
+              "pre (before katran) and/or post (after katran, requires "
+              "balancer built w/ KATRAN_EXIT_HOOK)");
+DEFINE_string(exit_hook_path, "",
+              "path to pinned balancer's exit_hook map (by default it is "
+              "looked up by name)");
 DEFINE_string(pcap_path, "", "path to pcap file");
 DEFINE_int32(packet_limit, 0,
-             "max number of packets to be written in pcap file");
+             "max number of packets to be captured (enforced in bpf program) "
+             "and written in pcap file");
+DEFINE_int32(sample_rate, 1,
+             "capture (on average) only 1 out of sample_rate matched packets");
+DEFINE_int32(pps_limit, 10000,
+             "max number of captured packets per second on each cpu "
+             "(0 - no limit)");
 DEFINE_bool(clear, false, "remove xdpdump from shared array");
 DEFINE_bool(mute, false, "switch off output of received packets");
 DEFINE_int32(snaplen, 0,
@@ -49,6 +70,16 @@ DEFINE_int32(bpf_mmap_pages, 2,
              "How many pages should be mmap-ed to the perf event for each CPU. "
              "It must be a power of 2.");
 DEFINE_int32(duration_ms, -1, "how long to take a capture");
+DEFINE_bool(aggregate, false,
+            "aggregate matched packets by flow in bpf program instead of "
+            "capturing them; prints the busiest flows every second");
+DEFINE_int32(top_n, 20, "number of flows printed in aggregating mode");
+DEFINE_int32(max_flows, 65536, "max number of flows in aggregating mode");
+DEFINE_string(aggregate_output, "",
+              "file where totals of all flows are written on exit "
+              "(aggregating mode)");
+DEFINE_string(aggregate_format, "csv",
+              "format of aggregate_output file: csv or json");
 
 using PcapWriter = katran::PcapWriter;
 
@@ -107,10 +138,62 @@ int main(int argc, char **argv) {
     filter.proto = (uint8_t)FLAGS_proto;
   }
 
+  if (FLAGS_offset_len < 0 || FLAGS_offset_len > 4) {
+    std::cout << "offset_len should be between 0 and 4\n";
+    return -1;
+  }
+  if (FLAGS_offset < 0 || FLAGS_offset > xdpdump::kMaxPatternOffset) {
+    std::cout << "offset should be between 0 and "
+              << xdpdump::kMaxPatternOffset << "\n";
+    return -1;
+  }
   filter.offset = (uint16_t)FLAGS_offset;
   filter.offset_len = (uint16_t)FLAGS_offset_len;
   filter.pattern = (uint32_t)FLAGS_pattern;
   filter.map_path = FLAGS_map_path;
+  filter.prog_path = FLAGS_xdpdump_prog;
+  filter.pcap_filter = FLAGS_pcap_filter;
+  filter.exit_hook_path = FLAGS_exit_hook_path;
+  if (FLAGS_sample_rate < 1 || FLAGS_pps_limit < 0 ||
+      FLAGS_packet_limit < 0) {
+    std::cout << "sample_rate must be positive; pps_limit and packet_limit "
+              << "must not be negative\n";
+    return -1;
+  }
+  filter.sample_rate = (uint32_t)FLAGS_sample_rate;
+  filter.pps_limit = (uint32_t)FLAGS_pps_limit;
+  filter.count = (uint64_t)FLAGS_packet_limit;
+  if (FLAGS_aggregate) {
+    if (FLAGS_top_n <= 0 || FLAGS_max_flows <= 0) {
+      std::cout << "top_n and max_flows must be positive\n";
+      return -1;
+    }
+    if (FLAGS_aggregate_format != "csv" && FLAGS_aggregate_format != "json") {
+      std::cout << "aggregate_format must be csv or json\n";
+      return -1;
+    }
+    if (!FLAGS_pcap_path.empty()) {
+      std::cout << "pcap_path can't be used in aggregating mode\n";
+      return -1;
+    }
+  }
+  filter.aggregate = FLAGS_aggregate;
+  filter.top_n = (uint32_t)FLAGS_top_n;
+  filter.max_flows = (uint32_t)FLAGS_max_flows;
+  filter.aggregate_output = FLAGS_aggregate_output;
+  filter.aggregate_format = FLAGS_aggregate_format;
+  std::vector<std::string> points;
+  folly::split(',', FLAGS_capture_points, points);
+  for (const auto &point : points) {
+    if (point == "pre") {
+      filter.points |= xdpdump::kCapturePre;
+    } else if (point == "post") {
+      filter.points |= xdpdump::kCapturePost;
+    } else {
+      std::cout << "unknown capture point: " << point << "\n";
+      return -1;
+    }
+  }
   filter.mute = FLAGS_mute;
   filter.cpu = FLAGS_cpu;
   filter.pages = FLAGS_bpf_mmap_pages;